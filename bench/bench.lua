@@ -0,0 +1,121 @@
+-- bench.lua
+-- Throughput benchmark of the luaSGF Lua API.
+--
+-- Usage: lua bench/bench.lua [--quick]
+--
+-- Sweeps input length, half_window, poly_order, boundary mode and API path
+-- and prints one CSV line per measurement:
+--
+--   path        apply, apply_valid, calc, buffer_apply, buffer_apply_valid,
+--               apply_into (buffer in place)
+--   us_call     CPU time per call
+--   ns_sample   per input sample, split into marshal_ns + compute_ns
+--   heap_kb     Lua heap growth per call in KB (tables, buffers), GC stopped;
+--               a byte volume, not a count of allocations
+--
+-- The compute part is the time of the same filter on a float buffer, which
+-- runs the kernels on the buffer memory without any conversion; for table
+-- paths the remainder is spent converting between Lua tables and C arrays.
+-- Compare compute_ns with the native harness luaSGF_bench (CMake option
+-- LUASGF_BUILD_BENCH) for the overhead of the binding itself.
+
+local sg = require("luaSGF")
+
+local quick = (arg and arg[1] == "--quick")
+local MIN_TIME = quick and 0.05 or 0.2      -- seconds per measurement
+
+-- CPU time in seconds: portable, and the filters run single-threaded here
+local clock = os.clock
+
+local lengths = quick and {1000, 100000} or {1000, 10000, 100000, 1000000}
+local half_windows = {2, 8, 32}
+local poly_orders = {2, 4}
+local boundaries = {
+    {"polynomial", sg.BOUNDARY_POLYNOMIAL},
+    {"reflect", sg.BOUNDARY_REFLECT},
+    {"periodic", sg.BOUNDARY_PERIODIC},
+    {"constant", sg.BOUNDARY_CONSTANT},
+}
+
+local function make_signal(n)
+    local t = {}
+    for i = 1, n do
+        t[i] = math.sin(i * 0.01) + 0.1 * math.sin(i * 1.7)
+    end
+    return t
+end
+
+-- Repeats fn until MIN_TIME has passed.
+-- Returns seconds per call and KB of Lua heap growth per call.
+local function measure(fn)
+    fn() -- warm-up: grows scratch arenas, fills the coefficient cache
+    collectgarbage()
+    collectgarbage("stop")
+    local calls, kb = 0, 0
+    local start = clock()
+    local elapsed
+    repeat
+        local before = collectgarbage("count")
+        fn()
+        kb = kb + (collectgarbage("count") - before)
+        calls = calls + 1
+        elapsed = clock() - start
+        -- Keep the heap bounded for large inputs
+        if kb > 256 * 1024 then
+            collectgarbage("restart")
+            collectgarbage()
+            collectgarbage("stop")
+        end
+    until elapsed >= MIN_TIME
+    collectgarbage("restart")
+    return elapsed / calls, kb / calls
+end
+
+local function report(path, boundary, hw, poly, len, per_call, compute, kb)
+    local ns = per_call * 1e9 / len
+    local compute_ns = math.min(compute * 1e9 / len, ns)
+    print(string.format("%s,%s,%d,%d,%d,%.3f,%.3f,%.3f,%.3f,%.3e,%.1f",
+        path, boundary, hw, poly, len, per_call * 1e6, ns, ns - compute_ns,
+        compute_ns, len / per_call, kb))
+end
+
+print("# kernel level: " .. sg.simd_level())
+print("path,boundary,half_window,poly_order,length,us_call,ns_sample," ..
+      "marshal_ns,compute_ns,samples_per_sec,heap_kb")
+
+for _, len in ipairs(lengths) do
+    local input = make_signal(len)
+    local buf = sg.buffer.from_table(input)
+    local work = sg.buffer.from_table(input)
+
+    for _, hw in ipairs(half_windows) do
+        for _, poly in ipairs(poly_orders) do
+            for b, mode in ipairs(boundaries) do
+                local f = sg.new({half_window = hw, poly_order = poly,
+                                  boundary = mode[2]})
+
+                -- Compute reference: zero-copy buffer paths
+                local t_buf, kb_buf = measure(function() return f:apply(buf) end)
+                local t_bufv, kb_bufv = measure(function() return f:apply_valid(buf) end)
+                report("buffer_apply", mode[1], hw, poly, len, t_buf, t_buf, kb_buf)
+
+                local t, kb = measure(function() return f:apply(input) end)
+                report("apply", mode[1], hw, poly, len, t, t_buf, kb)
+
+                local t_into, kb_into = measure(function() return f:apply_into(work) end)
+                report("apply_into", mode[1], hw, poly, len, t_into, t_buf, kb_into)
+
+                -- Boundary modes only matter for same-length output
+                if b == 1 then
+                    report("buffer_apply_valid", mode[1], hw, poly, len, t_bufv, t_bufv,
+                           kb_bufv)
+                    t, kb = measure(function() return f:apply_valid(input) end)
+                    report("apply_valid", mode[1], hw, poly, len, t, t_bufv, kb)
+                    t, kb = measure(function() return sg.calc(hw, poly, 0, 0, input) end)
+                    report("calc", mode[1], hw, poly, len, t, t_buf, kb)
+                end
+                f:destroy()
+            end
+        end
+    end
+end
@@ -0,0 +1,211 @@
+/*
+MIT License
+
+Copyright (c) 2025-2026 The OneLuaPro project authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * Native benchmark harness.
+ * Times the core library (savgol_apply, savgol_apply_valid) and the interior
+ * kernels of the binding on plain C arrays, i.e. the compute part of the Lua
+ * API without any marshalling. Compare with bench/bench.lua to see the
+ * marshalling overhead.
+ *
+ * Usage: luaSGF_bench [--quick]
+ * Output: one CSV line per measurement.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <savgolFilter.h>
+
+#include "../src/luaSGF_kernel.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// Minimum measuring time per configuration
+#define BENCH_MIN_NS 200000000.0
+
+/**
+ * @brief Monotonic clock in nanoseconds.
+ */
+static double bench_now_ns(void) {
+#if defined(_WIN32)
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER now;
+  if (freq.QuadPart == 0) {
+    QueryPerformanceFrequency(&freq);
+  }
+  QueryPerformanceCounter(&now);
+  return (double)now.QuadPart * 1e9 / (double)freq.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+#endif
+}
+
+typedef enum {
+  BENCH_APPLY = 0,    // savgol_apply
+  BENCH_VALID,        // savgol_apply_valid
+  BENCH_KERNEL,       // sgf_interior_f with the extracted weights
+  BENCH_KERNEL_SYM    // sgf_interior_sym_f (folded)
+} BenchPath;
+
+static const char *const bench_path_names[] = {"apply", "apply_valid", "kernel",
+					       "kernel_sym"};
+static const char *const bench_boundary_names[] = {"polynomial", "reflect",
+						   "periodic", "constant"};
+
+typedef struct {
+  const SavgolFilter *filter;
+  const float *weights;
+  int symmetry;
+  const float *in;
+  float *out;
+  size_t len;
+} BenchCase;
+
+/**
+ * @brief Runs one call of the path; returns non-zero on failure.
+ */
+static int bench_run(const BenchCase *c, BenchPath path) {
+  int n = c->filter->config.half_window;
+  size_t count = c->len - 2 * (size_t)n;
+  switch (path) {
+  case BENCH_APPLY:
+    return savgol_apply(c->filter, c->in, c->out, c->len) != 0;
+  case BENCH_VALID:
+    return savgol_apply_valid(c->filter, c->in, c->len, c->out) != count;
+  case BENCH_KERNEL:
+    sgf_interior_f(c->weights, 2 * n + 1, c->in, c->out, count);
+    return 0;
+  default:
+    sgf_interior_sym_f(c->weights, n, c->symmetry, c->in, c->out, count);
+    return 0;
+  }
+}
+
+/**
+ * @brief Repeats a path until BENCH_MIN_NS have passed and prints the result.
+ */
+static int bench_measure(const BenchCase *c, BenchPath path) {
+  if (bench_run(c, path) != 0) {  // warm-up, also checks the configuration
+    return 1;
+  }
+  size_t calls = 0;
+  double start = bench_now_ns(), elapsed = 0.0;
+  do {
+    if (bench_run(c, path) != 0) {
+      return 1;
+    }
+    calls++;
+    elapsed = bench_now_ns() - start;
+  } while (elapsed < BENCH_MIN_NS);
+
+  double per_call = elapsed / (double)calls;
+  printf("%s,%s,%d,%d,%zu,%.3f,%.3f,%.3e\n", bench_path_names[path],
+	 bench_boundary_names[c->filter->config.boundary], c->filter->config.half_window,
+	 c->filter->config.poly_order, c->len, per_call / 1e3,
+	 per_call / (double)c->len, (double)c->len * 1e9 / per_call);
+  return 0;
+}
+
+/**
+ * @brief Extracts the centered weights of a core filter from impulses.
+ */
+static int bench_weights(const SavgolFilter *filter, float *w) {
+  size_t ws = (size_t)filter->window_size;
+  float impulse[2 * SGF_MAX_HALF_WINDOW + 1] = {0.0f};
+  for (size_t j = 0; j < ws; j++) {
+    impulse[j] = 1.0f;
+    if (savgol_apply_valid(filter, impulse, ws, w + j) != 1) {
+      return 1;
+    }
+    impulse[j] = 0.0f;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int quick = (argc > 1 && strcmp(argv[1], "--quick") == 0);
+  static const size_t lengths[] = {1000, 10000, 100000, 1000000};
+  static const int half_windows[] = {2, 8, 32};
+  static const int poly_orders[] = {2, 4};
+  size_t nlengths = quick ? 2 : sizeof(lengths) / sizeof(lengths[0]);
+  size_t max_len = lengths[nlengths - 1];
+
+  float *in = (float *)malloc(max_len * sizeof(float));
+  float *out = (float *)malloc(max_len * sizeof(float));
+  if (in == NULL || out == NULL) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  for (size_t i = 0; i < max_len; i++) {
+    in[i] = (float)(sin(0.01 * (double)i) + 0.1 * sin(1.7 * (double)i));
+  }
+
+  printf("# kernel level: %s\n", sgf_simd_name(sgf_simd_level()));
+  printf("path,boundary,half_window,poly_order,length,us_per_call,ns_per_sample,"
+	 "samples_per_sec\n");
+
+  for (size_t h = 0; h < sizeof(half_windows) / sizeof(half_windows[0]); h++) {
+    for (size_t p = 0; p < sizeof(poly_orders) / sizeof(poly_orders[0]); p++) {
+      for (int b = SAVGOL_BOUNDARY_POLYNOMIAL; b <= SAVGOL_BOUNDARY_CONSTANT; b++) {
+	SavgolConfig config = {(uint8_t)half_windows[h], (uint8_t)poly_orders[p], 0,
+			       1.0f, (SavgolBoundaryMode)b};
+	SavgolFilter *filter = savgol_create(&config);
+	float w[2 * SGF_MAX_HALF_WINDOW + 1];
+	if (filter == NULL || bench_weights(filter, w) != 0) {
+	  fprintf(stderr, "savgol_create failed (n=%d, m=%d)\n", half_windows[h],
+		  poly_orders[p]);
+	  return 1;
+	}
+	BenchCase c = {filter, w, sgf_symmetrize_f(w, half_windows[h], 0), in, out, 0};
+
+	for (size_t l = 0; l < nlengths; l++) {
+	  c.len = lengths[l];
+	  /* Boundary modes only differ for same-length output */
+	  for (int path = BENCH_APPLY; path <= BENCH_KERNEL_SYM; path++) {
+	    if (path != BENCH_APPLY && b != SAVGOL_BOUNDARY_POLYNOMIAL) {
+	      continue;
+	    }
+	    if (bench_measure(&c, (BenchPath)path) != 0) {
+	      fprintf(stderr, "%s failed\n", bench_path_names[path]);
+	      return 1;
+	    }
+	  }
+	}
+	savgol_destroy(filter);
+      }
+    }
+  }
+
+  free(in);
+  free(out);
+  return 0;
+}
@@ -1,5 +1,13 @@
 local sg = require("luaSGF")
 
+-- Compares two sequences element by element
+local function assert_same(expected, actual, tol)
+    assert.is.equal(#expected, #actual)
+    for i = 1, #expected do
+        assert.near(expected[i], actual[i], tol or 1e-6)
+    end
+end
+
 describe("SavgolFilter Lifecycle and Validation", function()
 
     it("Create filter with valid config", function()
@@ -423,3 +431,1676 @@ end)
 
 end)
 
+
+describe("luaSGF Buffers", function()
+
+    it("from_table / to_table round trip", function()
+        local buf = sg.buffer.from_table({1, 2, 3, 4}, "double")
+
+        assert.is_userdata(buf)
+        assert.is.equal(4, #buf)
+        assert.is.equal("double", buf:dtype())
+        assert.is.same({1, 2, 3, 4}, buf:to_table())
+    end)
+
+    it("Indexing and bounds", function()
+        local buf = sg.buffer.new(3)
+
+        assert.is.equal("float", buf:dtype())
+        assert.is.equal(0.0, buf[1])
+        assert.is_nil(buf[4])
+
+        buf[2] = 1.5
+        assert.is.equal(1.5, buf[2])
+
+        assert.has_error(function() buf[4] = 1.0 end)
+    end)
+
+    it("apply() on a buffer matches apply() on a table", function()
+        local filter = sg.new({half_window = 5, poly_order = 2})
+        local input = {}
+        for i = 1, 50 do input[i] = math.sin(i / 10) end
+
+        local expected = filter:apply(input)
+        for _, dtype in ipairs({"float", "double"}) do
+            local result = filter:apply(sg.buffer.from_table(input, dtype))
+
+            assert.is_userdata(result)
+            assert.is.equal(dtype, result:dtype())
+            assert.is.equal(#expected, #result)
+            for i = 1, #expected do
+                assert.near(expected[i], result[i], 1e-6)
+            end
+        end
+    end)
+
+    it("apply_valid() on a buffer returns the shorter buffer", function()
+        local hw = 5
+        local filter = sg.new({half_window = hw, poly_order = 2})
+        local input = {}
+        for i = 1, 100 do input[i] = i - 1 end
+
+        local result = filter:apply_valid(sg.buffer.from_table(input))
+
+        assert.is.equal(100 - 2 * hw, #result)
+        for i = 1, #result do
+            assert.near((i - 1) + hw, result[i], 0.1)
+        end
+    end)
+
+end)
+
+describe("SavgolFilter apply_into", function()
+
+    local input = {}
+    for i = 1, 50 do input[i] = math.sin(i / 10) end
+
+    it("apply_into() fills and returns the given table", function()
+        local filter = sg.new({half_window = 5, poly_order = 2})
+        local expected = filter:apply(input)
+
+        -- Pre-filled, longer table: stale tail must be removed
+        local out = {}
+        for i = 1, 60 do out[i] = -1 end
+
+        local result = filter:apply_into(input, out)
+
+        assert.is.equal(out, result)
+        assert.is.equal(#expected, #out)
+        for i = 1, #expected do
+            assert.near(expected[i], out[i], 1e-6)
+        end
+    end)
+
+    it("apply_into() without output works in-place", function()
+        local filter = sg.new({half_window = 5, poly_order = 2})
+        local expected = filter:apply(input)
+
+        local data = sg.buffer.from_table(input)
+        local result = filter:apply_into(data)
+
+        assert.is.equal(data, result)
+        for i = 1, #expected do
+            assert.near(expected[i], data[i], 1e-6)
+        end
+    end)
+
+    it("apply_valid_into() checks the output buffer length", function()
+        local hw = 5
+        local filter = sg.new({half_window = hw, poly_order = 2})
+        local expected = filter:apply_valid(input)
+
+        local out = sg.buffer.new(#input - 2 * hw, "double")
+        filter:apply_valid_into(input, out)
+        for i = 1, #expected do
+            assert.near(expected[i], out[i], 1e-6)
+        end
+
+        assert.has_error(function()
+            filter:apply_valid_into(input, sg.buffer.new(#input))
+        end)
+    end)
+
+end)
+
+describe("SavgolFilter scratch arena", function()
+
+    local input = {}
+    for i = 1, 100 do input[i] = i end
+
+    it("shrink() releases the memory kept from previous calls", function()
+        local filter = sg.new({half_window = 5, poly_order = 2})
+
+        filter:apply(input)
+        assert.is_true(filter:shrink() > 0)
+        assert.is.equal(0, filter:shrink())
+
+        -- Filtering still works after shrinking
+        assert.is.equal(#input, #filter:apply(input))
+    end)
+
+    it("scratch_limit drops oversized arenas after the call", function()
+        local filter = sg.new({half_window = 5, poly_order = 2, scratch_limit = 64})
+
+        local result = filter:apply(input)
+
+        assert.is.equal(#input, #result)
+        assert.is.equal(0, filter:shrink())
+    end)
+
+end)
+
+describe("luaSGF Streams", function()
+
+    local cfg = {half_window = 5, poly_order = 2}
+    local input = {}
+    for i = 1, 60 do input[i] = math.sin(i / 7) + 0.1 * math.cos(i) end
+
+    local function concat(dst, src)
+        for i = 1, #src do dst[#dst + 1] = src[i] end
+    end
+
+    it("Centered stream matches apply() for arbitrary chunking", function()
+        local expected = sg.new(cfg):apply(input)
+        local st = sg.stream(cfg)
+        local result = {}
+
+        -- Chunks of varying size, including empty ones and single samples
+        local pos, size = 1, 0
+        while pos <= #input do
+            local chunk = {}
+            for i = pos, math.min(#input, pos + size - 1) do
+                chunk[#chunk + 1] = input[i]
+            end
+            concat(result, st:push(chunk))
+            pos = pos + size
+            size = (size + 1) % 7
+        end
+        concat(result, st:flush())
+
+        assert.is.equal(5, st:latency())
+        assert.is.equal(#expected, #result)
+        for i = 1, #expected do
+            assert.near(expected[i], result[i], 1e-5)
+        end
+    end)
+
+    it("Causal stream has no latency and tracks a linear ramp", function()
+        local st = sg.stream({half_window = 5, poly_order = 2, causal = true})
+        local ramp = {}
+        for i = 1, 40 do ramp[i] = 2.0 * i end
+
+        local result = st:push(ramp)
+
+        assert.is.equal(0, st:latency())
+        assert.is.equal(#ramp, #result)
+        for i = 1, #ramp do
+            assert.near(ramp[i], result[i], 1e-3)
+        end
+        assert.is.equal(0, #st:flush())
+    end)
+
+    it("Rejects periodic boundaries", function()
+        assert.has_error(function()
+            sg.stream({half_window = 5, poly_order = 2, boundary = sg.BOUNDARY_PERIODIC})
+        end)
+    end)
+
+    it("Follows the filter options of new()", function()
+        local long = {}
+        for i = 1, 300 do long[i] = math.sin(i / 11) + 0.05 * ((i * 37) % 11) end
+
+        for _, c in ipairs({
+            {half_window = 5, poly_order = 2, precision = "double"},
+            {half_window = 5, poly_order = 2, target_point = 2},
+            {half_window = 40, poly_order = 3},
+        }) do
+            local expected = sg.new(c):apply(long)
+            local st = sg.stream(c)
+            local result = {}
+            for pos = 1, #long, 13 do
+                local chunk = {}
+                for i = pos, math.min(#long, pos + 12) do chunk[#chunk + 1] = long[i] end
+                concat(result, st:push(chunk))
+            end
+            concat(result, st:flush())
+
+            assert.is.equal(c.half_window - (c.target_point or 0), st:latency())
+            assert_same(expected, result, c.precision and 1e-12 or 1e-5)
+        end
+    end)
+
+    it("Rejects missing samples and causal target points", function()
+        assert.has_error(function()
+            sg.stream({half_window = 5, poly_order = 2, missing = "skip"})
+        end)
+        assert.has_error(function()
+            sg.stream({half_window = 5, poly_order = 2, causal = true, target_point = 1})
+        end)
+    end)
+
+end)
+
+describe("SavgolFilter double precision", function()
+
+    it("Matches the float filter on ordinary data", function()
+        local input = {}
+        for i = 1, 50 do input[i] = math.sin(i / 10) end
+
+        for _, b in ipairs({sg.BOUNDARY_POLYNOMIAL, sg.BOUNDARY_CONSTANT}) do
+            local f32 = sg.new({half_window = 5, poly_order = 2, boundary = b})
+            local f64 = sg.new({half_window = 5, poly_order = 2, boundary = b,
+                                precision = "double"})
+            local r32 = f32:apply(input)
+            local r64 = f64:apply(input)
+
+            assert.is.equal(#r32, #r64)
+            for i = 1, #r32 do
+                assert.near(r32[i], r64[i], 1e-5)
+            end
+        end
+    end)
+
+    it("Keeps precision with large offsets", function()
+        -- 1.7e9 + small ramp: float would lose the ramp entirely
+        local filter = sg.new({half_window = 5, poly_order = 2, precision = "double"})
+        local input = {}
+        for i = 1, 40 do input[i] = 1.7e9 + 0.001 * i end
+
+        local result = filter:apply(input)
+        for i = 1, #input do
+            assert.near(input[i], result[i], 1e-6)
+        end
+
+        local buf = filter:apply_valid(sg.buffer.from_table(input, "double"))
+        assert.is.equal("double", buf:dtype())
+        assert.near(input[6], buf[1], 1e-6)
+    end)
+
+    it("Derivatives with a small time_step", function()
+        local dt = 1e-6
+        local filter = sg.new({half_window = 5, poly_order = 2, derivative = 1,
+                               time_step = dt, precision = "double"})
+        local input = {}
+        for i = 1, 40 do input[i] = 3.0 * (i * dt) end
+
+        local result = filter:apply_into(input, {})
+        for i = 1, #result do
+            assert.near(3.0, result[i], 1e-6)
+        end
+    end)
+
+    it("Rejects unknown precision", function()
+        assert.has_error(function()
+            sg.new({half_window = 5, poly_order = 2, precision = "half"})
+        end)
+    end)
+
+end)
+
+describe("SIMD kernel selection", function()
+
+    it("Reports the active level", function()
+        local level = sg.simd_level()
+        assert.is_true(level == "scalar" or level == "sse2" or
+                       level == "avx2" or level == "neon")
+    end)
+
+    it("Scalar kernel matches the default kernel", function()
+        local input = {}
+        for i = 1, 257 do input[i] = math.sin(i / 7) + 0.1 * math.cos(i * 3) end
+
+        local default = sg.simd_level()
+        local filter = sg.new({half_window = 7, poly_order = 3})
+        local fast = filter:apply(input)
+        local fast_valid = filter:apply_valid(input)
+
+        sg.simd_level("scalar")
+        local slow = filter:apply(input)
+        local slow_valid = filter:apply_valid(input)
+        sg.simd_level(default)
+
+        assert.is.equal(#slow, #fast)
+        for i = 1, #slow do
+            assert.near(slow[i], fast[i], 1e-5)
+        end
+        for i = 1, #slow_valid do
+            assert.near(slow_valid[i], fast_valid[i], 1e-5)
+        end
+    end)
+
+    it("Rejects unknown levels", function()
+        assert.has_error(function() sg.simd_level("avx512") end)
+    end)
+
+end)
+
+describe("Folded symmetric kernels", function()
+
+    -- Time reversal maps the interior of a symmetric filter onto itself and
+    -- negates it for an antisymmetric one.
+    local function check_reversal(config, sign, tol)
+        local filter = sg.new(config)
+        local input, reversed = {}, {}
+        for i = 1, 200 do input[i] = math.sin(i / 9) + 0.02 * i * i / 200 end
+        for i = 1, 200 do reversed[i] = input[201 - i] end
+
+        local fwd = filter:apply_valid(input)
+        local bwd = filter:apply_valid(reversed)
+        for i = 1, #fwd do
+            assert.near(fwd[i], sign * bwd[#bwd + 1 - i], tol)
+        end
+    end
+
+    it("Smoothing with a wide window", function()
+        check_reversal({half_window = 32, poly_order = 4}, 1, 1e-5)
+        check_reversal({half_window = 32, poly_order = 4, precision = "double"}, 1, 1e-12)
+    end)
+
+    it("Odd and even derivatives", function()
+        check_reversal({half_window = 12, poly_order = 3, derivative = 1}, -1, 1e-5)
+        check_reversal({half_window = 12, poly_order = 3, derivative = 2}, 1, 1e-5)
+        check_reversal({half_window = 12, poly_order = 4, derivative = 3,
+                        precision = "double"}, -1, 1e-12)
+    end)
+
+    it("Antisymmetric kernel ignores constant offsets", function()
+        local filter = sg.new({half_window = 32, poly_order = 2, derivative = 1})
+        local input = {}
+        for i = 1, 100 do input[i] = 1000.0 end
+        local result = filter:apply_valid(input)
+        for i = 1, #result do
+            assert.is.equal(0, result[i])
+        end
+    end)
+
+end)
+
+describe("SavgolFilter batch apply", function()
+
+    local function channel(len, phase)
+        local t = {}
+        for i = 1, len do t[i] = math.sin(i / 5 + phase) end
+        return t
+    end
+
+    it("Matches apply() per channel", function()
+        local filter = sg.new({half_window = 4, poly_order = 2})
+        local channels = {channel(40, 0), channel(25, 1), sg.buffer.from_table(channel(60, 2))}
+
+        local results = filter:apply_batch(channels)
+        assert.is.equal(#channels, #results)
+        for c = 1, 2 do
+            local expected = filter:apply(channels[c])
+            assert.is.equal(#expected, #results[c])
+            for i = 1, #expected do
+                assert.is.equal(expected[i], results[c][i])
+            end
+        end
+
+        local expected = filter:apply(channels[3])
+        assert.is.equal("float", results[3]:dtype())
+        for i = 1, #expected do
+            assert.is.equal(expected[i], results[3][i])
+        end
+    end)
+
+    it("Valid output and double precision", function()
+        local filter = sg.new({half_window = 4, poly_order = 2, precision = "double"})
+        local channels = {channel(30, 0), channel(31, 0.5)}
+
+        local results = filter:apply_valid_batch(channels)
+        for c = 1, #channels do
+            local expected = filter:apply_valid(channels[c])
+            assert.is.equal(#expected, #results[c])
+            for i = 1, #expected do
+                assert.is.equal(expected[i], results[c][i])
+            end
+        end
+    end)
+
+    it("Filters the rows of a 2-D buffer", function()
+        local filter = sg.new({half_window = 3, poly_order = 2})
+        local rows, stride = 4, 20
+        local flat = {}
+        for r = 1, rows do
+            local ch = channel(stride, r)
+            for i = 1, stride do flat[(r - 1) * stride + i] = ch[i] end
+        end
+        local matrix = sg.buffer.from_table(flat, "double")
+
+        local out = filter:apply_valid_batch(matrix, stride)
+        local out_stride = stride - 6
+        assert.is.equal(rows * out_stride, #out)
+        assert.is.equal("double", out:dtype())
+        for r = 1, rows do
+            local expected = filter:apply_valid(channel(stride, r))
+            for i = 1, out_stride do
+                assert.near(expected[i], out[(r - 1) * out_stride + i], 1e-6)
+            end
+        end
+    end)
+
+    it("Rejects invalid channels", function()
+        local filter = sg.new({half_window = 3, poly_order = 2})
+        assert.has_error(function() filter:apply_batch({channel(20, 0), channel(3, 0)}) end)
+        assert.has_error(function() filter:apply_batch({channel(20, 0), 42}) end)
+        assert.has_error(function() filter:apply_batch(sg.buffer.new(21), 10) end)
+    end)
+
+end)
+
+describe("SavgolFilter threads", function()
+
+    it("Large inputs give the same result on the worker pool", function()
+        local len = 300000
+        local buf = sg.buffer.new(len)
+        for i = 1, len do buf[i] = math.sin(i / 50) + ((i * 7919) % 13) / 13 end
+
+        for _, b in ipairs({sg.BOUNDARY_POLYNOMIAL, sg.BOUNDARY_PERIODIC}) do
+            local serial = sg.new({half_window = 8, poly_order = 3, boundary = b})
+            local parallel = sg.new({half_window = 8, poly_order = 3, boundary = b,
+                                     threads = 4})
+            local r1 = serial:apply(buf)
+            local r4 = parallel:apply(buf)
+            for i = 1, len do
+                assert.is.equal(r1[i], r4[i])
+            end
+        end
+    end)
+
+    it("Distributes the rows of a 2-D buffer", function()
+        local rows, stride = 8, 100
+        local matrix = sg.buffer.new(rows * stride, "double")
+        for i = 1, #matrix do matrix[i] = math.cos(i / 7) end
+
+        local config = {half_window = 5, poly_order = 2, precision = "double"}
+        local serial = sg.new(config)
+        config.threads = 0
+        local parallel = sg.new(config)
+
+        local r1 = serial:apply_batch(matrix, stride)
+        local r2 = parallel:apply_batch(matrix, stride)
+        for i = 1, #r1 do
+            assert.is.equal(r1[i], r2[i])
+        end
+    end)
+
+    it("Rejects invalid thread counts", function()
+        assert.has_error(function() sg.new({half_window = 5, poly_order = 2, threads = -1}) end)
+        assert.has_error(function() sg.new({half_window = 5, poly_order = 2, threads = 1000}) end)
+    end)
+
+end)
+
+describe("Coefficient cache", function()
+
+    before_each(function()
+        collectgarbage()
+        sg.cache_clear()
+    end)
+
+    it("Shares weights between identical configurations", function()
+        local config = {half_window = 6, poly_order = 3, derivative = 1}
+        local f1 = sg.new(config)
+        local f2 = sg.new(config)
+        local f3 = sg.new({half_window = 6, poly_order = 3, derivative = 1,
+                           precision = "double"})
+
+        local st = sg.cache_stats()
+        assert.is.equal(1, st.hits)
+        assert.is.equal(2, st.misses)
+        assert.is.equal(2, st.entries)
+        assert.is.equal(2, st.in_use)
+
+        local input = {}
+        for i = 1, 30 do input[i] = i * i end
+        local r1, r2 = f1:apply(input), f2:apply(input)
+        for i = 1, #r1 do
+            assert.is.equal(r1[i], r2[i])
+        end
+        f3:destroy()
+    end)
+
+    it("Keeps unused entries until cleared", function()
+        local f = sg.new({half_window = 4, poly_order = 2})
+        f:destroy()
+
+        local st = sg.cache_stats()
+        assert.is.equal(1, st.entries)
+        assert.is.equal(0, st.in_use)
+
+        sg.new({half_window = 4, poly_order = 2}):destroy()
+        assert.is.equal(1, sg.cache_stats().hits)
+
+        assert.is.equal(1, sg.cache_clear())
+        st = sg.cache_stats()
+        assert.is.equal(0, st.entries)
+        assert.is.equal(0, st.hits)
+    end)
+
+    it("Does not affect filters in use", function()
+        local f = sg.new({half_window = 4, poly_order = 2})
+        assert.is.equal(0, sg.cache_clear())
+        local result = f:apply({1, 2, 3, 4, 5, 6, 7, 8, 9, 10})
+        assert.near(5, result[5], 1e-5)
+    end)
+
+end)
+
+describe("Multi-derivative filters", function()
+
+    local function signal(len)
+        local t = {}
+        for i = 1, len do t[i] = math.sin(i / 6) + 0.001 * i * i end
+        return t
+    end
+
+    it("Matches one filter per derivative order", function()
+        local config = {half_window = 6, poly_order = 3, time_step = 0.5,
+                        boundary = sg.BOUNDARY_REFLECT}
+        local multi = sg.new_multi(config, {0, 1, 2})
+        local input = signal(80)
+        local results = {multi:apply(input)}
+
+        assert.is.equal(3, #results)
+        for k, d in ipairs({0, 1, 2}) do
+            config.derivative = d
+            local expected = sg.new(config):apply(input)
+            assert.is.equal(#expected, #results[k])
+            for i = 1, #expected do
+                assert.is.equal(expected[i], results[k][i])
+            end
+        end
+    end)
+
+    it("Valid output with buffers and config.derivatives", function()
+        local multi = sg.new_multi({half_window = 4, poly_order = 2, derivatives = {1, 0},
+                                    precision = "double"})
+        local buf = sg.buffer.from_table(signal(50), "double")
+        local d1, d0 = multi:apply_valid(buf)
+
+        assert.is.equal("double", d1:dtype())
+        assert.is.equal(42, #d0)
+        local expected = sg.new({half_window = 4, poly_order = 2, derivative = 1,
+                                 precision = "double"}):apply_valid(buf)
+        for i = 1, #expected do
+            assert.is.equal(expected[i], d1[i])
+        end
+        assert.are.same({1, 0}, multi:derivatives())
+    end)
+
+    it("Rejects invalid derivative lists", function()
+        assert.has_error(function() sg.new_multi({half_window = 4, poly_order = 2}) end)
+        assert.has_error(function() sg.new_multi({half_window = 4, poly_order = 2}, {}) end)
+        assert.has_error(function() sg.new_multi({half_window = 4, poly_order = 2}, {0, 3}) end)
+    end)
+
+end)
+
+describe("Legacy calc() fast path", function()
+
+    before_each(function()
+        collectgarbage()
+        sg.cache_clear()
+    end)
+
+    it("Reuses cached weights for repeated calls", function()
+        local input = {}
+        for i = 1, 200 do input[i] = math.sin(i / 7) + (i % 3) * 0.1 end
+
+        local r1 = sg.calc(5, 2, 0, 0, input)
+        local r2 = sg(5, 2, 0, 0, input)
+        local st = sg.cache_stats()
+        assert.is.equal(1, st.misses)
+        assert.is.equal(1, st.hits)
+        assert.is.equal(0, st.in_use)
+        for i = 1, #input do
+            assert.is.equal(r1[i], r2[i])
+        end
+    end)
+
+    it("Agrees with the direct computation on short inputs", function()
+        -- 21 samples (< two windows) bypass the cache, 50 do not
+        local input = {}
+        for i = 1, 50 do input[i] = i * 0.5 + math.cos(i) end
+        local short = {}
+        for i = 1, 21 do short[i] = input[i] end
+
+        local r_short = sg.calc(5, 2, 0, 1, short)
+        assert.is.equal(0, sg.cache_stats().misses)
+        local r_long = sg.calc(5, 2, 0, 1, input)
+        assert.is.equal(1, sg.cache_stats().misses)
+
+        -- Outputs far enough from the end of the short input coincide
+        for i = 1, 21 - 5 do
+            assert.near(r_short[i], r_long[i], 1e-4)
+        end
+    end)
+
+end)
+
+describe("SavgolFilter target point", function()
+
+    local input = {}
+    for i = 1, 40 do input[i] = 2 + 0.5 * i - 0.02 * i * i end
+
+    it("Reproduces quadratics for every target point", function()
+        for t = -4, 4 do
+            for _, precision in ipairs({"float", "double"}) do
+                local f = sg.new({half_window = 4, poly_order = 2, target_point = t,
+                                  precision = precision})
+                local result = f:apply(input)
+                for i = 1, #input do
+                    assert.near(input[i], result[i], 1e-3)
+                end
+            end
+        end
+    end)
+
+    it("Causal filters only use past samples", function()
+        local f = sg.new({half_window = 3, poly_order = 2, target_point = 3,
+                          boundary = sg.BOUNDARY_CONSTANT})
+        local a = f:apply(input)
+        local changed = {}
+        for i = 1, #input do changed[i] = input[i] end
+        for i = 21, #input do changed[i] = changed[i] + 100 end
+        local b = f:apply(changed)
+        for i = 1, 20 do
+            assert.is.equal(a[i], b[i])
+        end
+        assert.is_not.equal(a[21], b[21])
+    end)
+
+    it("Aligns valid output with the estimated sample", function()
+        local f = sg.new({half_window = 4, poly_order = 2, derivative = 1,
+                          target_point = 4})
+        local result = f:apply_valid(input)
+        assert.is.equal(#input - 8, #result)
+        for i = 1, #result do
+            local k = i + 8
+            assert.near(0.5 - 0.04 * k, result[i], 1e-3)
+        end
+    end)
+
+    it("Rejects target points outside the window", function()
+        assert.has_error(function()
+            sg.new({half_window = 4, poly_order = 2, target_point = 5})
+        end)
+    end)
+
+end)
+
+describe("Filter statistics", function()
+
+    local input = {}
+    for i = 1, 100 do input[i] = math.sin(i / 5) end
+
+    it("Counts calls of filters created with stats = true", function()
+        local f = sg.new({half_window = 3, poly_order = 2, stats = true})
+        f:apply(input)
+        f:apply_valid(input)
+        f:apply(sg.buffer.from_table(input))
+
+        local st = f:stats()
+        assert.is_true(st.enabled)
+        assert.is.equal(3, st.calls)
+        assert.is.equal(300, st.samples)
+        assert.is_true(st.bytes_allocated > 0)
+        assert.is_true(st.read_ns >= 0 and st.compute_ns >= 0 and st.write_ns >= 0)
+
+        f:stats(true)
+        assert.is.equal(0, f:stats().calls)
+    end)
+
+    it("Counts the overlap-save work areas of wide windows", function()
+        local long = {}
+        for i = 1, 8192 do long[i] = math.sin(i / 50) end
+        local buf = sg.buffer.from_table(long)
+
+        -- 401 taps: the FFT engine allocates work areas besides the scratch
+        local direct = sg.new({half_window = 200, poly_order = 3, stats = true, fft = false})
+        local fft = sg.new({half_window = 200, poly_order = 3, stats = true, fft = true})
+        direct:apply(buf)
+        fft:apply(buf)
+
+        assert.is.equal("fft", fft:info().kernel)
+        assert.is_true(#long >= fft:info().fft_min)
+        assert.is_true(fft:stats().bytes_allocated > direct:stats().bytes_allocated)
+    end)
+
+    it("Does not count by default", function()
+        local f = sg.new({half_window = 3, poly_order = 2})
+        f:apply(input)
+        local st = f:stats()
+        assert.is_false(st.enabled)
+        assert.is.equal(0, st.calls)
+    end)
+
+    it("Accumulates module-wide totals while enabled", function()
+        sg.stats(true)
+        assert.is_false(sg.stats_enable(true))
+        local f = sg.new({half_window = 3, poly_order = 2})
+        f:apply(input)
+        f:apply_batch({input, input})
+        assert.is_true(sg.stats_enable(false))
+        f:apply(input)
+
+        local st = sg.stats()
+        assert.is_false(st.enabled)
+        assert.is.equal(2, st.calls)
+        assert.is.equal(300, st.samples)
+        assert.is.equal(2, f:stats().calls)
+    end)
+
+end)
+
+describe("SavgolFilter views", function()
+
+    local n = 60
+    local left, right, stereo = {}, {}, {}
+    for i = 1, n do
+        left[i] = math.sin(i / 7)
+        right[i] = math.cos(i / 3) + 0.01 * i
+        stereo[2 * i - 1] = left[i]
+        stereo[2 * i] = right[i]
+    end
+
+    it("apply() reads one channel of interleaved data", function()
+        local f = sg.new({half_window = 4, poly_order = 2})
+        assert_same(f:apply(right), f:apply(stereo, {offset = 2, stride = 2}))
+        assert_same(f:apply_valid(left), f:apply_valid(stereo, {stride = 2}))
+
+        local buf = sg.buffer.from_table(stereo, "double")
+        local res = f:apply(buf, {offset = 2, stride = 2})
+        assert.is.equal("double", res:dtype())
+        assert_same(f:apply(right), res:to_table())
+    end)
+
+    it("count selects a segment", function()
+        local f = sg.new({half_window = 3, poly_order = 2, precision = "double"})
+        local segment = {}
+        for i = 1, 20 do segment[i] = left[10 + i] end
+        assert_same(f:apply(segment), f:apply(left, {offset = 11, count = 20}), 1e-12)
+
+        local buf = sg.buffer.from_table(left)
+        assert_same(f:apply(segment), f:apply(buf, {offset = 11, count = 20}):to_table())
+    end)
+
+    it("apply_into() writes back into the same view in place", function()
+        local f = sg.new({half_window = 4, poly_order = 2})
+        local data = {}
+        for i = 1, #stereo do data[i] = stereo[i] end
+        f:apply_into(data, nil, {offset = 1, stride = 2})
+
+        local expected = f:apply(left)
+        for i = 1, n do
+            assert.near(expected[i], data[2 * i - 1], 1e-6)
+            assert.is.equal(right[i], data[2 * i])   -- other channel untouched
+        end
+    end)
+
+    it("apply_valid_into() scatters into a strided buffer", function()
+        local hw = 4
+        local f = sg.new({half_window = hw, poly_order = 2})
+        local out = sg.buffer.new(2 * (n - 2 * hw))
+        f:apply_valid_into(stereo, out, {offset = 2, stride = 2, out_offset = 2, out_stride = 2})
+
+        local expected = f:apply_valid(right)
+        for i = 1, #expected do
+            assert.near(expected[i], out[2 * i], 1e-6)
+            assert.is.equal(0, out[2 * i - 1])
+        end
+    end)
+
+    it("Rejects views outside the data", function()
+        local f = sg.new({half_window = 4, poly_order = 2})
+        assert.has_error(function() f:apply(left, {offset = 0}) end)
+        assert.has_error(function() f:apply(left, {offset = 2, count = n}) end)
+        assert.has_error(function() f:apply(left, {offset = n - 3}) end)    -- shorter than the window
+        assert.has_error(function()
+            f:apply_into(left, sg.buffer.new(n), {out_offset = 2})
+        end)
+    end)
+
+end)
+
+describe("apply_file", function()
+
+    local function write_samples(path, fmt, values)
+        local fh = assert(io.open(path, "wb"))
+        fh:write(string.rep("H", 16))   -- header skipped via offset
+        for i = 1, #values do fh:write(string.pack(fmt, values[i])) end
+        fh:close()
+    end
+
+    local function read_samples(path, fmt)
+        local fh = assert(io.open(path, "rb"))
+        local data = fh:read("a")
+        fh:close()
+        local values, pos = {}, 1
+        while pos <= #data do
+            values[#values + 1], pos = string.unpack(fmt, data, pos)
+        end
+        return values
+    end
+
+    local a, b, interleaved = {}, {}, {}
+    for i = 1, 500 do
+        a[i] = math.sin(i / 9)
+        b[i] = math.cos(i / 4) + 0.001 * i
+        interleaved[2 * i - 1], interleaved[2 * i] = a[i], b[i]
+    end
+
+    it("Matches apply() for every channel", function()
+        local src, dst = os.tmpname(), os.tmpname()
+        write_samples(src, "=d", interleaved)
+
+        local f = sg.new({half_window = 5, poly_order = 3, boundary = sg.BOUNDARY_REFLECT})
+        local frames = sg.apply_file(f, src, dst, {dtype = "double", offset = 16, channels = 2})
+        assert.is.equal(500, frames)
+
+        local out = read_samples(dst, "=d")
+        local ea, eb = f:apply(a), f:apply(b)
+        assert.is.equal(1000, #out)
+        for i = 1, 500 do
+            assert.near(ea[i], out[2 * i - 1], 1e-5)
+            assert.near(eb[i], out[2 * i], 1e-5)
+        end
+        os.remove(src)
+        os.remove(dst)
+    end)
+
+    it("Writes 'valid' output of a single float channel", function()
+        local src, dst = os.tmpname(), os.tmpname()
+        write_samples(src, "=f", a)
+
+        local f = sg.new({half_window = 4, poly_order = 2})
+        assert.is.equal(500 - 8, sg.apply_file(f, src, dst, {offset = 16, valid = true}))
+
+        local out = read_samples(dst, "=f")
+        local expected = f:apply_valid(a)
+        assert.is.equal(#expected, #out)
+        for i = 1, #expected do
+            assert.near(expected[i], out[i], 1e-5)
+        end
+        os.remove(src)
+        os.remove(dst)
+    end)
+
+    it("Rejects inputs that do not fit the layout", function()
+        local src, dst = os.tmpname(), os.tmpname()
+        write_samples(src, "=f", {1, 2, 3})
+        local f = sg.new({half_window = 4, poly_order = 2})
+        assert.has_error(function() sg.apply_file(f, src, dst, {offset = 16}) end)     -- too short
+        assert.has_error(function() sg.apply_file(f, src, dst, {offset = 15}) end)     -- partial sample
+        assert.has_error(function() sg.apply_file(f, src .. ".missing", dst) end)
+        assert.has_error(function() sg.apply_file(f, src, src) end)
+        os.remove(src)
+        os.remove(dst)
+    end)
+
+    it("Rejects misaligned offsets and other paths of the input", function()
+        local src, dst = os.tmpname(), os.tmpname()
+        local fh = assert(io.open(src, "wb"))
+        fh:write("HHHH")
+        for i = 1, #a do fh:write(string.pack("=d", a[i])) end
+        fh:close()
+        local f = sg.new({half_window = 4, poly_order = 2})
+        assert.has_error(function() sg.apply_file(f, src, dst, {dtype = "double", offset = 4}) end)
+        assert.is.equal(#a, sg.apply_file(f, src, dst, {dtype = "float", offset = 4}) / 2)
+
+        local alias = src:gsub("([^/\\]+)$", "./%1")
+        assert.has_error(function() sg.apply_file(f, src, alias, {offset = 4}) end)
+        fh = assert(io.open(src, "rb"))
+        assert.is.equal(4 + 8 * #a, #fh:read("a"))   -- input left intact
+        fh:close()
+        os.remove(src)
+        os.remove(dst)
+    end)
+
+end)
+
+describe("SavgolFilter apply_irregular", function()
+
+    local function poly(x) return 1 + 2 * x - 0.5 * x * x end
+    local function dpoly(x) return 2 - x end
+
+    it("Matches apply() on uniform timestamps", function()
+        local f = sg.new({half_window = 4, poly_order = 2, derivative = 1,
+                          time_step = 0.25, precision = "double"})
+        local t, y = {}, {}
+        for i = 1, 80 do t[i] = 3 + 0.25 * i; y[i] = math.sin(i / 6) end
+        local expected = f:apply(y)
+        local result = f:apply_irregular(t, y)
+        assert.is.equal(#expected, #result)
+        for i = 1, #expected do
+            assert.near(expected[i], result[i], 1e-9)
+        end
+    end)
+
+    it("Reproduces polynomials on jittered timestamps", function()
+        local smooth = sg.new({half_window = 5, poly_order = 2})
+        local slope = sg.new({half_window = 5, poly_order = 2, derivative = 1})
+        local t, y = {}, {}
+        for i = 1, 120 do
+            t[i] = 0.1 * i + 0.03 * math.sin(i * 2.1)
+            y[i] = poly(t[i])
+        end
+        local s, d = smooth:apply_irregular(t, y), slope:apply_irregular(t, y)
+        for i = 1, #t do
+            assert.near(y[i], s[i], 1e-9)
+            assert.near(dpoly(t[i]), d[i], 1e-7)
+        end
+    end)
+
+    it("Returns a buffer for buffer samples", function()
+        local f = sg.new({half_window = 3, poly_order = 2})
+        local t, y = {}, {}
+        for i = 1, 40 do t[i] = i + 0.2 * (i % 2); y[i] = poly(t[i]) end
+        local res = f:apply_irregular(sg.buffer.from_table(t, "double"),
+                                      sg.buffer.from_table(y, "double"))
+        assert.is.equal("double", res:dtype())
+        assert.near(y[20], res[20], 1e-9)
+    end)
+
+    it("Rejects invalid timestamps", function()
+        local f = sg.new({half_window = 3, poly_order = 2})
+        local t, y = {}, {}
+        for i = 1, 20 do t[i] = i; y[i] = i end
+        assert.has_error(function() f:apply_irregular({1, 2, 3}, y) end)
+        t[10] = t[9]
+        assert.has_error(function() f:apply_irregular(t, y) end)
+    end)
+
+end)
+
+describe("Pipelines", function()
+
+    local input = {}
+    for i = 1, 400 do input[i] = math.sin(i / 15) + 0.2 * math.cos(i * 1.3) end
+
+    it("Matches the stages applied one after another", function()
+        for _, boundary in ipairs({sg.BOUNDARY_POLYNOMIAL, sg.BOUNDARY_REFLECT,
+                                   sg.BOUNDARY_PERIODIC, sg.BOUNDARY_CONSTANT}) do
+            local smooth = sg.new({half_window = 12, poly_order = 2, boundary = boundary})
+            local slope = sg.new({half_window = 3, poly_order = 2, derivative = 1,
+                                  boundary = boundary})
+            local p = sg.pipeline{smooth, slope}
+            assert_same(slope:apply(smooth:apply(input)), p:apply(input), 1e-5)
+            assert_same(slope:apply_valid(smooth:apply_valid(input)), p:apply_valid(input), 1e-5)
+        end
+    end)
+
+    it("Composes the kernel", function()
+        local a = sg.new({half_window = 2, poly_order = 2, precision = "double"})
+        local b = sg.new({half_window = 4, poly_order = 3, precision = "double"})
+        local taps, w = sg.pipeline{a, b}:taps()
+        assert.is.equal(13, taps)
+        local sum = 0
+        for i = 1, taps do sum = sum + w[i] end
+        assert.near(1.0, sum, 1e-12)
+    end)
+
+    it("compose = false gives the same result", function()
+        local a = sg.new({half_window = 8, poly_order = 3, precision = "double"})
+        local b = sg.new({half_window = 2, poly_order = 2, target_point = 2, precision = "double"})
+        local fast = sg.pipeline{a, b}
+        local plain = sg.pipeline({a, b}, {compose = false})
+        local buf = sg.buffer.from_table(input, "double")
+        assert_same(plain:apply(buf):to_table(), fast:apply(buf):to_table(), 1e-12)
+    end)
+
+    it("Rejects invalid stages", function()
+        local f = sg.new({half_window = 2, poly_order = 2})
+        local d = sg.new({half_window = 2, poly_order = 2, precision = "double"})
+        assert.has_error(function() sg.pipeline{} end)
+        assert.has_error(function() sg.pipeline{f, {}} end)
+        assert.has_error(function() sg.pipeline{f, d} end)
+        local gaps = sg.new({half_window = 2, poly_order = 2, missing = "skip"})
+        assert.has_error(function() sg.pipeline{f, gaps} end)
+
+        local p = sg.pipeline{f}
+        f:destroy()
+        assert.has_error(function() p:apply(input) end)
+    end)
+
+end)
+
+describe("Wide windows", function()
+
+    local input = {}
+    for i = 1, 5000 do input[i] = math.sin(i / 200) + 0.3 * math.cos(i * 0.9) end
+
+    it("Accepts windows beyond the core library limit", function()
+        local f = sg.new({half_window = 100, poly_order = 2, precision = "double"})
+        local out = f:apply(input)
+        assert.is.equal(#input, #out)
+        assert.is.equal(#input - 200, #f:apply_valid(input))
+        assert.has_error(function() sg.new({half_window = 5000, poly_order = 2}) end)
+    end)
+
+    it("Reports half_window beyond the limit as such", function()
+        for _, n in ipairs({4097, 5000, -1}) do
+            local ok, err = pcall(sg.new, {half_window = n, poly_order = 2})
+            assert.is_false(ok)
+            assert.matches("half_window out of range (max: 4096)", err, 1, true)
+        end
+        assert.is_true(pcall(sg.new, {half_window = 4096, poly_order = 2, precision = "double"}))
+    end)
+
+    it("FFT and direct convolution agree", function()
+        for _, precision in ipairs({"float", "double"}) do
+            for _, boundary in ipairs({sg.BOUNDARY_POLYNOMIAL, sg.BOUNDARY_REFLECT,
+                                       sg.BOUNDARY_PERIODIC}) do
+                local cfg = {half_window = 300, poly_order = 4, derivative = 1,
+                             boundary = boundary, precision = precision}
+                cfg.fft = false
+                local direct = sg.new(cfg)
+                cfg.fft = true
+                local fft = sg.new(cfg)
+                local tol = (precision == "double") and 1e-12 or 1e-6
+                assert_same(direct:apply(input), fft:apply(input), tol)
+                assert_same(direct:apply_valid(input), fft:apply_valid(input), tol)
+            end
+        end
+    end)
+
+    it("Preserves polynomials up to the fit order", function()
+        local cubic = {}
+        for i = 1, 2000 do cubic[i] = 1e-9 * (i - 700) ^ 3 + 0.002 * i end
+        local f = sg.new({half_window = 400, poly_order = 3, precision = "double"})
+        assert_same(cubic, f:apply(cubic), 1e-9)
+    end)
+
+end)
+
+describe("SavgolFilter apply_decimated", function()
+
+    local input = {}
+    for i = 1, 503 do input[i] = math.sin(i / 17) + 0.3 * math.cos(i * 0.7) end
+
+    it("Matches every k-th output of apply", function()
+        for _, boundary in ipairs({sg.BOUNDARY_POLYNOMIAL, sg.BOUNDARY_REFLECT,
+                                   sg.BOUNDARY_PERIODIC, sg.BOUNDARY_CONSTANT}) do
+            for _, precision in ipairs({"float", "double"}) do
+                local f = sg.new({half_window = 6, poly_order = 3, boundary = boundary,
+                                  precision = precision})
+                local full = f:apply(input)
+                for _, k in ipairs({1, 4, 10}) do
+                    for phase = 0, k - 1, 3 do
+                        local out = f:apply_decimated(input, k, phase)
+                        assert.is.equal(math.ceil((#input - phase) / k), #out)
+                        for i = 1, #out do
+                            assert.near(full[phase + 1 + (i - 1) * k], out[i], 1e-5)
+                        end
+                    end
+                end
+            end
+        end
+    end)
+
+    it("Returns buffers for buffer input", function()
+        local f = sg.new({half_window = 4, poly_order = 2, target_point = 4})
+        local buf = sg.buffer.from_table(input, "double")
+        local out = f:apply_decimated(buf, 5, 2)
+        local full = f:apply(input)
+        assert.is.equal(101, #out)
+        assert.near(full[3], out[1], 1e-5)
+        assert.near(full[503], out[101], 1e-5)
+    end)
+
+    it("Rejects invalid arguments", function()
+        local f = sg.new({half_window = 4, poly_order = 2})
+        assert.has_error(function() f:apply_decimated(input, 0) end)
+        assert.has_error(function() f:apply_decimated(input, 4, 4) end)
+        assert.has_error(function() f:apply_decimated({1, 2, 3}, 2) end)
+    end)
+
+end)
+
+describe("Series", function()
+
+    local input = {}
+    for i = 1, 300 do input[i] = math.sin(i / 13) + 0.25 * math.cos(i * 0.9) end
+
+    local function assert_matches(f, s, samples)
+        local expected = f:apply(samples)
+        local out = s:output()
+        assert.is.equal(#samples, #s)
+        for i = 1, #samples do
+            assert.near(expected[i], out[i], 1e-5)
+        end
+    end
+
+    it("Matches apply after edits", function()
+        for _, boundary in ipairs({sg.BOUNDARY_POLYNOMIAL, sg.BOUNDARY_REFLECT,
+                                   sg.BOUNDARY_PERIODIC, sg.BOUNDARY_CONSTANT}) do
+            for _, precision in ipairs({"float", "double"}) do
+                local f = sg.new({half_window = 5, poly_order = 3, boundary = boundary,
+                                  precision = precision})
+                local samples = {table.unpack(input, 1, 200)}
+                local s = sg.series(f, samples)
+                assert_matches(f, s, samples)
+
+                samples[1] = 3; s:set(1, 3)
+                samples[120] = -2; s:set(120, -2)
+                assert_matches(f, s, samples)
+
+                for i = 0, 9 do samples[150 + i] = i / 10 end
+                s:update_range(150, {0, 0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.9})
+                assert_matches(f, s, samples)
+
+                for i = 201, 300 do samples[i] = input[i] end
+                s:append({table.unpack(input, 201, 299)})
+                s:append(input[300])
+                assert_matches(f, s, samples)
+            end
+        end
+    end)
+
+    it("Recomputes only the affected outputs", function()
+        local f = sg.new({half_window = 4, poly_order = 2})
+        local s = sg.series(f, input)
+        local first, last = s:set(100, 0)
+        assert.is.equal(96, first)
+        assert.is.equal(104, last)
+        first, last = s:append(1)
+        assert.is.equal(297, first)
+        assert.is.equal(301, last)
+    end)
+
+    it("Waits for a complete window", function()
+        local f = sg.new({half_window = 2, poly_order = 2})
+        local s = sg.series(f)
+        assert.is_nil(s:append({1, 2, 3, 4}))
+        assert.is_nil(s:get(1))
+        assert.has_error(function() s:output() end)
+        local first, last = s:append(5)
+        assert.is.equal(1, first)
+        assert.is.equal(5, last)
+        assert.near(3, s:get(3), 1e-5)
+    end)
+
+    it("Rejects invalid arguments", function()
+        local f = sg.new({half_window = 2, poly_order = 2})
+        local s = sg.series(f, {1, 2, 3, 4, 5})
+        assert.has_error(function() s:set(7, 1) end)
+        assert.has_error(function() s:update_range(2, 1) end)
+        assert.has_error(function() s:append("1") end)
+        assert.is.equal(5, #s)
+        f:destroy()
+        assert.has_error(function() s:get(1) end)
+    end)
+
+end)
+
+describe("Raw sample buffers", function()
+
+    local volts = 10 / 32768
+    local values = {}
+    for i = 1, 600 do values[i] = 4 * math.sin(i / 20) + 0.5 * math.cos(i * 1.1) end
+
+    it("Stores scaled and saturated values", function()
+        local buf = sg.buffer.from_table({1.0, -2.5, 100, -100}, "int16", volts)
+        assert.is.equal("int16", buf:dtype())
+        assert.near(1.0, buf[1], volts / 2)
+        assert.near(-2.5, buf[2], volts / 2)
+        assert.near(32767 * volts, buf[3], 1e-9)
+        assert.near(-32768 * volts, buf[4], 1e-9)
+        local scale, offset = buf:scaling()
+        assert.is.equal(volts, scale)
+        assert.is.equal(0, offset)
+
+        local u = sg.buffer.new(2, "uint16", 1, -1000)
+        u[1] = -1000.4
+        assert.is.equal(-1000, u[1])
+        local h = sg.buffer.from_table({0.1, 65504, 1e6}, "float16")
+        assert.near(0.1, h[1], 1e-4)
+        assert.is.equal(65504, h[2])
+        assert.is.equal(math.huge, h[3])
+    end)
+
+    it("Creates buffers from binary strings", function()
+        local bytes = string.pack("=i2i2i2", 1, -2, 300)
+        local buf = sg.buffer.from_string(bytes, "int16", 0.5, 1)
+        assert.is.equal(3, #buf)
+        assert.is.equal(1.5, buf[1])
+        assert.is.equal(0, buf[2])
+        assert.is.equal(151, buf[3])
+        assert.has_error(function() sg.buffer.from_string("abc", "int16") end)
+    end)
+
+    it("Filters like the converted samples", function()
+        for _, dtype in ipairs({"int16", "int32", "uint16", "float16"}) do
+            for _, precision in ipairs({"float", "double"}) do
+                local offset = (dtype == "uint16") and -10 or 0
+                local raw = sg.buffer.from_table(values, dtype, volts, offset)
+                local f = sg.new({half_window = 6, poly_order = 3, precision = precision})
+                local expected = f:apply(raw:to_table())
+                local out = f:apply(raw)
+                assert.is.equal(precision, out:dtype())
+                for i = 1, #values do
+                    assert.near(expected[i], out[i], 1e-5)
+                end
+                local valid = f:apply_valid(raw)
+                assert.is.equal(#values - 12, #valid)
+                assert.near(expected[7], valid[1], 1e-5)
+            end
+        end
+    end)
+
+    it("Writes into raw buffers", function()
+        local raw = sg.buffer.from_table(values, "int16", volts)
+        local f = sg.new({half_window = 4, poly_order = 2})
+        local expected = f:apply(raw)
+        local out = sg.buffer.new(#values, "int16", volts)
+        f:apply_into(raw, out)
+        f:apply_into(raw)   -- in place
+        for i = 1, #values do
+            assert.near(expected[i], out[i], volts)
+            assert.near(expected[i], raw[i], volts)
+        end
+    end)
+
+    it("Filters raw sample files", function()
+        local src, dst = os.tmpname(), os.tmpname()
+        local fh = assert(io.open(src, "wb"))
+        local raw = sg.buffer.from_table(values, "int16", volts)
+        local bytes = {}
+        for i = 1, #values do bytes[i] = string.pack("=i2", math.floor(raw[i] / volts + 0.5)) end
+        fh:write(table.concat(bytes))
+        fh:close()
+
+        local f = sg.new({half_window = 5, poly_order = 3})
+        assert.is.equal(#values, sg.apply_file(f, src, dst, {dtype = "int16", scale = volts}))
+        fh = assert(io.open(dst, "rb"))
+        local out = sg.buffer.from_string(fh:read("a"))
+        fh:close()
+        local expected = f:apply(raw)
+        assert.is.equal(#values, #out)
+        for i = 1, #values do
+            assert.near(expected[i], out[i], 1e-5)
+        end
+        assert.has_error(function() sg.apply_file(f, src, dst, {scale = 2}) end)
+        os.remove(src)
+        os.remove(dst)
+    end)
+
+    it("Rejects invalid scaling", function()
+        assert.has_error(function() sg.buffer.new(4, "float", 2) end)
+        assert.has_error(function() sg.buffer.new(4, "int16", 0) end)
+        assert.has_error(function() sg.new({half_window = 2, poly_order = 2, precision = "int16"}) end)
+    end)
+
+end)
+
+describe("Missing samples", function()
+
+    local clean = {}
+    for i = 1, 120 do clean[i] = 0.5 + 0.02 * i - 0.0003 * i * i end
+    local gappy = {table.unpack(clean)}
+    gappy[3], gappy[40], gappy[41], gappy[90] = nil, 0 / 0, nil, 0 / 0
+
+    local function isnan(v) return v ~= v end
+
+    it("Raises on holes by default", function()
+        local f = sg.new({half_window = 4, poly_order = 2})
+        assert.has_error(function() f:apply(gappy) end)
+        assert.has_error(function() sg.new({half_window = 4, poly_order = 2, missing = "drop"}) end)
+    end)
+
+    it("Propagates gaps to the affected outputs only", function()
+        for _, precision in ipairs({"float", "double"}) do
+            local f = sg.new({half_window = 4, poly_order = 2, precision = precision,
+                              missing = "propagate"})
+            local ref = f:apply(clean)
+            local out = f:apply(gappy)
+            for i = 1, #clean do
+                local near_gap = i <= 7 or (i >= 36 and i <= 45) or (i >= 86 and i <= 94)
+                assert.is.equal(near_gap, isnan(out[i]))
+                if not near_gap then assert.near(ref[i], out[i], 1e-5) end
+            end
+        end
+    end)
+
+    it("Refits windows with gaps", function()
+        for _, precision in ipairs({"float", "double"}) do
+            local f = sg.new({half_window = 4, poly_order = 2, precision = precision,
+                              missing = "skip"})
+            local out = f:apply(gappy)
+            for i = 1, #clean do
+                assert.near(clean[i], out[i], 1e-4)   -- quadratic data is reproduced
+            end
+            local slope = sg.new({half_window = 4, poly_order = 2, derivative = 1,
+                                  precision = precision, missing = "skip"})
+            local v = slope:apply_valid(gappy)
+            assert.near(0.02 - 0.0006 * 41, v[41 - 4], 1e-4)
+        end
+    end)
+
+    it("Interpolates gaps", function()
+        local line = {}
+        for i = 1, 60 do line[i] = 2 * i end
+        line[10], line[30], line[31] = nil, 0 / 0, 0 / 0
+        local f = sg.new({half_window = 3, poly_order = 1, missing = "interpolate"})
+        local out = f:apply(line)
+        for i = 1, 60 do
+            assert.near(2 * i, out[i], 1e-4)
+        end
+        local buf = sg.buffer.from_table({0 / 0, 0 / 0, 0 / 0, 0 / 0, 0 / 0, 0 / 0, 0 / 0})
+        assert.is_true(isnan(f:apply(buf)[1]))
+    end)
+
+    it("Handles gaps in batch rows alike on the worker pool", function()
+        local rows, stride = 6, #clean
+        for _, precision in ipairs({"float", "double"}) do
+            local matrix = sg.buffer.new(rows * stride, precision)
+            for r = 0, rows - 1 do
+                for i = 1, stride do matrix[r * stride + i] = clean[i] + r end
+                matrix[r * stride + 10 + 7 * r] = 0 / 0
+            end
+            for _, missing in ipairs({"propagate", "skip", "interpolate"}) do
+                local config = {half_window = 4, poly_order = 2, precision = precision,
+                                missing = missing}
+                local serial = sg.new(config)
+                config.threads = 4
+                local parallel = sg.new(config)
+                local r1 = serial:apply_batch(matrix, stride)
+                local r4 = parallel:apply_batch(matrix, stride)
+                for i = 1, #r1 do
+                    if isnan(r1[i]) then
+                        assert.is_true(isnan(r4[i]))
+                    else
+                        assert.is.equal(r1[i], r4[i])
+                    end
+                end
+                if missing ~= "propagate" then
+                    assert.near(clean[50] + 1, r4[stride + 50], 1e-4)
+                    assert.is_false(isnan(r4[stride + 17]))
+                end
+            end
+        end
+    end)
+
+    it("Decimates the gap-aware outputs of apply()", function()
+        local f = sg.new({half_window = 4, poly_order = 2, missing = "skip"})
+        local ref = f:apply(gappy)
+        local out = f:apply_decimated(gappy, 3, 1)
+        assert.is.equal(40, #out)
+        for i = 1, #out do
+            assert.near(ref[2 + 3 * (i - 1)], out[i], 1e-6)
+            assert.near(clean[2 + 3 * (i - 1)], out[i], 1e-4)
+        end
+    end)
+
+    it("Refreshes series with gaps", function()
+        local f = sg.new({half_window = 4, poly_order = 2, missing = "skip"})
+        local s = sg.series(f, gappy)
+        local first, last = s:set(60, 0 / 0)
+        assert.is.equal(1, first)
+        assert.is.equal(#clean, last)
+        for i = 1, #clean do
+            assert.near(clean[i], s:get(i), 1e-4)
+        end
+    end)
+
+    it("Handles gaps for every derivative order of a multi filter", function()
+        local kin = sg.new_multi({half_window = 4, poly_order = 2, missing = "skip"}, {0, 1})
+        local pos, vel = kin:apply(gappy)
+        for i = 1, #clean do
+            assert.near(clean[i], pos[i], 1e-4)
+        end
+        assert.near(0.02 - 0.0006 * 41, vel[41], 1e-4)
+    end)
+
+    it("Rejects missing in apply_file and streams", function()
+        local src, dst = os.tmpname(), os.tmpname()
+        local fh = assert(io.open(src, "wb"))
+        for i = 1, #clean do fh:write(string.pack("=f", i == 40 and 0 / 0 or clean[i])) end
+        fh:close()
+
+        local f = sg.new({half_window = 4, poly_order = 2, missing = "skip"})
+        local ok, err = pcall(sg.apply_file, f, src, dst)
+        assert.is_false(ok)
+        assert.matches("missing=skip is not supported by apply_file", err, 1, true)
+        ok, err = pcall(sg.stream, {half_window = 4, poly_order = 2, missing = "skip"})
+        assert.is_false(ok)
+        assert.matches("missing=skip is not supported by stream", err, 1, true)
+        os.remove(src)
+        os.remove(dst)
+    end)
+
+end)
+
+describe("2-D filters", function()
+
+    local rows, cols = 20, 30
+    local function surface(r, c) return 1 + 0.1 * c - 0.2 * r + 0.01 * c * c + 0.02 * r * c end
+    local image = {}
+    for r = 0, rows - 1 do
+        for c = 0, cols - 1 do image[r * cols + c + 1] = surface(r, c) end
+    end
+
+    it("Reproduces quadratic surfaces", function()
+        for _, fit in ipairs({"tensor", "total"}) do
+            local f = sg.new_2d({half_window = 3, poly_order = 2, precision = "double", fit = fit})
+            assert.is.equal(fit == "tensor", f:separable())
+            local out = f:apply(sg.buffer.from_table(image, "double"), rows, cols)
+            assert.is.equal(rows * cols, #out)
+            for i = 1, rows * cols do assert.near(image[i], out[i], 1e-9) end
+        end
+    end)
+
+    it("Matches filtering rows and then columns", function()
+        local config = {half_window = 2, poly_order = 2, precision = "double",
+                        boundary = sg.BOUNDARY_REFLECT, x = {half_window = 4}}
+        local f = sg.new_2d(config)
+        local noisy = {}
+        for i = 1, rows * cols do noisy[i] = math.sin(i * 0.37) end
+        local out = f:apply(sg.buffer.from_table(noisy, "double"), rows, cols)
+        local fx = sg.new({half_window = 4, poly_order = 2, boundary = sg.BOUNDARY_REFLECT,
+                           precision = "double"})
+        local fy = sg.new({half_window = 2, poly_order = 2, boundary = sg.BOUNDARY_REFLECT,
+                           precision = "double"})
+        local tmp = {}
+        for r = 0, rows - 1 do
+            tmp[r + 1] = fx:apply({table.unpack(noisy, r * cols + 1, (r + 1) * cols)})
+        end
+        for c = 1, cols do
+            local column = {}
+            for r = 1, rows do column[r] = tmp[r][c] end
+            local ref = fy:apply(column)
+            for r = 1, rows do assert.near(ref[r], out[(r - 1) * cols + c], 1e-12) end
+        end
+    end)
+
+    it("Computes derivatives of a total fit, also at the edges", function()
+        local f = sg.new_2d({half_window = 2, poly_order = 2, fit = "total", precision = "double",
+                             x = {derivative = 1, time_step = 0.5}})
+        assert.is_false(f:separable())
+        local out = f:apply(sg.buffer.from_table(image, "double"), rows, cols)
+        for r = 0, rows - 1 do
+            for c = 0, cols - 1 do
+                assert.near((0.1 + 0.02 * c + 0.02 * r) / 0.5, out[r * cols + c + 1], 1e-9)
+            end
+        end
+        local w = f:weights()
+        assert.is.equal(5, #w)
+        assert.is.equal(5, #w[1])
+        assert.is_true(sg.new_2d({half_window = 2, poly_order = 1, fit = "total",
+                                  boundary = sg.BOUNDARY_REFLECT}):separable())
+    end)
+
+    it("Reads strided images and returns valid outputs", function()
+        local padded = {}
+        for r = 0, rows - 1 do
+            for c = 0, cols + 1 do padded[r * (cols + 2) + c + 1] = image[r * cols + math.min(c, cols - 1) + 1] end
+        end
+        local f = sg.new_2d({half_window = 2, poly_order = 2, y = {half_window = 1}})
+        local out = f:apply_valid(sg.buffer.from_table(padded), rows, cols, cols + 2)
+        assert.is.equal((rows - 2) * (cols - 4), #out)
+        assert.is.equal("float", out:dtype())
+        assert.near(surface(1, 2), out[1], 1e-3)
+        assert.has_error(function() f:apply(sg.buffer.from_table(image), rows, cols, cols + 2) end)
+        assert.has_error(function() f:apply(sg.buffer.from_table(image), 2, cols) end)
+        assert.has_error(function() sg.new_2d({half_window = 2, poly_order = 2, target_point = 1}) end)
+        assert.has_error(function() sg.new_2d({half_window = 2, poly_order = 2, missing = "skip"}) end)
+        assert.has_error(function()
+            sg.new_2d({half_window = 2, poly_order = 2, fit = "total", x = {missing = "propagate"}})
+        end)
+        assert.has_error(function()
+            sg.new_2d({half_window = 2, poly_order = 2, fit = "total", x = {derivative = 2},
+                       y = {derivative = 1}})
+        end)
+    end)
+
+end)
+
+describe("Resumable calls", function()
+    local data = {}
+    for i = 1, 1000 do data[i] = math.sin(i * 0.05) + 0.1 * math.sin(i * 1.3) end
+
+    it("Steps to the result of apply", function()
+        local f = sg.new({half_window = 4, poly_order = 2, boundary = sg.BOUNDARY_REFLECT})
+        local job = f:apply_async(data, {chunk = 100})
+        assert.is_nil(job:result())
+        local done, progress, steps = false, 0, 0
+        repeat
+            local last = progress
+            done, progress = job:step()
+            assert.is_true(progress >= last and progress <= 1)
+            steps = steps + 1
+        until done
+        assert.is_true(steps > 10)
+        local ref, out = f:apply(data), job:result()
+        assert.is.equal(#ref, #out)
+        for i = 1, #ref do assert.near(ref[i], out[i], 1e-6) end
+    end)
+
+    it("Yields inside coroutines and returns valid outputs for buffers", function()
+        local f = sg.new({half_window = 4, poly_order = 2, precision = "double"})
+        local buf = sg.buffer.from_table(data, "double")
+        local co = coroutine.wrap(function()
+            return f:apply_async(buf, {chunk = 64, valid = true}):run()
+        end)
+        local yields, r = 0, co()
+        while type(r) == "number" do yields, r = yields + 1, co() end
+        assert.is_true(yields > 10)
+        local ref = f:apply_valid(buf)
+        assert.is.equal(#ref, #r)
+        for i = 1, #ref do assert.near(ref[i], r[i], 1e-12) end
+        assert.is.equal(#ref, #f:apply_async(buf, {valid = true}):run())
+    end)
+
+    it("Reports holes and short inputs", function()
+        local f = sg.new({half_window = 4, poly_order = 2})
+        local gappy = {table.unpack(data, 1, 100)}
+        gappy[40] = nil
+        local job = f:apply_async(gappy)
+        assert.has_error(function() job:step() end)
+        assert.is_nil(job:result())
+        assert.has_error(function() f:apply_async({1, 2, 3}) end)
+    end)
+end)
+
+describe("Background calls", function()
+    local data = {}
+    for i = 1, 5000 do data[i] = math.sin(i * 0.05) + 0.1 * math.sin(i * 1.3) end
+
+    it("Returns the result of apply for several calls in flight", function()
+        local f = sg.new({half_window = 6, poly_order = 3, precision = "double"})
+        local buf = sg.buffer.from_table(data, "double")
+        local jobs = {}
+        for i = 1, 8 do jobs[i] = f:submit(i % 2 == 0 and buf or data) end
+        local ref = f:apply(data)
+        for i = 1, 8 do
+            local out = jobs[i]:wait()
+            assert.is_true(jobs[i]:ready())
+            assert.is.equal(out, jobs[i]:result())
+            assert.is.equal(#ref, #out)
+            for k = 1, #ref, 97 do assert.near(ref[k], out[k], 1e-12) end
+        end
+        assert.is.equal("table", type(jobs[1]:result()))
+    end)
+
+    it("Outlives the filter and converts element types", function()
+        local f = sg.new({half_window = 4, poly_order = 2})
+        local ref = f:apply_valid(sg.buffer.from_table(data, "double"))
+        local job = f:submit(sg.buffer.from_table(data, "double"), {valid = true})
+        f:destroy()
+        local out = job:wait()
+        assert.is.equal("double", out:dtype())
+        assert.is.equal(#ref, #out)
+        for k = 1, #ref, 97 do assert.near(ref[k], out[k], 1e-6) end
+    end)
+
+    it("Rejects holes and short inputs when submitting", function()
+        local f = sg.new({half_window = 4, poly_order = 2})
+        local gappy = {table.unpack(data, 1, 100)}
+        gappy[40] = nil
+        assert.has_error(function() f:submit(gappy) end)
+        assert.has_error(function() f:submit({1, 2, 3}) end)
+    end)
+end)
+
+describe("Kernel selection", function()
+    it("Reports unrolled kernels for common half windows", function()
+        for _, hw in ipairs({2, 3, 5, 7}) do
+            local info = sg.new({half_window = hw, poly_order = 2}):info()
+            assert.is.equal("unrolled", info.kernel)
+            assert.is.equal(2 * hw + 1, info.window_size)
+            assert.is.equal(sg.simd_level(), info.simd)
+        end
+        assert.is.equal("folded", sg.new({half_window = 9, poly_order = 2}):info().kernel)
+        assert.is.equal("generic",
+                        sg.new({half_window = 3, poly_order = 2, target_point = 3}):info().kernel)
+        local d = sg.new({half_window = 5, poly_order = 3, derivative = 1, precision = "double"})
+        local info = d:info()
+        assert.is.equal("unrolled", info.kernel)
+        assert.is.equal("double", info.precision)
+        assert.is.equal(1, info.derivative)
+    end)
+
+    it("Matches the generic kernel", function()
+        local data = {}
+        for i = 1, 300 do data[i] = 0.5 + 0.01 * i - 2e-4 * i * i + 1e-6 * i * i * i end
+        for _, hw in ipairs({2, 3, 5, 7}) do
+            for d = 0, 1 do
+                local unrolled = sg.new({half_window = hw, poly_order = 3, derivative = d,
+                                         precision = "double"})
+                local shifted = sg.new({half_window = hw, poly_order = 3, derivative = d,
+                                        precision = "double", target_point = 1})
+                assert.is.equal("generic", shifted:info().kernel)
+                -- Both reproduce the cubic: outputs agree one window apart
+                local a, b = unrolled:apply_valid(data), shifted:apply_valid(data)
+                for i = 2, #a do assert.near(a[i], b[i - 1], 1e-9) end
+            end
+        end
+    end)
+end)
+
+describe("Dumped filters", function()
+    local data = {}
+    for i = 1, 400 do data[i] = math.sin(i * 0.07) + 0.1 * math.cos(i * 1.9) end
+
+    it("Round-trips configurations of both precisions", function()
+        local configs = {
+            {half_window = 5, poly_order = 2, boundary = sg.BOUNDARY_REFLECT},
+            {half_window = 4, poly_order = 3, derivative = 1, time_step = 0.1, precision = "double"},
+            {half_window = 6, poly_order = 2, target_point = 6},
+            {half_window = 40, poly_order = 4, precision = "double", missing = "skip"},
+        }
+        for _, config in ipairs(configs) do
+            local f = sg.new(config)
+            local g = sg.load(f:dump())
+            assert.is_true(g:info().shared)
+            assert.is.equal(f:info().window_size, g:info().window_size)
+            assert.is.equal(f:info().missing, g:info().missing)
+            local a, b = f:apply(data), g:apply(data)
+            for i = 1, #a do assert.near(a[i], b[i], 1e-12) end
+        end
+    end)
+
+    it("References the weight store", function()
+        local config = {half_window = 17, poly_order = 3, precision = "double"}
+        local before = sg.store_stats()
+        local f = sg.new({half_window = 17, poly_order = 3, precision = "double",
+                          shared = true})
+        local g = sg.load(sg.new(config):dump())
+        local st = sg.store_stats()
+        assert.is.equal(before.entries + 1, st.entries)
+        assert.is_true(st.bytes > 0)
+        assert.is_true(f:info().shared)
+        assert.is_false(sg.new(config):info().shared)
+        local a, b = f:apply(data), g:apply(data)
+        for i = 1, #a do assert.is.equal(a[i], b[i]) end
+    end)
+
+    it("Rejects invalid dumps", function()
+        local blob = sg.new({half_window = 3, poly_order = 2}):dump()
+        assert.has_error(function() sg.load("not a filter") end)
+        assert.has_error(function() sg.load(blob:sub(1, #blob - 1)) end)
+        assert.has_error(function() sg.load("XXXX" .. blob:sub(5)) end)
+    end)
+end)
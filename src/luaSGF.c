@@ -26,12 +26,66 @@ SOFTWARE.
 #include <lauxlib.h>
 #include <lualib.h>
 
+#include <math.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <savgolFilter.h>
 
+#include "luaSGF_kernel.h"
+
 #define LUASGF_VERSION "luaSGF 2.0.1"
+
+// Symbol visibility of the module entry point for -fvisibility=hidden builds
+#if defined(__GNUC__) && !defined(_WIN32)
+#define LUASGF_EXPORT __attribute__((visibility("default")))
+#else
+#define LUASGF_EXPORT
+#endif
 #define LUASGF_METATABLE "luaSGF.Filter"
+#define LUASGF_BUFFER_METATABLE "luaSGF.Buffer"
+#define LUASGF_SCRATCH_METATABLE "luaSGF.Scratch"
+#define LUASGF_STREAM_METATABLE "luaSGF.Stream"
+#define LUASGF_POOL_KEY "luaSGF.Pool"
+#define LUASGF_MONITOR_KEY "luaSGF.Monitor"
+#define LUASGF_CACHE_METATABLE "luaSGF.Cache"
+#define LUASGF_MULTI_METATABLE "luaSGF.MultiFilter"
+#define LUASGF_FILEMAPS_METATABLE "luaSGF.FileMaps"
+#define LUASGF_PIPELINE_METATABLE "luaSGF.Pipeline"
+#define LUASGF_SERIES_METATABLE "luaSGF.Series"
+#define LUASGF_FILTER2D_METATABLE "luaSGF.Filter2D"
+#define LUASGF_ASYNC_METATABLE "luaSGF.AsyncJob"
+#define LUASGF_SUBMIT_METATABLE "luaSGF.Submitted"
+
+// Scratch memory the legacy calc() keeps between calls (bytes)
+#define LUASGF_CALC_SCRATCH_LIMIT (1u << 20)
+
+// Outputs of a multi-derivative filter, and the outputs per fused block
+#define LUASGF_MAX_OUTPUTS 8
+#define LUASGF_MULTI_BLOCK 4096
+
+// Stages of a pipeline
+#define LUASGF_MAX_STAGES 16
+
+// Unreferenced configurations the coefficient cache keeps for reuse
+#define LUASGF_CACHE_CAPACITY 64
+
+// Interior outputs per worker pool task; inputs below two chunks stay serial
+#define LUASGF_THREAD_CHUNK ((size_t)1 << 16)
+
+// Outputs per conversion block of raw buffers, small enough to stay in cache
+#define LUASGF_RAW_CHUNK ((size_t)1 << 12)
+
+// Output tile of 2-D filters per worker pool task: rows and columns
+#define LUASGF_TILE_ROWS ((size_t)64)
+#define LUASGF_TILE_COLS ((size_t)256)
+
+// Samples per step of apply_async(): about a millisecond of table conversion
+#define LUASGF_ASYNC_CHUNK ((size_t)1 << 16)
+
+// Frames per channel and chunk of apply_file() (raised to one task per thread)
+#define LUASGF_FILE_CHUNK ((size_t)1 << 18)
 
 // Savitzky-Golay Filter legacy API support
 typedef struct {
@@ -43,6 +97,272 @@ int mes_savgolFilter(MqsRawDataPoint_t data[], size_t dataSize, uint8_t halfWind
                      MqsRawDataPoint_t filteredData[], uint8_t polynomialOrder,
                      uint8_t targetPoint, uint8_t derivativeOrder);
 
+// Element types of luaSGF.Buffer storage; filters compute in float or double
+typedef enum {
+  LUASGF_DTYPE_FLOAT = 0,
+  LUASGF_DTYPE_DOUBLE,
+  LUASGF_DTYPE_INT16,     // raw types: value = stored * scale + offset
+  LUASGF_DTYPE_INT32,
+  LUASGF_DTYPE_UINT16,
+  LUASGF_DTYPE_FLOAT16    // IEEE 754 binary16
+} LuaSGF_DType;
+
+static const char *const luaSGF_dtype_names[] = {"float", "double", "int16", "int32",
+						 "uint16", "float16", NULL};
+// Filter precisions, a prefix of the element types
+static const char *const luaSGF_precision_names[] = {"float", "double", NULL};
+
+// Handling of missing samples (NaN, holes in tables), see new()
+enum {
+  LUASGF_MISSING_ERROR = 0,    // holes raise errors, NaN run through the kernels
+  LUASGF_MISSING_PROPAGATE,    // outputs whose window has a gap are NaN
+  LUASGF_MISSING_SKIP,         // windows with gaps are fitted to their valid samples
+  LUASGF_MISSING_INTERPOLATE   // gaps are filled linearly before filtering
+};
+
+static const char *const luaSGF_missing_names[] = {"error", "propagate", "skip",
+						   "interpolate", NULL};
+
+// Failures of util_run_precision(), see util_run_error()
+enum {
+  LUASGF_RUN_FAILED = 1,       // core library or boundary computation
+  LUASGF_RUN_NOMEM             // working memory could not be allocated
+};
+
+// Polynomials of 2-D filters, see new_2d()
+enum {
+  LUASGF_FIT_NONE = 0,      // destroyed
+  LUASGF_FIT_TENSOR,        // degree per axis: product of two 1-D filters
+  LUASGF_FIT_TOTAL          // total degree: 2-D kernel
+};
+
+static const char *const luaSGF_fit_names[] = {"tensor", "total", NULL};
+
+// Interior convolution of a filter, chosen when it is created
+enum {
+  LUASGF_KERNEL_GENERIC = 0,  // tap loop over asymmetric weights
+  LUASGF_KERNEL_FOLDED,       // (anti)symmetric weights, tap loop
+  LUASGF_KERNEL_UNROLLED,     // (anti)symmetric weights of a common half window
+  LUASGF_KERNEL_FFT           // overlap-save, direct kernels for short inputs
+};
+
+static const char *const luaSGF_kernel_names[] = {"generic", "folded", "unrolled", "fft"};
+
+// Contiguous numeric storage, allocated inline behind the header
+typedef struct {
+  size_t len;
+  LuaSGF_DType dtype;
+  void *data;
+  double scale, offset;  // raw types only, see LuaSGF_DType
+} LuaSGF_Buffer;
+
+// Grow-only scratch memory, reused across calls
+typedef struct {
+  void *ptr;
+  size_t size;   // bytes currently allocated
+  size_t limit;  // bytes kept between calls (0 = unlimited)
+  uint64_t allocated;  // bytes allocated over the lifetime (statistics)
+} LuaSGF_Scratch;
+
+// Linear structure of the legacy calc() implementation for one configuration
+typedef struct {
+  int fast;            // structure verified, calc() may bypass mes_savgolFilter
+  int offset;          // interior output k is computed from x[k + offset] on
+  int lead, trail;     // leading/trailing outputs with their own weights
+  float *lead_rows;    // lead rows of window_size weights on the first window
+  float *trail_rows;   // trail rows of window_size weights on the last window
+} LuaSGF_Legacy;
+
+// Coefficients of one configuration, shared by all filters using it
+typedef struct LuaSGF_Coeffs {
+  struct LuaSGF_Coeffs *prev, *next;  // cache list, most recently used first
+  struct LuaSGF_Cache *cache;         // owning cache, NULL once it was collected
+  struct LuaSGF_Shared *shared;       // weight store entry owning filter, weights and
+				      // plan below, or NULL
+  int refs;                           // filters referencing the entry
+  SgfPlanConfig key;
+  LuaSGF_DType precision;
+  SavgolFilter *filter;               // float precision, target point 0
+  float *weights;                     // float precision: interior weights
+  int symmetry;                       // float precision
+  SgfPlan *plan;                      // double precision, or float off-center
+  LuaSGF_Legacy *legacy;              // calc() entries: weights are measured
+  double *uniform;                    // apply_irregular(): all window positions
+  SgfFft *fft;                        // overlap-save engine, created on first use
+} LuaSGF_Coeffs;
+
+// Immutable coefficients in the process-wide weight store, referenced by the
+// cache entries of any number of Lua states
+typedef struct LuaSGF_Shared {
+  struct LuaSGF_Shared *next;
+  int refs;                           // cache entries, under sgf_shared_lock()
+  size_t bytes;                       // memory of the coefficients
+  LuaSGF_Coeffs *coeffs;              // entry outside of any cache
+} LuaSGF_Shared;
+
+// Precomputed coefficients of a dumped filter (either may be NULL)
+typedef struct {
+  const double *plan;                 // SGF_PLAN_DATA() doubles of the plan
+  const float *weights;               // core library filters: interior weights
+} LuaSGF_Image;
+
+// Module-wide coefficient cache (one per Lua state)
+typedef struct LuaSGF_Cache {
+  LuaSGF_Coeffs *head, *tail;
+  size_t entries;
+  size_t idle;                        // entries without references
+  size_t hits, misses, evictions;
+} LuaSGF_Cache;
+
+// Phases of a filter call measured by the statistics counters
+enum {
+  LUASGF_PHASE_READ = 0,   // input conversion: tables, other element types
+  LUASGF_PHASE_COMPUTE,    // filter kernels
+  LUASGF_PHASE_WRITE,      // output conversion and result construction
+  LUASGF_PHASES
+};
+
+// Instrumentation counters of filter calls (opt-in)
+typedef struct {
+  uint64_t calls;
+  uint64_t samples;          // input samples processed
+  uint64_t bytes_allocated;  // arena memory allocated, see util_probe_allocated()
+  uint64_t ns[LUASGF_PHASES];
+} LuaSGF_Stats;
+
+// Module-wide counters (one per Lua state, anchored in the registry)
+typedef struct {
+  int enabled;             // count the calls of all filters
+  LuaSGF_Stats totals;     // all counted calls
+} LuaSGF_Monitor;
+
+// Filter userdata: core filter (float) or kernel plan (double), plus working memory
+typedef struct {
+  LuaSGF_Coeffs *coeffs;   // cache entry owning filter/weights/plan below
+  SavgolFilter *filter;    // float precision: core library filter (centered only)
+  float *weights;          // float precision: interior weights
+  int symmetry;            // float precision: SGF_SYMMETRIC etc. of the weights
+  SgfPlan *plan;           // double precision, and float filters with a target
+			   // point or a wide window: binding kernel plan
+  const SgfFft *fft;       // wide windows: overlap-save interior, or NULL
+  LuaSGF_DType precision;
+  int threads;             // worker pool threads for large inputs (1 = none)
+  int missing;             // LUASGF_MISSING_*
+  int kernel;              // LUASGF_KERNEL_* of the interior
+  int stats;               // count calls even if the module counters are off
+  LuaSGF_Stats counters;
+  LuaSGF_Monitor *monitor; // module-wide counters, NULL if not counted there
+  LuaSGF_Scratch scratch;
+  LuaSGF_Scratch fft_work; // overlap-save blocks, see util_fft_work()
+  LuaSGF_Scratch gap_work; // copies of inputs with gaps, see util_run_missing()
+} LuaSGF_Filter;
+
+// Options of new() beyond the core configuration
+typedef struct {
+  SavgolConfig config;
+  int half_window;         // full range, config.half_window is 8 bits
+  double time_step;        // full precision, config.time_step is float
+  int target_point;        // -half_window .. half_window
+  LuaSGF_DType precision;
+  int threads;
+  int missing;
+  int stats;
+  int fft;                 // 1 = always, 0 = never, -1 = above the crossover
+  int shared;              // coefficients from the process-wide weight store
+  const LuaSGF_Image *image; // precomputed coefficients (load()), or NULL
+  size_t scratch_limit;
+} LuaSGF_Options;
+
+// Filter producing several derivative orders from one pass over the input
+typedef struct {
+  int count;
+  LuaSGF_Filter filters[LUASGF_MAX_OUTPUTS];  // one per requested derivative
+  LuaSGF_Scratch scratch;
+} LuaSGF_Multi;
+
+// 2-D filter on row-major images: separable pair of filters, or a 2-D fit
+typedef struct {
+  int fit;                 // LUASGF_FIT_*, TENSOR whenever the fit factors
+  LuaSGF_Filter axes[2];   // separable: along y (columns) and x (rows)
+  SgfPlan2d *plan;         // otherwise: 2-D weights and boundary fit
+  float *weights;          // plan weights, float precision
+  LuaSGF_DType precision;
+  int threads;
+  LuaSGF_Scratch scratch;
+} LuaSGF_Filter2d;
+
+// Filters applied one after another, with their precomposed interior kernel
+typedef struct {
+  int count;
+  LuaSGF_Filter *stages[LUASGF_MAX_STAGES]; // referenced by the user value
+  LuaSGF_DType precision;
+  int compose;             // interior by the composed kernel
+  size_t lead, trail;      // boundary outputs of the cascade
+  size_t max_window;       // widest stage window
+  SgfPlan kernel;          // composed weights (no boundary rows)
+  float *weights;          // composed weights, float precision
+  SgfFft *fft;             // composed weights above the crossover, or NULL
+  LuaSGF_Filter composed;  // interior-only pseudo filter of kernel
+  LuaSGF_Scratch scratch;
+} LuaSGF_Pipeline;
+
+// Persistent input and its filtered copy, kept up to date by edits
+typedef struct {
+  LuaSGF_Filter *filter;   // referenced by the user value, NULL once destroyed
+  size_t len, cap;         // samples, allocated elements per array
+  char *in, *out;          // filter precision
+  char *work;              // boundary windows: 4 * window size elements
+} LuaSGF_Series;
+
+// Stages of a resumable call
+enum {
+  LUASGF_ASYNC_READ = 0,   // input conversion: tables, other element types
+  LUASGF_ASYNC_COMPUTE,    // interior chunk by chunk, then the boundary outputs
+  LUASGF_ASYNC_WRITE,      // output conversion
+  LUASGF_ASYNC_DONE
+};
+
+// Resumable apply() (user values: 1 = filter, 2 = input, 3 = result)
+typedef struct {
+  LuaSGF_Filter *filter;
+  int valid;
+  int stage;               // LUASGF_ASYNC_*
+  int failed;              // raised an error or was cancelled
+  size_t len, out_len;
+  size_t pos;              // samples done in the current stage
+  size_t chunk;            // samples per step
+  size_t done, total;      // progress over all stages
+  void *in, *out;          // filter precision: buffer memory or the copies
+  void *in_copy, *out_copy;  // allocated if the data needs conversion
+} LuaSGF_Async;
+
+// Call of filter:submit() on a background thread (user values: 1 = input,
+// 2 = result)
+typedef struct {
+  SgfPost post;
+  LuaSGF_Filter work;      // copy of the filter with its own coefficient reference
+  int valid;
+  int rc;                  // util_run_precision() result
+  int finished;            // result delivered and memory released
+  size_t len, out_len;
+  const void *in;          // pinned buffer data or in_copy
+  void *out;               // result buffer data or out_copy
+  void *in_copy, *out_copy;
+} LuaSGF_Submit;
+
+// Streaming filter state
+typedef struct {
+  LuaSGF_Filter filter;   // stream configuration; causal streams estimate the
+			  // newest sample (target point n, polynomial boundary)
+  void *hist;             // most recent samples in the filter precision
+			  // (capacity: window size)
+  size_t hist_len;
+  size_t count;           // samples pushed since start/flush/reset
+  int causal;
+  int as_buffer;          // output type follows the last pushed chunk
+  LuaSGF_DType dtype;
+} LuaSGF_Stream;
+
 /**
  * Savitzky-Golay Filter Module for Lua.
  * @module luaSGF
@@ -76,252 +396,3399 @@ static void util_fill_config(lua_State *L, int index, SavgolConfig *cfg) {
   lua_pop(L, 5); // Remove the 5 fields from stack
 }
 
-/*============================================================================
- * LIFECYCLE
- *============================================================================*/
 /**
- * Boundary handling modes.
- * Use these constants for the `config.boundary` field.
- * @section Boundary_Modes
+ * @brief Reads an optional string field of a config table and returns its
+ * position in lst (like luaL_checkoption for table fields).
  */
-
-/** Asymmetric polynomial fit (default). 
- * @field BOUNDARY_POLYNOMIAL */
-/** Mirror data at boundaries. 
- * @field BOUNDARY_REFLECT */
-/** Wrap data around (for periodic signals). 
- * @field BOUNDARY_PERIODIC */
-/** Extend edge values. 
- * @field BOUNDARY_CONSTANT */
+static int util_opt_field_option(lua_State *L, int index, const char *field,
+				 const char *def, const char *const lst[]) {
+  lua_getfield(L, index, field);
+  const char *name = luaL_optstring(L, -1, def);
+  for (int i = 0; lst[i] != NULL; i++) {
+    if (strcmp(lst[i], name) == 0) {
+      lua_pop(L, 1);
+      return i;
+    }
+  }
+  return luaL_error(L, "invalid value '%s' for config.%s", name, field);
+}
 
 /**
- * Creates a new SavgolFilter instance.
- * This constructor initializes the filter with the provided configuration and
- * precomputes the coefficients.
- * @function new
- * @tparam table config Configuration table for the filter.
- * @tparam int config.half_window Half-window size (n). The total window size is 2n+1.
- * @tparam int config.poly_order Polynomial order (m) for the fit. Must be < window size.
- * @tparam[opt=0] int config.derivative Derivative order (0 for smoothing).
- * @tparam[opt=1.0] float config.time_step Time interval between samples for scaling derivatives.
- * @tparam[opt=SAVGOL_BOUNDARY_POLYNOMIAL] int config.boundary Boundary handling mode.
- * @treturn SavgolFilter A new filter object handle.
- * @usage
- * local sg = require("luaSGF")
- * local filter = sg.new({
- *   half_window = 5,
- *   poly_order = 2,
- *   boundary = sg.BOUNDARY_REFLECT
- * })
+ * @brief Returns the filter at index, raising an error if it was destroyed.
  */
-static int luaSGF_savgol_create(lua_State *L) {
-  SavgolConfig config;
-  util_fill_config(L, 1, &config);
-
-  // Allocate userdata to hold the pointer to our C structure
-  SavgolFilter **ud = (SavgolFilter **)lua_newuserdata(L, sizeof(SavgolFilter *));
-    
-  // Initialize the filter using the core library
-  *ud = savgol_create(&config);
-    
-  if (*ud == NULL) {
-    return luaL_error(L, "luaSGF.new(): invalid parameters or out of memory");
-  }
+static LuaSGF_Filter *util_check_filter(lua_State *L, int index) {
+  LuaSGF_Filter *ud = (LuaSGF_Filter *)luaL_checkudata(L, index, LUASGF_METATABLE);
+  luaL_argcheck(L, ud->filter != NULL || ud->plan != NULL, index,
+		"filter has been destroyed");
+  return ud;
+}
 
-  // Assign metatable for OOP-style methods and GC
-  luaL_getmetatable(L, LUASGF_METATABLE);
-  lua_setmetatable(L, -2);
+static size_t util_window_size(const LuaSGF_Filter *ud) {
+  return (size_t)((ud->plan != NULL) ? ud->plan->window_size : ud->filter->window_size);
+}
 
-  return 1;
+static size_t util_half_window(const LuaSGF_Filter *ud) {
+  return (util_window_size(ud) - 1) / 2;
 }
 
 /**
- * Frees the resources associated with the filter.
- * This method can be called manually to free memory immediately. If not called,
- * Lua's Garbage Collector will invoke it automatically when the filter object
- * is no longer referenced.
- * @function SavgolFilter:destroy
- * @usage
- * -- Manual destruction
- * filter:destroy()
- * 
- * -- After destroy, calling any method on the filter will raise an error.
+ * @brief Number of leading boundary outputs: n + target_point.
  */
-static int luaSGF_savgol_destroy(lua_State *L) {
-  SavgolFilter **ud = (SavgolFilter **)luaL_checkudata(L, 1, LUASGF_METATABLE);
-  if (*ud != NULL) {
-    savgol_destroy(*ud);
-    *ud = NULL; // Prevent double-free
-  }
-  return 0;
+static size_t util_lead(const LuaSGF_Filter *ud) {
+  return (ud->plan != NULL) ? (size_t)ud->plan->lead : util_half_window(ud);
 }
 
 /*============================================================================
- * FILTERING
+ * SCRATCH ARENA
  *============================================================================*/
-/**
- * Applies the filter to a table of data.
- * This method performs the filtering and returns a **new** table of the same 
- * length as the input. Boundary regions are handled according to the 
- * `boundary` mode set during construction (e.g., polynomial extrapolation, 
- * reflection, etc.).
- * 
- * @function SavgolFilter:apply
- * @tparam table data A Lua table (array-style) containing numeric values.
- * @treturn table A new table containing the filtered results.
- * @raise Error if the table is shorter than the filter window, contains holes (`nil`), 
- * or if memory allocation fails.
- * @usage
- * local data = {1.1, 2.1, 1.9, 4.2, 3.8}
- * local result = filter:apply(data)
- * assert(#result == #data)
- */
-static int luaSGF_savgol_apply(lua_State *L) {
-  /* 1. Retrieve and validate the filter pointer */
-  /* luaL_checkudata ensures the object is of our specific metatable type */
-  SavgolFilter **ud = (SavgolFilter **)luaL_checkudata(L, 1, LUASGF_METATABLE);
-  luaL_argcheck(L, *ud != NULL, 1, "filter has been destroyed");
+static void util_scratch_init(LuaSGF_Scratch *s, size_t limit) {
+  s->ptr = NULL;
+  s->size = 0;
+  s->limit = limit;
+  s->allocated = 0;
+}
 
-  /* 2. Ensure second argument is a table */
-  luaL_checktype(L, 2, LUA_TTABLE);
-    
-  /* 3. Get table length using Lua 5.4 raw length */
-  size_t len = lua_rawlen(L, 2);
-    
-  /* 4. Check against filter window size */
-  if (len < (size_t)(*ud)->window_size) {
-    return luaL_error(L, "input table too short (min: %d, got: %d)", 
-		      (*ud)->window_size, (int)len);
-  }
-  
-  /* 5. Allocate memory (using malloc for large data chunks) */
-  float *in_data  = (float *)malloc(len * sizeof(float));
-  float *out_data = (float *)malloc(len * sizeof(float));
-    
-  if (!in_data || !out_data) {
-    free(in_data); 
-    free(out_data);
-    return luaL_error(L, "memory allocation failed");
-  }
+static void util_scratch_free(LuaSGF_Scratch *s) {
+  free(s->ptr);
+  s->ptr = NULL;
+  s->size = 0;
+}
 
-  /* 6. Extract values from Lua table */
-  /* In Lua 5.4, we use lua_rawgeti which is fast and avoids __index metamethods */
-  for (size_t i = 1; i <= len; i++) {
-    if (lua_rawgeti(L, 2, i) == LUA_TNIL) {
-      free(in_data); free(out_data);
-      return luaL_error(L, "input table has a hole at index %d", (int)i);
+/**
+ * @brief Makes sure the arena holds at least size bytes.
+ * The arena only grows; its previous contents are not preserved.
+ * @return Pointer to the arena memory, or NULL if out of memory.
+ */
+static void *util_scratch_reserve(LuaSGF_Scratch *s, size_t size) {
+  if (size > s->size || s->ptr == NULL) {
+    util_scratch_free(s);
+    s->ptr = malloc(size > 0 ? size : 1);
+    if (s->ptr == NULL) {
+      return NULL;
     }
-    in_data[i-1] = (float)luaL_checknumber(L, -1);
-    lua_pop(L, 1);
+    s->size = size;
+    s->allocated += size;
   }
+  return s->ptr;
+}
 
-  /* 7. Core calculation */
-  if (savgol_apply(*ud, in_data, out_data, len) != 0) {
-    free(in_data); free(out_data);
-    return luaL_error(L, "savgol_apply failed");
+/**
+ * @brief Like util_scratch_reserve() for count elements of esize bytes, but
+ * raises a Lua error on failure.
+ * Since the arena keeps ownership, later errors cannot leak the memory.
+ */
+static void *util_scratch_array(lua_State *L, LuaSGF_Scratch *s, size_t count,
+				size_t esize) {
+  if (count > SIZE_MAX / esize || util_scratch_reserve(s, count * esize) == NULL) {
+    luaL_error(L, "memory allocation failed");
   }
+  return s->ptr;
+}
 
-  /* 8. Create result table */
-  /* Pre-allocating the array part to 'len' prevents rehashes */
-  lua_createtable(L, (int)len, 0);
-    
-  for (size_t i = 0; i < len; i++) {
-    /* Convert float back to lua_Number (usually double) */
-    lua_pushnumber(L, (lua_Number)out_data[i]);
-    /* Set table[i+1] = value */
-    lua_rawseti(L, -2, i + 1);
+/**
+ * @brief Called at the end of a successful call: drops the arena if it grew
+ * beyond its limit.
+ */
+static void util_scratch_release(LuaSGF_Scratch *s) {
+  if (s->limit > 0 && s->size > s->limit) {
+    util_scratch_free(s);
   }
+}
 
-  /* 9. Final Cleanup */
-  free(in_data);
-  free(out_data);
-  
-  return 1; /* One return value: the new table */
+/**
+ * @brief Pushes a standalone scratch arena userdata (freed by __gc).
+ */
+static LuaSGF_Scratch *util_new_scratch(lua_State *L, size_t limit) {
+  LuaSGF_Scratch *s = (LuaSGF_Scratch *)lua_newuserdatauv(L, sizeof(LuaSGF_Scratch), 0);
+  util_scratch_init(s, limit);
+  luaL_setmetatable(L, LUASGF_SCRATCH_METATABLE);
+  return s;
+}
+
+static int luaSGF_scratch_gc(lua_State *L) {
+  util_scratch_free((LuaSGF_Scratch *)luaL_checkudata(L, 1, LUASGF_SCRATCH_METATABLE));
+  return 0;
+}
+
+/*============================================================================
+ * BUFFER
+ *============================================================================*/
+/**
+ * Numeric buffers.
+ * A `Buffer` is a userdata holding contiguous `float` or `double` samples.
+ * Filters accept buffers wherever they accept tables and then work directly on
+ * the buffer memory, avoiding the per-element conversion of Lua tables.
+ * @section Buffer
+ */
+
+/**
+ * @brief Size in bytes of one element of the given type.
+ */
+static size_t util_dtype_size(LuaSGF_DType dtype) {
+  static const size_t sizes[] = {sizeof(float), sizeof(double), sizeof(int16_t),
+				 sizeof(int32_t), sizeof(uint16_t), sizeof(uint16_t)};
+  return sizes[dtype];
 }
 
 /**
- * Applies the filter returning only VALID output.
- * This method does not perform boundary extrapolation. It returns only those 
- * samples where the filter window was fully contained within the input data. 
- * As a result, the output table is shorter than the input table.
- *
- * **Output length** = `input_length - 2 * half_window`.
- *
- * @function SavgolFilter:apply_valid
- * @tparam table data Array-style table containing numeric values to be filtered.
- * @treturn table A new (shorter) table containing the valid filtered samples.
- * @raise Error if the input table is shorter than the filter window size or if 
- * memory allocation fails.
- * @usage
- * -- If half_window is 5, the first and last 5 samples are discarded.
- * local input = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11} -- length 11
- * local result = filter:apply_valid(input)
- * print(#result) -- Output: 1
+ * @brief Non-zero for the integer and half-precision types, which are
+ * converted (and scaled) to the filter precision when read.
  */
-static int luaSGF_savgol_apply_valid(lua_State *L) {
-  /* Retrieve filter pointer */
-  SavgolFilter **ud = (SavgolFilter **)luaL_checkudata(L, 1, LUASGF_METATABLE);
-  luaL_argcheck(L, *ud != NULL, 1, "filter has been destroyed");
+static int util_dtype_raw(LuaSGF_DType dtype) {
+  return dtype >= LUASGF_DTYPE_INT16;
+}
 
-  /* Ensure argument 2 is the input data table */
-  luaL_checktype(L, 2, LUA_TTABLE);
-  size_t in_len = lua_rawlen(L, 2);
-    
-  /* Calculate expected output length: L - 2*n */
-  int hw = (*ud)->config.half_window;
-    
-  /* Boundary check: input must be at least one full window size */
-  if (in_len < (size_t)(*ud)->window_size) {
-    return luaL_error(L, "input table too short for 'valid' output (min: %d, got: %d)", 
-		      (*ud)->window_size, (int)in_len);
-  }
-    
-  size_t out_len = in_len - (2 * (size_t)hw);
+/**
+ * @brief Element type of results computed from data of the given type:
+ * the same for float and double, the filter precision for raw types.
+ */
+static LuaSGF_DType util_result_dtype(LuaSGF_DType dtype, LuaSGF_DType precision) {
+  return util_dtype_raw(dtype) ? precision : dtype;
+}
 
-  /* Allocate memory for C arrays */
-  float *in_data  = (float *)malloc(in_len * sizeof(float));
-  float *out_data = (float *)malloc(out_len * sizeof(float));
-    
-  if (!in_data || !out_data) {
-    free(in_data); free(out_data);
-    return luaL_error(L, "memory allocation failed");
+/**
+ * @brief Converts an IEEE 754 binary16 value to float (exact).
+ */
+static float util_half_to_float(uint16_t h) {
+  uint32_t sign = (uint32_t)(h & 0x8000u) << 16;
+  uint32_t exp = (h >> 10) & 0x1fu;
+  uint32_t mant = h & 0x3ffu;
+  if (exp == 0) {
+    /* Zero and subnormals: mant * 2^-24 */
+    float v = (float)mant * 5.9604644775390625e-8f;
+    return sign ? -v : v;
   }
+  uint32_t bits = sign | ((exp == 31) ? (0xffu << 23) : ((exp + 112u) << 23)) | (mant << 13);
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
 
-  /* Step 1: Copy from Lua table to C input array */
-  for (size_t i = 1; i <= in_len; i++) {
-    lua_rawgeti(L, 2, (int)i);
-    in_data[i-1] = (float)luaL_checknumber(L, -1);
-    lua_pop(L, 1);
+/**
+ * @brief Converts a float to binary16, rounding to nearest even; values
+ * beyond the range become infinite.
+ */
+static uint16_t util_float_to_half(float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  uint16_t sign = (uint16_t)((x >> 16) & 0x8000u);
+  uint32_t a = x & 0x7fffffffu;
+  if (a >= 0x7f800000u) {
+    return sign | 0x7c00u | ((a > 0x7f800000u) ? 0x200u : 0u);  // Inf, NaN
   }
-  
-  /* Step 2: Execute core library function */
-  /* According to header: returns samples written, or 0 on error */
-  size_t written = savgol_apply_valid(*ud, in_data, in_len, out_data);
-  
-  if (written == 0 && out_len > 0) {
-    free(in_data); free(out_data);
-    return luaL_error(L, "savgol_apply_valid core execution failed");
+  if (a >= 0x477ff000u) {
+    return sign | 0x7c00u;  // rounds above 65504
   }
-  
-  /* Step 3: Create the shorter Lua table and populate with results */
-  lua_createtable(L, (int)written, 0);
-  for (size_t i = 0; i < written; i++) {
-    lua_pushnumber(L, (lua_Number)out_data[i]);
-    lua_rawseti(L, -2, (int)(i + 1));
+  if (a < 0x38800000u) {
+    /* Below 2^-14: subnormal result, units of 2^-24 */
+    return sign | (uint16_t)nearbyintf(fabsf(f) * 16777216.0f);
   }
-
-  /* Cleanup */
-  free(in_data);
-  free(out_data);
-
-  return 1; /* Return the result table */
+  uint32_t r = a - (112u << 23);
+  r += 0xfffu + ((r >> 13) & 1u);
+  return sign | (uint16_t)(r >> 13);
 }
 
 /**
- * Direct filter calculation (Legacy API).
- * This function can be called as `sg.calc(...)` or directly as `sg(...)`.
- * It creates a temporary filter, processes the data, and returns the result.
- * 
+ * @brief Rounds a value to the nearest integer within [lo, hi] (NaN: 0).
+ */
+static double util_quantize(double v, double lo, double hi) {
+  if (v != v) {
+    return 0.0;
+  }
+  v = nearbyint(v);
+  return (v < lo) ? lo : ((v > hi) ? hi : v);
+}
+
+// Conversion loop body: y[i] = E(v) with v the source element
+#define LUASGF_LOAD(T, E)						\
+  {									\
+    const T *src = (const T *)buf->data + first;			\
+    for (size_t i = 0; i < count; i++) {				\
+      T v = src[i * stride];						\
+      y[i] = (E);							\
+    }									\
+  }									\
+  break
+
+/**
+ * @brief Reads count elements first, first + stride, ... of a buffer into
+ * an array of the given precision, applying the scale of raw types. Each
+ * element type has its own loop, so the conversion costs one multiply-add
+ * per sample.
+ */
+static void util_buffer_load(const LuaSGF_Buffer *buf, size_t first, size_t count,
+			     size_t stride, LuaSGF_DType precision, void *dst) {
+  if (buf->dtype == precision && stride == 1) {
+    memcpy(dst, (const char *)buf->data + first * util_dtype_size(precision),
+	   count * util_dtype_size(precision));
+    return;
+  }
+  if (precision == LUASGF_DTYPE_DOUBLE) {
+    double *y = (double *)dst;
+    double a = buf->scale, b = buf->offset;
+    switch (buf->dtype) {
+    case LUASGF_DTYPE_FLOAT:   LUASGF_LOAD(float, (double)v);
+    case LUASGF_DTYPE_DOUBLE:  LUASGF_LOAD(double, v);
+    case LUASGF_DTYPE_INT16:   LUASGF_LOAD(int16_t, a * v + b);
+    case LUASGF_DTYPE_INT32:   LUASGF_LOAD(int32_t, a * v + b);
+    case LUASGF_DTYPE_UINT16:  LUASGF_LOAD(uint16_t, a * v + b);
+    case LUASGF_DTYPE_FLOAT16: LUASGF_LOAD(uint16_t, a * util_half_to_float(v) + b);
+    }
+  } else {
+    float *y = (float *)dst;
+    float a = (float)buf->scale, b = (float)buf->offset;
+    switch (buf->dtype) {
+    case LUASGF_DTYPE_FLOAT:   LUASGF_LOAD(float, v);
+    case LUASGF_DTYPE_DOUBLE:  LUASGF_LOAD(double, (float)v);
+    case LUASGF_DTYPE_INT16:   LUASGF_LOAD(int16_t, a * (float)v + b);
+    case LUASGF_DTYPE_INT32:   LUASGF_LOAD(int32_t, (float)(buf->scale * v + buf->offset));
+    case LUASGF_DTYPE_UINT16:  LUASGF_LOAD(uint16_t, a * (float)v + b);
+    case LUASGF_DTYPE_FLOAT16: LUASGF_LOAD(uint16_t, a * util_half_to_float(v) + b);
+    }
+  }
+}
+#undef LUASGF_LOAD
+
+// Conversion loop body: dst element = E(v) with v the source value
+#define LUASGF_STORE(T, E)						\
+  {									\
+    T *dst = (T *)buf->data + first;					\
+    for (size_t i = 0; i < count; i++) {				\
+      double v = (precision == LUASGF_DTYPE_DOUBLE) ? ((const double *)src)[i] \
+	: (double)((const float *)src)[i];				\
+      dst[i * stride] = (T)(E);						\
+    }									\
+  }									\
+  break
+
+/**
+ * @brief Writes an array of the given precision to the elements first,
+ * first + stride, ... of a buffer. Raw types store (v - offset) / scale,
+ * integers rounded and saturated to their range.
+ */
+static void util_buffer_store(LuaSGF_Buffer *buf, size_t first, size_t count,
+			      size_t stride, LuaSGF_DType precision, const void *src) {
+  if (buf->dtype == precision && stride == 1) {
+    memcpy((char *)buf->data + first * util_dtype_size(precision), src,
+	   count * util_dtype_size(precision));
+    return;
+  }
+  double inv = 1.0 / buf->scale, b = buf->offset;
+  switch (buf->dtype) {
+  case LUASGF_DTYPE_FLOAT:   LUASGF_STORE(float, v);
+  case LUASGF_DTYPE_DOUBLE:  LUASGF_STORE(double, v);
+  case LUASGF_DTYPE_INT16:   LUASGF_STORE(int16_t, util_quantize((v - b) * inv, -32768.0, 32767.0));
+  case LUASGF_DTYPE_INT32:   LUASGF_STORE(int32_t, util_quantize((v - b) * inv, -2147483648.0,
+								 2147483647.0));
+  case LUASGF_DTYPE_UINT16:  LUASGF_STORE(uint16_t, util_quantize((v - b) * inv, 0.0, 65535.0));
+  case LUASGF_DTYPE_FLOAT16: LUASGF_STORE(uint16_t, util_float_to_half((float)((v - b) * inv)));
+  }
+}
+#undef LUASGF_STORE
+
+/**
+ * @brief Buffer header for elements [first, first + len) of buf.
+ */
+static LuaSGF_Buffer util_buffer_slice(const LuaSGF_Buffer *buf, size_t first, size_t len) {
+  LuaSGF_Buffer slice = *buf;
+  slice.len = len;
+  slice.data = (char *)buf->data + first * util_dtype_size(buf->dtype);
+  return slice;
+}
+
+/**
+ * @brief Pushes a new zero-initialized buffer with room for len elements.
+ * Header and samples share one userdata block, so no __gc is required.
+ */
+static LuaSGF_Buffer *util_new_buffer(lua_State *L, size_t len, LuaSGF_DType dtype) {
+  /* Round header up so the samples are suitably aligned for double */
+  size_t header = (sizeof(LuaSGF_Buffer) + 15) & ~(size_t)15;
+  size_t esize = util_dtype_size(dtype);
+
+  if (len > (SIZE_MAX - header) / esize) {
+    luaL_error(L, "buffer too large (%d elements)", (int)len);
+  }
+
+  LuaSGF_Buffer *buf = (LuaSGF_Buffer *)lua_newuserdatauv(L, header + len * esize, 0);
+  buf->len = len;
+  buf->dtype = dtype;
+  buf->data = (char *)buf + header;
+  buf->scale = 1.0;
+  buf->offset = 0.0;
+  memset(buf->data, 0, len * esize);
+
+  luaL_getmetatable(L, LUASGF_BUFFER_METATABLE);
+  lua_setmetatable(L, -2);
+  return buf;
+}
+
+/**
+ * @brief Reads element i (0-based) of a buffer as lua_Number.
+ */
+static lua_Number util_buffer_get(const LuaSGF_Buffer *buf, size_t i) {
+  if (buf->dtype == LUASGF_DTYPE_DOUBLE) {
+    return (lua_Number)((const double *)buf->data)[i];
+  }
+  if (buf->dtype == LUASGF_DTYPE_FLOAT) {
+    return (lua_Number)((const float *)buf->data)[i];
+  }
+  double v;
+  util_buffer_load(buf, i, 1, 1, LUASGF_DTYPE_DOUBLE, &v);
+  return (lua_Number)v;
+}
+
+/**
+ * @brief Writes element i (0-based) of a buffer.
+ */
+static void util_buffer_set(LuaSGF_Buffer *buf, size_t i, lua_Number v) {
+  if (buf->dtype == LUASGF_DTYPE_DOUBLE) {
+    ((double *)buf->data)[i] = (double)v;
+  } else if (buf->dtype == LUASGF_DTYPE_FLOAT) {
+    ((float *)buf->data)[i] = (float)v;
+  } else {
+    double x = (double)v;
+    util_buffer_store(buf, i, 1, 1, LUASGF_DTYPE_DOUBLE, &x);
+  }
+}
+
+/**
+ * @brief Reads the element type and the optional scale and offset of raw
+ * types from the arguments arg, arg + 1 and arg + 2 into a new buffer.
+ */
+static LuaSGF_Buffer *util_new_buffer_args(lua_State *L, size_t len, int arg) {
+  LuaSGF_DType dtype = (LuaSGF_DType)luaL_checkoption(L, arg, "float", luaSGF_dtype_names);
+  double scale = (double)luaL_optnumber(L, arg + 1, 1.0);
+  double offset = (double)luaL_optnumber(L, arg + 2, 0.0);
+  luaL_argcheck(L, scale != 0.0 && isfinite(scale), arg + 1, "scale must be finite and non-zero");
+  luaL_argcheck(L, isfinite(offset), arg + 2, "offset must be finite");
+  if (!util_dtype_raw(dtype) && (scale != 1.0 || offset != 0.0)) {
+    luaL_argerror(L, arg + 1, "scale and offset require an integer or float16 dtype");
+  }
+  LuaSGF_Buffer *buf = util_new_buffer(L, len, dtype);
+  buf->scale = scale;
+  buf->offset = offset;
+  return buf;
+}
+
+/**
+ * Creates a new zero-filled buffer.
+ * Besides `"float"` and `"double"`, samples may be stored as `"int16"`,
+ * `"int32"`, `"uint16"` (e.g. ADC counts) or `"float16"`. Elements of these
+ * raw types represent `stored * scale + offset`; filters convert them on the
+ * fly, and return results of their own precision.
+ * @function buffer.new
+ * @tparam int length Number of elements.
+ * @tparam[opt="float"] string dtype Element type.
+ * @tparam[opt=1] number scale Value of one count (raw types only).
+ * @tparam[opt=0] number offset Value of a stored zero (raw types only).
+ * @treturn Buffer A new buffer.
+ * @usage
+ * local buf = sg.buffer.new(1000000, "float")
+ * print(#buf) -- 1000000
+ * local adc = sg.buffer.new(4096, "int16", 10 / 32768)  -- +-10 V converter
+ */
+static int luaSGF_buffer_new(lua_State *L) {
+  lua_Integer len = luaL_checkinteger(L, 1);
+  luaL_argcheck(L, len >= 0, 1, "length must not be negative");
+
+  util_new_buffer_args(L, (size_t)len, 2);
+  return 1;
+}
+
+/**
+ * Creates a buffer holding a copy of an array-style table.
+ * Values are stored like by assignment: raw types keep
+ * `(v - offset) / scale`, rounded and saturated for integers.
+ * @function buffer.from_table
+ * @tparam table data Array-style table containing numeric values.
+ * @tparam[opt="float"] string dtype Element type, see `buffer.new`.
+ * @tparam[opt=1] number scale Value of one count (raw types only).
+ * @tparam[opt=0] number offset Value of a stored zero (raw types only).
+ * @treturn Buffer A new buffer with `#data` elements.
+ * @raise Error if the table contains holes or non-numeric values.
+ * @usage
+ * local buf = sg.buffer.from_table({1, 2, 3, 2, 1}, "double")
+ */
+static int luaSGF_buffer_from_table(lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  size_t len = lua_rawlen(L, 1);
+
+  LuaSGF_Buffer *buf = util_new_buffer_args(L, len, 2);
+
+  for (size_t i = 1; i <= len; i++) {
+    if (lua_rawgeti(L, 1, i) == LUA_TNIL) {
+      return luaL_error(L, "input table has a hole at index %d", (int)i);
+    }
+    util_buffer_set(buf, i - 1, luaL_checknumber(L, -1));
+    lua_pop(L, 1);
+  }
+  return 1;
+}
+
+/**
+ * Creates a buffer from binary samples in native byte order, e.g. a block
+ * read from an acquisition device or file.
+ * @function buffer.from_string
+ * @tparam string bytes Samples, a multiple of the element size long.
+ * @tparam[opt="float"] string dtype Element type, see `buffer.new`.
+ * @tparam[opt=1] number scale Value of one count (raw types only).
+ * @tparam[opt=0] number offset Value of a stored zero (raw types only).
+ * @treturn Buffer A new buffer with `#bytes / element size` elements.
+ * @raise Error if the length of `bytes` is not a multiple of the element size.
+ * @usage
+ * local counts = sg.buffer.from_string(dev:read(8192), "int16", 5 / 32768)
+ */
+static int luaSGF_buffer_from_string(lua_State *L) {
+  size_t size;
+  const char *bytes = luaL_checklstring(L, 1, &size);
+  LuaSGF_DType dtype = (LuaSGF_DType)luaL_checkoption(L, 2, "float", luaSGF_dtype_names);
+  size_t esize = util_dtype_size(dtype);
+  luaL_argcheck(L, size % esize == 0, 1, "length is not a multiple of the element size");
+
+  LuaSGF_Buffer *buf = util_new_buffer_args(L, size / esize, 2);
+  memcpy(buf->data, bytes, size);
+  return 1;
+}
+
+/**
+ * Copies the buffer contents into a new Lua table.
+ * @function Buffer:to_table
+ * @treturn table A new array-style table with `#buf` numbers.
+ * @usage
+ * local t = buf:to_table()
+ */
+static int luaSGF_buffer_to_table(lua_State *L) {
+  LuaSGF_Buffer *buf = (LuaSGF_Buffer *)luaL_checkudata(L, 1, LUASGF_BUFFER_METATABLE);
+
+  lua_createtable(L, (int)buf->len, 0);
+  for (size_t i = 0; i < buf->len; i++) {
+    lua_pushnumber(L, util_buffer_get(buf, i));
+    lua_rawseti(L, -2, i + 1);
+  }
+  return 1;
+}
+
+/**
+ * Returns the element type of the buffer.
+ * @function Buffer:dtype
+ * @treturn string `"float"`, `"double"`, `"int16"`, `"int32"`, `"uint16"` or
+ * `"float16"`.
+ */
+static int luaSGF_buffer_dtype(lua_State *L) {
+  LuaSGF_Buffer *buf = (LuaSGF_Buffer *)luaL_checkudata(L, 1, LUASGF_BUFFER_METATABLE);
+  lua_pushstring(L, luaSGF_dtype_names[buf->dtype]);
+  return 1;
+}
+
+/**
+ * Returns the scale and offset of the element values, `1` and `0` for float
+ * and double buffers.
+ * @function Buffer:scaling
+ * @treturn number Value of one count.
+ * @treturn number Value of a stored zero.
+ */
+static int luaSGF_buffer_scaling(lua_State *L) {
+  LuaSGF_Buffer *buf = (LuaSGF_Buffer *)luaL_checkudata(L, 1, LUASGF_BUFFER_METATABLE);
+  lua_pushnumber(L, (lua_Number)buf->scale);
+  lua_pushnumber(L, (lua_Number)buf->offset);
+  return 2;
+}
+
+/**
+ * Returns the number of elements (`#buf`).
+ * @function Buffer:__len
+ * @treturn int Number of elements.
+ */
+static int luaSGF_buffer_len(lua_State *L) {
+  LuaSGF_Buffer *buf = (LuaSGF_Buffer *)luaL_checkudata(L, 1, LUASGF_BUFFER_METATABLE);
+  lua_pushinteger(L, (lua_Integer)buf->len);
+  return 1;
+}
+
+/**
+ * Element access (`buf[i]`, 1-based) and method lookup.
+ * Out-of-range indices yield nil, like a Lua table.
+ * @function Buffer:__index
+ */
+static int luaSGF_buffer_index(lua_State *L) {
+  LuaSGF_Buffer *buf = (LuaSGF_Buffer *)luaL_checkudata(L, 1, LUASGF_BUFFER_METATABLE);
+
+  if (lua_type(L, 2) == LUA_TNUMBER) {
+    int isint;
+    lua_Integer i = lua_tointegerx(L, 2, &isint);
+    if (isint && i >= 1 && (lua_Unsigned)i <= (lua_Unsigned)buf->len) {
+      lua_pushnumber(L, util_buffer_get(buf, (size_t)(i - 1)));
+    } else {
+      lua_pushnil(L);
+    }
+    return 1;
+  }
+
+  /* Non-numeric keys: look up methods in the upvalue table */
+  lua_pushvalue(L, 2);
+  lua_rawget(L, lua_upvalueindex(1));
+  return 1;
+}
+
+/**
+ * Element assignment (`buf[i] = v`, 1-based).
+ * @function Buffer:__newindex
+ * @raise Error if the index is out of range or the value is not a number.
+ */
+static int luaSGF_buffer_newindex(lua_State *L) {
+  LuaSGF_Buffer *buf = (LuaSGF_Buffer *)luaL_checkudata(L, 1, LUASGF_BUFFER_METATABLE);
+  lua_Integer i = luaL_checkinteger(L, 2);
+  lua_Number v = luaL_checknumber(L, 3);
+
+  luaL_argcheck(L, i >= 1 && (lua_Unsigned)i <= (lua_Unsigned)buf->len, 2,
+		"index out of range");
+  util_buffer_set(buf, (size_t)(i - 1), v);
+  return 0;
+}
+
+/**
+ * @brief String representation, e.g. "luaSGF.Buffer(float, 100)".
+ */
+static int luaSGF_buffer_tostring(lua_State *L) {
+  LuaSGF_Buffer *buf = (LuaSGF_Buffer *)luaL_checkudata(L, 1, LUASGF_BUFFER_METATABLE);
+  lua_pushfstring(L, "%s(%s, %I)", LUASGF_BUFFER_METATABLE,
+		  luaSGF_dtype_names[buf->dtype], (lua_Integer)buf->len);
+  return 1;
+}
+
+/*============================================================================
+ * COEFFICIENT CACHE
+ *============================================================================*/
+/*
+ * Filters with identical configuration share one LuaSGF_Coeffs entry, so the
+ * least-squares weights are computed once per Lua state. Entries are
+ * reference counted; unreferenced ones stay cached (least recently used
+ * first out) up to LUASGF_CACHE_CAPACITY. Filters and the cache may be
+ * collected in any order: entries still referenced when the cache goes away
+ * are orphaned and freed by their last filter.
+ */
+
+/**
+ * @brief Extracts the centered weights of the core filter for the SIMD
+ * interior kernel: 'valid' filtering of a unit impulse at position j of a
+ * single window yields weight j.
+ * @return Non-zero on failure.
+ */
+static int util_coeffs_extract(LuaSGF_Coeffs *e) {
+  size_t w = (size_t)e->filter->window_size;
+  float *impulse = (float *)calloc(w, sizeof(float));
+  e->weights = (float *)malloc(w * sizeof(float));
+  if (impulse == NULL || e->weights == NULL) {
+    free(impulse);
+    return 1;
+  }
+
+  for (size_t j = 0; j < w; j++) {
+    impulse[j] = 1.0f;
+    if (savgol_apply_valid(e->filter, impulse, w, e->weights + j) != 1) {
+      free(impulse);
+      return 1;
+    }
+    impulse[j] = 0.0f;
+  }
+  free(impulse);
+
+  /* Smoothing and even derivatives are symmetric, odd ones antisymmetric */
+  e->symmetry = sgf_symmetrize_f(e->weights, e->filter->config.half_window,
+				 e->filter->config.derivative);
+  return 0;
+}
+
+/*
+ * Weights of the legacy calc() path are measured rather than recomputed: the
+ * reference implementation mes_savgolFilter() is linear, so filtering unit
+ * impulses of a probe signal yields its complete filter matrix. Rows that are
+ * shifted copies of one kernel form the interior; the remaining leading and
+ * trailing rows must only depend on the first resp. last window. Whenever
+ * this structure cannot be verified, calc() keeps using the reference.
+ */
+#define LUASGF_LEGACY_PROBE(w) (4 * (w))
+
+/**
+ * @brief Checks whether row k of the P x P matrix m is the kernel applied to
+ * the window starting at k + offset.
+ */
+static int util_legacy_row_is_kernel(const float *m, int p, int k, int offset,
+				     const float *kernel, int w, float tol) {
+  int start = k + offset;
+  if (start < 0 || start + w > p) {
+    return 0;
+  }
+  const float *row = m + (size_t)k * p;
+  for (int j = 0; j < p; j++) {
+    float expect = (j >= start && j < start + w) ? kernel[j - start] : 0.0f;
+    if (fabsf(row[j] - expect) > tol) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief Copies row k of m restricted to columns [start, start + w).
+ * @return 0 if the row has no weight outside this window.
+ */
+static int util_legacy_copy_row(const float *m, int p, int k, int start, int w,
+				float *dst) {
+  const float *row = m + (size_t)k * p;
+  for (int j = 0; j < p; j++) {
+    if ((j < start || j >= start + w) && row[j] != 0.0f) {
+      return -1;
+    }
+  }
+  memcpy(dst, row + start, (size_t)w * sizeof(float));
+  return 0;
+}
+
+/**
+ * @brief Legacy filtering with measured weights (len >= 2 * window size).
+ */
+static void util_legacy_run(const LuaSGF_Coeffs *e, const float *in, size_t len,
+			    float *out) {
+  const LuaSGF_Legacy *lg = e->legacy;
+  int n = e->key.half_window;
+  size_t w = (size_t)(2 * n + 1);
+  size_t count = len - (size_t)lg->lead - (size_t)lg->trail;
+  const float *start = in + lg->lead + lg->offset;
+
+  if (e->symmetry != SGF_ASYMMETRIC) {
+    sgf_interior_sym_f(e->weights, n, e->symmetry, start, out + lg->lead, count);
+  } else {
+    sgf_interior_f(e->weights, (int)w, start, out + lg->lead, count);
+  }
+
+  for (int i = 0; i < lg->lead; i++) {
+    const float *r = lg->lead_rows + (size_t)i * w;
+    float acc = 0.0f;
+    for (size_t j = 0; j < w; j++) {
+      acc += r[j] * in[j];
+    }
+    out[i] = acc;
+  }
+  const float *tail = in + len - w;
+  for (int i = 0; i < lg->trail; i++) {
+    const float *r = lg->trail_rows + (size_t)i * w;
+    float acc = 0.0f;
+    for (size_t j = 0; j < w; j++) {
+      acc += r[j] * tail[j];
+    }
+    out[len - lg->trail + i] = acc;
+  }
+}
+
+/**
+ * @brief Measures the legacy filter matrix and derives the fast-path weights.
+ * @return Non-zero if out of memory; an unverified structure is not an error
+ * but leaves legacy->fast at 0.
+ */
+static int util_legacy_measure(LuaSGF_Coeffs *e) {
+  int n = e->key.half_window;
+  int w = 2 * n + 1;
+  int p = LUASGF_LEGACY_PROBE(w);
+  uint8_t hw = (uint8_t)n, poly = (uint8_t)e->key.poly_order;
+  uint8_t tp = (uint8_t)e->key.target_point, deriv = (uint8_t)e->key.derivative;
+
+  LuaSGF_Legacy *lg = (LuaSGF_Legacy *)calloc(1, sizeof(LuaSGF_Legacy));
+  MqsRawDataPoint_t *x = (MqsRawDataPoint_t *)calloc(2 * (size_t)p, sizeof(MqsRawDataPoint_t));
+  float *m = (float *)malloc((size_t)p * p * sizeof(float));
+  e->legacy = lg;
+  e->weights = (float *)malloc((size_t)w * sizeof(float));
+  if (lg != NULL) {
+    lg->lead_rows = (float *)malloc(2 * (size_t)w * w * sizeof(float));
+  }
+  if (lg == NULL || x == NULL || m == NULL || e->weights == NULL || lg->lead_rows == NULL) {
+    free(x); free(m);
+    return 1;
+  }
+  lg->trail_rows = lg->lead_rows + (size_t)w * w;
+  MqsRawDataPoint_t *y = x + p;
+
+  /* Column j of the matrix is the response to an impulse at j */
+  for (int j = 0; j < p; j++) {
+    x[j].phaseAngle = 1.0f;
+    if (mes_savgolFilter(x, (size_t)p, hw, y, poly, tp, deriv) != 0) {
+      goto done;
+    }
+    x[j].phaseAngle = 0.0f;
+    for (int k = 0; k < p; k++) {
+      m[(size_t)k * p + j] = y[k].phaseAngle;
+    }
+  }
+
+  /* Interior kernel from the middle row: support must fit one window */
+  int k0 = p / 2;
+  int first = -1, last = -1;
+  float peak = 0.0f;
+  for (int j = 0; j < p; j++) {
+    float v = m[(size_t)k0 * p + j];
+    if (v != 0.0f) {
+      first = (first < 0) ? j : first;
+      last = j;
+    }
+    peak = fmaxf(peak, fabsf(v));
+  }
+  if (first < 0 || last - first >= w) {
+    goto done;
+  }
+  lg->offset = -n;
+  if (k0 - n > first || k0 + n < last) {
+    lg->offset = first - k0;
+  }
+  memcpy(e->weights, m + (size_t)k0 * p + k0 + lg->offset, (size_t)w * sizeof(float));
+
+  /* Leading/trailing rows deviating from the kernel */
+  float tol = 1e-6f * peak;
+  while (lg->lead < p && !util_legacy_row_is_kernel(m, p, lg->lead, lg->offset,
+						    e->weights, w, tol)) {
+    lg->lead++;
+  }
+  while (lg->trail < p && !util_legacy_row_is_kernel(m, p, p - 1 - lg->trail, lg->offset,
+						     e->weights, w, tol)) {
+    lg->trail++;
+  }
+  if (lg->lead > w || lg->trail > w) {
+    goto done;
+  }
+  for (int k = lg->lead; k < p - lg->trail; k++) {
+    if (!util_legacy_row_is_kernel(m, p, k, lg->offset, e->weights, w, tol)) {
+      goto done;
+    }
+  }
+  for (int i = 0; i < lg->lead; i++) {
+    if (util_legacy_copy_row(m, p, i, 0, w, lg->lead_rows + (size_t)i * w) != 0) {
+      goto done;
+    }
+  }
+  for (int i = 0; i < lg->trail; i++) {
+    if (util_legacy_copy_row(m, p, p - lg->trail + i, p - w, w,
+			     lg->trail_rows + (size_t)i * w) != 0) {
+      goto done;
+    }
+  }
+  if (lg->offset == -n) {
+    e->symmetry = sgf_symmetrize_f(e->weights, n, e->key.derivative);
+  }
+
+  /* Cross-check on the shortest input served by the fast path */
+  {
+    size_t len = 2 * (size_t)w;
+    float *fin = m, *fout = m + len;
+    for (size_t i = 0; i < len; i++) {
+      fin[i] = (float)sin(0.37 * (double)i) + 0.01f * (float)i;
+      x[i].phaseAngle = fin[i];
+    }
+    if (mes_savgolFilter(x, len, hw, y, poly, tp, deriv) != 0) {
+      goto done;
+    }
+    lg->fast = 1;
+    util_legacy_run(e, fin, len, fout);
+    float ref = 0.0f;
+    for (size_t i = 0; i < len; i++) {
+      ref = fmaxf(ref, fabsf(y[i].phaseAngle));
+    }
+    for (size_t i = 0; i < len; i++) {
+      if (fabsf(fout[i] - y[i].phaseAngle) > 1e-4f * (ref + 1.0f)) {
+	lg->fast = 0;
+	break;
+      }
+    }
+  }
+
+done:
+  free(x);
+  free(m);
+  return 0;
+}
+
+/**
+ * @brief Computes the coefficients of a configuration into a new entry, or
+ * copies them from a dumped filter.
+ * @return Non-zero on invalid parameters or out of memory.
+ */
+static int util_coeffs_compute(LuaSGF_Coeffs *e, const LuaSGF_Image *image) {
+  const SgfPlanConfig *key = &e->key;
+  const double *data = (image != NULL) ? image->plan : NULL;
+
+  if (e->precision == LUASGF_DTYPE_DOUBLE) {
+    // Double precision: weights are computed by the binding kernel
+    e->plan = (data != NULL) ? sgf_plan_restore(key, data) : sgf_plan_create(key);
+    return (e->plan == NULL);
+  }
+
+  if (key->target_point != 0 || key->half_window > SGF_MAX_HALF_WINDOW) {
+    // The core library only evaluates the window center of at most 65 taps:
+    // float copy of a plan
+    e->plan = (data != NULL) ? sgf_plan_restore(key, data) : sgf_plan_create(key);
+    e->weights = (e->plan != NULL) ?
+      (float *)malloc((size_t)e->plan->window_size * sizeof(float)) : NULL;
+    if (e->weights == NULL) {
+      return 1;
+    }
+    for (int j = 0; j < e->plan->window_size; j++) {
+      e->weights[j] = (float)e->plan->weights[j];
+    }
+    e->symmetry = e->plan->symmetry;
+    return 0;
+  }
+
+  // Float precision: the core library filter provides the weights
+  SavgolConfig config = {key->half_window, key->poly_order, key->derivative,
+			 (float)key->time_step, (SavgolBoundaryMode)key->boundary};
+  e->filter = savgol_create(&config);
+  if (e->filter == NULL) {
+    return 1;
+  }
+  if (image == NULL || image->weights == NULL) {
+    return util_coeffs_extract(e);
+  }
+  size_t w = (size_t)e->filter->window_size;
+  e->weights = (float *)malloc(w * sizeof(float));
+  if (e->weights == NULL) {
+    return 1;
+  }
+  memcpy(e->weights, image->weights, w * sizeof(float));
+  e->symmetry = sgf_symmetrize_f(e->weights, key->half_window, key->derivative);
+  return 0;
+}
+
+/**
+ * @brief Frees the coefficients an entry owns (not those of the store).
+ */
+static void util_coeffs_free_weights(LuaSGF_Coeffs *e) {
+  if (e->shared == NULL) {
+    if (e->filter != NULL) {
+      savgol_destroy(e->filter);
+    }
+    sgf_plan_destroy(e->plan);
+    free(e->weights);
+  }
+  e->filter = NULL;
+  e->plan = NULL;
+  e->weights = NULL;
+}
+
+static int util_key_equal(const SgfPlanConfig *a, const SgfPlanConfig *b) {
+  return a->half_window == b->half_window && a->poly_order == b->poly_order &&
+    a->derivative == b->derivative && a->time_step == b->time_step &&
+    a->boundary == b->boundary && a->target_point == b->target_point;
+}
+
+/*
+ * Process-wide weight store: its coefficients are computed once and then
+ * only read, by the filters of every Lua state referencing them. A state's
+ * cache entry for a stored configuration points to the store entry instead
+ * of holding a copy; the store entry is freed with its last reference.
+ * Entries are created, referenced and released under sgf_shared_lock().
+ */
+static LuaSGF_Shared *luaSGF_store = NULL;
+
+/**
+ * @brief Returns a referenced store entry for the configuration, creating
+ * it (from the image if given) if no state holds one.
+ * @return The entry, or NULL on invalid parameters or out of memory.
+ */
+static LuaSGF_Shared *util_store_acquire(const SgfPlanConfig *key, LuaSGF_DType precision,
+					 const LuaSGF_Image *image) {
+  sgf_shared_lock();
+  LuaSGF_Shared *s = luaSGF_store;
+  while (s != NULL && !(s->coeffs->precision == precision &&
+			util_key_equal(&s->coeffs->key, key))) {
+    s = s->next;
+  }
+  if (s != NULL) {
+    s->refs++;
+    sgf_shared_unlock();
+    return s;
+  }
+
+  s = (LuaSGF_Shared *)calloc(1, sizeof(LuaSGF_Shared));
+  LuaSGF_Coeffs *e = (LuaSGF_Coeffs *)calloc(1, sizeof(LuaSGF_Coeffs));
+  if (s != NULL && e != NULL) {
+    e->key = *key;
+    e->precision = precision;
+    if (util_coeffs_compute(e, image) == 0) {
+      size_t w = (size_t)(2 * key->half_window + 1);
+      s->bytes = sizeof(LuaSGF_Coeffs) + ((e->weights != NULL) ? w * sizeof(float) : 0) +
+	((e->plan != NULL) ? SGF_PLAN_DATA(w, key->poly_order) * sizeof(double) : 0);
+      s->refs = 1;
+      s->coeffs = e;
+      s->next = luaSGF_store;
+      luaSGF_store = s;
+      sgf_shared_unlock();
+      return s;
+    }
+    util_coeffs_free_weights(e);
+  }
+  sgf_shared_unlock();
+  free(e);
+  free(s);
+  return NULL;
+}
+
+static void util_store_release(LuaSGF_Shared *s) {
+  sgf_shared_lock();
+  if (--s->refs > 0) {
+    sgf_shared_unlock();
+    return;
+  }
+  LuaSGF_Shared **link = &luaSGF_store;
+  while (*link != s) {
+    link = &(*link)->next;
+  }
+  *link = s->next;
+  sgf_shared_unlock();
+
+  util_coeffs_free_weights(s->coeffs);
+  free(s->coeffs);
+  free(s);
+}
+
+/**
+ * Returns statistics of the process-wide weight store.
+ * Filters created with `shared = true` or by `load` take their coefficients
+ * from the store, which all Lua states of the process share.
+ * @function store_stats
+ * @treturn table Fields `entries` (stored configurations), `references`
+ * (cache entries of all Lua states using them) and `bytes`.
+ */
+static int luaSGF_store_stats(lua_State *L) {
+  lua_Integer entries = 0, refs = 0, bytes = 0;
+  sgf_shared_lock();
+  for (LuaSGF_Shared *s = luaSGF_store; s != NULL; s = s->next) {
+    entries++;
+    refs += s->refs;
+    bytes += (lua_Integer)s->bytes;
+  }
+  sgf_shared_unlock();
+  lua_createtable(L, 0, 3);
+  lua_pushinteger(L, entries);
+  lua_setfield(L, -2, "entries");
+  lua_pushinteger(L, refs);
+  lua_setfield(L, -2, "references");
+  lua_pushinteger(L, bytes);
+  lua_setfield(L, -2, "bytes");
+  return 1;
+}
+
+static void util_coeffs_free(LuaSGF_Coeffs *e) {
+  if (e->shared != NULL) {
+    util_store_release(e->shared);
+  }
+  util_coeffs_free_weights(e);
+  if (e->legacy != NULL) {
+    free(e->legacy->lead_rows);
+    free(e->legacy);
+  }
+  free(e->uniform);
+  sgf_fft_destroy(e->fft);
+  free(e);
+}
+
+/**
+ * @brief Computes the coefficients of a configuration.
+ * @param shared Non-zero to reference the weight store instead.
+ * @param image Precomputed coefficients, or NULL.
+ * @return New entry without cache links, or NULL on invalid parameters or
+ * out of memory.
+ */
+static LuaSGF_Coeffs *util_coeffs_create(const SgfPlanConfig *key, LuaSGF_DType precision,
+					 int legacy, int shared, const LuaSGF_Image *image) {
+  LuaSGF_Coeffs *e = (LuaSGF_Coeffs *)calloc(1, sizeof(LuaSGF_Coeffs));
+  if (e == NULL) {
+    return NULL;
+  }
+  e->key = *key;
+  e->precision = precision;
+
+  if (legacy) {
+    // Legacy calc(): weights measured from the reference implementation
+    if (util_legacy_measure(e) != 0) {
+      util_coeffs_free(e);
+      return NULL;
+    }
+    return e;
+  }
+
+  if (shared) {
+    e->shared = util_store_acquire(key, precision, image);
+    if (e->shared == NULL) {
+      free(e);
+      return NULL;
+    }
+    e->filter = e->shared->coeffs->filter;
+    e->weights = e->shared->coeffs->weights;
+    e->symmetry = e->shared->coeffs->symmetry;
+    e->plan = e->shared->coeffs->plan;
+    return e;
+  }
+
+  if (util_coeffs_compute(e, image) != 0) {
+    util_coeffs_free(e);
+    return NULL;
+  }
+  return e;
+}
+
+static void util_cache_unlink(LuaSGF_Cache *c, LuaSGF_Coeffs *e) {
+  if (e->prev != NULL) {
+    e->prev->next = e->next;
+  } else {
+    c->head = e->next;
+  }
+  if (e->next != NULL) {
+    e->next->prev = e->prev;
+  } else {
+    c->tail = e->prev;
+  }
+  e->prev = e->next = NULL;
+  c->entries--;
+}
+
+static void util_cache_push_front(LuaSGF_Cache *c, LuaSGF_Coeffs *e) {
+  e->prev = NULL;
+  e->next = c->head;
+  if (c->head != NULL) {
+    c->head->prev = e;
+  } else {
+    c->tail = e;
+  }
+  c->head = e;
+  c->entries++;
+}
+
+/**
+ * @brief Frees unreferenced entries, oldest first, until at most keep remain.
+ * @return Number of entries freed.
+ */
+static size_t util_cache_trim(LuaSGF_Cache *c, size_t keep) {
+  size_t freed = 0;
+  LuaSGF_Coeffs *e = c->tail;
+  while (e != NULL && c->idle > keep) {
+    LuaSGF_Coeffs *prev = e->prev;
+    if (e->refs == 0) {
+      util_cache_unlink(c, e);
+      util_coeffs_free(e);
+      c->idle--;
+      freed++;
+    }
+    e = prev;
+  }
+  return freed;
+}
+
+/**
+ * @brief Returns a referenced entry for the configuration, computing it on a
+ * cache miss.
+ * @param legacy Non-zero for the weights of the legacy calc() function.
+ * @param shared Non-zero for coefficients of the weight store.
+ * @param image Precomputed coefficients for a miss, or NULL.
+ * @return The entry, or NULL on invalid parameters or out of memory.
+ */
+static LuaSGF_Coeffs *util_cache_acquire(LuaSGF_Cache *c, const SgfPlanConfig *key,
+					 LuaSGF_DType precision, int legacy, int shared,
+					 const LuaSGF_Image *image) {
+  for (LuaSGF_Coeffs *e = c->head; e != NULL; e = e->next) {
+    if (e->precision == precision && (e->legacy != NULL) == (legacy != 0) &&
+	(e->shared != NULL) == (shared != 0) && util_key_equal(&e->key, key)) {
+      if (e->refs++ == 0) {
+	c->idle--;
+      }
+      util_cache_unlink(c, e);
+      util_cache_push_front(c, e);
+      c->hits++;
+      return e;
+    }
+  }
+
+  c->misses++;
+  LuaSGF_Coeffs *e = util_coeffs_create(key, precision, legacy, shared, image);
+  if (e != NULL) {
+    e->cache = c;
+    e->refs = 1;
+    util_cache_push_front(c, e);
+  }
+  return e;
+}
+
+/**
+ * @brief Drops a reference; unreferenced entries stay cached for reuse.
+ */
+static void util_cache_release(LuaSGF_Coeffs *e) {
+  if (--e->refs > 0) {
+    return;
+  }
+  LuaSGF_Cache *c = e->cache;
+  if (c == NULL) {
+    util_coeffs_free(e); /* orphaned: the cache was collected before */
+    return;
+  }
+  c->idle++;
+  c->evictions += util_cache_trim(c, LUASGF_CACHE_CAPACITY);
+}
+
+static int luaSGF_cache_gc(lua_State *L) {
+  LuaSGF_Cache *c = (LuaSGF_Cache *)luaL_checkudata(L, 1, LUASGF_CACHE_METATABLE);
+  LuaSGF_Coeffs *e = c->head;
+  while (e != NULL) {
+    LuaSGF_Coeffs *next = e->next;
+    if (e->refs == 0) {
+      util_coeffs_free(e);
+    } else {
+      e->prev = e->next = NULL;
+      e->cache = NULL;
+    }
+    e = next;
+  }
+  memset(c, 0, sizeof(LuaSGF_Cache));
+  return 0;
+}
+
+/**
+ * @brief Pushes a new, empty coefficient cache.
+ */
+static LuaSGF_Cache *util_new_cache(lua_State *L) {
+  LuaSGF_Cache *c = (LuaSGF_Cache *)lua_newuserdatauv(L, sizeof(LuaSGF_Cache), 0);
+  memset(c, 0, sizeof(LuaSGF_Cache));
+  luaL_setmetatable(L, LUASGF_CACHE_METATABLE);
+  return c;
+}
+
+/**
+ * Returns statistics of the coefficient cache.
+ * Filters created by `new` with identical configuration share their
+ * precomputed weights. The cache keeps up to 64 configurations that are no
+ * longer used by any filter.
+ * @function cache_stats
+ * @treturn table Fields `entries` (cached configurations), `in_use`
+ * (configurations referenced by live filters), `hits`, `misses` and
+ * `evictions`.
+ * @usage
+ * local st = sg.cache_stats()
+ * print(st.hits / (st.hits + st.misses))
+ */
+static int luaSGF_cache_stats(lua_State *L) {
+  LuaSGF_Cache *c = (LuaSGF_Cache *)lua_touserdata(L, lua_upvalueindex(2));
+  lua_createtable(L, 0, 5);
+  lua_pushinteger(L, (lua_Integer)c->entries);
+  lua_setfield(L, -2, "entries");
+  lua_pushinteger(L, (lua_Integer)(c->entries - c->idle));
+  lua_setfield(L, -2, "in_use");
+  lua_pushinteger(L, (lua_Integer)c->hits);
+  lua_setfield(L, -2, "hits");
+  lua_pushinteger(L, (lua_Integer)c->misses);
+  lua_setfield(L, -2, "misses");
+  lua_pushinteger(L, (lua_Integer)c->evictions);
+  lua_setfield(L, -2, "evictions");
+  return 1;
+}
+
+/**
+ * Empties the coefficient cache.
+ * Frees all configurations not used by a live filter and resets the hit,
+ * miss and eviction counters. Filters in use are not affected.
+ * @function cache_clear
+ * @treturn int Number of configurations freed.
+ */
+static int luaSGF_cache_clear(lua_State *L) {
+  LuaSGF_Cache *c = (LuaSGF_Cache *)lua_touserdata(L, lua_upvalueindex(2));
+  size_t freed = util_cache_trim(c, 0);
+  c->hits = c->misses = c->evictions = 0;
+  lua_pushinteger(L, (lua_Integer)freed);
+  return 1;
+}
+
+/*============================================================================
+ * STATISTICS
+ *============================================================================*/
+/*
+ * Calls are only timed while counting is enabled for the filter (config.stats)
+ * or for the module (stats_enable()); otherwise a probe costs one branch per
+ * phase. Times are cumulative nanoseconds of the monotonic clock.
+ */
+
+// Timing of one filter call; inactive (ud == NULL) while counting is off
+typedef struct {
+  LuaSGF_Filter *ud;
+  uint64_t mark;
+  uint64_t allocated;      // util_probe_allocated() at the start
+  LuaSGF_Stats delta;
+} LuaSGF_Probe;
+
+/**
+ * @brief Bytes allocated over the lifetime by all arenas of a filter: the
+ * scratch arena, the overlap-save work areas and the gap handling buffers.
+ */
+static uint64_t util_probe_allocated(const LuaSGF_Filter *ud) {
+  return ud->scratch.allocated + ud->fft_work.allocated + ud->gap_work.allocated;
+}
+
+static void util_probe_start(LuaSGF_Probe *p, LuaSGF_Filter *ud) {
+  int on = ud->stats || (ud->monitor != NULL && ud->monitor->enabled);
+  p->ud = on ? ud : NULL;
+  if (on) {
+    memset(&p->delta, 0, sizeof(LuaSGF_Stats));
+    p->allocated = util_probe_allocated(ud);
+    p->mark = sgf_clock_ns();
+  }
+}
+
+/**
+ * @brief Attributes the time since the last mark to a phase.
+ */
+static void util_probe_phase(LuaSGF_Probe *p, int phase) {
+  if (p->ud != NULL) {
+    uint64_t now = sgf_clock_ns();
+    p->delta.ns[phase] += now - p->mark;
+    p->mark = now;
+  }
+}
+
+static void util_stats_add(LuaSGF_Stats *dst, const LuaSGF_Stats *src) {
+  dst->calls += src->calls;
+  dst->samples += src->samples;
+  dst->bytes_allocated += src->bytes_allocated;
+  for (int i = 0; i < LUASGF_PHASES; i++) {
+    dst->ns[i] += src->ns[i];
+  }
+}
+
+/**
+ * @brief Ends a call: attributes the remaining time to phase and adds the
+ * call to the filter and module counters.
+ */
+static void util_probe_finish(LuaSGF_Probe *p, int phase, size_t samples) {
+  LuaSGF_Filter *ud = p->ud;
+  if (ud == NULL) {
+    return;
+  }
+  util_probe_phase(p, phase);
+  p->delta.calls = 1;
+  p->delta.samples = samples;
+  p->delta.bytes_allocated = util_probe_allocated(ud) - p->allocated;
+  util_stats_add(&ud->counters, &p->delta);
+  if (ud->monitor != NULL) {
+    util_stats_add(&ud->monitor->totals, &p->delta);
+  }
+}
+
+/**
+ * @brief Pushes counters as a table.
+ */
+static void util_push_stats(lua_State *L, const LuaSGF_Stats *st, int enabled) {
+  static const char *const phase_names[LUASGF_PHASES] = {"read_ns", "compute_ns",
+							 "write_ns"};
+  lua_createtable(L, 0, 4 + LUASGF_PHASES);
+  lua_pushinteger(L, (lua_Integer)st->calls);
+  lua_setfield(L, -2, "calls");
+  lua_pushinteger(L, (lua_Integer)st->samples);
+  lua_setfield(L, -2, "samples");
+  lua_pushinteger(L, (lua_Integer)st->bytes_allocated);
+  lua_setfield(L, -2, "bytes_allocated");
+  for (int i = 0; i < LUASGF_PHASES; i++) {
+    lua_pushinteger(L, (lua_Integer)st->ns[i]);
+    lua_setfield(L, -2, phase_names[i]);
+  }
+  lua_pushboolean(L, enabled);
+  lua_setfield(L, -2, "enabled");
+}
+
+/**
+ * Returns the call statistics of the filter.
+ * Calls are counted if the filter was created with `stats = true` or while
+ * module-wide counting is enabled (`stats_enable`). Time is split into
+ * reading the input (table access, element type conversion), computing, and
+ * writing the result (conversion, table construction).
+ * @function SavgolFilter:stats
+ * @tparam[opt=false] boolean reset Zero the counters after reading them.
+ * @treturn table Fields `calls`, `samples` (input samples), `bytes_allocated`
+ * (scratch memory), `read_ns`, `compute_ns`, `write_ns` and `enabled`.
+ * @usage
+ * local f = sg.new({half_window = 5, poly_order = 2, stats = true})
+ * f:apply(data)
+ * local st = f:stats()
+ * print(st.compute_ns / st.samples, "ns per sample")
+ */
+static int luaSGF_savgol_stats(lua_State *L) {
+  LuaSGF_Filter *ud = util_check_filter(L, 1);
+  int enabled = ud->stats || (ud->monitor != NULL && ud->monitor->enabled);
+  util_push_stats(L, &ud->counters, enabled);
+  if (lua_toboolean(L, 2)) {
+    memset(&ud->counters, 0, sizeof(LuaSGF_Stats));
+  }
+  return 1;
+}
+
+/**
+ * Describes the filter and the kernel chosen for it.
+ * Centered filters have (anti)symmetric weights and run a folded kernel,
+ * which is unrolled at compile time for half windows 2 to 7 ("unrolled");
+ * off-center filters run the "generic" tap loop and wide windows the FFT
+ * engine ("fft", with the direct kernels for inputs shorter than `fft_min`).
+ * @function SavgolFilter:info
+ * @treturn table Fields `kernel`, `simd` (see `simd_level`), `fft_min` (fft
+ * only), `half_window`, `window_size`, `poly_order`, `derivative`,
+ * `target_point`, `boundary`, `precision`, `threads`, `missing` and `shared`
+ * (coefficients from the weight store).
+ * @usage
+ * print(sg.new({half_window = 3, poly_order = 2}):info().kernel) -- unrolled
+ */
+static int luaSGF_savgol_info(lua_State *L) {
+  LuaSGF_Filter *ud = util_check_filter(L, 1);
+  const SgfPlanConfig *key = &ud->coeffs->key;
+  lua_createtable(L, 0, 14);
+  lua_pushstring(L, luaSGF_kernel_names[ud->kernel]);
+  lua_setfield(L, -2, "kernel");
+  lua_pushstring(L, sgf_simd_name(sgf_simd_level()));
+  lua_setfield(L, -2, "simd");
+  if (ud->fft != NULL) {
+    lua_pushinteger(L, (lua_Integer)sgf_fft_taps(ud->fft) + (lua_Integer)util_window_size(ud) - 1);
+    lua_setfield(L, -2, "fft_min");
+  }
+  lua_pushinteger(L, (lua_Integer)key->half_window);
+  lua_setfield(L, -2, "half_window");
+  lua_pushinteger(L, (lua_Integer)util_window_size(ud));
+  lua_setfield(L, -2, "window_size");
+  lua_pushinteger(L, (lua_Integer)key->poly_order);
+  lua_setfield(L, -2, "poly_order");
+  lua_pushinteger(L, (lua_Integer)key->derivative);
+  lua_setfield(L, -2, "derivative");
+  lua_pushinteger(L, (lua_Integer)key->target_point);
+  lua_setfield(L, -2, "target_point");
+  lua_pushinteger(L, (lua_Integer)key->boundary);
+  lua_setfield(L, -2, "boundary");
+  lua_pushstring(L, luaSGF_precision_names[ud->precision]);
+  lua_setfield(L, -2, "precision");
+  lua_pushinteger(L, (lua_Integer)ud->threads);
+  lua_setfield(L, -2, "threads");
+  lua_pushstring(L, luaSGF_missing_names[ud->missing]);
+  lua_setfield(L, -2, "missing");
+  lua_pushboolean(L, ud->coeffs->shared != NULL);
+  lua_setfield(L, -2, "shared");
+  return 1;
+}
+
+/**
+ * Returns the module-wide call statistics.
+ * The totals of all counted filter calls of this Lua state, see
+ * `SavgolFilter:stats`.
+ * @function stats
+ * @tparam[opt=false] boolean reset Zero the totals after reading them.
+ * @treturn table Same fields as `SavgolFilter:stats`; `enabled` reflects
+ * `stats_enable`.
+ */
+static int luaSGF_stats(lua_State *L) {
+  LuaSGF_Monitor *mon = (LuaSGF_Monitor *)lua_touserdata(L, lua_upvalueindex(3));
+  util_push_stats(L, &mon->totals, mon->enabled);
+  if (lua_toboolean(L, 1)) {
+    memset(&mon->totals, 0, sizeof(LuaSGF_Stats));
+  }
+  return 1;
+}
+
+/**
+ * Enables or disables counting for all filters.
+ * Filters created with `stats = true` are counted regardless.
+ * @function stats_enable
+ * @tparam boolean on New state.
+ * @treturn boolean Previous state.
+ * @usage
+ * sg.stats_enable(true)
+ * run_workload()
+ * local st = sg.stats(true) -- read and reset
+ */
+static int luaSGF_stats_enable(lua_State *L) {
+  LuaSGF_Monitor *mon = (LuaSGF_Monitor *)lua_touserdata(L, lua_upvalueindex(3));
+  luaL_checkany(L, 1);
+  lua_pushboolean(L, mon->enabled);
+  mon->enabled = lua_toboolean(L, 1);
+  return 1;
+}
+
+/*============================================================================
+ * LIFECYCLE
+ *============================================================================*/
+/**
+ * @brief Reads the configuration table of new() and related constructors.
+ */
+static void util_fill_options(lua_State *L, int index, LuaSGF_Options *opts) {
+  util_fill_config(L, index, &opts->config);
+
+  lua_getfield(L, index, "half_window");
+  lua_Integer half_window = lua_tointeger(L, -1);
+  luaL_argcheck(L, half_window >= 0 && half_window <= SGF_MAX_PLAN_HALF_WINDOW, index,
+		"half_window out of range (max: 4096)");
+  opts->half_window = (int)half_window;
+  lua_getfield(L, index, "fft");
+  opts->fft = lua_isnil(L, -1) ? -1 : lua_toboolean(L, -1);
+  lua_pop(L, 2);
+
+  lua_getfield(L, index, "scratch_limit");
+  lua_Integer limit = luaL_optinteger(L, -1, 0);
+  luaL_argcheck(L, limit >= 0, index, "scratch_limit must not be negative");
+  lua_getfield(L, index, "time_step");
+  opts->time_step = (double)luaL_optnumber(L, -1, 1.0);
+  lua_getfield(L, index, "threads");
+  lua_Integer threads = luaL_optinteger(L, -1, 1);
+  luaL_argcheck(L, threads >= 0 && threads <= SGF_POOL_MAX_THREADS, index,
+		"threads out of range");
+  lua_getfield(L, index, "target_point");
+  lua_Integer target = luaL_optinteger(L, -1, 0);
+  luaL_argcheck(L, target >= -(lua_Integer)opts->half_window &&
+		target <= (lua_Integer)opts->half_window, index,
+		"target_point must be within [-half_window, half_window]");
+  lua_getfield(L, index, "stats");
+  opts->stats = lua_toboolean(L, -1);
+  lua_getfield(L, index, "shared");
+  opts->shared = lua_toboolean(L, -1);
+  lua_pop(L, 6);
+
+  opts->target_point = (int)target;
+  opts->image = NULL;
+  opts->scratch_limit = (size_t)limit;
+  opts->threads = (threads == 0) ? sgf_pool_cpu_count() : (int)threads;
+  opts->precision = (LuaSGF_DType)util_opt_field_option(L, index, "precision", "float",
+							luaSGF_precision_names);
+  opts->missing = util_opt_field_option(L, index, "missing", "error", luaSGF_missing_names);
+}
+
+/**
+ * @brief Overlap-save engine of a cache entry for the fft option (1 = always,
+ * 0 = never, -1 = from the crossover window size of the precision on).
+ * @return The engine, or NULL for direct convolution (also if out of memory).
+ */
+static SgfFft *util_coeffs_fft(LuaSGF_Coeffs *e, int mode) {
+  int taps = (e->plan != NULL) ? e->plan->window_size : e->filter->window_size;
+  int crossover = (e->precision == LUASGF_DTYPE_DOUBLE) ? SGF_FFT_MIN_TAPS_D :
+    SGF_FFT_MIN_TAPS_F;
+  if (mode == 0 || (mode < 0 && taps < crossover)) {
+    return NULL;
+  }
+
+  if (e->fft != NULL) {
+    return e->fft;
+  }
+  if (e->plan != NULL) {
+    e->fft = sgf_fft_create(e->plan->weights, taps);
+  } else {
+    // Core library filter: its extracted float weights
+    double *w = (double *)malloc((size_t)taps * sizeof(double));
+    if (w != NULL) {
+      for (int j = 0; j < taps; j++) {
+	w[j] = (double)e->weights[j];
+      }
+      e->fft = sgf_fft_create(w, taps);
+      free(w);
+    }
+  }
+  return e->fft;
+}
+
+/**
+ * @brief Initializes a filter with the cached coefficients of the options
+ * and the given derivative order.
+ * @return 0 on success, -1 on invalid parameters or out of memory (the
+ * filter is then in the destroyed state).
+ */
+static int util_filter_init(LuaSGF_Filter *ud, LuaSGF_Cache *cache,
+			    const LuaSGF_Options *opts, int derivative) {
+  memset(ud, 0, sizeof(LuaSGF_Filter));
+  ud->precision = opts->precision;
+  ud->threads = opts->threads;
+  ud->missing = opts->missing;
+  ud->stats = opts->stats;
+  util_scratch_init(&ud->scratch, opts->scratch_limit);
+  util_scratch_init(&ud->fft_work, 0);
+  util_scratch_init(&ud->gap_work, opts->scratch_limit);
+
+  SgfPlanConfig key = {opts->half_window, opts->config.poly_order, derivative,
+		       opts->time_step, (int)opts->config.boundary, opts->target_point};
+  ud->coeffs = util_cache_acquire(cache, &key, opts->precision, 0, opts->shared, opts->image);
+  if (ud->coeffs == NULL) {
+    return -1;
+  }
+  ud->filter = ud->coeffs->filter;
+  ud->weights = ud->coeffs->weights;
+  ud->symmetry = ud->coeffs->symmetry;
+  ud->plan = ud->coeffs->plan;
+  ud->fft = util_coeffs_fft(ud->coeffs, opts->fft);
+
+  int symmetry = (ud->precision == LUASGF_DTYPE_DOUBLE) ? ud->plan->symmetry : ud->symmetry;
+  if (ud->fft != NULL) {
+    ud->kernel = LUASGF_KERNEL_FFT;
+  } else if (symmetry == SGF_ASYMMETRIC) {
+    ud->kernel = LUASGF_KERNEL_GENERIC;
+  } else {
+    ud->kernel = sgf_interior_unrolled(opts->half_window) ? LUASGF_KERNEL_UNROLLED
+							   : LUASGF_KERNEL_FOLDED;
+  }
+  return 0;
+}
+
+/**
+ * @brief Drops the coefficients and working memory of a filter (idempotent).
+ */
+static void util_filter_release(LuaSGF_Filter *ud) {
+  if (ud->coeffs != NULL) {
+    util_cache_release(ud->coeffs);
+    ud->coeffs = NULL; // Prevent double release
+  }
+  ud->filter = NULL;
+  ud->weights = NULL;
+  ud->plan = NULL;
+  ud->fft = NULL;
+  util_scratch_free(&ud->scratch);
+  util_scratch_free(&ud->fft_work);
+  util_scratch_free(&ud->gap_work);
+}
+
+/**
+ * Boundary handling modes.
+ * Use these constants for the `config.boundary` field.
+ * @section Boundary_Modes
+ */
+
+/** Asymmetric polynomial fit (default). 
+ * @field BOUNDARY_POLYNOMIAL */
+/** Mirror data at boundaries. 
+ * @field BOUNDARY_REFLECT */
+/** Wrap data around (for periodic signals). 
+ * @field BOUNDARY_PERIODIC */
+/** Extend edge values. 
+ * @field BOUNDARY_CONSTANT */
+
+/**
+ * Creates a new SavgolFilter instance.
+ * This constructor initializes the filter with the provided configuration and
+ * precomputes the coefficients.
+ * @function new
+ * @tparam table config Configuration table for the filter.
+ * @tparam int config.half_window Half-window size (n). The total window size is 2n+1.
+ * Up to 32 for the core library; wider windows (up to 4096) are computed by
+ * the binding in double precision.
+ * @tparam int config.poly_order Polynomial order (m) for the fit. Must be < window size.
+ * @tparam[opt=0] int config.derivative Derivative order (0 for smoothing).
+ * @tparam[opt=1.0] float config.time_step Time interval between samples for scaling derivatives.
+ * @tparam[opt=SAVGOL_BOUNDARY_POLYNOMIAL] int config.boundary Boundary handling mode.
+ * @tparam[opt=0] int config.target_point Sample of the window that is
+ * estimated, relative to its center (`-half_window` to `half_window`).
+ * Output `k` is computed from the window ending at sample
+ * `k + half_window - target_point`, so `target_point = half_window` gives a
+ * causal filter that only uses the current and past samples. The first
+ * `half_window + target_point` and the last `half_window - target_point`
+ * outputs are boundary outputs; 'valid' output `i` estimates sample
+ * `i + half_window + target_point`. Off-center weights are computed by the
+ * binding in double precision.
+ * @tparam[opt="float"] string config.precision Processing precision. `"float"`
+ * uses the core library; `"double"` computes weights and convolution in double
+ * precision, avoiding any float conversion of the samples and time step.
+ * @tparam[opt=0] int config.scratch_limit Maximum number of bytes of scratch
+ * memory the filter keeps between calls (0 = unlimited). The scratch arena
+ * grows to the largest input seen; larger requests are served and released
+ * again after the call.
+ * @tparam[opt=1] int config.threads Threads used for inputs of more than
+ * 128k samples and for 2-D batches (0 = one per CPU). The interior is split
+ * into chunks processed by a worker pool owned by the module; boundaries are
+ * computed once on the calling thread.
+ * @tparam[opt=false] boolean config.stats Count calls, samples, scratch
+ * allocations and time per phase for this filter, see `SavgolFilter:stats`.
+ * @tparam[opt] boolean config.fft Convolve the interior by overlap-save FFT
+ * blocks (`true`) or directly (`false`). By default the FFT is used from 257
+ * taps for double and 513 taps for float precision.
+ * @tparam[opt="error"] string config.missing Treatment of missing samples, NaN
+ * or holes (`nil`) in tables, by `apply`, `apply_valid` and the `_into`
+ * variants. `"error"` raises an error for holes and lets NaN run through the
+ * convolution; `"propagate"` makes exactly the outputs whose window contains
+ * a gap NaN; `"skip"` fits those windows to their valid samples only (NaN if
+ * fewer than `poly_order + 1` remain); `"interpolate"` fills gaps linearly
+ * between their neighbours first. Gap-free input runs the normal kernels.
+ * @tparam[opt=false] boolean config.shared Take the coefficients from the
+ * process-wide weight store, which all Lua states share without copies.
+ * @treturn SavgolFilter A new filter object handle.
+ * @usage
+ * local sg = require("luaSGF")
+ * local filter = sg.new({
+ *   half_window = 5,
+ *   poly_order = 2,
+ *   boundary = sg.BOUNDARY_REFLECT
+ * })
+ */
+static int luaSGF_savgol_create(lua_State *L) {
+  LuaSGF_Options opts;
+  util_fill_options(L, 1, &opts);
+
+  // Allocate userdata to hold our C structure
+  LuaSGF_Filter *ud = (LuaSGF_Filter *)lua_newuserdatauv(L, sizeof(LuaSGF_Filter), 0);
+  LuaSGF_Cache *cache = (LuaSGF_Cache *)lua_touserdata(L, lua_upvalueindex(2));
+  if (util_filter_init(ud, cache, &opts, opts.config.derivative) != 0) {
+    return luaL_error(L, "luaSGF.new(): invalid parameters or out of memory");
+  }
+  ud->monitor = (LuaSGF_Monitor *)lua_touserdata(L, lua_upvalueindex(3));
+
+  // Assign metatable for OOP-style methods and GC
+  luaL_getmetatable(L, LUASGF_METATABLE);
+  lua_setmetatable(L, -2);
+
+  return 1;
+}
+
+/**
+ * Frees the resources associated with the filter.
+ * This method can be called manually to free memory immediately. If not called,
+ * Lua's Garbage Collector will invoke it automatically when the filter object
+ * is no longer referenced.
+ * @function SavgolFilter:destroy
+ * @usage
+ * -- Manual destruction
+ * filter:destroy()
+ * 
+ * -- After destroy, calling any method on the filter will raise an error.
+ */
+static int luaSGF_savgol_destroy(lua_State *L) {
+  LuaSGF_Filter *ud = (LuaSGF_Filter *)luaL_checkudata(L, 1, LUASGF_METATABLE);
+  util_filter_release(ud);
+  return 0;
+}
+
+/**
+ * Releases the filter's scratch memory.
+ * Filters keep the working memory of their largest call for reuse. Call this
+ * after processing an unusually large input to hand the memory back; the
+ * arena grows again on demand.
+ * @function SavgolFilter:shrink
+ * @treturn int Number of bytes released.
+ * @usage
+ * filter:apply(huge_table)
+ * filter:shrink()
+ */
+static int luaSGF_savgol_shrink(lua_State *L) {
+  LuaSGF_Filter *ud = util_check_filter(L, 1);
+  size_t released = ud->scratch.size + ud->fft_work.size + ud->gap_work.size;
+  util_scratch_free(&ud->scratch);
+  util_scratch_free(&ud->fft_work);
+  util_scratch_free(&ud->gap_work);
+  lua_pushinteger(L, (lua_Integer)released);
+  return 1;
+}
+
+/*
+ * Dumped filters: a LuaSGF_Dump header in native byte order, followed by the
+ * coefficients of the cache entry. Plans store their weights and fit rows
+ * (SGF_PLAN_DATA() doubles), core library filters their float weights.
+ */
+#define LUASGF_DUMP_VERSION 1
+#define LUASGF_DUMP_ORDER 0x01020304u
+
+enum {
+  LUASGF_DUMP_FFT = 1,     // overlap-save interior
+  LUASGF_DUMP_STATS = 2    // stats option
+};
+
+typedef struct {
+  char magic[4];           // "LSGF"
+  uint8_t version, precision, boundary, flags;
+  int32_t half_window, poly_order, derivative, target_point;
+  double time_step;
+  int32_t threads, missing;
+  uint64_t scratch_limit;
+  uint32_t count;          // coefficients following the header
+  uint32_t order;          // LUASGF_DUMP_ORDER as written
+} LuaSGF_Dump;
+
+/**
+ * @brief Number of coefficients dumped for a configuration: plan data, or
+ * the weights if the core library computes the filter.
+ * @param plan Set to non-zero for plan data (doubles), 0 for floats.
+ */
+static size_t util_dump_count(const SgfPlanConfig *key, LuaSGF_DType precision, int *plan) {
+  size_t w = (size_t)(2 * key->half_window + 1);
+  *plan = (precision == LUASGF_DTYPE_DOUBLE || key->target_point != 0 ||
+	   key->half_window > SGF_MAX_HALF_WINDOW);
+  return *plan ? SGF_PLAN_DATA(w, key->poly_order) : w;
+}
+
+/**
+ * Serializes the filter.
+ * The string holds the configuration and the precomputed coefficients, so
+ * `load` recreates the filter without solving any fit, e.g. in other Lua
+ * states or worker processes of the same build and platform.
+ * @function SavgolFilter:dump
+ * @treturn string Binary representation of the filter.
+ * @usage
+ * local blob = sg.new({half_window = 12, poly_order = 3}):dump()
+ * local f = sg.load(blob)   -- in another state of the same process
+ */
+static int luaSGF_savgol_dump(lua_State *L) {
+  LuaSGF_Filter *ud = util_check_filter(L, 1);
+  const LuaSGF_Coeffs *e = ud->coeffs;
+  int plan;
+  size_t count = util_dump_count(&e->key, ud->precision, &plan);
+
+  LuaSGF_Dump h;
+  memset(&h, 0, sizeof(LuaSGF_Dump));
+  memcpy(h.magic, "LSGF", 4);
+  h.version = LUASGF_DUMP_VERSION;
+  h.precision = (uint8_t)ud->precision;
+  h.boundary = (uint8_t)e->key.boundary;
+  h.flags = (uint8_t)((ud->fft != NULL ? LUASGF_DUMP_FFT : 0) |
+		      (ud->stats ? LUASGF_DUMP_STATS : 0));
+  h.half_window = e->key.half_window;
+  h.poly_order = e->key.poly_order;
+  h.derivative = e->key.derivative;
+  h.target_point = e->key.target_point;
+  h.time_step = e->key.time_step;
+  h.threads = ud->threads;
+  h.missing = ud->missing;
+  h.scratch_limit = (uint64_t)ud->scratch.limit;
+  h.count = (uint32_t)count;
+  h.order = LUASGF_DUMP_ORDER;
+
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  luaL_addlstring(&b, (const char *)&h, sizeof(LuaSGF_Dump));
+  if (plan) {
+    luaL_addlstring(&b, (const char *)ud->plan->weights, count * sizeof(double));
+  } else {
+    luaL_addlstring(&b, (const char *)ud->weights, count * sizeof(float));
+  }
+  luaL_pushresult(&b);
+  return 1;
+}
+
+/**
+ * Recreates a filter from `SavgolFilter:dump`.
+ * The coefficients come from the process-wide weight store (as with
+ * `shared = true`): the first Lua state loading a configuration copies them
+ * from the string, all others reference the stored ones.
+ * @function load
+ * @tparam string blob Output of `dump` of the same build.
+ * @treturn SavgolFilter The filter.
+ * @raise Error if the string is not a dump of this build or platform.
+ * @usage
+ * local f = sg.load(io.open("smooth.sgf", "rb"):read("a"))
+ */
+static int luaSGF_load(lua_State *L) {
+  size_t len;
+  const char *blob = luaL_checklstring(L, 1, &len);
+  LuaSGF_Dump h;
+  luaL_argcheck(L, len >= sizeof(LuaSGF_Dump), 1, "not a dumped filter");
+  memcpy(&h, blob, sizeof(LuaSGF_Dump));
+  luaL_argcheck(L, memcmp(h.magic, "LSGF", 4) == 0, 1, "not a dumped filter");
+  luaL_argcheck(L, h.version == LUASGF_DUMP_VERSION && h.order == LUASGF_DUMP_ORDER, 1,
+		"dumped by another version or byte order");
+  luaL_argcheck(L, h.precision <= LUASGF_DTYPE_DOUBLE &&
+		h.half_window >= 1 && h.half_window <= SGF_MAX_PLAN_HALF_WINDOW &&
+		h.poly_order >= 0 && h.poly_order <= SGF_MAX_POLY_ORDER &&
+		h.derivative >= 0 && h.derivative <= h.poly_order &&
+		h.target_point >= -h.half_window && h.target_point <= h.half_window &&
+		h.boundary <= SAVGOL_BOUNDARY_CONSTANT && h.time_step > 0.0 &&
+		h.missing >= LUASGF_MISSING_ERROR && h.missing <= LUASGF_MISSING_INTERPOLATE &&
+		h.threads >= 1 && h.threads <= SGF_POOL_MAX_THREADS, 1,
+		"invalid filter configuration");
+
+  LuaSGF_Options opts;
+  memset(&opts, 0, sizeof(LuaSGF_Options));
+  opts.config.half_window = (uint8_t)h.half_window;
+  opts.config.poly_order = (uint8_t)h.poly_order;
+  opts.config.derivative = (uint8_t)h.derivative;
+  opts.config.time_step = (float)h.time_step;
+  opts.config.boundary = (SavgolBoundaryMode)h.boundary;
+  opts.half_window = h.half_window;
+  opts.time_step = h.time_step;
+  opts.target_point = h.target_point;
+  opts.precision = (LuaSGF_DType)h.precision;
+  opts.threads = h.threads;
+  opts.missing = h.missing;
+  opts.stats = (h.flags & LUASGF_DUMP_STATS) != 0;
+  opts.fft = (h.flags & LUASGF_DUMP_FFT) != 0;
+  opts.shared = 1;
+  opts.scratch_limit = (size_t)h.scratch_limit;
+
+  SgfPlanConfig key = {h.half_window, h.poly_order, h.derivative, h.time_step,
+		       (int)h.boundary, h.target_point};
+  int plan;
+  size_t count = util_dump_count(&key, opts.precision, &plan);
+  size_t esize = plan ? sizeof(double) : sizeof(float);
+  luaL_argcheck(L, h.count == count && len == sizeof(LuaSGF_Dump) + count * esize, 1,
+		"truncated or inconsistent dump");
+
+  // The copy aligns the coefficients for the kernels
+  void *data = malloc(count * esize);
+  if (data == NULL) {
+    return luaL_error(L, "memory allocation failed");
+  }
+  memcpy(data, blob + sizeof(LuaSGF_Dump), count * esize);
+  LuaSGF_Image image = {plan ? (const double *)data : NULL,
+			plan ? NULL : (const float *)data};
+  opts.image = &image;
+
+  LuaSGF_Filter *ud = (LuaSGF_Filter *)lua_newuserdatauv(L, sizeof(LuaSGF_Filter), 0);
+  LuaSGF_Cache *cache = (LuaSGF_Cache *)lua_touserdata(L, lua_upvalueindex(2));
+  int rc = util_filter_init(ud, cache, &opts, h.derivative);
+  free(data);
+  if (rc != 0) {
+    return luaL_error(L, "luaSGF.load(): invalid parameters or out of memory");
+  }
+  ud->monitor = (LuaSGF_Monitor *)lua_touserdata(L, lua_upvalueindex(3));
+  luaL_setmetatable(L, LUASGF_METATABLE);
+  return 1;
+}
+
+/*============================================================================
+ * FILTERING
+ *============================================================================*/
+/**
+ * @brief Work areas of tasks concurrent util_interior() calls, from the
+ * arena of the filter.
+ * @return sgf_fft_work() doubles per task, or NULL if the filter convolves
+ * directly or memory is short (direct convolution then).
+ */
+static double *util_fft_work(LuaSGF_Filter *ud, size_t tasks) {
+  if (ud->fft == NULL) {
+    return NULL;
+  }
+  size_t size = sgf_fft_work(ud->fft);
+  if (tasks > SIZE_MAX / sizeof(double) / size) {
+    return NULL;
+  }
+  return (double *)util_scratch_reserve(&ud->fft_work, tasks * size * sizeof(double));
+}
+
+/**
+ * @brief Number of consecutive parts of a work split each pool task covers.
+ * Overlap-save filters need a work area per task, so their parts are spread
+ * over one task per thread.
+ */
+static size_t util_task_parts(const LuaSGF_Filter *ud, size_t parts) {
+  size_t threads = (ud->threads > 1) ? (size_t)ud->threads : 1;
+  return (ud->fft != NULL) ? (parts + threads - 1) / threads : 1;
+}
+
+/**
+ * @brief Interior outputs y[i], i < count, of the window starting at in[i]
+ * in the filter's precision. Float weights are folded if (anti)symmetric.
+ * @param work Work area from util_fft_work(), or NULL to convolve directly.
+ */
+static void util_interior(const LuaSGF_Filter *ud, const void *in, void *out,
+			  size_t count, double *work) {
+  if (work != NULL && count >= (size_t)sgf_fft_taps(ud->fft)) {
+    // Wide windows
+    if (ud->precision == LUASGF_DTYPE_DOUBLE) {
+      sgf_fft_interior_d(ud->fft, (const double *)in, (double *)out, count, work);
+    } else {
+      sgf_fft_interior_f(ud->fft, (const float *)in, (float *)out, count, work);
+    }
+    return;
+  }
+  if (ud->precision == LUASGF_DTYPE_DOUBLE) {
+    sgf_apply_valid_d(ud->plan, (const double *)in,
+		      count + (size_t)ud->plan->window_size - 1, (double *)out);
+  } else if (ud->symmetry != SGF_ASYMMETRIC) {
+    sgf_interior_sym_f(ud->weights, (int)util_half_window(ud), ud->symmetry,
+		       (const float *)in, (float *)out, count);
+  } else {
+    sgf_interior_f(ud->weights, (int)util_window_size(ud), (const float *)in,
+		   (float *)out, count);
+  }
+}
+
+/**
+ * @brief Computes the n + t leading and n - t trailing outputs (len >= window
+ * size). Float boundary samples only depend on the first and last window, so
+ * the core library handles them on these two slices; periodic boundaries wrap
+ * around the whole signal and are computed from the weights directly.
+ * Filters with a plan use the binding kernel.
+ * @return Non-zero on failure.
+ */
+static int util_edges(LuaSGF_Filter *ud, const void *in, size_t len, void *out) {
+  if (ud->precision == LUASGF_DTYPE_DOUBLE) {
+    sgf_apply_edges_d(ud->plan, (const double *)in, (double *)out, len);
+    return 0;
+  }
+  if (ud->plan != NULL) {
+    sgf_apply_edges_f(ud->plan, (const float *)in, (float *)out, len);
+    return 0;
+  }
+
+  SavgolFilter *filter = ud->filter;
+  size_t w = (size_t)filter->window_size;
+  size_t n = (size_t)filter->config.half_window;
+  const float *x = (const float *)in;
+  float *y = (float *)out;
+  float edge[2 * SGF_MAX_HALF_WINDOW + 1];
+
+  if (filter->config.boundary == SAVGOL_BOUNDARY_PERIODIC) {
+    sgf_edges_periodic_f(ud->weights, (int)n, x, y, len);
+    return 0;
+  }
+  if (savgol_apply(filter, x, edge, w) != 0) {
+    return 1;
+  }
+  memcpy(y, edge, n * sizeof(float));
+  if (savgol_apply(filter, x + len - w, edge, w) != 0) {
+    return 1;
+  }
+  memcpy(y + len - n, edge + n + 1, n * sizeof(float));
+  return 0;
+}
+
+// Interior work split across the worker pool
+typedef struct {
+  const LuaSGF_Filter *ud;
+  const char *in;
+  char *out;
+  size_t in_step, out_step;  // elements between consecutive parts
+  size_t count;              // interior outputs in total
+  size_t count_step;         // interior outputs per part
+  size_t parts;              // parts per task, see util_task_parts()
+  double *fft_work;          // sgf_fft_work() doubles per task, or NULL
+} LuaSGF_Job;
+
+static void util_interior_task(void *arg, size_t task) {
+  const LuaSGF_Job *job = (const LuaSGF_Job *)arg;
+  size_t esize = util_dtype_size(job->ud->precision);
+  double *work = (job->fft_work != NULL) ?
+    job->fft_work + task * sgf_fft_work(job->ud->fft) : NULL;
+  for (size_t p = task * job->parts; p < (task + 1) * job->parts; p++) {
+    size_t done = p * job->count_step;
+    if (done >= job->count) {
+      break;
+    }
+    size_t count = job->count - done;
+    if (count > job->count_step) {
+      count = job->count_step;
+    }
+    util_interior(job->ud, job->in + p * job->in_step * esize,
+		  job->out + p * job->out_step * esize, count, work);
+  }
+}
+
+/**
+ * @brief Runs a LuaSGF_Job of the given number of parts on the worker pool.
+ */
+static void util_job_run(LuaSGF_Filter *ud, LuaSGF_Job *job, size_t parts) {
+  job->parts = util_task_parts(ud, parts);
+  size_t tasks = (parts + job->parts - 1) / job->parts;
+  job->fft_work = util_fft_work(ud, tasks);
+  sgf_pool_run(ud->threads, util_interior_task, job, tasks);
+}
+
+/**
+ * @brief util_interior() on the worker pool for large inputs: the outputs are
+ * split into chunks, whose input windows overlap by 2n samples.
+ */
+static void util_interior_mt(LuaSGF_Filter *ud, const void *in, void *out, size_t count) {
+  if (ud->threads <= 1 || count < 2 * LUASGF_THREAD_CHUNK) {
+    util_interior(ud, in, out, count, util_fft_work(ud, 1));
+    return;
+  }
+  LuaSGF_Job job = {ud, (const char *)in, (char *)out, LUASGF_THREAD_CHUNK,
+		    LUASGF_THREAD_CHUNK, count, LUASGF_THREAD_CHUNK, 1, NULL};
+  util_job_run(ud, &job, (count + LUASGF_THREAD_CHUNK - 1) / LUASGF_THREAD_CHUNK);
+}
+
+/**
+ * @brief util_run_precision() without missing-sample handling.
+ */
+static int util_run_dense(LuaSGF_Filter *ud, const void *in, size_t len,
+			  void *out, size_t out_len, int valid) {
+  size_t n = util_half_window(ud);
+
+  if (valid) {
+    util_interior_mt(ud, in, out, out_len);
+    return 0;
+  }
+  util_interior_mt(ud, in, (char *)out + util_lead(ud) * util_dtype_size(ud->precision),
+		   len - 2 * n);
+  return util_edges(ud, in, len, out);
+}
+
+/*
+ * Missing samples.
+ * Gaps are NaN samples (holes of tables are read as NaN). Interpolation fills
+ * them in a copy of the input; otherwise they are zeroed in the copy, the
+ * input is filtered as usual, and the outputs whose window has a gap are
+ * replaced afterwards. Boundary outputs are taken to depend on the whole
+ * first (last) window, and on both for periodic boundaries.
+ */
+
+/**
+ * @brief Fills the NaN samples of x linearly between their valid neighbours,
+ * leading and trailing gaps with the nearest valid sample.
+ */
+static void util_missing_interpolate(LuaSGF_Buffer *x) {
+  size_t prev = SIZE_MAX;
+  for (size_t i = 0; i <= x->len; i++) {
+    double v = (i < x->len) ? util_buffer_get(x, i) : 0.0;
+    if (i < x->len && v != v) {
+      continue;
+    }
+    double a = (prev != SIZE_MAX) ? util_buffer_get(x, prev) : v;
+    double b = (i < x->len) ? v : a;
+    for (size_t j = (prev != SIZE_MAX) ? prev + 1 : 0; j < i; j++) {
+      double f = (prev != SIZE_MAX && i < x->len) ? (double)(j - prev) / (double)(i - prev)
+	: 0.0;
+      util_buffer_set(x, j, a + (b - a) * f);
+    }
+    prev = i;
+  }
+}
+
+/**
+ * @brief Least-squares estimate at position x0 of the window of w samples
+ * from 'start' on, fitted to its valid (non-NaN) samples only.
+ * @param work 4w + SGF_WEIGHTS_WORK(w, poly_order) doubles.
+ * @return The estimate, NaN if fewer than poly_order + 1 samples are valid.
+ */
+static double util_missing_fit(const LuaSGF_Filter *ud, const LuaSGF_Buffer *in,
+			       size_t start, size_t w, size_t x0, double *work) {
+  const SgfPlanConfig *key = &ud->coeffs->key;
+  double *u = work, *y = work + w, *wt = work + 2 * w;
+  size_t count = 0;
+  double span = (double)(w - 1);
+  for (size_t j = 0; j < w; j++) {
+    double v = util_buffer_get(in, start + j);
+    if (v == v) {
+      u[count] = (double)j / span;  // normalized abscissas, see apply_irregular()
+      y[count++] = v;
+    }
+  }
+  if (count <= (size_t)key->poly_order ||
+      sgf_weights_at(u, (int)count, (double)x0 / span, key->poly_order, key->derivative,
+		     wt, work + 4 * w) != 0) {
+    return NAN;
+  }
+  double acc = 0.0;
+  for (size_t j = 0; j < count; j++) {
+    acc += wt[j] * y[j];
+  }
+  return acc * pow(span * key->time_step, -key->derivative);
+}
+
+/**
+ * @brief util_run_precision() for inputs with gaps, see LUASGF_MISSING_*.
+ * The copy of the input and the gap counts live in the gap_work arena of the
+ * filter, since callers may hold buffers of its scratch arena.
+ * @return -1 if the input has no gaps (nothing written), otherwise 0 on
+ * success, LUASGF_RUN_FAILED or LUASGF_RUN_NOMEM.
+ */
+static int util_run_missing(LuaSGF_Filter *ud, const void *in, size_t len,
+			    void *out, size_t out_len, int valid) {
+  LuaSGF_Buffer src = {len, ud->precision, (void *)in, 1.0, 0.0};
+  size_t first = 0;
+  if (ud->precision == LUASGF_DTYPE_DOUBLE) {
+    while (first < len && ((const double *)in)[first] == ((const double *)in)[first]) {
+      first++;
+    }
+  } else {
+    while (first < len && ((const float *)in)[first] == ((const float *)in)[first]) {
+      first++;
+    }
+  }
+  if (first == len) {
+    return -1;  // gap-free: normal kernels
+  }
+
+  size_t w = util_window_size(ud);
+  size_t lead = util_lead(ud), trail = w - 1 - lead;
+  size_t esize = util_dtype_size(ud->precision);
+  size_t m = (size_t)ud->coeffs->key.poly_order;
+  size_t work_len = 4 * w + SGF_WEIGHTS_WORK(w, m);
+  if (len > (SIZE_MAX / 2 - work_len * sizeof(double)) / (sizeof(size_t) + esize)) {
+    return LUASGF_RUN_NOMEM;
+  }
+  /* Doubles first, so that every part stays aligned */
+  double *work = (double *)util_scratch_reserve(&ud->gap_work, work_len * sizeof(double) +
+						(len + 1) * sizeof(size_t) + len * esize);
+  if (work == NULL) {
+    return LUASGF_RUN_NOMEM;
+  }
+  size_t *gaps = (size_t *)(work + work_len);  // gaps before i
+  char *copy = (char *)(gaps + len + 1);
+
+  LuaSGF_Buffer x = {len, ud->precision, copy, 1.0, 0.0};
+  LuaSGF_Buffer y = {out_len, ud->precision, out, 1.0, 0.0};
+  memcpy(copy, in, len * esize);
+  gaps[0] = 0;
+  for (size_t i = 0; i < len; i++) {
+    double v = util_buffer_get(&src, i);
+    gaps[i + 1] = gaps[i] + (v != v);
+    if (v != v && ud->missing != LUASGF_MISSING_INTERPOLATE) {
+      util_buffer_set(&x, i, 0.0);
+    }
+  }
+
+  int rc = 0;
+  if (gaps[len] == len) {
+    for (size_t i = 0; i < out_len; i++) {
+      util_buffer_set(&y, i, NAN);
+    }
+  } else if (ud->missing == LUASGF_MISSING_INTERPOLATE) {
+    util_missing_interpolate(&x);
+    rc = util_run_dense(ud, copy, len, out, out_len, valid);
+  } else {
+    rc = util_run_dense(ud, copy, len, out, out_len, valid);
+    int boundary = (ud->plan != NULL) ? ud->plan->config.boundary
+				      : (int)ud->filter->config.boundary;
+    size_t head = gaps[w], tail = gaps[len] - gaps[len - w];
+    for (size_t i = 0; i < out_len && rc == 0; i++) {
+      size_t k = valid ? i + lead : i;
+      size_t start = (k < lead) ? 0 : ((k >= len - trail) ? len - w : k - lead);
+      size_t missing = gaps[start + w] - gaps[start];
+      if (k < lead || k >= len - trail) {
+	missing = (boundary == SAVGOL_BOUNDARY_PERIODIC) ? head + tail : missing;
+      }
+      if (missing == 0) {
+	continue;
+      }
+      double v = NAN;
+      if (ud->missing == LUASGF_MISSING_SKIP) {
+	v = util_missing_fit(ud, &src, start, w, k - start, work);
+      }
+      util_buffer_set(&y, i, v);
+    }
+  }
+  util_scratch_release(&ud->gap_work);
+  return rc ? LUASGF_RUN_FAILED : 0;
+}
+
+/**
+ * @brief Filters an array of the filter's precision (float or double) with
+ * len >= window size. Input and output must not overlap. Gaps are handled
+ * according to the missing option of the filter.
+ * @param valid Non-zero to produce 'valid' output (no boundary extrapolation).
+ * @return 0 on success, LUASGF_RUN_FAILED or LUASGF_RUN_NOMEM.
+ */
+static int util_run_precision(LuaSGF_Filter *ud, const void *in, size_t len,
+			      void *out, size_t out_len, int valid) {
+  if (ud->missing != LUASGF_MISSING_ERROR) {
+    int rc = util_run_missing(ud, in, len, out, out_len, valid);
+    if (rc >= 0) {
+      return rc;
+    }
+  }
+  return util_run_dense(ud, in, len, out, out_len, valid) ? LUASGF_RUN_FAILED : 0;
+}
+
+/**
+ * @brief Raises the error of a failed util_run_precision() call: fmt like
+ * luaL_error(), or "out of memory" if that was the cause.
+ */
+static int util_run_error(lua_State *L, int rc, const char *fmt, ...) {
+  if (rc == LUASGF_RUN_NOMEM) {
+    return luaL_error(L, "out of memory");
+  }
+  va_list args;
+  va_start(args, fmt);
+  luaL_where(L, 1);
+  lua_pushvfstring(L, fmt, args);
+  va_end(args);
+  lua_concat(L, 2);
+  return lua_error(L);
+}
+
+/**
+ * @brief Raises an argument error for methods that do not handle missing
+ * samples if missing (LUASGF_MISSING_*) asks for it.
+ */
+static void util_check_dense(lua_State *L, int arg, int missing, const char *method) {
+  if (missing != LUASGF_MISSING_ERROR) {
+    luaL_argerror(L, arg, lua_pushfstring(L, "missing=%s is not supported by %s",
+					  luaSGF_missing_names[missing], method));
+  }
+}
+
+/**
+ * @brief Copies samples from a table or buffer into a double array.
+ * @param buf Buffer at idx, or NULL if idx holds a table.
+ * @return 0 on success, otherwise the 1-based index of the first hole.
+ */
+static size_t util_read_samples_d(lua_State *L, int idx, const LuaSGF_Buffer *buf,
+				  double *dst, size_t len) {
+  if (buf != NULL) {
+    util_buffer_load(buf, 0, len, 1, LUASGF_DTYPE_DOUBLE, dst);
+    return 0;
+  }
+
+  for (size_t i = 1; i <= len; i++) {
+    if (lua_rawgeti(L, idx, i) == LUA_TNIL) {
+      lua_pop(L, 1);
+      return i;
+    }
+    dst[i-1] = (double)luaL_checknumber(L, -1);
+    lua_pop(L, 1);
+  }
+  return 0;
+}
+
+/**
+ * @brief Copies a double array into an existing table or buffer.
+ * Tables are overwritten from index 1 on and trimmed to len entries.
+ * @param buf Buffer at idx, or NULL if idx holds a table.
+ */
+static void util_write_samples_d(lua_State *L, int idx, LuaSGF_Buffer *buf,
+				 const double *src, size_t len) {
+  if (buf != NULL) {
+    util_buffer_store(buf, 0, len, 1, LUASGF_DTYPE_DOUBLE, src);
+    return;
+  }
+
+  size_t old_len = lua_rawlen(L, idx);
+  for (size_t i = 0; i < len; i++) {
+    lua_pushnumber(L, (lua_Number)src[i]);
+    lua_rawseti(L, idx, i + 1);
+  }
+  for (size_t i = old_len; i > len; i--) {
+    lua_pushnil(L);
+    lua_rawseti(L, idx, i);
+  }
+}
+
+/**
+ * @brief Double-precision implementation of all apply variants.
+ * Samples are read as lua_Number (or straight from double buffers) and
+ * filtered by the binding kernel, so no narrowing to float takes place.
+ * Stack: 1 = filter, 2 = data, out_index = destination.
+ * @param valid Non-zero to produce 'valid' output (no boundary extrapolation).
+ * @param out_index Stack index of the destination (apply_into), or 0 to
+ * return a new table/buffer like apply().
+ */
+static int util_apply_double(lua_State *L, LuaSGF_Filter *ud, int valid,
+			     int out_index) {
+  SgfPlan *plan = ud->plan;
+
+  LuaSGF_Buffer *in_buf = (LuaSGF_Buffer *)luaL_testudata(L, 2, LUASGF_BUFFER_METATABLE);
+  if (in_buf == NULL) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+  }
+  LuaSGF_Buffer *out_buf = NULL;
+  if (out_index != 0) {
+    out_buf = (LuaSGF_Buffer *)luaL_testudata(L, out_index, LUASGF_BUFFER_METATABLE);
+    if (out_buf == NULL) {
+      luaL_checktype(L, out_index, LUA_TTABLE);
+    }
+  }
+  int in_place = (out_index != 0 && lua_rawequal(L, 2, out_index));
+
+  size_t len = (in_buf != NULL) ? in_buf->len : lua_rawlen(L, 2);
+  if (len < (size_t)plan->window_size) {
+    return luaL_error(L, "input too short (min: %d, got: %d)",
+		      plan->window_size, (int)len);
+  }
+
+  size_t out_len = valid ? len - 2 * (size_t)plan->config.half_window : len;
+  if (out_buf != NULL && out_buf->len != out_len) {
+    return luaL_error(L, "output buffer length mismatch (expected: %d, got: %d)",
+		      (int)out_len, (int)out_buf->len);
+  }
+
+  /* apply() on a buffer returns a new buffer of the same element type */
+  if (out_index == 0 && in_buf != NULL) {
+    out_buf = util_new_buffer(L, out_len, util_result_dtype(in_buf->dtype, ud->precision));
+    out_index = lua_gettop(L);
+  }
+
+  /* Double buffers are used in place unless input and output alias */
+  int direct_in  = (in_buf != NULL && in_buf->dtype == LUASGF_DTYPE_DOUBLE && !in_place);
+  int direct_out = (out_buf != NULL && out_buf->dtype == LUASGF_DTYPE_DOUBLE);
+
+  LuaSGF_Probe probe;
+  util_probe_start(&probe, ud);
+  size_t tmp_len = (direct_in ? 0 : len) + (direct_out ? 0 : out_len);
+  double *tmp = (double *)util_scratch_array(L, &ud->scratch, tmp_len, sizeof(double));
+  double *in_data  = direct_in ? (double *)in_buf->data : tmp;
+  double *out_data = direct_out ? (double *)out_buf->data : tmp + (direct_in ? 0 : len);
+
+  if (!direct_in) {
+    size_t hole = util_read_samples_d(L, 2, in_buf, in_data, len);
+    if (hole != 0) {
+      return luaL_error(L, "input table has a hole at index %d", (int)hole);
+    }
+  }
+  util_probe_phase(&probe, LUASGF_PHASE_READ);
+
+  int rc = util_run_precision(ud, in_data, len, out_data, out_len, valid);
+  if (rc != 0) {
+    return util_run_error(L, rc, valid ? "savgol_apply_valid core execution failed"
+				 : "savgol_apply failed");
+  }
+  util_probe_phase(&probe, LUASGF_PHASE_COMPUTE);
+
+  if (!direct_out) {
+    if (out_index == 0) {
+      /* apply() on a table: new result table */
+      lua_createtable(L, (int)out_len, 0);
+      out_index = lua_gettop(L);
+    }
+    util_write_samples_d(L, out_index, out_buf, out_data, out_len);
+  }
+  util_scratch_release(&ud->scratch);
+  util_probe_finish(&probe, LUASGF_PHASE_WRITE, len);
+
+  lua_settop(L, out_index);
+  return 1;
+}
+
+/**
+ * @brief Filters a buffer and pushes the result as a new buffer.
+ * Float buffers are handed to the core library without any copy. Double
+ * buffers are narrowed to float for the core and widened back afterwards.
+ * @param valid Non-zero to produce 'valid' output (no boundary extrapolation).
+ */
+static int util_apply_buffer(lua_State *L, LuaSGF_Filter *ud,
+			     const LuaSGF_Buffer *in, int valid) {
+  size_t w = util_window_size(ud);
+  size_t len = in->len;
+
+  if (len < w) {
+    return luaL_error(L, "input buffer too short (min: %d, got: %d)",
+		      (int)w, (int)len);
+  }
+
+  size_t out_len = valid ? len - w + 1 : len;
+  LuaSGF_Buffer *out = util_new_buffer(L, out_len, util_result_dtype(in->dtype, ud->precision));
+  LuaSGF_Probe probe;
+  util_probe_start(&probe, ud);
+
+  if (in->dtype == LUASGF_DTYPE_FLOAT) {
+    /* Zero-copy: the core works on the buffer storage directly */
+    int rc = util_run_precision(ud, (const float *)in->data, len,
+				(float *)out->data, out_len, valid);
+    if (rc != 0) {
+      return util_run_error(L, rc, valid ? "savgol_apply_valid core execution failed"
+				   : "savgol_apply failed");
+    }
+    util_probe_finish(&probe, LUASGF_PHASE_COMPUTE, len);
+    return 1;
+  }
+
+  /* Double buffer: the core computes in float precision */
+  float *in_data  = (float *)util_scratch_array(L, &ud->scratch, len + out_len,
+						sizeof(float));
+  float *out_data = in_data + len;
+
+  const double *src = (const double *)in->data;
+  for (size_t i = 0; i < len; i++) {
+    in_data[i] = (float)src[i];
+  }
+  util_probe_phase(&probe, LUASGF_PHASE_READ);
+
+  int rc = util_run_precision(ud, in_data, len, out_data, out_len, valid);
+  if (rc != 0) {
+    return util_run_error(L, rc, valid ? "savgol_apply_valid core execution failed"
+				 : "savgol_apply failed");
+  }
+  util_probe_phase(&probe, LUASGF_PHASE_COMPUTE);
+
+  double *dst = (double *)out->data;
+  for (size_t i = 0; i < out_len; i++) {
+    dst[i] = (double)out_data[i];
+  }
+
+  util_scratch_release(&ud->scratch);
+  util_probe_finish(&probe, LUASGF_PHASE_WRITE, len);
+  return 1;
+}
+
+/*
+ * Strided views.
+ * apply(), apply_valid() and the _into variants take an optional view table
+ * selecting `count` samples from index `offset` on, `stride` elements apart,
+ * e.g. one channel of interleaved data. Results may be scattered likewise.
+ */
+
+// Element range of a table or buffer, 0-based
+typedef struct {
+  size_t offset;
+  size_t count;
+  size_t stride;
+} LuaSGF_View;
+
+/**
+ * @brief Reads an optional positive integer field of the view table at arg.
+ */
+static size_t util_view_field(lua_State *L, int arg, const char *field, size_t def) {
+  lua_getfield(L, arg, field);
+  if (lua_isnil(L, -1)) {
+    lua_pop(L, 1);
+    return def;
+  }
+  int isnum;
+  lua_Integer v = lua_tointegerx(L, -1, &isnum);
+  if (!isnum || v < 1) {
+    return luaL_error(L, "view.%s must be a positive integer", field);
+  }
+  lua_pop(L, 1);
+  return (size_t)v;
+}
+
+/**
+ * @brief Reads offset, count and stride of the view table at arg over an
+ * object of len elements. The count defaults to all elements from offset on.
+ */
+static void util_check_view(lua_State *L, int arg, size_t len, LuaSGF_View *v) {
+  luaL_checktype(L, arg, LUA_TTABLE);
+  v->offset = util_view_field(L, arg, "offset", 1) - 1;
+  v->stride = util_view_field(L, arg, "stride", 1);
+  size_t avail = (v->offset < len) ? (len - v->offset + v->stride - 1) / v->stride : 0;
+  v->count = util_view_field(L, arg, "count", avail);
+  luaL_argcheck(L, v->count <= avail, arg, "view exceeds the input");
+}
+
+/**
+ * @brief Copies a view of a table into an array of the given precision.
+ * @param holes Non-zero to read holes as NaN (missing samples).
+ * @return 0 on success, otherwise the 1-based index of the first hole.
+ */
+static size_t util_gather_table(lua_State *L, int idx, const LuaSGF_View *v,
+				LuaSGF_DType precision, void *dst, int holes) {
+  for (size_t i = 0; i < v->count; i++) {
+    size_t k = v->offset + i * v->stride;
+    lua_Number x = (lua_Number)NAN;
+    if (lua_rawgeti(L, idx, (lua_Integer)k + 1) != LUA_TNIL) {
+      x = luaL_checknumber(L, -1);
+    } else if (!holes) {
+      lua_pop(L, 1);
+      return k + 1;
+    }
+    lua_pop(L, 1);
+    if (precision == LUASGF_DTYPE_DOUBLE) {
+      ((double *)dst)[i] = (double)x;
+    } else {
+      ((float *)dst)[i] = (float)x;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Copies a view of a table or buffer into an array of the given
+ * precision.
+ * @param buf Buffer at idx, or NULL if idx holds a table.
+ * @return 0 on success, otherwise the 1-based index of the first hole.
+ */
+static size_t util_gather(lua_State *L, int idx, const LuaSGF_Buffer *buf,
+			  const LuaSGF_View *v, LuaSGF_DType precision, void *dst) {
+  if (buf != NULL) {
+    util_buffer_load(buf, v->offset, v->count, v->stride, precision, dst);
+    return 0;
+  }
+  return util_gather_table(L, idx, v, precision, dst, 0);
+}
+
+/**
+ * @brief Copies an array of the given precision into a view of a table or
+ * buffer. Other elements are left untouched; tables are not trimmed.
+ * @param buf Buffer at idx, or NULL if idx holds a table.
+ */
+static void util_scatter(lua_State *L, int idx, LuaSGF_Buffer *buf,
+			 const LuaSGF_View *v, LuaSGF_DType precision, const void *src) {
+  if (buf != NULL) {
+    util_buffer_store(buf, v->offset, v->count, v->stride, precision, src);
+    return;
+  }
+  for (size_t i = 0; i < v->count; i++) {
+    size_t k = v->offset + i * v->stride;
+    lua_Number x = (precision == LUASGF_DTYPE_DOUBLE) ? (lua_Number)((const double *)src)[i]
+      : (lua_Number)((const float *)src)[i];
+    lua_pushnumber(L, x);
+    lua_rawseti(L, idx, (lua_Integer)k + 1);
+  }
+}
+
+/**
+ * @brief Boundary outputs of one channel of interleaved frames.
+ * They only depend on the first and last window (all boundary modes wrap,
+ * reflect or clamp within 2n samples of the ends), so both windows are
+ * gathered back to back and filtered as one short signal of 2w samples.
+ * @param work 4w elements of the filter precision.
+ * @return Non-zero on failure.
+ */
+static int util_interleaved_edges(LuaSGF_Filter *ud, const LuaSGF_Buffer *in, LuaSGF_Buffer *out,
+			   size_t channels, size_t c, size_t frames, void *work) {
+  size_t w = util_window_size(ud);
+  size_t lead = util_lead(ud), trail = 2 * util_half_window(ud) - lead;
+  size_t esize = util_dtype_size(ud->precision);
+  size_t len = (frames < 2 * w) ? frames : 2 * w;
+  char *x = (char *)work;
+  char *y = x + 2 * w * esize;
+
+  if (len == frames) {
+    LuaSGF_View all = {c, frames, channels};
+    util_gather(NULL, 0, in, &all, ud->precision, x);
+  } else {
+    LuaSGF_View head = {c, w, channels};
+    LuaSGF_View tail = {(frames - w) * channels + c, w, channels};
+    util_gather(NULL, 0, in, &head, ud->precision, x);
+    util_gather(NULL, 0, in, &tail, ud->precision, x + w * esize);
+  }
+  if (util_edges(ud, x, len, y)) {
+    return 1;
+  }
+  LuaSGF_View left = {c, lead, channels};
+  LuaSGF_View right = {(frames - trail) * channels + c, trail, channels};
+  util_scatter(NULL, 0, out, &left, ud->precision, y);
+  util_scatter(NULL, 0, out, &right, ud->precision, y + (len - trail) * esize);
+  return 0;
+}
+
+/**
+ * @brief Filters all channels of interleaved frames (in->len / channels
+ * frames) into out, e.g. a mapped file. The interior is computed in chunks
+ * of outputs whose input windows overlap by 2n frames, so other element
+ * types are converted chunk by chunk; single channels of the filter
+ * precision are read and written in place.
+ * @param work (2 * chunk + 2n) + 4w elements of the filter precision, or 4w
+ * for a single channel in the filter precision.
+ * @return 0 on success, otherwise the 1-based channel that failed.
+ */
+static size_t util_run_interleaved(LuaSGF_Filter *ud, const LuaSGF_Buffer *in, LuaSGF_Buffer *out,
+			    size_t channels, int valid, size_t chunk, void *work) {
+  size_t n = util_half_window(ud);
+  size_t esize = util_dtype_size(ud->precision);
+  size_t frames = in->len / channels;
+  int direct = (channels == 1 && in->dtype == ud->precision && out->dtype == ud->precision);
+  char *x = (char *)work;
+  char *y = x + (direct ? 0 : chunk + 2 * n) * esize;
+  char *edge = y + (direct ? 0 : chunk) * esize;
+
+  size_t interior = frames - 2 * n;
+  size_t base = valid ? 0 : util_lead(ud);
+  for (size_t done = 0; done < interior; done += chunk) {
+    size_t count = (interior - done < chunk) ? interior - done : chunk;
+    if (direct) {
+      util_interior_mt(ud, (const char *)in->data + done * esize,
+		       (char *)out->data + (base + done) * esize, count);
+      continue;
+    }
+    for (size_t c = 0; c < channels; c++) {
+      LuaSGF_View src = {done * channels + c, count + 2 * n, channels};
+      LuaSGF_View dst = {(base + done) * channels + c, count, channels};
+      util_gather(NULL, 0, in, &src, ud->precision, x);
+      util_interior_mt(ud, x, y, count);
+      util_scatter(NULL, 0, out, &dst, ud->precision, y);
+    }
+  }
+
+  for (size_t c = 0; c < channels && !valid; c++) {
+    if (util_interleaved_edges(ud, in, out, channels, c, frames, edge)) {
+      return c + 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief apply variants on a view of the input (both precisions).
+ * Buffers of the filter precision are read and written in place when their
+ * stride is 1; other views go through the scratch arena, without any
+ * intermediate Lua table.
+ * Stack: 1 = filter, 2 = data, view_index = view table.
+ * @param valid Non-zero to produce 'valid' output (no boundary extrapolation).
+ * @param out_index Stack index of the destination (apply_into), or 0 to
+ * return a new contiguous table/buffer like apply().
+ * @param view_index Stack index of the view, or 0 for all samples.
+ */
+static int util_apply_view(lua_State *L, LuaSGF_Filter *ud, int valid,
+			   int out_index, int view_index) {
+  LuaSGF_Buffer *in_buf = (LuaSGF_Buffer *)luaL_testudata(L, 2, LUASGF_BUFFER_METATABLE);
+  if (in_buf == NULL) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+  }
+  size_t len = (in_buf != NULL) ? in_buf->len : lua_rawlen(L, 2);
+  LuaSGF_View in_view = {0, len, 1};
+  if (view_index != 0) {
+    util_check_view(L, view_index, len, &in_view);
+  }
+
+  size_t w = util_window_size(ud);
+  if (in_view.count < w) {
+    return luaL_error(L, "input view too short (min: %d, got: %d)",
+		      (int)w, (int)in_view.count);
+  }
+  size_t out_len = valid ? in_view.count - w + 1 : in_view.count;
+
+  /* In place, the result goes back into the same view by default */
+  LuaSGF_View out_view = {0, out_len, 1};
+  LuaSGF_Buffer *out_buf = NULL;
+  int in_place = 0;
+  if (out_index != 0) {
+    out_buf = (LuaSGF_Buffer *)luaL_testudata(L, out_index, LUASGF_BUFFER_METATABLE);
+    if (out_buf == NULL) {
+      luaL_checktype(L, out_index, LUA_TTABLE);
+    }
+    in_place = lua_rawequal(L, 2, out_index);
+    if (view_index != 0) {
+      out_view.offset = util_view_field(L, view_index, "out_offset",
+					in_place ? in_view.offset + 1 : 1) - 1;
+      out_view.stride = util_view_field(L, view_index, "out_stride",
+					in_place ? in_view.stride : 1);
+    } else if (out_buf != NULL && out_buf->len != out_len) {
+      return luaL_error(L, "output buffer length mismatch (expected: %d, got: %d)",
+			(int)out_len, (int)out_buf->len);
+    }
+    if (out_buf != NULL && (out_view.offset >= out_buf->len ||
+			    (out_buf->len - 1 - out_view.offset) / out_view.stride < out_len - 1)) {
+      return luaL_error(L, "output view exceeds the buffer (length: %d)",
+			(int)out_buf->len);
+    }
+  } else if (in_buf != NULL) {
+    out_buf = util_new_buffer(L, out_len, util_result_dtype(in_buf->dtype, ud->precision));
+    out_index = lua_gettop(L);
+  } else {
+    lua_createtable(L, (int)out_len, 0);
+    out_index = lua_gettop(L);
+  }
+
+  size_t esize = util_dtype_size(ud->precision);
+  int direct_in  = (in_buf != NULL && in_buf->dtype == ud->precision &&
+		    in_view.stride == 1 && !in_place);
+  int direct_out = (out_buf != NULL && out_buf->dtype == ud->precision &&
+		    out_view.stride == 1);
+
+  LuaSGF_Probe probe;
+  util_probe_start(&probe, ud);
+  size_t tmp_len = (direct_in ? 0 : in_view.count) + (direct_out ? 0 : out_len);
+  char *tmp = (char *)util_scratch_array(L, &ud->scratch, tmp_len, esize);
+  void *in_data  = direct_in ? (char *)in_buf->data + in_view.offset * esize : tmp;
+  void *out_data = direct_out ? (char *)out_buf->data + out_view.offset * esize
+    : tmp + (direct_in ? 0 : in_view.count) * esize;
+
+  if (!direct_in) {
+    size_t hole = (in_buf == NULL)
+      ? util_gather_table(L, 2, &in_view, ud->precision, in_data,
+			  ud->missing != LUASGF_MISSING_ERROR)
+      : util_gather(L, 2, in_buf, &in_view, ud->precision, in_data);
+    if (hole != 0) {
+      return luaL_error(L, "input table has a hole at index %d", (int)hole);
+    }
+  }
+  util_probe_phase(&probe, LUASGF_PHASE_READ);
+
+  int rc = util_run_precision(ud, in_data, in_view.count, out_data, out_len, valid);
+  if (rc != 0) {
+    return util_run_error(L, rc, valid ? "savgol_apply_valid core execution failed"
+				 : "savgol_apply failed");
+  }
+  util_probe_phase(&probe, LUASGF_PHASE_COMPUTE);
+
+  if (!direct_out) {
+    util_scatter(L, out_index, out_buf, &out_view, ud->precision, out_data);
+  }
+  if (view_index == 0 && out_buf == NULL) {
+    /* Without a view, result tables are trimmed like by apply_into() */
+    for (size_t i = lua_rawlen(L, out_index); i > out_len; i--) {
+      lua_pushnil(L);
+      lua_rawseti(L, out_index, (lua_Integer)i);
+    }
+  }
+  util_scratch_release(&ud->scratch);
+  util_probe_finish(&probe, LUASGF_PHASE_WRITE, in_view.count);
+
+  lua_settop(L, out_index);
+  return 1;
+}
+
+/**
+ * @brief Non-zero if the data (stack index 2) or the destination (out_index,
+ * 0 for none) is a buffer of a raw element type.
+ */
+static int util_raw_args(lua_State *L, int out_index) {
+  LuaSGF_Buffer *in_buf = (LuaSGF_Buffer *)luaL_testudata(L, 2, LUASGF_BUFFER_METATABLE);
+  LuaSGF_Buffer *out_buf = (out_index != 0)
+    ? (LuaSGF_Buffer *)luaL_testudata(L, out_index, LUASGF_BUFFER_METATABLE) : NULL;
+  return (in_buf != NULL && util_dtype_raw(in_buf->dtype)) ||
+    (out_buf != NULL && util_dtype_raw(out_buf->dtype));
+}
+
+/**
+ * @brief apply variants with raw buffers (int16 etc.), see util_raw_args().
+ * Between two distinct buffers the samples are converted block by block
+ * while filtering, so no converted copy of the whole input exists; the
+ * scratch memory is bounded by LUASGF_RAW_CHUNK. Tables and in-place
+ * filtering go through util_apply_view().
+ * Stack: 1 = filter, 2 = data, out_index = destination or 0.
+ */
+static int util_apply_raw(lua_State *L, LuaSGF_Filter *ud, int valid, int out_index) {
+  LuaSGF_Buffer *in_buf = (LuaSGF_Buffer *)luaL_testudata(L, 2, LUASGF_BUFFER_METATABLE);
+  LuaSGF_Buffer *out_buf = (out_index != 0)
+    ? (LuaSGF_Buffer *)luaL_testudata(L, out_index, LUASGF_BUFFER_METATABLE) : NULL;
+  if (in_buf == NULL || (out_index != 0 && (out_buf == NULL || out_buf == in_buf))) {
+    return util_apply_view(L, ud, valid, out_index, 0);
+  }
+
+  size_t w = util_window_size(ud);
+  size_t n = util_half_window(ud);
+  size_t len = in_buf->len;
+  if (len < w) {
+    return luaL_error(L, "input too short (min: %d, got: %d)", (int)w, (int)len);
+  }
+  size_t out_len = valid ? len - w + 1 : len;
+  if (out_buf == NULL) {
+    out_buf = util_new_buffer(L, out_len, util_result_dtype(in_buf->dtype, ud->precision));
+    out_index = lua_gettop(L);
+  } else if (out_buf->len != out_len) {
+    return luaL_error(L, "output buffer length mismatch (expected: %d, got: %d)",
+		      (int)out_len, (int)out_buf->len);
+  }
+
+  size_t chunk = LUASGF_RAW_CHUNK;
+  if (ud->threads > 1) {
+    chunk = (size_t)ud->threads * LUASGF_THREAD_CHUNK;
+  }
+  LuaSGF_Probe probe;
+  util_probe_start(&probe, ud);
+  void *work = util_scratch_array(L, &ud->scratch, 2 * chunk + 2 * n + 4 * w,
+				  util_dtype_size(ud->precision));
+  if (util_run_interleaved(ud, in_buf, out_buf, 1, valid, chunk, work) != 0) {
+    return luaL_error(L, valid ? "savgol_apply_valid core execution failed"
+		      : "savgol_apply failed");
+  }
+  util_scratch_release(&ud->scratch);
+  util_probe_finish(&probe, LUASGF_PHASE_COMPUTE, len);
+
+  lua_settop(L, out_index);
+  return 1;
+}
+
+/**
+ * Applies the filter to a table of data.
+ * This method performs the filtering and returns a **new** table of the same 
+ * length as the input. Boundary regions are handled according to the 
+ * `boundary` mode set during construction (e.g., polynomial extrapolation, 
+ * reflection, etc.).
+ * If `data` is a `Buffer`, the filter runs directly on the buffer memory and a
+ * new `Buffer` of the same element type is returned instead of a table.
+ *
+ * The optional `view` filters only `count` samples starting at index `offset`
+ * (default 1), taken `stride` elements apart (default 1), e.g. one channel of
+ * interleaved data. The samples are read straight from `data`; the result is
+ * contiguous and has `count` elements.
+ * 
+ * @function SavgolFilter:apply
+ * @tparam table|Buffer data A Lua table (array-style) containing numeric values,
+ * or a buffer.
+ * @tparam[opt] table view `{offset=, count=, stride=}`; `count` defaults to
+ * all samples from `offset` on.
+ * @treturn table|Buffer A new table (or buffer) containing the filtered results.
+ * @raise Error if the table is shorter than the filter window, contains holes (`nil`), 
+ * or if memory allocation fails.
+ * @usage
+ * local data = {1.1, 2.1, 1.9, 4.2, 3.8}
+ * local result = filter:apply(data)
+ * assert(#result == #data)
+ * -- second channel of interleaved stereo samples
+ * local right = filter:apply(stereo, {offset = 2, stride = 2})
+ */
+static int luaSGF_savgol_apply(lua_State *L) {
+  /* 1. Retrieve and validate the filter */
+  /* luaL_checkudata ensures the object is of our specific metatable type */
+  LuaSGF_Filter *ud = util_check_filter(L, 1);
+  if (!lua_isnoneornil(L, 3)) {
+    return util_apply_view(L, ud, 0, 0, 3);
+  }
+  if (ud->missing != LUASGF_MISSING_ERROR) {
+    return util_apply_view(L, ud, 0, 0, 0);
+  }
+  if (util_raw_args(L, 0)) {
+    return util_apply_raw(L, ud, 0, 0);
+  }
+  if (ud->precision == LUASGF_DTYPE_DOUBLE) {
+    return util_apply_double(L, ud, 0, 0);
+  }
+
+  /* 2. Buffers bypass the table marshalling entirely */
+  LuaSGF_Buffer *buf = (LuaSGF_Buffer *)luaL_testudata(L, 2, LUASGF_BUFFER_METATABLE);
+  if (buf != NULL) {
+    return util_apply_buffer(L, ud, buf, 0);
+  }
+
+  /* Otherwise the second argument must be a table */
+  luaL_checktype(L, 2, LUA_TTABLE);
+    
+  /* 3. Get table length using Lua 5.4 raw length */
+  size_t len = lua_rawlen(L, 2);
+    
+  /* 4. Check against filter window size */
+  if (len < util_window_size(ud)) {
+    return luaL_error(L, "input table too short (min: %d, got: %d)", 
+		      (int)util_window_size(ud), (int)len);
+  }
+  
+  /* 5. Take working memory from the filter's scratch arena */
+  /* The arena owns the memory, so the errors below cannot leak it */
+  LuaSGF_Probe probe;
+  util_probe_start(&probe, ud);
+  float *in_data  = (float *)util_scratch_array(L, &ud->scratch, 2 * len, sizeof(float));
+  float *out_data = in_data + len;
+
+  /* 6. Extract values from Lua table */
+  /* In Lua 5.4, we use lua_rawgeti which is fast and avoids __index metamethods */
+  for (size_t i = 1; i <= len; i++) {
+    if (lua_rawgeti(L, 2, i) == LUA_TNIL) {
+      return luaL_error(L, "input table has a hole at index %d", (int)i);
+    }
+    in_data[i-1] = (float)luaL_checknumber(L, -1);
+    lua_pop(L, 1);
+  }
+
+  util_probe_phase(&probe, LUASGF_PHASE_READ);
+
+  /* 7. Core calculation */
+  int rc = util_run_precision(ud, in_data, len, out_data, len, 0);
+  if (rc != 0) {
+    return util_run_error(L, rc, "savgol_apply failed");
+  }
+  util_probe_phase(&probe, LUASGF_PHASE_COMPUTE);
+
+  /* 8. Create result table */
+  /* Pre-allocating the array part to 'len' prevents rehashes */
+  lua_createtable(L, (int)len, 0);
+    
+  for (size_t i = 0; i < len; i++) {
+    /* Convert float back to lua_Number (usually double) */
+    lua_pushnumber(L, (lua_Number)out_data[i]);
+    /* Set table[i+1] = value */
+    lua_rawseti(L, -2, i + 1);
+  }
+
+  /* 9. Trim the arena if it exceeds the configured limit */
+  util_scratch_release(&ud->scratch);
+  util_probe_finish(&probe, LUASGF_PHASE_WRITE, len);
+  
+  return 1; /* One return value: the new table */
+}
+
+/**
+ * Applies the filter returning only VALID output.
+ * This method does not perform boundary extrapolation. It returns only those 
+ * samples where the filter window was fully contained within the input data. 
+ * As a result, the output table is shorter than the input table.
+ * Buffers are accepted as input as well and yield a buffer as output.
+ *
+ * **Output length** = `input_length - 2 * half_window`.
+ *
+ * @function SavgolFilter:apply_valid
+ * @tparam table|Buffer data Array-style table (or buffer) containing numeric
+ * values to be filtered.
+ * @tparam[opt] table view `{offset=, count=, stride=}` selecting the samples,
+ * see `apply`.
+ * @treturn table|Buffer A new (shorter) table or buffer containing the valid
+ * filtered samples.
+ * @raise Error if the input table is shorter than the filter window size or if 
+ * memory allocation fails.
+ * @usage
+ * -- If half_window is 5, the first and last 5 samples are discarded.
+ * local input = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11} -- length 11
+ * local result = filter:apply_valid(input)
+ * print(#result) -- Output: 1
+ */
+static int luaSGF_savgol_apply_valid(lua_State *L) {
+  /* Retrieve filter */
+  LuaSGF_Filter *ud = util_check_filter(L, 1);
+  if (!lua_isnoneornil(L, 3)) {
+    return util_apply_view(L, ud, 1, 0, 3);
+  }
+  if (ud->missing != LUASGF_MISSING_ERROR) {
+    return util_apply_view(L, ud, 1, 0, 0);
+  }
+  if (util_raw_args(L, 0)) {
+    return util_apply_raw(L, ud, 1, 0);
+  }
+  if (ud->precision == LUASGF_DTYPE_DOUBLE) {
+    return util_apply_double(L, ud, 1, 0);
+  }
+
+  /* Buffers bypass the table marshalling entirely */
+  LuaSGF_Buffer *buf = (LuaSGF_Buffer *)luaL_testudata(L, 2, LUASGF_BUFFER_METATABLE);
+  if (buf != NULL) {
+    return util_apply_buffer(L, ud, buf, 1);
+  }
+
+  /* Ensure argument 2 is the input data table */
+  luaL_checktype(L, 2, LUA_TTABLE);
+  size_t in_len = lua_rawlen(L, 2);
+    
+  /* Calculate expected output length: L - 2*n */
+  int hw = (int)util_half_window(ud);
+    
+  /* Boundary check: input must be at least one full window size */
+  if (in_len < util_window_size(ud)) {
+    return luaL_error(L, "input table too short for 'valid' output (min: %d, got: %d)", 
+		      (int)util_window_size(ud), (int)in_len);
+  }
+    
+  size_t out_len = in_len - (2 * (size_t)hw);
+
+  /* Working memory for the C arrays comes from the scratch arena */
+  LuaSGF_Probe probe;
+  util_probe_start(&probe, ud);
+  float *in_data  = (float *)util_scratch_array(L, &ud->scratch, in_len + out_len,
+						sizeof(float));
+  float *out_data = in_data + in_len;
+
+  /* Step 1: Copy from Lua table to C input array */
+  for (size_t i = 1; i <= in_len; i++) {
+    lua_rawgeti(L, 2, (int)i);
+    in_data[i-1] = (float)luaL_checknumber(L, -1);
+    lua_pop(L, 1);
+  }
+  
+  util_probe_phase(&probe, LUASGF_PHASE_READ);
+
+  /* Step 2: Execute the interior kernel (no boundary handling needed) */
+  size_t written = out_len;
+  int rc = util_run_precision(ud, in_data, in_len, out_data, out_len, 1);
+  if (rc != 0) {
+    return util_run_error(L, rc, "savgol_apply_valid core execution failed");
+  }
+  util_probe_phase(&probe, LUASGF_PHASE_COMPUTE);
+  
+  /* Step 3: Create the shorter Lua table and populate with results */
+  lua_createtable(L, (int)written, 0);
+  for (size_t i = 0; i < written; i++) {
+    lua_pushnumber(L, (lua_Number)out_data[i]);
+    lua_rawseti(L, -2, (int)(i + 1));
+  }
+
+  util_scratch_release(&ud->scratch);
+  util_probe_finish(&probe, LUASGF_PHASE_WRITE, in_len);
+
+  return 1; /* Return the result table */
+}
+
+/**
+ * @brief Copies samples from a table or buffer into a float array.
+ * @param buf Buffer at idx, or NULL if idx holds a table.
+ * @return 0 on success, otherwise the 1-based index of the first hole.
+ */
+static size_t util_read_samples(lua_State *L, int idx, const LuaSGF_Buffer *buf,
+				float *dst, size_t len) {
+  if (buf != NULL) {
+    util_buffer_load(buf, 0, len, 1, LUASGF_DTYPE_FLOAT, dst);
+    return 0;
+  }
+
+  for (size_t i = 1; i <= len; i++) {
+    if (lua_rawgeti(L, idx, i) == LUA_TNIL) {
+      lua_pop(L, 1);
+      return i;
+    }
+    dst[i-1] = (float)luaL_checknumber(L, -1);
+    lua_pop(L, 1);
+  }
+  return 0;
+}
+
+/**
+ * @brief Copies a float array into an existing table or buffer.
+ * Tables are overwritten from index 1 on; stale entries beyond len are
+ * cleared so that the table length afterwards equals len.
+ * @param buf Buffer at idx, or NULL if idx holds a table.
+ */
+static void util_write_samples(lua_State *L, int idx, LuaSGF_Buffer *buf,
+			       const float *src, size_t len) {
+  if (buf != NULL) {
+    util_buffer_store(buf, 0, len, 1, LUASGF_DTYPE_FLOAT, src);
+    return;
+  }
+
+  size_t old_len = lua_rawlen(L, idx);
+  for (size_t i = 0; i < len; i++) {
+    lua_pushnumber(L, (lua_Number)src[i]);
+    lua_rawseti(L, idx, i + 1);
+  }
+  for (size_t i = old_len; i > len; i--) {
+    lua_pushnil(L);
+    lua_rawseti(L, idx, i);
+  }
+}
+
+/**
+ * @brief Common implementation of apply_into() and apply_valid_into().
+ * Stack: 1 = filter, 2 = data, 3 = out (optional, defaults to data),
+ * 4 = view (optional).
+ * @param valid Non-zero to produce 'valid' output (no boundary extrapolation).
+ */
+static int util_apply_into(lua_State *L, int valid) {
+  LuaSGF_Filter *ud = util_check_filter(L, 1);
+  size_t w = util_window_size(ud);
+
+  /* Validate input: table or buffer */
+  LuaSGF_Buffer *in_buf = (LuaSGF_Buffer *)luaL_testudata(L, 2, LUASGF_BUFFER_METATABLE);
+  if (in_buf == NULL) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+  }
+
+  /* Missing output means in-place operation on the input */
+  lua_settop(L, 4);
+  if (lua_isnil(L, 3)) {
+    lua_pushvalue(L, 2);
+    lua_replace(L, 3);
+  }
+  if (!lua_isnil(L, 4)) {
+    return util_apply_view(L, ud, valid, 3, 4);
+  }
+  lua_settop(L, 3);
+  if (ud->missing != LUASGF_MISSING_ERROR) {
+    return util_apply_view(L, ud, valid, 3, 0);
+  }
+  if (util_raw_args(L, 3)) {
+    return util_apply_raw(L, ud, valid, 3);
+  }
+  if (ud->precision == LUASGF_DTYPE_DOUBLE) {
+    return util_apply_double(L, ud, valid, 3);
+  }
+  LuaSGF_Buffer *out_buf = (LuaSGF_Buffer *)luaL_testudata(L, 3, LUASGF_BUFFER_METATABLE);
+  if (out_buf == NULL) {
+    luaL_checktype(L, 3, LUA_TTABLE);
+  }
+  int in_place = lua_rawequal(L, 2, 3);
+
+  size_t len = (in_buf != NULL) ? in_buf->len : lua_rawlen(L, 2);
+  if (len < w) {
+    return luaL_error(L, "input too short (min: %d, got: %d)", (int)w, (int)len);
+  }
+
+  size_t out_len = valid ? len - w + 1 : len;
+  if (out_buf != NULL && out_buf->len != out_len) {
+    return luaL_error(L, "output buffer length mismatch (expected: %d, got: %d)",
+		      (int)out_len, (int)out_buf->len);
+  }
+
+  /* Float buffers are used directly unless input and output alias */
+  int direct_in  = (in_buf != NULL && in_buf->dtype == LUASGF_DTYPE_FLOAT && !in_place);
+  int direct_out = (out_buf != NULL && out_buf->dtype == LUASGF_DTYPE_FLOAT);
+
+  /* Staging arrays are carved from the scratch arena */
+  LuaSGF_Probe probe;
+  util_probe_start(&probe, ud);
+  size_t tmp_len = (direct_in ? 0 : len) + (direct_out ? 0 : out_len);
+  float *tmp = (float *)util_scratch_array(L, &ud->scratch, tmp_len, sizeof(float));
+  float *in_tmp  = direct_in ? NULL : tmp;
+  float *out_tmp = direct_out ? NULL : tmp + (direct_in ? 0 : len);
+
+  const float *in_data = direct_in ? (const float *)in_buf->data : in_tmp;
+  float *out_data = direct_out ? (float *)out_buf->data : out_tmp;
+
+  if (!direct_in) {
+    size_t hole = util_read_samples(L, 2, in_buf, in_tmp, len);
+    if (hole != 0) {
+      return luaL_error(L, "input table has a hole at index %d", (int)hole);
+    }
+  }
+
+  util_probe_phase(&probe, LUASGF_PHASE_READ);
+
+  /* Core calculation */
+  int rc = util_run_precision(ud, in_data, len, out_data, out_len, valid);
+  if (rc != 0) {
+    return util_run_error(L, rc, valid ? "savgol_apply_valid core execution failed"
+				 : "savgol_apply failed");
+  }
+  util_probe_phase(&probe, LUASGF_PHASE_COMPUTE);
+
+  if (!direct_out) {
+    util_write_samples(L, 3, out_buf, out_tmp, out_len);
+  }
+  util_scratch_release(&ud->scratch);
+  util_probe_finish(&probe, LUASGF_PHASE_WRITE, len);
+
+  lua_settop(L, 3);
+  return 1; /* Return the output object */
+}
+
+/**
+ * Applies the filter, writing the result into an existing table or buffer.
+ * Works like `apply`, but instead of creating a new result it overwrites `out`
+ * and returns it, so that repeated filtering of same-sized frames does not
+ * allocate. If `out` is omitted, the result is written back into `data`
+ * (in-place filtering).
+ *
+ * A table passed as `out` is overwritten from index 1 on and trimmed to the
+ * result length. A buffer passed as `out` must have exactly the result length;
+ * its element type may differ from the input.
+ *
+ * With a `view`, the input samples are selected as in `apply` and the result
+ * is written to `out` from index `out_offset` on, `out_stride` elements apart.
+ * Both default to 1, or to the input view's `offset` and `stride` when
+ * filtering in place. Other elements of `out` are left untouched and tables
+ * are not trimmed; a buffer only has to be long enough.
+ *
+ * @function SavgolFilter:apply_into
+ * @tparam table|Buffer data Input samples.
+ * @tparam[opt=data] table|Buffer out Destination for the filtered samples.
+ * @tparam[opt] table view `{offset=, count=, stride=, out_offset=, out_stride=}`.
+ * @treturn table|Buffer `out` (or `data` for in-place operation).
+ * @raise Error if the input is too short, contains holes, the output buffer
+ * length does not match, or if memory allocation fails.
+ * @usage
+ * local out = {}
+ * for frame in frames do
+ *   filter:apply_into(frame, out)  -- reuses 'out' every time
+ * end
+ * filter:apply_into(buf)           -- in-place
+ * -- left channel of interleaved stereo in place
+ * filter:apply_into(stereo, nil, {offset = 1, stride = 2})
+ */
+static int luaSGF_savgol_apply_into(lua_State *L) {
+  return util_apply_into(L, 0);
+}
+
+/**
+ * Applies the filter returning only VALID output into an existing object.
+ * The 'valid' counterpart to `apply_into`: writes
+ * `input_length - 2 * half_window` samples into `out` and returns it. For
+ * in-place operation on a table the table is shortened accordingly; buffers
+ * cannot change length and thus require a separate `out` buffer.
+ *
+ * @function SavgolFilter:apply_valid_into
+ * @tparam table|Buffer data Input samples.
+ * @tparam[opt=data] table|Buffer out Destination for the valid filtered samples.
+ * @tparam[opt] table view Input and output view, see `apply_into`.
+ * @treturn table|Buffer `out` (or `data` for in-place operation).
+ * @raise Error if the input is too short, contains holes, the output buffer
+ * length does not match, or if memory allocation fails.
+ * @usage
+ * local out = sg.buffer.new(#input - 2 * 5)
+ * filter:apply_valid_into(input, out)
+ */
+static int luaSGF_savgol_apply_valid_into(lua_State *L) {
+  return util_apply_into(L, 1);
+}
+
+/**
+ * @brief Filters one buffer (or buffer row) into another.
+ * Storage of the filter's precision is used directly, other element types
+ * are converted through work (len + out_len elements of that precision).
+ * @return 0 on success, otherwise the util_run_precision() error.
+ */
+static int util_run_view(LuaSGF_Filter *ud, const LuaSGF_Buffer *in,
+			 LuaSGF_Buffer *out, int valid, void *work) {
+  size_t esize = util_dtype_size(ud->precision);
+  int direct_in  = (in->dtype == ud->precision);
+  int direct_out = (out->dtype == ud->precision);
+  void *in_data  = direct_in ? in->data : work;
+  void *out_data = direct_out ? out->data : (char *)work + in->len * esize;
+
+  if (!direct_in) {
+    if (ud->precision == LUASGF_DTYPE_DOUBLE) {
+      util_read_samples_d(NULL, 0, in, (double *)in_data, in->len);
+    } else {
+      util_read_samples(NULL, 0, in, (float *)in_data, in->len);
+    }
+  }
+  int rc = util_run_precision(ud, in_data, in->len, out_data, out->len, valid);
+  if (rc != 0) {
+    return rc;
+  }
+  if (!direct_out) {
+    if (ud->precision == LUASGF_DTYPE_DOUBLE) {
+      util_write_samples_d(NULL, 0, out, (const double *)out_data, out->len);
+    } else {
+      util_write_samples(NULL, 0, out, (const float *)out_data, out->len);
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Batch filtering of the rows of a buffer.
+ * Stack: 1 = filter, 2 = buffer, 3 = stride (samples per row).
+ */
+static int util_apply_batch_rows(lua_State *L, LuaSGF_Filter *ud,
+				 const LuaSGF_Buffer *in, int valid) {
+  lua_Integer stride = luaL_checkinteger(L, 3);
+  size_t w = util_window_size(ud);
+
+  luaL_argcheck(L, stride > 0 && in->len % (size_t)stride == 0, 3,
+		"buffer length must be a multiple of stride");
+  if ((size_t)stride < w) {
+    return luaL_error(L, "input too short (min: %d, got: %d)", (int)w, (int)stride);
+  }
+
+  size_t rows = in->len / (size_t)stride;
+  size_t out_stride = valid ? (size_t)stride - w + 1 : (size_t)stride;
+  LuaSGF_Buffer *out = util_new_buffer(L, rows * out_stride,
+				       util_result_dtype(in->dtype, ud->precision));
+
+  size_t esize = util_dtype_size(ud->precision);
+  LuaSGF_Probe probe;
+  util_probe_start(&probe, ud);
+
+  /* Rows stored in the filter precision are distributed across the pool;
+     gaps take the per-row path, which refits the windows around them */
+  if (ud->threads > 1 && rows > 1 && in->dtype == ud->precision &&
+      ud->missing == LUASGF_MISSING_ERROR) {
+    size_t n = util_half_window(ud);
+    LuaSGF_Job job = {ud, (const char *)in->data,
+		      (char *)out->data + (valid ? 0 : util_lead(ud) * esize),
+		      (size_t)stride, out_stride, rows * ((size_t)stride - 2 * n),
+		      (size_t)stride - 2 * n, 1, NULL};
+    util_job_run(ud, &job, rows);
+
+    for (size_t r = 0; r < rows && !valid; r++) {
+      if (util_edges(ud, (const char *)in->data + r * (size_t)stride * esize,
+		     (size_t)stride, (char *)out->data + r * out_stride * esize)) {
+	return luaL_error(L, "filtering of row %d failed", (int)(r + 1));
+      }
+    }
+    util_probe_finish(&probe, LUASGF_PHASE_COMPUTE, in->len);
+    return 1;
+  }
+
+  void *work = util_scratch_array(L, &ud->scratch, (size_t)stride + out_stride, esize);
+  for (size_t r = 0; r < rows; r++) {
+    LuaSGF_Buffer in_row = util_buffer_slice(in, r * (size_t)stride, (size_t)stride);
+    LuaSGF_Buffer out_row = util_buffer_slice(out, r * out_stride, out_stride);
+    int rc = util_run_view(ud, &in_row, &out_row, valid, work);
+    if (rc != 0) {
+      return util_run_error(L, rc, "filtering of row %d failed", (int)(r + 1));
+    }
+  }
+
+  util_scratch_release(&ud->scratch);
+  util_probe_finish(&probe, LUASGF_PHASE_COMPUTE, in->len);
+  return 1;
+}
+
+/**
+ * @brief Common implementation of apply_batch() and apply_valid_batch().
+ * Stack: 1 = filter, 2 = array of channels or buffer, 3 = stride (buffer only).
+ * @param valid Non-zero to produce 'valid' output (no boundary extrapolation).
+ */
+static int util_apply_batch(lua_State *L, int valid) {
+  LuaSGF_Filter *ud = util_check_filter(L, 1);
+  LuaSGF_Buffer *rows = (LuaSGF_Buffer *)luaL_testudata(L, 2, LUASGF_BUFFER_METATABLE);
+  if (rows != NULL) {
+    return util_apply_batch_rows(L, ud, rows, valid);
+  }
+  luaL_checktype(L, 2, LUA_TTABLE);
+
+  size_t w = util_window_size(ud);
+  size_t count = lua_rawlen(L, 2);
+
+  /* First pass: validate all channels and size the shared work area */
+  size_t max_len = 0, total = 0;
+  for (size_t c = 1; c <= count; c++) {
+    lua_rawgeti(L, 2, c);
+    LuaSGF_Buffer *buf = (LuaSGF_Buffer *)luaL_testudata(L, -1, LUASGF_BUFFER_METATABLE);
+    if (buf == NULL && !lua_istable(L, -1)) {
+      return luaL_error(L, "channel %d is not a table or buffer", (int)c);
+    }
+    size_t len = (buf != NULL) ? buf->len : lua_rawlen(L, -1);
+    if (len < w) {
+      return luaL_error(L, "channel %d too short (min: %d, got: %d)",
+			(int)c, (int)w, (int)len);
+    }
+    max_len = (len > max_len) ? len : max_len;
+    total += len;
+    lua_pop(L, 1);
+  }
+
+  LuaSGF_Probe probe;
+  util_probe_start(&probe, ud);
+  size_t esize = util_dtype_size(ud->precision);
+  char *work = (char *)util_scratch_array(L, &ud->scratch, 2 * max_len, esize);
+  char *out_data = work + max_len * esize;
+
+  lua_createtable(L, (int)count, 0);
+  for (size_t c = 1; c <= count; c++) {
+    lua_rawgeti(L, 2, c);
+    LuaSGF_Buffer *buf = (LuaSGF_Buffer *)luaL_testudata(L, -1, LUASGF_BUFFER_METATABLE);
+    size_t len = (buf != NULL) ? buf->len : lua_rawlen(L, -1);
+    size_t out_len = valid ? len - w + 1 : len;
+
+    if (buf != NULL) {
+      LuaSGF_Buffer *out = util_new_buffer(L, out_len,
+					   util_result_dtype(buf->dtype, ud->precision));
+      int rc = util_run_view(ud, buf, out, valid, work);
+      if (rc != 0) {
+	return util_run_error(L, rc, "filtering of channel %d failed", (int)c);
+      }
+      util_probe_phase(&probe, LUASGF_PHASE_COMPUTE);
+    } else {
+      int idx = lua_gettop(L);
+      size_t hole = (ud->precision == LUASGF_DTYPE_DOUBLE)
+	? util_read_samples_d(L, idx, NULL, (double *)work, len)
+	: util_read_samples(L, idx, NULL, (float *)work, len);
+      if (hole != 0) {
+	return luaL_error(L, "channel %d has a hole at index %d", (int)c, (int)hole);
+      }
+      util_probe_phase(&probe, LUASGF_PHASE_READ);
+      int rc = util_run_precision(ud, work, len, out_data, out_len, valid);
+      if (rc != 0) {
+	return util_run_error(L, rc, "filtering of channel %d failed", (int)c);
+      }
+      util_probe_phase(&probe, LUASGF_PHASE_COMPUTE);
+      lua_createtable(L, (int)out_len, 0);
+      if (ud->precision == LUASGF_DTYPE_DOUBLE) {
+	util_write_samples_d(L, idx + 1, NULL, (const double *)out_data, out_len);
+      } else {
+	util_write_samples(L, idx + 1, NULL, (const float *)out_data, out_len);
+      }
+      util_probe_phase(&probe, LUASGF_PHASE_WRITE);
+    }
+    lua_rawseti(L, -3, c); /* results[c] = output */
+    lua_pop(L, 1);         /* channel */
+  }
+
+  util_scratch_release(&ud->scratch);
+  util_probe_finish(&probe, LUASGF_PHASE_WRITE, total);
+  return 1;
+}
+
+/**
+ * Applies the filter to many channels in a single call.
+ * Every channel is filtered like `apply` would, but the work area is shared
+ * and sized once for the longest channel, so hundreds of channels cost one
+ * call instead of hundreds. Channels may differ in length and type.
+ *
+ * Alternatively, a buffer holding consecutive rows of `stride` samples each
+ * (a row-major 2-D array) is filtered row by row into a new buffer of the
+ * same shape and element type.
+ *
+ * @function SavgolFilter:apply_batch
+ * @tparam table|Buffer channels Array of tables/buffers, or a 2-D buffer.
+ * @tparam[opt] int stride Samples per row, required for a 2-D buffer.
+ * @treturn table|Buffer Array of results in channel order, or a 2-D buffer.
+ * @raise Error if a channel is too short, contains holes or is no table or
+ * buffer, or if the buffer length is not a multiple of `stride`.
+ * @usage
+ * local results = filter:apply_batch({ch1, ch2, ch3})
+ * local smoothed = filter:apply_batch(matrix, 1000) -- rows of 1000 samples
+ */
+static int luaSGF_savgol_apply_batch(lua_State *L) {
+  return util_apply_batch(L, 0);
+}
+
+/**
+ * Applies the filter with VALID output to many channels in a single call.
+ * The 'valid' counterpart to `apply_batch`: each result (or output row) has
+ * `length - 2 * half_window` samples.
+ * @function SavgolFilter:apply_valid_batch
+ * @tparam table|Buffer channels Array of tables/buffers, or a 2-D buffer.
+ * @tparam[opt] int stride Samples per row, required for a 2-D buffer.
+ * @treturn table|Buffer Array of results in channel order, or a 2-D buffer
+ * with rows of `stride - 2 * half_window` samples.
+ * @raise Error as for `apply_batch`.
+ */
+static int luaSGF_savgol_apply_valid_batch(lua_State *L) {
+  return util_apply_batch(L, 1);
+}
+
+/**
+ * Direct filter calculation (Legacy API).
+ * This function can be called as `sg.calc(...)` or directly as `sg(...)`.
+ * The weights of each parameter combination are derived from the reference
+ * implementation on first use and kept in the module-wide coefficient cache,
+ * so repeated calls only run the (SIMD) filter kernels. Inputs shorter than
+ * two windows are processed by the reference implementation directly.
+ * 
  * @function calc
  * @tparam int half_window Half-window size (n).
  * @tparam int poly_order Polynomial order (m).
@@ -333,94 +3800,3057 @@ static int luaSGF_savgol_apply_valid(lua_State *L) {
  * @treturn[2] nil If an error occurs, the first return value is nil.
  * @treturn[2] string An error message describing the failure.
  * @usage
- * local sg = require("luaSGF")
- * -- Using the explicit function:
- * local result, err = sg.calc(5, 2, 0, 0, {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11})
- * 
- * -- Using the functional style (shorthand):
- * local result, err = sg(5, 2, 0, 0, my_data_table)
+ * local sg = require("luaSGF")
+ * -- Using the explicit function:
+ * local result, err = sg.calc(5, 2, 0, 0, {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11})
+ * 
+ * -- Using the functional style (shorthand):
+ * local result, err = sg(5, 2, 0, 0, my_data_table)
+ */
+static int luaSGF_calc(lua_State *L) {
+  /* 
+   * 1. Handle argument offset
+   * If called as sg(hw, poly, ...), index 1 is the table 'sg'.
+   * If called as sg.calc(hw, poly, ...), index 1 is 'hw'.
+   */
+  int offset = (lua_istable(L, 1) && lua_gettop(L) > 1) ? 1 : 0;
+
+  /* 2. Extract and validate arguments using the offset */
+  uint8_t halfWindowSize  = (uint8_t)luaL_checkinteger(L, 1 + offset);
+  uint8_t polynomialOrder = (uint8_t)luaL_checkinteger(L, 2 + offset);
+  uint8_t targetPoint     = (uint8_t)luaL_checkinteger(L, 3 + offset);
+  uint8_t derivativeOrder = (uint8_t)luaL_checkinteger(L, 4 + offset);
+  
+  /* Basic validation against your rules */
+  if (halfWindowSize < 1) {
+    lua_pushnil(L);
+    lua_pushstring(L, "Half-window size must be greater than 0.");
+    return 2;
+  }
+  if (polynomialOrder >= (uint8_t)(2 * halfWindowSize + 1)) {
+    lua_pushnil(L);
+    lua_pushstring(L, "Polynomial order must be less than the filter window size.");
+    return 2;
+  }
+  if (targetPoint > (2 * halfWindowSize)) {
+    lua_pushnil(L);
+    lua_pushstring(L, "Target point must be within the filter window.");
+    return 2;
+  }
+
+  /* 3. Validate input table (now at index 5 + offset) */
+  luaL_checktype(L, 5 + offset, LUA_TTABLE);
+  size_t dataSize = (size_t)lua_rawlen(L, 5 + offset);
+  if ((size_t)(2 * halfWindowSize + 1) > dataSize) {
+    lua_pushnil(L);
+    lua_pushstring(L, "Filter window size must not exceed data size.");
+    return 2;
+  }
+
+  /* 4. Take memory from the module-wide scratch arena (upvalue 1) */
+  LuaSGF_Scratch *scratch = (LuaSGF_Scratch *)lua_touserdata(L, lua_upvalueindex(1));
+  if (dataSize > SIZE_MAX / (2 * sizeof(MqsRawDataPoint_t)) ||
+      util_scratch_reserve(scratch, 2 * dataSize * sizeof(MqsRawDataPoint_t)) == NULL) {
+    lua_pushnil(L);
+    lua_pushstring(L, "Memory allocation failure.");
+    return 2;
+  }
+
+  /* 5. Fast path: cached weights for inputs of at least two windows */
+  size_t windowSize = (size_t)(2 * halfWindowSize + 1);
+  if (halfWindowSize <= SGF_MAX_HALF_WINDOW && dataSize >= 2 * windowSize) {
+    LuaSGF_Cache *cache = (LuaSGF_Cache *)lua_touserdata(L, lua_upvalueindex(2));
+    SgfPlanConfig key = {halfWindowSize, polynomialOrder, derivativeOrder, 1.0,
+			 SAVGOL_BOUNDARY_POLYNOMIAL, targetPoint};
+    LuaSGF_Coeffs *e = util_cache_acquire(cache, &key, LUASGF_DTYPE_FLOAT, 1, 0, NULL);
+    if (e != NULL && e->legacy->fast) {
+      float *in = (float *)scratch->ptr;
+      float *out = in + dataSize;
+      for (size_t i = 1; i <= dataSize; i++) {
+	lua_rawgeti(L, 5 + offset, (int)i);
+	in[i-1] = (float)lua_tonumber(L, -1);
+	lua_pop(L, 1);
+      }
+      util_legacy_run(e, in, dataSize, out);
+      util_cache_release(e);
+
+      lua_createtable(L, (int)dataSize, 0);
+      for (size_t i = 0; i < dataSize; i++) {
+	lua_pushnumber(L, (lua_Number)out[i]);
+	lua_rawseti(L, -2, (int)(i + 1));
+      }
+      util_scratch_release(scratch);
+      lua_pushnil(L);
+      return 2;
+    }
+    if (e != NULL) {
+      util_cache_release(e);
+    }
+  }
+
+  MqsRawDataPoint_t *rawData = (MqsRawDataPoint_t *)scratch->ptr;
+  MqsRawDataPoint_t *filteredData = rawData + dataSize;
+
+  /* 6. Reference implementation: transfer Lua table to C array */
+  for (size_t i = 1; i <= dataSize; i++) {
+    lua_rawgeti(L, 5 + offset, (int)i);
+    rawData[i-1].phaseAngle = (float)lua_tonumber(L, -1);
+    lua_pop(L, 1);
+  }
+
+  /* 7. Perform calculation */
+  int res = mes_savgolFilter(rawData, dataSize, halfWindowSize, filteredData,
+                               polynomialOrder, targetPoint, derivativeOrder);
+
+  if (res != 0) {
+    util_scratch_release(scratch);
+    lua_pushnil(L);
+    lua_pushstring(L, "Internal filter execution failed.");
+    return 2;
+  }
+
+  /* 8. Build result table (Lua 5.4 optimized) */
+  lua_createtable(L, (int)dataSize, 0);
+  for (size_t i = 0; i < dataSize; i++) {
+    lua_pushnumber(L, (lua_Number)filteredData[i].phaseAngle);
+    lua_rawseti(L, -2, (int)(i + 1));
+  }
+
+  util_scratch_release(scratch);
+  lua_pushnil(L); // No error message
+  return 2;
+}
+
+/*============================================================================
+ * RESUMABLE CALLS
+ *============================================================================*/
+static LuaSGF_Async *util_check_async(lua_State *L, int index) {
+  return (LuaSGF_Async *)luaL_checkudata(L, index, LUASGF_ASYNC_METATABLE);
+}
+
+/**
+ * @brief Frees the working memory of a resumable call and ends it.
+ */
+static void util_async_finish(LuaSGF_Async *job, int failed) {
+  free(job->in_copy);
+  free(job->out_copy);
+  job->in_copy = job->out_copy = NULL;
+  job->in = job->out = NULL;
+  job->stage = LUASGF_ASYNC_DONE;
+  job->failed |= failed;
+}
+
+/**
+ * @brief Advances a resumable call by up to budget samples of work, raising
+ * an error (and failing the call) on holes or if the filter was destroyed.
+ * Stack: index = the call.
+ */
+static void util_async_step(lua_State *L, int index, LuaSGF_Async *job, size_t budget) {
+  LuaSGF_Filter *ud = job->filter;
+  if (job->stage != LUASGF_ASYNC_DONE && ud->filter == NULL && ud->plan == NULL) {
+    util_async_finish(job, 1);
+    luaL_error(L, "filter has been destroyed");
+  }
+  size_t esize = util_dtype_size(ud->precision);
+  size_t count = job->len - 2 * util_half_window(ud);
+
+  while (budget > 0 && job->stage != LUASGF_ASYNC_DONE) {
+    size_t stage_len = (job->stage == LUASGF_ASYNC_READ) ? job->len :
+      (job->stage == LUASGF_ASYNC_COMPUTE) ? count : job->out_len;
+    size_t k = (stage_len - job->pos < budget) ? stage_len - job->pos : budget;
+    char *in = (char *)job->in + job->pos * esize;
+
+    if (job->stage == LUASGF_ASYNC_READ && job->in_copy != NULL) {
+      lua_getiuservalue(L, index, 2);
+      LuaSGF_Buffer *buf = (LuaSGF_Buffer *)luaL_testudata(L, -1, LUASGF_BUFFER_METATABLE);
+      if (buf != NULL) {
+	util_buffer_load(buf, job->pos, k, 1, ud->precision, in);
+      } else {
+	LuaSGF_View v = {job->pos, k, 1};
+	size_t hole = util_gather_table(L, lua_gettop(L), &v, ud->precision, in,
+					ud->missing != LUASGF_MISSING_ERROR);
+	if (hole != 0) {
+	  util_async_finish(job, 1);
+	  luaL_error(L, "input table has a hole at index %d", (int)hole);
+	}
+      }
+      lua_pop(L, 1);
+    } else if (job->stage == LUASGF_ASYNC_COMPUTE &&
+	       ud->missing != LUASGF_MISSING_ERROR) {
+      // Gaps change the outputs around them: in a single step
+      k = count - job->pos;
+      int rc = util_run_precision(ud, job->in, job->len, job->out, job->out_len,
+				  job->valid);
+      if (rc != 0) {
+	util_async_finish(job, 1);
+	util_run_error(L, rc, "savgol_apply failed");
+      }
+    } else if (job->stage == LUASGF_ASYNC_COMPUTE) {
+      size_t first = (job->valid ? 0 : util_lead(ud)) + job->pos;
+      util_interior_mt(ud, in, (char *)job->out + first * esize, k);
+      if (job->pos + k == count && !job->valid &&
+	  util_edges(ud, job->in, job->len, job->out)) {
+	util_async_finish(job, 1);
+	luaL_error(L, "savgol_apply failed");
+      }
+    } else if (job->stage == LUASGF_ASYNC_WRITE && job->out_copy != NULL) {
+      lua_getiuservalue(L, index, 3);
+      LuaSGF_Buffer *buf = (LuaSGF_Buffer *)luaL_testudata(L, -1, LUASGF_BUFFER_METATABLE);
+      if (buf != NULL) {
+	util_buffer_store(buf, job->pos, k, 1, ud->precision,
+			  (char *)job->out + job->pos * esize);
+      } else {
+	LuaSGF_Buffer src = {job->out_len, ud->precision, job->out, 1.0, 0.0};
+	for (size_t i = job->pos; i < job->pos + k; i++) {
+	  lua_pushnumber(L, util_buffer_get(&src, i));
+	  lua_rawseti(L, -2, (lua_Integer)i + 1);
+	}
+      }
+      lua_pop(L, 1);
+    } else {
+      // Stage without conversion
+      job->stage++;
+      continue;
+    }
+
+    job->pos += k;
+    job->done += k;
+    budget = (k < budget) ? budget - k : 0;
+    if (job->pos == stage_len) {
+      job->stage++;
+      job->pos = 0;
+    }
+  }
+  if (job->stage == LUASGF_ASYNC_DONE) {
+    util_async_finish(job, 0);
+  }
+}
+
+/**
+ * Starts a resumable filter call.
+ * The returned job computes the same output as `apply` (or `apply_valid`)
+ * in slices of about `chunk` samples: `job:step()` processes one slice and
+ * returns, so long inputs can be filtered between the requests of an event
+ * loop, and `job:run()` inside a coroutine yields after every slice. Input
+ * conversion, the interior and the output conversion are sliced alike; with
+ * `config.missing` the computation itself takes one step.
+ *
+ * The job references the filter and the data; neither should be modified
+ * before it is done.
+ *
+ * @function SavgolFilter:apply_async
+ * @tparam table|Buffer data Input samples.
+ * @tparam[opt] table options
+ * @tparam[opt=65536] int options.chunk Samples per step.
+ * @tparam[opt=false] boolean options.valid Compute the `apply_valid` output.
+ * @treturn AsyncJob The job.
+ * @raise Error if the input is too short or out of memory; holes are
+ * reported by the step that reads them.
+ * @usage
+ * local job = filter:apply_async(samples, {chunk = 100000})
+ * while not job:step() do handle_requests() end
+ * local smoothed = job:result()
+ */
+static int luaSGF_savgol_apply_async(lua_State *L) {
+  LuaSGF_Filter *ud = util_check_filter(L, 1);
+  LuaSGF_Buffer *in = (LuaSGF_Buffer *)luaL_testudata(L, 2, LUASGF_BUFFER_METATABLE);
+  if (in == NULL) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+  }
+  lua_Integer chunk = (lua_Integer)LUASGF_ASYNC_CHUNK;
+  int valid = 0;
+  if (!lua_isnoneornil(L, 3)) {
+    luaL_checktype(L, 3, LUA_TTABLE);
+    lua_getfield(L, 3, "chunk");
+    chunk = luaL_optinteger(L, -1, chunk);
+    lua_getfield(L, 3, "valid");
+    valid = lua_toboolean(L, -1);
+    lua_pop(L, 2);
+    luaL_argcheck(L, chunk > 0, 3, "chunk must be positive");
+  }
+  lua_settop(L, 2);
+
+  size_t w = util_window_size(ud);
+  size_t len = (in != NULL) ? in->len : lua_rawlen(L, 2);
+  if (len < w) {
+    return luaL_error(L, "input too short (min: %d, got: %d)", (int)w, (int)len);
+  }
+
+  LuaSGF_Async *job = (LuaSGF_Async *)lua_newuserdatauv(L, sizeof(LuaSGF_Async), 3);
+  memset(job, 0, sizeof(LuaSGF_Async));
+  job->stage = LUASGF_ASYNC_DONE;
+  job->failed = 1;
+  luaL_setmetatable(L, LUASGF_ASYNC_METATABLE);
+  lua_pushvalue(L, 1);
+  lua_setiuservalue(L, 3, 1);
+  lua_pushvalue(L, 2);
+  lua_setiuservalue(L, 3, 2);
+
+  size_t out_len = valid ? len - w + 1 : len;
+  size_t esize = util_dtype_size(ud->precision);
+  LuaSGF_Buffer *out = NULL;
+  if (in != NULL) {
+    out = util_new_buffer(L, out_len, util_result_dtype(in->dtype, ud->precision));
+  } else {
+    lua_createtable(L, (int)out_len, 0);
+  }
+  lua_setiuservalue(L, 3, 3);
+
+  if (in == NULL || in->dtype != ud->precision) {
+    job->in_copy = malloc(len * esize);
+  }
+  if (out == NULL || out->dtype != ud->precision) {
+    job->out_copy = malloc(out_len * esize);
+  }
+  if ((job->in_copy == NULL && (in == NULL || in->dtype != ud->precision)) ||
+      (job->out_copy == NULL && (out == NULL || out->dtype != ud->precision))) {
+    util_async_finish(job, 1);
+    return luaL_error(L, "memory allocation failed");
+  }
+
+  job->filter = ud;
+  job->valid = valid;
+  job->stage = LUASGF_ASYNC_READ;
+  job->failed = 0;
+  job->len = len;
+  job->out_len = out_len;
+  job->chunk = (size_t)chunk;
+  job->in = (job->in_copy != NULL) ? job->in_copy : in->data;
+  job->out = (job->out_copy != NULL) ? job->out_copy : out->data;
+  job->total = (job->in_copy != NULL ? len : 0) + (len - 2 * util_half_window(ud)) +
+    (job->out_copy != NULL ? out_len : 0);
+  return 1;
+}
+
+/**
+ * Processes the next slice of the call.
+ * @function AsyncJob:step
+ * @tparam[opt] int samples Work of this step in samples (default: the
+ * `chunk` of `apply_async`).
+ * @treturn boolean `true` once the call is done.
+ * @treturn number Progress from 0 to 1.
+ * @raise Error if the input has holes or the filter has been destroyed; the
+ * job is failed afterwards.
+ */
+static int luaSGF_async_step(lua_State *L) {
+  LuaSGF_Async *job = util_check_async(L, 1);
+  lua_Integer samples = luaL_optinteger(L, 2, (lua_Integer)job->chunk);
+  luaL_argcheck(L, samples > 0, 2, "samples must be positive");
+  lua_settop(L, 1);
+  util_async_step(L, 1, job, (size_t)samples);
+  lua_pushboolean(L, job->stage == LUASGF_ASYNC_DONE);
+  lua_pushnumber(L, (job->stage == LUASGF_ASYNC_DONE) ? 1.0 :
+		 (lua_Number)job->done / (lua_Number)job->total);
+  return 2;
+}
+
+/**
+ * @brief Continuation of AsyncJob:run(), stepping until done and yielding
+ * the progress between steps when possible.
+ */
+static int util_async_run_k(lua_State *L, int status, lua_KContext ctx) {
+  (void)status;
+  (void)ctx;
+  lua_settop(L, 1);
+  LuaSGF_Async *job = util_check_async(L, 1);
+  while (job->stage != LUASGF_ASYNC_DONE) {
+    util_async_step(L, 1, job, job->chunk);
+    if (job->stage != LUASGF_ASYNC_DONE && lua_isyieldable(L)) {
+      lua_pushnumber(L, (lua_Number)job->done / (lua_Number)job->total);
+      return lua_yieldk(L, 1, 0, util_async_run_k);
+    }
+  }
+  if (job->failed) {
+    return luaL_error(L, "job has failed or was cancelled");
+  }
+  lua_getiuservalue(L, 1, 3);
+  return 1;
+}
+
+/**
+ * Runs the call to completion.
+ * Inside a coroutine, the coroutine yields the progress (0 to 1) after each
+ * step and continues on the next resume; elsewhere all steps run at once.
+ * @function AsyncJob:run
+ * @treturn table|Buffer The result, as `apply` would return it.
+ * @raise Error as for `step`, or if the job has failed.
+ * @usage
+ * local co = coroutine.wrap(function() return filter:apply_async(data):run() end)
+ * local r = co()
+ * while type(r) == "number" do scheduler_tick(); r = co() end
+ */
+static int luaSGF_async_run(lua_State *L) {
+  return util_async_run_k(L, LUA_OK, 0);
+}
+
+/**
+ * Returns the result of a completed call.
+ * @function AsyncJob:result
+ * @treturn table|Buffer|nil The result, or nil while the call is not done
+ * or if it has failed.
+ */
+static int luaSGF_async_result(lua_State *L) {
+  LuaSGF_Async *job = util_check_async(L, 1);
+  if (job->stage != LUASGF_ASYNC_DONE || job->failed) {
+    lua_pushnil(L);
+    return 1;
+  }
+  lua_getiuservalue(L, 1, 3);
+  return 1;
+}
+
+/**
+ * Cancels the call and frees its working memory.
+ * Also invoked by the garbage collector.
+ * @function AsyncJob:cancel
+ */
+static int luaSGF_async_cancel(lua_State *L) {
+  LuaSGF_Async *job = util_check_async(L, 1);
+  util_async_finish(job, job->stage != LUASGF_ASYNC_DONE);
+  return 0;
+}
+
+/*============================================================================
+ * BACKGROUND CALLS
+ *============================================================================*/
+static LuaSGF_Submit *util_check_submit(lua_State *L, int index) {
+  return (LuaSGF_Submit *)luaL_checkudata(L, index, LUASGF_SUBMIT_METATABLE);
+}
+
+static void util_submit_task(void *arg, size_t task) {
+  LuaSGF_Submit *job = (LuaSGF_Submit *)arg;
+  (void)task;
+  job->rc = util_run_precision(&job->work, job->in, job->len, job->out, job->out_len,
+			       job->valid);
+}
+
+/**
+ * @brief Frees the working memory and the coefficient reference of a call
+ * that is done or was never queued. Runs on the Lua thread, which owns the
+ * coefficient cache.
+ */
+static void util_submit_finish(LuaSGF_Submit *job) {
+  free(job->in_copy);
+  free(job->out_copy);
+  job->in_copy = job->out_copy = NULL;
+  job->in = job->out = NULL;
+  if (job->work.coeffs != NULL) {
+    util_filter_release(&job->work);
+  }
+  job->finished = 1;
+}
+
+/**
+ * @brief Pushes the result of a call that is done, converting it on first
+ * use. Stack: index = the call.
+ */
+static void util_submit_result(lua_State *L, int index, LuaSGF_Submit *job) {
+  if (!job->finished) {
+    if (job->rc != 0) {
+      util_submit_finish(job);
+      util_run_error(L, job->rc, "savgol_apply failed");
+    }
+    if (job->out_copy != NULL) {
+      lua_getiuservalue(L, index, 2);
+      LuaSGF_Buffer *buf = (LuaSGF_Buffer *)luaL_testudata(L, -1, LUASGF_BUFFER_METATABLE);
+      if (buf != NULL) {
+	util_buffer_store(buf, 0, job->out_len, 1, job->work.precision, job->out);
+      } else {
+	LuaSGF_Buffer src = {job->out_len, job->work.precision, job->out, 1.0, 0.0};
+	for (size_t i = 0; i < job->out_len; i++) {
+	  lua_pushnumber(L, util_buffer_get(&src, i));
+	  lua_rawseti(L, -2, (lua_Integer)i + 1);
+	}
+      }
+      lua_pop(L, 1);
+    }
+    util_submit_finish(job);
+  }
+  if (job->rc != 0) {
+    util_run_error(L, job->rc, "savgol_apply failed");
+  }
+  lua_getiuservalue(L, index, 2);
+}
+
+/**
+ * Filters data on a background thread.
+ * The call computes the same output as `apply` (or `apply_valid`) on one of
+ * the module's background threads (up to one per processor) and returns a
+ * handle at once, so several calls can keep as many cores busy while the
+ * Lua thread goes on, e.g. with I/O. Buffers of the filter precision are
+ * used in place, so they must not be modified until the call is done; other
+ * buffers and tables are copied first.
+ *
+ * The call has its own reference to the coefficients: destroying the filter
+ * does not affect it. Handles collected before the result was fetched wait
+ * for the call to finish (or remove it from the queue).
+ *
+ * @function SavgolFilter:submit
+ * @tparam table|Buffer data Input samples.
+ * @tparam[opt] table options
+ * @tparam[opt=false] boolean options.valid Compute the `apply_valid` output.
+ * @treturn Submitted The call handle.
+ * @raise Error if the input is too short or contains holes (`nil`), or if
+ * memory allocation fails.
+ * @usage
+ * local jobs = {}
+ * for i, channel in ipairs(channels) do jobs[i] = filter:submit(channel) end
+ * for i, job in ipairs(jobs) do save(i, job:wait()) end
+ */
+static int luaSGF_savgol_submit(lua_State *L) {
+  LuaSGF_Filter *ud = util_check_filter(L, 1);
+  LuaSGF_Buffer *in = (LuaSGF_Buffer *)luaL_testudata(L, 2, LUASGF_BUFFER_METATABLE);
+  if (in == NULL) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+  }
+  int valid = 0;
+  if (!lua_isnoneornil(L, 3)) {
+    luaL_checktype(L, 3, LUA_TTABLE);
+    lua_getfield(L, 3, "valid");
+    valid = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+  }
+  lua_settop(L, 2);
+
+  size_t w = util_window_size(ud);
+  size_t len = (in != NULL) ? in->len : lua_rawlen(L, 2);
+  if (len < w) {
+    return luaL_error(L, "input too short (min: %d, got: %d)", (int)w, (int)len);
+  }
+
+  LuaSGF_Submit *job = (LuaSGF_Submit *)lua_newuserdatauv(L, sizeof(LuaSGF_Submit), 2);
+  memset(job, 0, sizeof(LuaSGF_Submit));
+  job->finished = 1;
+  luaL_setmetatable(L, LUASGF_SUBMIT_METATABLE);
+  lua_pushvalue(L, 2);
+  lua_setiuservalue(L, 3, 1);
+
+  size_t out_len = valid ? len - w + 1 : len;
+  size_t esize = util_dtype_size(ud->precision);
+  LuaSGF_Buffer *out = NULL;
+  if (in != NULL) {
+    out = util_new_buffer(L, out_len, util_result_dtype(in->dtype, ud->precision));
+  } else {
+    lua_createtable(L, (int)out_len, 0);
+  }
+  lua_setiuservalue(L, 3, 2);
+
+  int copy_in = (in == NULL || in->dtype != ud->precision);
+  int copy_out = (out == NULL || out->dtype != ud->precision);
+  job->in_copy = copy_in ? malloc(len * esize) : NULL;
+  job->out_copy = copy_out ? malloc(out_len * esize) : NULL;
+  if ((copy_in && job->in_copy == NULL) || (copy_out && job->out_copy == NULL)) {
+    util_submit_finish(job);
+    return luaL_error(L, "memory allocation failed");
+  }
+  if (in != NULL) {
+    if (copy_in) {
+      util_buffer_load(in, 0, len, 1, ud->precision, job->in_copy);
+    }
+  } else {
+    LuaSGF_View v = {0, len, 1};
+    size_t hole = util_gather_table(L, 2, &v, ud->precision, job->in_copy,
+				    ud->missing != LUASGF_MISSING_ERROR);
+    if (hole != 0) {
+      util_submit_finish(job);
+      return luaL_error(L, "input table has a hole at index %d", (int)hole);
+    }
+  }
+
+  job->work = *ud;
+  job->work.coeffs->refs++;
+  job->work.stats = 0;
+  job->work.monitor = NULL;
+  util_scratch_init(&job->work.scratch, 0);
+  util_scratch_init(&job->work.fft_work, 0);
+  util_scratch_init(&job->work.gap_work, 0);
+  job->valid = valid;
+  job->len = len;
+  job->out_len = out_len;
+  job->in = copy_in ? job->in_copy : in->data;
+  job->out = copy_out ? job->out_copy : out->data;
+  job->finished = 0;
+  sgf_post_submit(&job->post, util_submit_task, job);
+  return 1;
+}
+
+/**
+ * Tells whether the call is done.
+ * @function Submitted:ready
+ * @treturn boolean `true` once `result` returns without waiting.
+ */
+static int luaSGF_submit_ready(lua_State *L) {
+  LuaSGF_Submit *job = util_check_submit(L, 1);
+  lua_pushboolean(L, job->finished || sgf_post_state(&job->post) == SGF_POST_DONE);
+  return 1;
+}
+
+/**
+ * Waits for the call to finish and returns its result.
+ * @function Submitted:wait
+ * @treturn table|Buffer The result, as `apply` would return it.
+ * @raise Error if the filter failed.
+ */
+static int luaSGF_submit_wait(lua_State *L) {
+  LuaSGF_Submit *job = util_check_submit(L, 1);
+  if (!job->finished) {
+    sgf_post_wait(&job->post);
+  }
+  util_submit_result(L, 1, job);
+  return 1;
+}
+
+/**
+ * Returns the result if the call is done, without waiting.
+ * @function Submitted:result
+ * @treturn table|Buffer|nil The result, or nil while the call is running.
+ * @raise Error if the filter failed.
+ */
+static int luaSGF_submit_result(lua_State *L) {
+  LuaSGF_Submit *job = util_check_submit(L, 1);
+  if (!job->finished && sgf_post_state(&job->post) != SGF_POST_DONE) {
+    lua_pushnil(L);
+    return 1;
+  }
+  util_submit_result(L, 1, job);
+  return 1;
+}
+
+static int luaSGF_submit_gc(lua_State *L) {
+  LuaSGF_Submit *job = util_check_submit(L, 1);
+  if (!job->finished) {
+    if (!sgf_post_cancel(&job->post)) {
+      sgf_post_wait(&job->post);
+    }
+    util_submit_finish(job);
+  }
+  return 0;
+}
+
+/*============================================================================
+ * FILES
+ *============================================================================*/
+// Mappings of one apply_file() call, unmapped by __gc if the call fails
+typedef struct {
+  SgfMap *in, *out;
+} LuaSGF_FileMaps;
+
+static int luaSGF_filemaps_gc(lua_State *L) {
+  LuaSGF_FileMaps *maps = (LuaSGF_FileMaps *)luaL_checkudata(L, 1, LUASGF_FILEMAPS_METATABLE);
+  if (maps->in != NULL) {
+    sgf_map_close(maps->in);
+    maps->in = NULL;
+  }
+  if (maps->out != NULL) {
+    sgf_map_close(maps->out);
+    maps->out = NULL;
+  }
+  return 0;
+}
+
+/**
+ * Filters a raw sample file into another file.
+ * Both files are memory-mapped, so their size is only limited by the address
+ * space and not by the Lua heap. The input holds samples of one of the
+ * buffer element types in native byte order (e.g. raw `int16` ADC counts,
+ * converted chunk by chunk), optionally behind a header of `offset` bytes, with
+ * `channels` interleaved channels. Each channel is filtered like `apply`
+ * (or `apply_valid`) would: the signal is processed in chunks whose windows
+ * overlap across the seams, and boundary handling only applies at the file
+ * ends.
+ *
+ * The output file is created (or truncated) and holds the filtered samples
+ * in the same channel layout, without the header, as `float` or `double`
+ * like the input, or in the filter precision for raw input types.
+ *
+ * @function apply_file
+ * @tparam SavgolFilter filter Filter created by `new`.
+ * @tparam string in_path Input file.
+ * @tparam string out_path Output file, must not be the input file (also
+ * not through a link).
+ * @tparam[opt] table options
+ * - `dtype` (`"float"`): element type of the input samples, see `buffer.new`.
+ * - `scale` (`1`), `bias` (`0`): raw types only, a stored sample `s`
+ *   represents `s * scale + bias`.
+ * - `out_dtype`: element type of the output; raw output types are stored
+ *   with the `scale` and `bias` of the input, rounded and saturated.
+ * - `offset` (`0`): bytes to skip at the beginning of the input, a
+ *   multiple of the element size.
+ * - `channels` (`1`): number of interleaved channels.
+ * - `valid` (`false`): write 'valid' output (`frames - 2 * half_window`
+ *   frames per channel) like `apply_valid`.
+ * @treturn integer Number of frames (samples per channel) written.
+ * @raise Error if a file cannot be mapped, the input size does not fit the
+ * layout, a channel is shorter than the filter window, if the filter handles
+ * missing samples, or if memory allocation fails.
+ * @usage
+ * local f = sg.new({half_window = 16, poly_order = 3})
+ * sg.apply_file(f, "run42.f32", "run42_smooth.f32", {channels = 4})
+ * sg.apply_file(f, "adc.raw", "adc_volts.f32", {dtype = "int16", scale = 10 / 32768})
+ */
+static int luaSGF_apply_file(lua_State *L) {
+  LuaSGF_Filter *ud = util_check_filter(L, 1);
+  const char *in_path = luaL_checkstring(L, 2);
+  const char *out_path = luaL_checkstring(L, 3);
+  util_check_dense(L, 1, ud->missing, "apply_file");
+
+  LuaSGF_DType dtype = LUASGF_DTYPE_FLOAT;
+  LuaSGF_DType out_dtype = LUASGF_DTYPE_FLOAT;
+  lua_Integer offset = 0, channels = 1;
+  double scale = 1.0, bias = 0.0;
+  int valid = 0;
+  if (!lua_isnoneornil(L, 4)) {
+    luaL_checktype(L, 4, LUA_TTABLE);
+    dtype = (LuaSGF_DType)util_opt_field_option(L, 4, "dtype", "float", luaSGF_dtype_names);
+    out_dtype = util_result_dtype(dtype, ud->precision);
+    out_dtype = (LuaSGF_DType)util_opt_field_option(L, 4, "out_dtype",
+						    luaSGF_dtype_names[out_dtype],
+						    luaSGF_dtype_names);
+    lua_getfield(L, 4, "offset");
+    offset = luaL_optinteger(L, -1, 0);
+    lua_getfield(L, 4, "channels");
+    channels = luaL_optinteger(L, -1, 1);
+    lua_getfield(L, 4, "valid");
+    valid = lua_toboolean(L, -1);
+    lua_getfield(L, 4, "scale");
+    scale = (double)luaL_optnumber(L, -1, 1.0);
+    lua_getfield(L, 4, "bias");
+    bias = (double)luaL_optnumber(L, -1, 0.0);
+    lua_pop(L, 5);
+    luaL_argcheck(L, offset >= 0, 4, "offset must not be negative");
+    luaL_argcheck(L, (size_t)offset % util_dtype_size(dtype) == 0, 4,
+		  "offset must be a multiple of the sample size");
+    luaL_argcheck(L, channels >= 1, 4, "channels must be positive");
+    luaL_argcheck(L, scale != 0.0 && isfinite(scale) && isfinite(bias), 4,
+		  "scale must be finite and non-zero, bias finite");
+    luaL_argcheck(L, (scale == 1.0 && bias == 0.0) || util_dtype_raw(dtype), 4,
+		  "scale and bias require an integer or float16 dtype");
+  }
+  lua_settop(L, 3);
+
+  LuaSGF_FileMaps *maps = (LuaSGF_FileMaps *)lua_newuserdatauv(L, sizeof(LuaSGF_FileMaps), 0);
+  maps->in = maps->out = NULL;
+  luaL_setmetatable(L, LUASGF_FILEMAPS_METATABLE);
+
+  maps->in = sgf_map_open(in_path, 0, 0);
+  if (maps->in == NULL) {
+    return luaL_error(L, "cannot map input file '%s'", in_path);
+  }
+  /* Checked on the open input, so links and other spellings of its path
+     are caught before the output is truncated */
+  luaL_argcheck(L, !sgf_map_same_file(maps->in, out_path), 3,
+		"output file must differ from the input");
+  size_t size = sgf_map_size(maps->in);
+  size_t frame = (size_t)channels * util_dtype_size(dtype);
+  size_t out_frame = (size_t)channels * util_dtype_size(out_dtype);
+  if ((size_t)offset > size || (size - (size_t)offset) % frame != 0) {
+    return luaL_error(L, "input file size does not match the layout (%I bytes)",
+		      (lua_Integer)size);
+  }
+  size_t frames = (size - (size_t)offset) / frame;
+  size_t w = util_window_size(ud);
+  if (frames < w) {
+    return luaL_error(L, "input file too short (min: %d frames, got: %I)",
+		      (int)w, (lua_Integer)frames);
+  }
+  size_t out_frames = valid ? frames - w + 1 : frames;
+
+  maps->out = sgf_map_open(out_path, out_frames * out_frame, 1);
+  if (maps->out == NULL) {
+    return luaL_error(L, "cannot create output file '%s'", out_path);
+  }
+  /* Raw outputs are stored with the scale of the input */
+  LuaSGF_Buffer in = {frames * (size_t)channels, dtype,
+		      (char *)sgf_map_data(maps->in) + offset, scale, bias};
+  LuaSGF_Buffer out = {out_frames * (size_t)channels, out_dtype, sgf_map_data(maps->out),
+		       scale, bias};
+
+  size_t n = util_half_window(ud);
+  size_t chunk = LUASGF_FILE_CHUNK;
+  if ((size_t)ud->threads * LUASGF_THREAD_CHUNK > chunk) {
+    chunk = (size_t)ud->threads * LUASGF_THREAD_CHUNK;
+  }
+  int direct = (channels == 1 && dtype == ud->precision && out_dtype == ud->precision);
+
+  LuaSGF_Probe probe;
+  util_probe_start(&probe, ud);
+  void *work = util_scratch_array(L, &ud->scratch,
+				  (direct ? 0 : 2 * chunk + 2 * n) + 4 * w,
+				  util_dtype_size(ud->precision));
+  size_t failed = util_run_interleaved(ud, &in, &out, (size_t)channels, valid, chunk, work);
+  if (failed != 0) {
+    return luaL_error(L, "filtering of channel %d failed", (int)failed);
+  }
+  util_scratch_release(&ud->scratch);
+  util_probe_finish(&probe, LUASGF_PHASE_COMPUTE, frames * (size_t)channels);
+
+  int closed = sgf_map_close(maps->out);
+  maps->out = NULL;
+  sgf_map_close(maps->in);
+  maps->in = NULL;
+  if (closed != 0) {
+    return luaL_error(L, "cannot write output file '%s'", out_path);
+  }
+  lua_pushinteger(L, (lua_Integer)out_frames);
+  return 1;
+}
+
+/*============================================================================
+ * DECIMATION
+ *============================================================================*/
+/**
+ * @brief Filters x (len >= window size, filter precision) at the output
+ * positions phase, phase + k, ... only and writes them to y.
+ * The boundary outputs are taken from the first and last window pair
+ * (compressed to 2w samples like apply_file()).
+ * @param work 4 * window size elements of the filter precision.
+ * @return Non-zero on failure.
+ */
+static int util_decimate_run(LuaSGF_Filter *ud, const void *x, size_t len, size_t k,
+			     size_t phase, void *y, void *work) {
+  size_t w = util_window_size(ud);
+  size_t lead = util_lead(ud), trail = 2 * util_half_window(ud) - lead;
+  size_t esize = util_dtype_size(ud->precision);
+  size_t count = (len > phase) ? (len - phase + k - 1) / k : 0;
+  size_t elen = (len < 2 * w) ? len : 2 * w;
+  char *ex = (char *)work;
+  char *ey = ex + 2 * w * esize;
+
+  /* Windows of the boundary outputs */
+  const char *edge = (const char *)x;
+  if (elen < len) {
+    memcpy(ex, x, w * esize);
+    memcpy(ex + w * esize, (const char *)x + (len - w) * esize, w * esize);
+    edge = ex;
+  }
+  if (util_edges(ud, edge, elen, ey)) {
+    return 1;
+  }
+
+  /* Retained outputs [first, last) lie in the interior */
+  size_t first = (phase >= lead) ? 0 : (lead - phase + k - 1) / k;
+  size_t last = (len - trail > phase) ? (len - trail - phase + k - 1) / k : 0;
+  if (first > last) {
+    first = last;
+  }
+  for (size_t i = 0; i < count; i++) {
+    size_t p = phase + i * k;
+    if (p < lead) {
+      memcpy((char *)y + i * esize, ey + p * esize, esize);
+    } else if (p >= len - trail) {
+      memcpy((char *)y + i * esize, ey + (elen - (len - p)) * esize, esize);
+    }
+  }
+  if (first < last) {
+    size_t start = phase + first * k - lead;  // window of output 'first'
+    if (ud->precision == LUASGF_DTYPE_DOUBLE) {
+      sgf_interior_strided_d(ud->plan->weights, (int)w, (const double *)x + start, k,
+			     (double *)y + first, last - first);
+    } else {
+      sgf_interior_strided_f(ud->weights, (int)w, (const float *)x + start, k,
+			     (float *)y + first, last - first);
+    }
+  }
+  return 0;
+}
+
+/**
+ * Applies the filter and keeps every k-th output only.
+ * Same result as taking elements `phase + 1`, `phase + 1 + k`, ... of
+ * `filter:apply(data)`, but only the retained outputs are computed: the
+ * interior costs k times fewer convolutions and no full-length result is
+ * built. Retained boundary outputs follow the boundary mode as usual.
+ * Filters handling missing samples compute the full result first, since
+ * every gap changes the windows around it.
+ * @function SavgolFilter:apply_decimated
+ * @tparam table|Buffer data Input samples.
+ * @tparam int k Decimation factor (1 = every output).
+ * @tparam[opt=0] int phase Offset of the first retained output, 0 to k - 1.
+ * @treturn table|Buffer `ceil((#data - phase) / k)` outputs; a buffer of the
+ * input element type for buffer input.
+ * @raise Error if the input is shorter than the window, has holes, or if k
+ * or phase are out of range.
+ * @usage
+ * -- smooth and downsample 1 kHz data to 100 Hz
+ * local slow = filter:apply_decimated(fast, 10)
+ */
+static int luaSGF_savgol_apply_decimated(lua_State *L) {
+  LuaSGF_Filter *ud = util_check_filter(L, 1);
+  LuaSGF_Buffer *in_buf = (LuaSGF_Buffer *)luaL_testudata(L, 2, LUASGF_BUFFER_METATABLE);
+  if (in_buf == NULL) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+  }
+  lua_Integer k = luaL_checkinteger(L, 3);
+  lua_Integer phase = luaL_optinteger(L, 4, 0);
+  luaL_argcheck(L, k >= 1, 3, "decimation factor must be positive");
+  luaL_argcheck(L, phase >= 0 && phase < k, 4, "phase must be within [0, k)");
+  lua_settop(L, 2);
+
+  size_t len = (in_buf != NULL) ? in_buf->len : lua_rawlen(L, 2);
+  size_t w = util_window_size(ud);
+  if (len < w) {
+    return luaL_error(L, "input too short (min: %d, got: %d)", (int)w, (int)len);
+  }
+  size_t out_len = (len > (size_t)phase) ? (len - (size_t)phase + (size_t)k - 1) / (size_t)k
+    : 0;
+
+  LuaSGF_Buffer *out_buf = NULL;
+  if (in_buf != NULL) {
+    out_buf = util_new_buffer(L, out_len, util_result_dtype(in_buf->dtype, ud->precision));
+  } else {
+    lua_createtable(L, (int)out_len, 0);
+  }
+
+  size_t esize = util_dtype_size(ud->precision);
+  int direct_in  = (in_buf != NULL && in_buf->dtype == ud->precision);
+  int direct_out = (out_buf != NULL && out_buf->dtype == ud->precision);
+
+  /* Gaps move the outputs of every window they touch, so filters handling
+     missing samples compute the full result and pick the retained outputs */
+  int gaps = (ud->missing != LUASGF_MISSING_ERROR);
+  size_t work_len = gaps ? len : 4 * w;
+
+  LuaSGF_Probe probe;
+  util_probe_start(&probe, ud);
+  size_t tmp_len = (direct_in ? 0 : len) + (direct_out ? 0 : out_len) + work_len;
+  char *tmp = (char *)util_scratch_array(L, &ud->scratch, tmp_len, esize);
+  void *in_data  = direct_in ? in_buf->data : tmp;
+  void *out_data = direct_out ? out_buf->data : tmp + (direct_in ? 0 : len) * esize;
+  char *work = tmp + (tmp_len - work_len) * esize;
+
+  if (!direct_in) {
+    LuaSGF_View all = {0, len, 1};
+    size_t hole = (in_buf == NULL)
+      ? util_gather_table(L, 2, &all, ud->precision, in_data, gaps)
+      : util_gather(L, 2, in_buf, &all, ud->precision, in_data);
+    if (hole != 0) {
+      return luaL_error(L, "input table has a hole at index %d", (int)hole);
+    }
+  }
+  util_probe_phase(&probe, LUASGF_PHASE_READ);
+
+  if (gaps) {
+    int rc = util_run_precision(ud, in_data, len, work, len, 0);
+    if (rc != 0) {
+      return util_run_error(L, rc, "savgol_apply failed");
+    }
+    for (size_t i = 0; i < out_len; i++) {
+      memcpy((char *)out_data + i * esize, work + ((size_t)phase + i * (size_t)k) * esize,
+	     esize);
+    }
+  } else if (util_decimate_run(ud, in_data, len, (size_t)k, (size_t)phase, out_data, work)) {
+    return luaL_error(L, "savgol_apply failed");
+  }
+  util_probe_phase(&probe, LUASGF_PHASE_COMPUTE);
+
+  if (!direct_out) {
+    LuaSGF_View all = {0, out_len, 1};
+    util_scatter(L, 3, out_buf, &all, ud->precision, out_data);
+  }
+  util_scratch_release(&ud->scratch);
+  util_probe_finish(&probe, LUASGF_PHASE_WRITE, len);
+  return 1;
+}
+
+/*============================================================================
+ * IRREGULAR SAMPLING
+ *============================================================================*/
+/*
+ * apply_irregular() fits every window against its actual timestamps. Windows
+ * that are uniform within LUASGF_UNIFORM_TOL of their mean spacing use the
+ * precomputed weights of the filter; the others are looked up in a small
+ * per-call cache keyed by the quantized, normalized window shape, so
+ * repeating jitter patterns are only fitted once.
+ */
+
+// Relative deviation from the mean spacing still treated as uniform
+#define LUASGF_UNIFORM_TOL 1e-6
+// Direct-mapped cache slots for non-uniform window shapes
+#define LUASGF_PATTERN_SLOTS 128
+// Quantization of normalized timestamps in the pattern keys (2^-32)
+#define LUASGF_PATTERN_SCALE 4294967296.0
+
+// Pattern cache slot; its key (w + 1 integers) and weights (w) are stored
+// in separate arrays of the work memory
+typedef struct {
+  int used;
+  uint64_t hash;
+} LuaSGF_PatternSlot;
+
+/**
+ * @brief Weights of all window positions (W rows of W) for unit spacing,
+ * computed on first use and kept with the coefficients.
+ * @return NULL if out of memory.
+ */
+static const double *util_uniform_rows(LuaSGF_Coeffs *e) {
+  if (e->uniform == NULL) {
+    int w = 2 * e->key.half_window + 1;
+    double *rows = (double *)malloc((size_t)w * w * sizeof(double));
+    if (rows == NULL) {
+      return NULL;
+    }
+    for (int p = 0; p < w; p++) {
+      if (sgf_weights(w, p, e->key.poly_order, e->key.derivative, rows + (size_t)p * w)) {
+	free(rows);
+	return NULL;
+      }
+    }
+    e->uniform = rows;
+  }
+  return e->uniform;
+}
+
+/**
+ * @brief Filters samples y taken at increasing timestamps t (len >= w).
+ * Output k is the fit of the window starting at k - lead (shifted inwards at
+ * the ends) evaluated at t[k].
+ * @param work util_irregular_work() bytes, 8-byte aligned.
+ * @return 0 on success, otherwise the 1-based index of the first output
+ * whose fit failed.
+ */
+static size_t util_run_irregular(const LuaSGF_Coeffs *e, const double *uniform,
+				 const double *t, const double *y, size_t len, double *out,
+				 void *work) {
+  int n = e->key.half_window, m = e->key.poly_order, d = e->key.derivative;
+  size_t w = 2 * (size_t)n + 1;
+  size_t lead = (size_t)(n + e->key.target_point);
+
+  LuaSGF_PatternSlot *slots = (LuaSGF_PatternSlot *)work;
+  int64_t *keys = (int64_t *)(slots + LUASGF_PATTERN_SLOTS);
+  double *cached = (double *)(keys + LUASGF_PATTERN_SLOTS * (w + 1));
+  double *u = cached + LUASGF_PATTERN_SLOTS * w;
+  double *fit = u + w;
+  int64_t key[2 * SGF_MAX_HALF_WINDOW + 2];
+  memset(slots, 0, LUASGF_PATTERN_SLOTS * sizeof(LuaSGF_PatternSlot));
+
+  for (size_t k = 0; k < len; k++) {
+    size_t s = (k < lead) ? 0 : k - lead;
+    if (s > len - w) {
+      s = len - w;
+    }
+    size_t p = k - s;
+    const double *x = t + s;
+    double span = x[w - 1] - x[0];
+    double h = span / (double)(w - 1);
+    if (!(h > 0.0)) {
+      return k + 1;
+    }
+
+    /* Near-uniform windows: precomputed weights, scaled to the spacing */
+    int uniform_window = 1;
+    for (size_t j = 1; j + 1 < w && uniform_window; j++) {
+      uniform_window = fabs(x[j] - x[0] - (double)j * h) <= LUASGF_UNIFORM_TOL * h;
+    }
+    const double *wt;
+    double scale;
+    if (uniform_window) {
+      wt = uniform + p * w;
+      scale = pow(h, -d);
+    } else {
+      /* Normalized shape: u_j in [0, 1] plus the evaluated position */
+      uint64_t hash = 1469598103934665603u ^ p;
+      for (size_t j = 0; j < w; j++) {
+	u[j] = (x[j] - x[0]) / span;
+	key[j] = (int64_t)llround(u[j] * LUASGF_PATTERN_SCALE);
+	hash = (hash ^ (uint64_t)key[j]) * 1099511628211u;
+      }
+      key[w] = (int64_t)p;
+
+      size_t slot = (size_t)(hash % LUASGF_PATTERN_SLOTS);
+      int64_t *slot_key = keys + slot * (w + 1);
+      wt = cached + slot * w;
+      if (!slots[slot].used || slots[slot].hash != hash ||
+	  memcmp(slot_key, key, (w + 1) * sizeof(int64_t)) != 0) {
+	if (sgf_weights_at(u, (int)w, u[p], m, d, cached + slot * w, fit) != 0) {
+	  return k + 1;
+	}
+	memcpy(slot_key, key, (w + 1) * sizeof(int64_t));
+	slots[slot].used = 1;
+	slots[slot].hash = hash;
+      }
+      scale = pow(span, -d);
+    }
+
+    double acc = 0.0;
+    for (size_t j = 0; j < w; j++) {
+      acc += wt[j] * y[s + j];
+    }
+    out[k] = acc * scale;
+  }
+  return 0;
+}
+
+/**
+ * @brief Bytes of work memory needed by util_run_irregular().
+ */
+static size_t util_irregular_work(const LuaSGF_Coeffs *e) {
+  size_t w = 2 * (size_t)e->key.half_window + 1;
+  return LUASGF_PATTERN_SLOTS * (sizeof(LuaSGF_PatternSlot) + (w + 1) * sizeof(int64_t) +
+				 w * sizeof(double)) +
+    (w + SGF_WEIGHTS_WORK(w, e->key.poly_order)) * sizeof(double);
+}
+
+/**
+ * Applies the filter to samples with non-uniform timestamps.
+ * Every output is the polynomial fitted by least squares to the window's
+ * actual timestamps, evaluated at the output's own timestamp, so jittered or
+ * irregularly sampled data needs no resampling first. Windows with uniform
+ * spacing (within a relative 1e-6) use the filter's precomputed weights.
+ *
+ * Derivatives are per unit of `t`; `time_step` is not used. At both ends the
+ * window is shifted inwards like the polynomial boundary mode, regardless of
+ * the filter's `boundary`. The computation is done in double precision.
+ *
+ * @function SavgolFilter:apply_irregular
+ * @tparam table|Buffer t Strictly increasing timestamps.
+ * @tparam table|Buffer y Samples, same length as `t`.
+ * @treturn table|Buffer A new table (or buffer of the element type of `y`)
+ * with one output per sample.
+ * @raise Error if the lengths differ, the input is shorter than the filter
+ * window, contains holes, the timestamps are not increasing, or if memory
+ * allocation fails.
+ * @usage
+ * local t, y = read_log()            -- jittered sample times
+ * local velocity = sg.new({half_window = 6, poly_order = 2, derivative = 1})
+ *   :apply_irregular(t, y)           -- units of y per unit of t
+ */
+static int luaSGF_savgol_apply_irregular(lua_State *L) {
+  LuaSGF_Filter *ud = util_check_filter(L, 1);
+  LuaSGF_Buffer *t_buf = (LuaSGF_Buffer *)luaL_testudata(L, 2, LUASGF_BUFFER_METATABLE);
+  if (t_buf == NULL) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+  }
+  LuaSGF_Buffer *y_buf = (LuaSGF_Buffer *)luaL_testudata(L, 3, LUASGF_BUFFER_METATABLE);
+  if (y_buf == NULL) {
+    luaL_checktype(L, 3, LUA_TTABLE);
+  }
+  lua_settop(L, 3);
+
+  size_t len = (y_buf != NULL) ? y_buf->len : lua_rawlen(L, 3);
+  size_t t_len = (t_buf != NULL) ? t_buf->len : lua_rawlen(L, 2);
+  if (t_len != len) {
+    return luaL_error(L, "timestamp and sample lengths differ (%d vs %d)",
+		      (int)t_len, (int)len);
+  }
+  size_t w = util_window_size(ud);
+  if (w > 2 * SGF_MAX_HALF_WINDOW + 1) {
+    return luaL_error(L, "apply_irregular() supports half_window <= %d",
+		      SGF_MAX_HALF_WINDOW);
+  }
+  if (len < w) {
+    return luaL_error(L, "input too short (min: %d, got: %d)", (int)w, (int)len);
+  }
+  const double *uniform = util_uniform_rows(ud->coeffs);
+  if (uniform == NULL) {
+    return luaL_error(L, "memory allocation failed");
+  }
+
+  LuaSGF_Probe probe;
+  util_probe_start(&probe, ud);
+  size_t work_size = util_irregular_work(ud->coeffs);
+  double *t = (double *)util_scratch_array(L, &ud->scratch,
+					   3 * len + (work_size + sizeof(double) - 1) / sizeof(double),
+					   sizeof(double));
+  double *y = t + len;
+  double *out = y + len;
+
+  size_t hole = util_read_samples_d(L, 2, t_buf, t, len);
+  if (hole != 0) {
+    return luaL_error(L, "timestamp table has a hole at index %d", (int)hole);
+  }
+  hole = util_read_samples_d(L, 3, y_buf, y, len);
+  if (hole != 0) {
+    return luaL_error(L, "input table has a hole at index %d", (int)hole);
+  }
+  for (size_t i = 1; i < len; i++) {
+    if (!(t[i] > t[i - 1])) {
+      return luaL_error(L, "timestamps must be increasing (index %d)", (int)(i + 1));
+    }
+  }
+  util_probe_phase(&probe, LUASGF_PHASE_READ);
+
+  size_t failed = util_run_irregular(ud->coeffs, uniform, t, y, len, out, out + len);
+  if (failed != 0) {
+    return luaL_error(L, "fit failed at index %d", (int)failed);
+  }
+  util_probe_phase(&probe, LUASGF_PHASE_COMPUTE);
+
+  if (y_buf != NULL) {
+    LuaSGF_Buffer *res = util_new_buffer(L, len, util_result_dtype(y_buf->dtype, ud->precision));
+    util_write_samples_d(L, 0, res, out, len);
+  } else {
+    lua_createtable(L, (int)len, 0);
+    util_write_samples_d(L, 4, NULL, out, len);
+  }
+  util_scratch_release(&ud->scratch);
+  util_probe_finish(&probe, LUASGF_PHASE_WRITE, len);
+  return 1;
+}
+
+/*============================================================================
+ * PIPELINES
+ *============================================================================*/
+/*
+ * A pipeline runs several filters back to back in one call. All stages are
+ * linear, so the interior of the cascade is a single convolution with the
+ * composed kernel (taps = sum of the windows - stages + 1), applied directly
+ * to the input without any intermediate signal. Only the boundary outputs
+ * run the stages one after another, on the first and last samples.
+ */
+static LuaSGF_Pipeline *util_check_pipeline(lua_State *L, int index) {
+  LuaSGF_Pipeline *pl = (LuaSGF_Pipeline *)luaL_checkudata(L, index, LUASGF_PIPELINE_METATABLE);
+  luaL_argcheck(L, pl->count > 0, index, "pipeline has been destroyed");
+  for (int i = 0; i < pl->count; i++) {
+    if (pl->stages[i]->filter == NULL && pl->stages[i]->plan == NULL) {
+      luaL_error(L, "stage %d of the pipeline has been destroyed", i + 1);
+    }
+  }
+  return pl;
+}
+
+/**
+ * @brief Runs the stages one after another on a (len elements), using b as
+ * the second buffer of the same size.
+ * @param valid Non-zero for 'valid' stages: the signal shrinks per stage.
+ * @return The buffer holding the result, or NULL on failure.
+ */
+static void *util_pipeline_cascade(LuaSGF_Pipeline *pl, void *a, void *b, size_t len,
+				   int valid) {
+  for (int i = 0; i < pl->count; i++) {
+    size_t out_len = valid ? len - util_window_size(pl->stages[i]) + 1 : len;
+    if (util_run_precision(pl->stages[i], a, len, b, out_len, valid)) {
+      return NULL;
+    }
+    void *t = a;
+    a = b;
+    b = t;
+    len = out_len;
+  }
+  return a;
+}
+
+/**
+ * @brief Filters len samples of the pipeline precision into out.
+ * @param work 2 * len elements.
+ * @return Non-zero on failure.
+ */
+static int util_pipeline_run(LuaSGF_Pipeline *pl, const void *in, size_t len, void *out,
+			     int valid, void *work) {
+  size_t esize = util_dtype_size(pl->precision);
+  size_t taps = (size_t)pl->kernel.window_size;
+  char *a = (char *)work;
+
+  if (valid && pl->compose) {
+    util_interior_mt(&pl->composed, in, out, len - taps + 1);
+    return 0;
+  }
+
+  /* Boundary outputs: the stages on the first and last s samples, back to
+   * back, so that wrapping and reflection see the true ends */
+  size_t s = pl->lead + pl->trail + taps + (size_t)pl->count;
+  size_t m = (pl->compose && 2 * s < len) ? 2 * s : len;
+  if (m == len) {
+    memcpy(a, in, len * esize);
+  } else {
+    memcpy(a, in, s * esize);
+    memcpy(a + s * esize, (const char *)in + (len - s) * esize, s * esize);
+  }
+  char *res = (char *)util_pipeline_cascade(pl, a, a + m * esize, m, valid);
+  if (res == NULL) {
+    return 1;
+  }
+  size_t out_len = valid ? len - taps + 1 : len;
+  if (m == len) {
+    memcpy(out, res, out_len * esize);
+    return 0;
+  }
+
+  util_interior_mt(&pl->composed, in, (char *)out + pl->lead * esize, len - taps + 1);
+  memcpy(out, res, pl->lead * esize);
+  memcpy((char *)out + (len - pl->trail) * esize, res + (m - pl->trail) * esize,
+	 pl->trail * esize);
+  return 0;
+}
+
+/**
+ * @brief Common implementation of Pipeline:apply() and apply_valid().
+ * Stack: 1 = pipeline, 2 = data.
+ */
+static int util_pipeline_apply(lua_State *L, int valid) {
+  LuaSGF_Pipeline *pl = util_check_pipeline(L, 1);
+  LuaSGF_Buffer *in_buf = (LuaSGF_Buffer *)luaL_testudata(L, 2, LUASGF_BUFFER_METATABLE);
+  if (in_buf == NULL) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+  }
+  lua_settop(L, 2);
+
+  size_t len = (in_buf != NULL) ? in_buf->len : lua_rawlen(L, 2);
+  size_t min_len = valid ? (size_t)pl->kernel.window_size : pl->max_window;
+  if (len < min_len) {
+    return luaL_error(L, "input too short (min: %d, got: %d)", (int)min_len, (int)len);
+  }
+  size_t out_len = valid ? len - (size_t)pl->kernel.window_size + 1 : len;
+  LuaSGF_DType precision = pl->precision;
+  size_t esize = util_dtype_size(precision);
+
+  /* Buffers of the pipeline precision are read and written in place */
+  int direct = (in_buf != NULL && in_buf->dtype == precision);
+  char *tmp = (char *)util_scratch_array(L, &pl->scratch,
+					 2 * len + (direct ? 0 : len + out_len), esize);
+  char *in_data = direct ? (char *)in_buf->data : tmp + 2 * len * esize;
+  if (!direct) {
+    size_t hole = (precision == LUASGF_DTYPE_DOUBLE)
+      ? util_read_samples_d(L, 2, in_buf, (double *)in_data, len)
+      : util_read_samples(L, 2, in_buf, (float *)in_data, len);
+    if (hole != 0) {
+      return luaL_error(L, "input table has a hole at index %d", (int)hole);
+    }
+  }
+
+  LuaSGF_Buffer *out_buf = NULL;
+  if (in_buf != NULL) {
+    out_buf = util_new_buffer(L, out_len, util_result_dtype(in_buf->dtype, precision));
+  }
+  char *out_data = direct ? (char *)out_buf->data : in_data + len * esize;
+  if (util_pipeline_run(pl, in_data, len, out_data, valid, tmp)) {
+    return luaL_error(L, "pipeline execution failed");
+  }
+
+  if (!direct) {
+    if (out_buf == NULL) {
+      lua_createtable(L, (int)out_len, 0);
+    }
+    if (precision == LUASGF_DTYPE_DOUBLE) {
+      util_write_samples_d(L, 3, out_buf, (const double *)out_data, out_len);
+    } else {
+      util_write_samples(L, 3, out_buf, (const float *)out_data, out_len);
+    }
+  }
+  util_scratch_release(&pl->scratch);
+  return 1;
+}
+
+/**
+ * @brief Computes the composed kernel of the stages (full convolution of
+ * their weights) and sets up the pseudo filter running it.
+ * @return 0 on success, -1 if out of memory.
+ */
+static int util_pipeline_compose(LuaSGF_Pipeline *pl, int threads) {
+  size_t taps = 1;
+  int derivative = 0;
+  for (int i = 0; i < pl->count; i++) {
+    taps += util_window_size(pl->stages[i]) - 1;
+    derivative += pl->stages[i]->coeffs->key.derivative;
+  }
+
+  double *w = (double *)calloc(taps, sizeof(double));
+  double *t = (double *)malloc(taps * sizeof(double));
+  pl->weights = (float *)malloc(taps * sizeof(float));
+  pl->kernel.weights = w;
+  if (w == NULL || t == NULL || pl->weights == NULL) {
+    free(t);
+    return -1;
+  }
+  w[0] = 1.0;
+  size_t len = 1;
+  for (int i = 0; i < pl->count; i++) {
+    const LuaSGF_Filter *ud = pl->stages[i];
+    size_t ws = util_window_size(ud);
+    memset(t, 0, (len + ws - 1) * sizeof(double));
+    for (size_t a = 0; a < len; a++) {
+      for (size_t b = 0; b < ws; b++) {
+	double wb = (ud->plan != NULL) ? ud->plan->weights[b] : (double)ud->weights[b];
+	t[a + b] += w[a] * wb;
+      }
+    }
+    len += ws - 1;
+    memcpy(w, t, len * sizeof(double));
+  }
+  free(t);
+
+  pl->kernel.window_size = (int)taps;
+  pl->kernel.config.half_window = (int)(taps - 1) / 2;
+  pl->kernel.lead = (int)pl->lead;
+  pl->kernel.trail = (int)pl->trail;
+  pl->kernel.symmetry = sgf_symmetrize_d(w, pl->kernel.config.half_window, derivative);
+  for (size_t j = 0; j < taps; j++) {
+    pl->weights[j] = (float)w[j];
+  }
+
+  /* Interior-only pseudo filter running the composed kernel */
+  pl->composed.precision = pl->precision;
+  pl->composed.threads = threads;
+  pl->composed.plan = &pl->kernel;
+  pl->composed.weights = pl->weights;
+  pl->composed.symmetry = pl->kernel.symmetry;
+  if ((int)taps >= ((pl->precision == LUASGF_DTYPE_DOUBLE) ? SGF_FFT_MIN_TAPS_D :
+		    SGF_FFT_MIN_TAPS_F)) {
+    pl->fft = sgf_fft_create(w, (int)taps);  // NULL: direct convolution
+    pl->composed.fft = pl->fft;
+  }
+  return 0;
+}
+
+/**
+ * Creates a pipeline of filters applied one after another.
+ * `pipeline:apply(data)` returns the same as
+ * `fN:apply(... f2:apply(f1:apply(data)))` (up to rounding), but in one
+ * native call: by default the stages are precomposed into a single
+ * convolution kernel for the interior, and only the boundary outputs are
+ * computed stage by stage. No intermediate result is materialized in Lua.
+ *
+ * All stages must be filters created by `new` with the same precision and
+ * without `missing`. The pipeline references the stages, so destroying one of
+ * them disables it.
+ *
+ * @function pipeline
+ * @tparam table stages Array of 1 to 16 `SavgolFilter` objects, applied in
+ * order.
+ * @tparam[opt] table options
+ * - `compose` (`true`): precompose the stages; `false` runs every stage on
+ *   the whole signal.
+ * @treturn Pipeline A new pipeline.
+ * @raise Error if the stages are invalid or if memory allocation fails.
+ * @usage
+ * local smooth = sg.new({half_window = 20, poly_order = 2})
+ * local slope  = sg.new({half_window = 3, poly_order = 2, derivative = 1})
+ * local p = sg.pipeline{smooth, slope}
+ * local velocity = p:apply(data)
+ */
+static int luaSGF_pipeline_create(lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  int compose = 1;
+  if (!lua_isnoneornil(L, 2)) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_getfield(L, 2, "compose");
+    compose = lua_isnil(L, -1) || lua_toboolean(L, -1);
+    lua_pop(L, 1);
+  }
+  size_t count = lua_rawlen(L, 1);
+  luaL_argcheck(L, count >= 1 && count <= LUASGF_MAX_STAGES, 1,
+		"between 1 and 16 stages expected");
+  lua_settop(L, 1);
+
+  LuaSGF_Pipeline *pl = (LuaSGF_Pipeline *)lua_newuserdatauv(L, sizeof(LuaSGF_Pipeline), 1);
+  memset(pl, 0, sizeof(LuaSGF_Pipeline));
+  luaL_setmetatable(L, LUASGF_PIPELINE_METATABLE);
+
+  /* The user value keeps the stages alive */
+  lua_createtable(L, (int)count, 0);
+  int threads = 1;
+  for (size_t i = 0; i < count; i++) {
+    lua_rawgeti(L, 1, (lua_Integer)(i + 1));
+    LuaSGF_Filter *ud = (LuaSGF_Filter *)luaL_testudata(L, -1, LUASGF_METATABLE);
+    if (ud == NULL || (ud->filter == NULL && ud->plan == NULL)) {
+      return luaL_error(L, "stage %d is not a filter", (int)(i + 1));
+    }
+    if (i > 0 && ud->precision != pl->precision) {
+      return luaL_error(L, "pipeline stages must share the precision");
+    }
+    if (ud->missing != LUASGF_MISSING_ERROR) {
+      return luaL_error(L, "stage %d handles missing samples (not supported)", (int)(i + 1));
+    }
+    lua_rawseti(L, -2, (lua_Integer)(i + 1));
+    pl->stages[i] = ud;
+    pl->precision = ud->precision;
+    pl->lead += util_lead(ud);
+    pl->trail += 2 * util_half_window(ud) - util_lead(ud);
+    if (util_window_size(ud) > pl->max_window) {
+      pl->max_window = util_window_size(ud);
+    }
+    threads = (ud->threads > threads) ? ud->threads : threads;
+  }
+  lua_setiuservalue(L, -2, 1);
+  pl->count = (int)count;
+  pl->compose = compose;
+  util_scratch_init(&pl->scratch, 0);
+
+  if (util_pipeline_compose(pl, threads) != 0) {
+    return luaL_error(L, "memory allocation failed");
+  }
+  return 1;
+}
+
+/**
+ * Applies all stages to the data.
+ * Same result as applying the stages one after another with `apply`.
+ * @function Pipeline:apply
+ * @tparam table|Buffer data Input samples, at least as long as the widest
+ * stage window.
+ * @treturn table|Buffer A new table (or buffer) of the same length.
+ * @raise Error if the input is too short, contains holes, or if memory
+ * allocation fails.
+ */
+static int luaSGF_pipeline_apply(lua_State *L) {
+  return util_pipeline_apply(L, 0);
+}
+
+/**
+ * Applies all stages returning only VALID output.
+ * Same result as chaining the stages with `apply_valid`: the output has
+ * `#data - taps + 1` samples, see `Pipeline:taps`.
+ * @function Pipeline:apply_valid
+ * @tparam table|Buffer data Input samples.
+ * @treturn table|Buffer A new (shorter) table or buffer.
+ * @raise Error if the input is shorter than the composed kernel, contains
+ * holes, or if memory allocation fails.
+ */
+static int luaSGF_pipeline_apply_valid(lua_State *L) {
+  return util_pipeline_apply(L, 1);
+}
+
+/**
+ * Returns the composed kernel of the pipeline.
+ * @function Pipeline:taps
+ * @treturn integer Number of taps (sum of the stage windows - stages + 1).
+ * @treturn table The composed weights.
+ */
+static int luaSGF_pipeline_taps(lua_State *L) {
+  LuaSGF_Pipeline *pl = util_check_pipeline(L, 1);
+  size_t taps = (size_t)pl->kernel.window_size;
+  lua_pushinteger(L, (lua_Integer)taps);
+  lua_createtable(L, (int)taps, 0);
+  for (size_t j = 0; j < taps; j++) {
+    lua_pushnumber(L, (lua_Number)pl->kernel.weights[j]);
+    lua_rawseti(L, -2, (lua_Integer)(j + 1));
+  }
+  return 2;
+}
+
+/**
+ * Frees the composed kernel and working memory of the pipeline.
+ * The stages are not affected. Also invoked by the garbage collector.
+ * @function Pipeline:destroy
+ */
+static int luaSGF_pipeline_destroy(lua_State *L) {
+  LuaSGF_Pipeline *pl = (LuaSGF_Pipeline *)luaL_checkudata(L, 1, LUASGF_PIPELINE_METATABLE);
+  free(pl->kernel.weights);
+  free(pl->weights);
+  sgf_fft_destroy(pl->fft);
+  pl->kernel.weights = NULL;
+  pl->weights = NULL;
+  pl->fft = NULL;
+  pl->composed.fft = NULL;
+  pl->count = 0;
+  util_scratch_free(&pl->scratch);
+  util_scratch_free(&pl->composed.fft_work);
+  return 0;
+}
+
+/*============================================================================
+ * SERIES
+ *============================================================================*/
+/*
+ * A series keeps its input and filtered output. Output k only depends on the
+ * window of input samples [k - lead, k - lead + w), so changing the samples
+ * [a, b) only affects the interior outputs [a - trail, b + lead) and, within
+ * w of an end (or on a length change), the boundary outputs. These are
+ * recomputed, everything else is kept.
+ */
+static LuaSGF_Series *util_check_series(lua_State *L, int index) {
+  LuaSGF_Series *sr = (LuaSGF_Series *)luaL_checkudata(L, index, LUASGF_SERIES_METATABLE);
+  luaL_argcheck(L, sr->filter != NULL, index, "series has been destroyed");
+  if (sr->filter->filter == NULL && sr->filter->plan == NULL) {
+    luaL_error(L, "the filter of the series has been destroyed");
+  }
+  return sr;
+}
+
+/**
+ * @brief Grows the arrays to hold at least len samples.
+ * @return Non-zero if out of memory (the series is unchanged).
+ */
+static int util_series_reserve(LuaSGF_Series *sr, size_t len) {
+  if (len <= sr->cap) {
+    return 0;
+  }
+  size_t cap = (sr->cap < 64) ? 64 : sr->cap;
+  while (cap < len) {
+    cap *= 2;
+  }
+  size_t esize = util_dtype_size(sr->filter->precision);
+  char *in = (char *)realloc(sr->in, cap * esize);
+  if (in != NULL) {
+    sr->in = in;
+  }
+  char *out = (in != NULL) ? (char *)realloc(sr->out, cap * esize) : NULL;
+  if (out == NULL) {
+    return 1;
+  }
+  sr->out = out;
+  sr->cap = cap;
+  return 0;
+}
+
+// Extends the recomputed outputs [range[0], range[1]) by [lo, hi)
+static void util_series_range(size_t range[2], size_t lo, size_t hi) {
+  if (lo < hi) {
+    range[0] = (lo < range[0]) ? lo : range[0];
+    range[1] = (hi > range[1]) ? hi : range[1];
+  }
+}
+
+/**
+ * @brief Recomputes the outputs affected by new samples [a, b), the series
+ * having had old_len samples before. Filters handling missing samples
+ * recompute the whole series, since a gap moves outputs beyond one window.
+ * @param range Set to the recomputed outputs [range[0], range[1]).
+ * @return 0 on success, otherwise the util_run_precision() error.
+ */
+static int util_series_refresh(LuaSGF_Series *sr, size_t a, size_t b, size_t old_len,
+			       size_t range[2]) {
+  LuaSGF_Filter *ud = sr->filter;
+  size_t w = util_window_size(ud);
+  size_t lead = util_lead(ud), trail = 2 * util_half_window(ud) - lead;
+  size_t esize = util_dtype_size(ud->precision);
+  size_t len = sr->len;
+
+  range[0] = len;
+  range[1] = 0;
+  if (len < w) {
+    return 0;
+  }
+  if (ud->missing != LUASGF_MISSING_ERROR) {
+    util_series_range(range, 0, len);
+    return util_run_precision(ud, sr->in, len, sr->out, len, 0);
+  }
+  if (old_len < w) {
+    a = 0;  // first complete set of outputs
+    b = len;
+  }
+
+  size_t lo = (a > trail + lead) ? a - trail : lead;
+  size_t hi = (b + lead < len - trail) ? b + lead : len - trail;
+  if (lo < hi) {
+    util_interior_mt(ud, sr->in + (lo - lead) * esize, sr->out + lo * esize, hi - lo);
+    util_series_range(range, lo, hi);
+  }
+
+  int boundary = (ud->plan != NULL) ? ud->plan->config.boundary
+				    : (int)ud->filter->config.boundary;
+  int periodic = (boundary == SAVGOL_BOUNDARY_PERIODIC);
+  int head = (a < w), tail = (b > len - w) || (len != old_len);
+  int left = head || (periodic && tail);
+  int right = tail || (periodic && head);
+  if (!left && !right) {
+    return 0;
+  }
+
+  /* Boundary outputs from the first and last window, see apply_decimated() */
+  size_t elen = (len < 2 * w) ? len : 2 * w;
+  const char *edge = sr->in;
+  char *ey = sr->work + 2 * w * esize;
+  if (elen < len) {
+    memcpy(sr->work, sr->in, w * esize);
+    memcpy(sr->work + w * esize, sr->in + (len - w) * esize, w * esize);
+    edge = sr->work;
+  }
+  if (util_edges(ud, edge, elen, ey)) {
+    return LUASGF_RUN_FAILED;
+  }
+  if (left) {
+    memcpy(sr->out, ey, lead * esize);
+    util_series_range(range, 0, lead);
+  }
+  if (right) {
+    memcpy(sr->out + (len - trail) * esize, ey + (elen - trail) * esize, trail * esize);
+    util_series_range(range, len - trail, len);
+  }
+  return 0;
+}
+
+/**
+ * @brief Pushes the 1-based first and last recomputed output, or nothing.
+ */
+static int util_series_push_range(lua_State *L, const size_t range[2]) {
+  if (range[0] >= range[1]) {
+    return 0;
+  }
+  lua_pushinteger(L, (lua_Integer)range[0] + 1);
+  lua_pushinteger(L, (lua_Integer)range[1]);
+  return 2;
+}
+
+/**
+ * @brief Writes the samples at idx (number, table or buffer) to the series
+ * from sample 'at' on, growing it if they reach past the end.
+ * @return Number of results pushed by util_series_push_range().
+ */
+static int util_series_write(lua_State *L, LuaSGF_Series *sr, int idx, size_t at) {
+  LuaSGF_DType precision = sr->filter->precision;
+  size_t esize = util_dtype_size(precision);
+  LuaSGF_Buffer *buf = NULL;
+  size_t count = 1;
+  if (lua_type(L, idx) != LUA_TNUMBER) {
+    buf = (LuaSGF_Buffer *)luaL_testudata(L, idx, LUASGF_BUFFER_METATABLE);
+    if (buf == NULL) {
+      luaL_checktype(L, idx, LUA_TTABLE);
+    }
+    count = (buf != NULL) ? buf->len : lua_rawlen(L, idx);
+  }
+
+  size_t old_len = sr->len;
+  size_t end = at + count;
+  if (util_series_reserve(sr, end)) {
+    return luaL_error(L, "memory allocation failed");
+  }
+  if (lua_type(L, idx) == LUA_TNUMBER) {
+    lua_Number v = lua_tonumber(L, idx);
+    if (precision == LUASGF_DTYPE_DOUBLE) {
+      ((double *)sr->in)[at] = (double)v;
+    } else {
+      ((float *)sr->in)[at] = (float)v;
+    }
+  } else {
+    /* Gather into the spare capacity first, so a hole leaves the series intact */
+    LuaSGF_View all = {0, count, 1};
+    char *dst = sr->in + at * esize;
+    if (at < sr->len) {
+      if (util_series_reserve(sr, sr->len + count)) {
+	return luaL_error(L, "memory allocation failed");
+      }
+      dst = sr->in + sr->len * esize;
+    }
+    size_t hole = (buf == NULL)
+      ? util_gather_table(L, idx, &all, precision, dst,
+			  sr->filter->missing != LUASGF_MISSING_ERROR)
+      : util_gather(L, idx, buf, &all, precision, dst);
+    if (hole != 0) {
+      return luaL_error(L, "input table has a hole at index %d", (int)hole);
+    }
+    if (dst != sr->in + at * esize) {
+      memmove(sr->in + at * esize, dst, count * esize);
+    }
+  }
+  if (end > sr->len) {
+    sr->len = end;
+  }
+
+  size_t range[2];
+  int rc = util_series_refresh(sr, at, end, old_len, range);
+  if (rc != 0) {
+    return util_run_error(L, rc, "savgol_apply failed");
+  }
+  return util_series_push_range(L, range);
+}
+
+/**
+ * Creates a filtered series.
+ * The series owns a copy of the samples and their filtered values. Edits
+ * through `set`, `update_range` and `append` only recompute the outputs
+ * whose windows contain changed samples (within `half_window` of them, and
+ * the boundary outputs when samples near an end change), so refreshing
+ * after k edits costs O(k * window) instead of a full `apply`. Outputs are
+ * available once the series holds at least one window of samples. Filters
+ * handling missing samples recompute all outputs on every edit.
+ * @function series
+ * @tparam SavgolFilter filter Filter to apply (referenced by the series).
+ * @tparam[opt] table|Buffer data Initial samples.
+ * @treturn Series A new series.
+ * @usage
+ * local s = sg.series(filter, history)
+ * s:append(new_samples)       -- recomputes the tail only
+ * local first, last = s:set(1000, 4.2)
+ * refresh_plot(s, first, last)
+ */
+static int luaSGF_series_create(lua_State *L) {
+  LuaSGF_Filter *ud = util_check_filter(L, 1);
+  lua_settop(L, 2);
+  LuaSGF_Series *sr = (LuaSGF_Series *)lua_newuserdatauv(L, sizeof(LuaSGF_Series), 1);
+  memset(sr, 0, sizeof(LuaSGF_Series));
+  luaL_setmetatable(L, LUASGF_SERIES_METATABLE);
+  lua_pushvalue(L, 1);
+  lua_setiuservalue(L, -2, 1);  // keeps the filter alive
+
+  sr->filter = ud;
+  sr->work = (char *)malloc(4 * util_window_size(ud) * util_dtype_size(ud->precision));
+  if (sr->work == NULL) {
+    return luaL_error(L, "memory allocation failed");
+  }
+  if (!lua_isnil(L, 2)) {
+    util_series_write(L, sr, 2, 0);
+    lua_settop(L, 3);
+  }
+  return 1;
+}
+
+/**
+ * Sets sample i and refreshes the affected outputs.
+ * @function Series:set
+ * @tparam int i Sample index, 1 to `#series + 1` (the latter appends).
+ * @tparam number v New value.
+ * @treturn[opt] int First recomputed output.
+ * @treturn[opt] int Last recomputed output; nothing while the series is
+ * shorter than the window.
+ */
+static int luaSGF_series_set(lua_State *L) {
+  LuaSGF_Series *sr = util_check_series(L, 1);
+  lua_Integer i = luaL_checkinteger(L, 2);
+  luaL_checknumber(L, 3);
+  luaL_argcheck(L, i >= 1 && (size_t)i <= sr->len + 1, 2, "index out of range");
+  return util_series_write(L, sr, 3, (size_t)i - 1);
+}
+
+/**
+ * Overwrites samples i, i + 1, ... with values and refreshes the affected
+ * outputs; the series grows if values reach past its end.
+ * @function Series:update_range
+ * @tparam int i First sample index, 1 to `#series + 1`.
+ * @tparam table|Buffer values New samples.
+ * @treturn[opt] int First recomputed output.
+ * @treturn[opt] int Last recomputed output.
+ */
+static int luaSGF_series_update_range(lua_State *L) {
+  LuaSGF_Series *sr = util_check_series(L, 1);
+  lua_Integer i = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, i >= 1 && (size_t)i <= sr->len + 1, 2, "index out of range");
+  luaL_argcheck(L, lua_type(L, 3) != LUA_TNUMBER, 3, "table or buffer expected");
+  return util_series_write(L, sr, 3, (size_t)i - 1);
+}
+
+/**
+ * Appends samples and refreshes the outputs near the end.
+ * @function Series:append
+ * @tparam number|table|Buffer values One sample or several.
+ * @treturn[opt] int First recomputed output.
+ * @treturn[opt] int Last recomputed output.
+ */
+static int luaSGF_series_append(lua_State *L) {
+  LuaSGF_Series *sr = util_check_series(L, 1);
+  return util_series_write(L, sr, 2, sr->len);
+}
+
+/**
+ * Returns filtered output i, or nil while the series is shorter than the
+ * window.
+ * @function Series:get
+ * @tparam int i Output index, 1 to `#series`.
+ * @treturn number|nil Filtered value.
+ */
+static int luaSGF_series_get(lua_State *L) {
+  LuaSGF_Series *sr = util_check_series(L, 1);
+  lua_Integer i = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, i >= 1 && (size_t)i <= sr->len, 2, "index out of range");
+  if (sr->len < util_window_size(sr->filter)) {
+    lua_pushnil(L);
+    return 1;
+  }
+  LuaSGF_Buffer out = {sr->len, sr->filter->precision, sr->out, 1.0, 0.0};
+  lua_pushnumber(L, util_buffer_get(&out, (size_t)i - 1));
+  return 1;
+}
+
+/**
+ * Returns a copy of the filtered outputs (or of the samples).
+ * @function Series:output
+ * @tparam[opt=false] boolean input Copy the samples instead.
+ * @treturn Buffer `#series` elements of the filter precision.
+ * @raise Error if the outputs are requested while the series is shorter
+ * than the window.
+ */
+static int luaSGF_series_output(lua_State *L) {
+  LuaSGF_Series *sr = util_check_series(L, 1);
+  int input = lua_toboolean(L, 2);
+  size_t w = util_window_size(sr->filter);
+  if (!input && sr->len < w) {
+    return luaL_error(L, "series too short (min: %d, got: %d)", (int)w, (int)sr->len);
+  }
+  LuaSGF_DType precision = sr->filter->precision;
+  LuaSGF_Buffer *buf = util_new_buffer(L, sr->len, precision);
+  if (sr->len > 0) {
+    memcpy(buf->data, input ? sr->in : sr->out, sr->len * util_dtype_size(precision));
+  }
+  return 1;
+}
+
+/**
+ * Returns the number of samples.
+ * @function Series:__len
+ * @treturn int Sample count.
+ */
+static int luaSGF_series_len(lua_State *L) {
+  LuaSGF_Series *sr = util_check_series(L, 1);
+  lua_pushinteger(L, (lua_Integer)sr->len);
+  return 1;
+}
+
+/**
+ * Frees the samples and outputs of the series; the filter is not affected.
+ * Also invoked by the garbage collector.
+ * @function Series:destroy
+ */
+static int luaSGF_series_destroy(lua_State *L) {
+  LuaSGF_Series *sr = (LuaSGF_Series *)luaL_checkudata(L, 1, LUASGF_SERIES_METATABLE);
+  free(sr->in);
+  free(sr->out);
+  free(sr->work);
+  memset(sr, 0, sizeof(LuaSGF_Series));
+  return 0;
+}
+
+/*============================================================================
+ * MULTI-DERIVATIVE FILTERS
+ *============================================================================*/
+static LuaSGF_Multi *util_check_multi(lua_State *L, int index) {
+  LuaSGF_Multi *mf = (LuaSGF_Multi *)luaL_checkudata(L, index, LUASGF_MULTI_METATABLE);
+  luaL_argcheck(L, mf->count > 0, index, "filter has been destroyed");
+  return mf;
+}
+
+// Fused interior work: every task covers a range of outputs for all orders
+typedef struct {
+  const LuaSGF_Multi *mf;
+  const char *in;
+  char *out[LUASGF_MAX_OUTPUTS];  // already offset to the first interior output
+  size_t count;                   // interior outputs in total
+  size_t chunk;                   // interior outputs per task
+  double *fft_work[LUASGF_MAX_OUTPUTS]; // sgf_fft_work() doubles per task, or NULL
+} LuaSGF_MultiJob;
+
+/**
+ * @brief Computes a range of interior outputs block by block, so that each
+ * input block is still cached when the next derivative order reads it.
+ */
+static void util_multi_task(void *arg, size_t task) {
+  const LuaSGF_MultiJob *job = (const LuaSGF_MultiJob *)arg;
+  const LuaSGF_Multi *mf = job->mf;
+  size_t esize = util_dtype_size(mf->filters[0].precision);
+  size_t begin = task * job->chunk;
+  size_t end = (job->count - begin > job->chunk) ? begin + job->chunk : job->count;
+
+  // Overlap-save transforms are wider than a block, run them on the whole task
+  size_t block = (mf->filters[0].fft != NULL) ? end - begin : LUASGF_MULTI_BLOCK;
+  for (size_t b = begin; b < end; b += block) {
+    size_t count = (end - b > block) ? block : end - b;
+    for (int k = 0; k < mf->count; k++) {
+      const LuaSGF_Filter *ud = &mf->filters[k];
+      double *work = (job->fft_work[k] != NULL) ?
+	job->fft_work[k] + task * sgf_fft_work(ud->fft) : NULL;
+      util_interior(ud, job->in + b * esize, job->out[k] + b * esize, count, work);
+    }
+  }
+}
+
+/**
+ * @brief Filters an array of the filter precision into one output per order.
+ * Filters handling missing samples run util_run_precision() once per order.
+ * @return 0 on success, otherwise the util_run_precision() error.
+ */
+static int util_multi_run(LuaSGF_Multi *mf, const void *in, size_t len,
+			  void *const *out, int valid) {
+  LuaSGF_Filter *f0 = &mf->filters[0];
+  size_t n = util_half_window(f0);
+  size_t esize = util_dtype_size(f0->precision);
+
+  if (f0->missing != LUASGF_MISSING_ERROR) {
+    size_t out_len = valid ? len - 2 * n : len;
+    for (int k = 0; k < mf->count; k++) {
+      int rc = util_run_precision(&mf->filters[k], in, len, out[k], out_len, valid);
+      if (rc != 0) {
+	return rc;
+      }
+    }
+    return 0;
+  }
+
+  LuaSGF_MultiJob job;
+  job.mf = mf;
+  job.in = (const char *)in;
+  job.count = len - 2 * n;
+  job.chunk = job.count;
+  for (int k = 0; k < mf->count; k++) {
+    job.out[k] = (char *)out[k] + (valid ? 0 : util_lead(f0) * esize);
+  }
+  if (f0->threads > 1 && job.count >= 2 * LUASGF_THREAD_CHUNK) {
+    size_t parts = (job.count + LUASGF_THREAD_CHUNK - 1) / LUASGF_THREAD_CHUNK;
+    job.chunk = util_task_parts(f0, parts) * LUASGF_THREAD_CHUNK;
+  }
+  size_t tasks = (job.count + job.chunk - 1) / job.chunk;
+  for (int k = 0; k < mf->count; k++) {
+    job.fft_work[k] = util_fft_work(&mf->filters[k], tasks);
+  }
+  sgf_pool_run(f0->threads, util_multi_task, &job, tasks);
+
+  for (int k = 0; k < mf->count && !valid; k++) {
+    if (util_edges(&mf->filters[k], in, len, out[k])) {
+      return LUASGF_RUN_FAILED;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Common implementation of MultiFilter:apply() and apply_valid().
+ * Stack: 1 = filter, 2 = data. Pushes one result per derivative order.
+ */
+static int util_multi_apply(lua_State *L, int valid) {
+  LuaSGF_Multi *mf = util_check_multi(L, 1);
+  LuaSGF_Filter *f0 = &mf->filters[0];
+  LuaSGF_Buffer *in_buf = (LuaSGF_Buffer *)luaL_testudata(L, 2, LUASGF_BUFFER_METATABLE);
+  if (in_buf == NULL) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+  }
+  lua_settop(L, 2);
+
+  size_t w = util_window_size(f0);
+  size_t len = (in_buf != NULL) ? in_buf->len : lua_rawlen(L, 2);
+  if (len < w) {
+    return luaL_error(L, "input too short (min: %d, got: %d)", (int)w, (int)len);
+  }
+  size_t out_len = valid ? len - w + 1 : len;
+  LuaSGF_DType precision = f0->precision;
+  size_t esize = util_dtype_size(precision);
+
+  /* Buffers of the filter precision are read and written in place */
+  int direct = (in_buf != NULL && in_buf->dtype == precision);
+  size_t tmp_len = (direct ? 0 : len + mf->count * out_len);
+  char *tmp = (char *)util_scratch_array(L, &mf->scratch, tmp_len, esize);
+
+  const void *in_data = direct ? in_buf->data : tmp;
+  if (!direct) {
+    LuaSGF_View all = {0, len, 1};
+    size_t hole = (in_buf == NULL)
+      ? util_gather_table(L, 2, &all, precision, tmp,
+			  f0->missing != LUASGF_MISSING_ERROR)
+      : util_gather(L, 2, in_buf, &all, precision, tmp);
+    if (hole != 0) {
+      return luaL_error(L, "input table has a hole at index %d", (int)hole);
+    }
+  }
+
+  void *out_data[LUASGF_MAX_OUTPUTS];
+  LuaSGF_Buffer *out_buf[LUASGF_MAX_OUTPUTS];
+  for (int k = 0; k < mf->count; k++) {
+    out_buf[k] = (in_buf != NULL)
+      ? util_new_buffer(L, out_len, util_result_dtype(in_buf->dtype, precision)) : NULL;
+    out_data[k] = direct ? out_buf[k]->data : tmp + (len + k * out_len) * esize;
+  }
+
+  int rc = util_multi_run(mf, in_data, len, out_data, valid);
+  if (rc != 0) {
+    return util_run_error(L, rc, valid ? "savgol_apply_valid core execution failed"
+				 : "savgol_apply failed");
+  }
+
+  /* Convert into the result buffers, or build the result tables */
+  for (int k = 0; k < mf->count && !direct; k++) {
+    int idx = 3 + k;
+    if (out_buf[k] == NULL) {
+      lua_createtable(L, (int)out_len, 0);
+    }
+    if (precision == LUASGF_DTYPE_DOUBLE) {
+      util_write_samples_d(L, idx, out_buf[k], (const double *)out_data[k], out_len);
+    } else {
+      util_write_samples(L, idx, out_buf[k], (const float *)out_data[k], out_len);
+    }
+  }
+
+  util_scratch_release(&mf->scratch);
+  return mf->count;
+}
+
+/**
+ * Creates a filter that computes several derivative orders in one pass.
+ * All orders share the configuration (window, polynomial order, time step,
+ * boundary, precision); `apply` reads the input once and evaluates all orders
+ * block by block while the input is in cache, returning one result per order.
+ * The usual `derivative` field is ignored. With `missing`, every order handles
+ * the gaps like `apply` of its own filter, without the shared pass.
+ *
+ * @function new_multi
+ * @tparam table config Filter configuration, see `new`.
+ * @tparam[opt] table derivatives Derivative orders, e.g. `{0, 1, 2}` (up to
+ * 8). Defaults to `config.derivatives`.
+ * @treturn MultiFilter A new filter object.
+ * @raise Error on invalid parameters or if no derivative order is given.
+ * @usage
+ * local kin = sg.new_multi({half_window = 8, poly_order = 3, time_step = dt},
+ *                          {0, 1, 2})
+ * local pos, vel, acc = kin:apply(samples)
+ */
+static int luaSGF_multi_create(lua_State *L) {
+  LuaSGF_Options opts;
+  util_fill_options(L, 1, &opts);
+
+  int list = 2;
+  if (lua_isnoneornil(L, 2)) {
+    lua_getfield(L, 1, "derivatives");
+    list = lua_gettop(L);
+  }
+  luaL_argcheck(L, lua_istable(L, list), 2, "table of derivative orders expected");
+  size_t count = lua_rawlen(L, list);
+  luaL_argcheck(L, count >= 1 && count <= LUASGF_MAX_OUTPUTS, 2,
+		"between 1 and 8 derivative orders expected");
+
+  LuaSGF_Multi *mf = (LuaSGF_Multi *)lua_newuserdatauv(L, sizeof(LuaSGF_Multi), 0);
+  memset(mf, 0, sizeof(LuaSGF_Multi));
+  util_scratch_init(&mf->scratch, opts.scratch_limit);
+  luaL_setmetatable(L, LUASGF_MULTI_METATABLE);
+
+  LuaSGF_Cache *cache = (LuaSGF_Cache *)lua_touserdata(L, lua_upvalueindex(2));
+  for (size_t k = 0; k < count; k++) {
+    lua_rawgeti(L, list, (lua_Integer)(k + 1));
+    lua_Integer d = luaL_checkinteger(L, -1);
+    lua_pop(L, 1);
+    if (d < 0 || d > SGF_MAX_DERIVATIVE ||
+	util_filter_init(&mf->filters[k], cache, &opts, (int)d) != 0) {
+      return luaL_error(L, "luaSGF.new_multi(): invalid parameters or out of memory");
+    }
+    mf->count = (int)k + 1;
+  }
+  return 1;
+}
+
+/**
+ * Applies all derivative orders to the data.
+ * Equivalent to calling `apply` of one filter per order, but the input is
+ * converted once and traversed once.
+ * @function MultiFilter:apply
+ * @tparam table|Buffer data Input samples.
+ * @treturn table|Buffer ... One result per derivative order, in the order
+ * given to `new_multi`; buffers of the input's element type for buffer
+ * input.
+ * @raise Error if the input is too short or contains holes.
+ */
+static int luaSGF_multi_apply(lua_State *L) {
+  return util_multi_apply(L, 0);
+}
+
+/**
+ * Applies all derivative orders returning only VALID output.
+ * @function MultiFilter:apply_valid
+ * @tparam table|Buffer data Input samples.
+ * @treturn table|Buffer ... One result of `length - 2 * half_window` samples
+ * per derivative order.
+ * @raise Error if the input is too short or contains holes.
+ */
+static int luaSGF_multi_apply_valid(lua_State *L) {
+  return util_multi_apply(L, 1);
+}
+
+/**
+ * Returns the derivative orders computed by the filter.
+ * @function MultiFilter:derivatives
+ * @treturn table Array of derivative orders.
+ */
+static int luaSGF_multi_derivatives(lua_State *L) {
+  LuaSGF_Multi *mf = util_check_multi(L, 1);
+  lua_createtable(L, mf->count, 0);
+  for (int k = 0; k < mf->count; k++) {
+    const SgfPlanConfig *key = &mf->filters[k].coeffs->key;
+    lua_pushinteger(L, key->derivative);
+    lua_rawseti(L, -2, k + 1);
+  }
+  return 1;
+}
+
+/**
+ * Frees the resources associated with the filter.
+ * Also invoked by the garbage collector.
+ * @function MultiFilter:destroy
+ */
+static int luaSGF_multi_destroy(lua_State *L) {
+  LuaSGF_Multi *mf = (LuaSGF_Multi *)luaL_checkudata(L, 1, LUASGF_MULTI_METATABLE);
+  for (int k = 0; k < mf->count; k++) {
+    util_filter_release(&mf->filters[k]);
+  }
+  mf->count = 0;
+  util_scratch_free(&mf->scratch);
+  return 0;
+}
+
+/*============================================================================
+ * 2-D FILTERS
+ *============================================================================*/
+static LuaSGF_Filter2d *util_check_2d(lua_State *L, int index) {
+  LuaSGF_Filter2d *f2 = (LuaSGF_Filter2d *)luaL_checkudata(L, index,
+							   LUASGF_FILTER2D_METATABLE);
+  luaL_argcheck(L, f2->fit != LUASGF_FIT_NONE, index, "filter has been destroyed");
+  return f2;
+}
+
+/**
+ * @brief Window rows (axis 0) or columns (axis 1) of a 2-D filter.
+ */
+static size_t util_2d_window(const LuaSGF_Filter2d *f2, int axis) {
+  return (f2->plan != NULL) ? (size_t)f2->plan->window[axis] :
+    util_window_size(&f2->axes[axis]);
+}
+
+/**
+ * @brief Interior weights of a 1-D filter, measured on impulses of the
+ * filter precision (float filters report their float weights).
+ * @param work Window size + 1 elements of the filter precision.
+ */
+static void util_axis_weights(const LuaSGF_Filter *ud, void *work, double *w) {
+  size_t ws = util_window_size(ud);
+  LuaSGF_Buffer x = {ws + 1, ud->precision, work, 1.0, 0.0};
+  LuaSGF_Buffer y = util_buffer_slice(&x, ws, 1);
+  memset(work, 0, ws * util_dtype_size(ud->precision));
+  for (size_t j = 0; j < ws; j++) {
+    util_buffer_set(&x, j, 1.0);
+    util_interior(ud, x.data, y.data, 1, NULL);
+    w[j] = (double)util_buffer_get(&y, 0);
+    util_buffer_set(&x, j, 0.0);
+  }
+}
+
+/**
+ * @brief Boundary outputs of a 1-D filter on len samples (len >= window size)
+ * as a matrix: row k holds the weights of the k-th of the lead leading and
+ * trailing outputs on all len samples, measured on impulses.
+ * @param work 2 * len elements of the filter precision.
+ * @return Non-zero on failure.
+ */
+static int util_axis_edges(LuaSGF_Filter *ud, size_t len, void *work, double *e) {
+  size_t lead = util_lead(ud);
+  size_t edges = util_window_size(ud) - 1;
+  LuaSGF_Buffer x = {2 * len, ud->precision, work, 1.0, 0.0};
+  LuaSGF_Buffer y = util_buffer_slice(&x, len, len);
+  memset(work, 0, len * util_dtype_size(ud->precision));
+  for (size_t j = 0; j < len; j++) {
+    util_buffer_set(&x, j, 1.0);
+    if (util_edges(ud, x.data, len, y.data)) {
+      return 1;
+    }
+    for (size_t k = 0; k < edges; k++) {
+      size_t at = (k < lead) ? k : len - edges + k;
+      e[k * len + j] = (double)util_buffer_get(&y, at);
+    }
+    util_buffer_set(&x, j, 0.0);
+  }
+  return 0;
+}
+
+/**
+ * @brief dst[c] = sum_j coef[j] * src_j[c], c < count, over the rows src_j of
+ * the filter precision given by index[j], or first + j if index is NULL.
+ * Rows start every stride elements; zero coefficients are skipped.
+ */
+static void util_2d_combine(LuaSGF_DType precision, const char *src, size_t stride,
+			    size_t first, const size_t *index, const double *coef,
+			    size_t terms, char *dst, size_t count) {
+  size_t esize = util_dtype_size(precision);
+  int started = 0;
+  for (size_t j = 0; j < terms; j++) {
+    if (coef[j] == 0.0) {
+      continue;
+    }
+    const char *row = src + ((index != NULL) ? index[j] : first + j) * stride * esize;
+    if (precision == LUASGF_DTYPE_DOUBLE) {
+      const double *x = (const double *)row;
+      double *y = (double *)dst;
+      double c = coef[j];
+      for (size_t i = 0; i < count; i++) {
+	y[i] = (started ? y[i] : 0.0) + c * x[i];
+      }
+    } else {
+      const float *x = (const float *)row;
+      float *y = (float *)dst;
+      float c = (float)coef[j];
+      for (size_t i = 0; i < count; i++) {
+	y[i] = (started ? y[i] : 0.0f) + c * x[i];
+      }
+    }
+    started = 1;
+  }
+  if (!started) {
+    memset(dst, 0, count * esize);
+  }
+}
+
+// 2-D work split across the worker pool into tiles of output rows and columns
+typedef struct {
+  const LuaSGF_Filter2d *f2;
+  const char *in;              // filter precision
+  char *out;
+  size_t in_stride, out_stride;  // elements between rows
+  size_t rows, cols;           // outputs covered by the tiles
+  size_t tiles_x;              // tiles per row of tiles
+  size_t first;                // separable row pass: column of the first output
+  size_t row_step;             // separable row pass: rows per task
+  double *fft_work;            // separable row pass: sgf_fft_work() doubles per
+			       // task, or NULL
+  int valid;
+  // Separable column pass: weights of every output row on the intermediate
+  size_t in_rows;              // rows of the intermediate
+  const double *weights;       // interior weights along y
+  const double *edges;         // boundary rows, see util_axis_edges()
+  const size_t *edge_rows;     // intermediate row of each boundary sample
+  size_t edge_len;
+} LuaSGF_Job2d;
+
+/**
+ * @brief Separable row pass: interior outputs of a block of image rows along
+ * x (job->cols per row, written from column job->first on).
+ */
+static void util_2d_rows_task(void *arg, size_t task) {
+  const LuaSGF_Job2d *job = (const LuaSGF_Job2d *)arg;
+  const LuaSGF_Filter *fx = &job->f2->axes[1];
+  size_t esize = util_dtype_size(job->f2->precision);
+  double *work = (job->fft_work != NULL) ? job->fft_work + task * sgf_fft_work(fx->fft) : NULL;
+  size_t end = (task + 1) * job->row_step;
+  end = (end > job->rows) ? job->rows : end;
+  for (size_t r = task * job->row_step; r < end; r++) {
+    util_interior(fx, job->in + r * job->in_stride * esize,
+		  job->out + (r * job->out_stride + job->first) * esize, job->cols, work);
+  }
+}
+
+/**
+ * @brief Separable column pass: one tile of outputs along y, each output row
+ * a combination of rows of the row pass result.
+ */
+static void util_2d_columns_task(void *arg, size_t task) {
+  const LuaSGF_Job2d *job = (const LuaSGF_Job2d *)arg;
+  const LuaSGF_Filter *fy = &job->f2->axes[0];
+  size_t esize = util_dtype_size(job->f2->precision);
+  size_t ws = util_window_size(fy);
+  size_t lead = util_lead(fy);
+  size_t trail = ws - 1 - lead;
+
+  size_t r0 = (task / job->tiles_x) * LUASGF_TILE_ROWS;
+  size_t c0 = (task % job->tiles_x) * LUASGF_TILE_COLS;
+  size_t r1 = (r0 + LUASGF_TILE_ROWS > job->rows) ? job->rows : r0 + LUASGF_TILE_ROWS;
+  size_t c1 = (c0 + LUASGF_TILE_COLS > job->cols) ? job->cols : c0 + LUASGF_TILE_COLS;
+
+  for (size_t r = r0; r < r1; r++) {
+    char *dst = job->out + (r * job->out_stride + c0) * esize;
+    const char *src = job->in + c0 * esize;
+    if (!job->valid && (r < lead || r >= job->in_rows - trail)) {
+      size_t k = (r < lead) ? r : lead + r - (job->in_rows - trail);
+      util_2d_combine(job->f2->precision, src, job->in_stride, 0, job->edge_rows,
+		      job->edges + k * job->edge_len, job->edge_len, dst, c1 - c0);
+    } else {
+      util_2d_combine(job->f2->precision, src, job->in_stride, job->valid ? r : r - lead,
+		      NULL, job->weights, ws, dst, c1 - c0);
+    }
+  }
+}
+
+/**
+ * @brief 2-D fit: one tile of interior outputs, accumulated from the 1-D
+ * interior kernels of the weight rows.
+ */
+static void util_2d_fit_task(void *arg, size_t task) {
+  const LuaSGF_Job2d *job = (const LuaSGF_Job2d *)arg;
+  const LuaSGF_Filter2d *f2 = job->f2;
+  int wy = f2->plan->window[0], wx = f2->plan->window[1];
+  size_t esize = util_dtype_size(f2->precision);
+  union {
+    double d[LUASGF_TILE_COLS];
+    float f[LUASGF_TILE_COLS];
+  } tmp;
+
+  size_t r0 = (task / job->tiles_x) * LUASGF_TILE_ROWS;
+  size_t c0 = (task % job->tiles_x) * LUASGF_TILE_COLS;
+  size_t r1 = (r0 + LUASGF_TILE_ROWS > job->rows) ? job->rows : r0 + LUASGF_TILE_ROWS;
+  size_t count = (c0 + LUASGF_TILE_COLS > job->cols) ? job->cols - c0 : LUASGF_TILE_COLS;
+
+  for (size_t r = r0; r < r1; r++) {
+    char *dst = job->out + (r * job->out_stride + c0) * esize;
+    for (int i = 0; i < wy; i++) {
+      const char *src = job->in + ((r + i) * job->in_stride + c0) * esize;
+      if (f2->precision == LUASGF_DTYPE_DOUBLE) {
+	double *y = (double *)dst;
+	sgf_interior_d(f2->plan->weights + i * wx, wx, (const double *)src,
+		       (i == 0) ? y : tmp.d, count);
+	for (size_t c = 0; c < count && i > 0; c++) {
+	  y[c] += tmp.d[c];
+	}
+      } else {
+	float *y = (float *)dst;
+	sgf_interior_f(f2->weights + i * wx, wx, (const float *)src,
+		       (i == 0) ? y : tmp.f, count);
+	for (size_t c = 0; c < count && i > 0; c++) {
+	  y[c] += tmp.f[c];
+	}
+      }
+    }
+  }
+}
+
+// Scratch parts start at 16-byte boundaries
+static size_t util_align16(size_t bytes) {
+  return (bytes + 15) & ~(size_t)15;
+}
+
+/**
+ * @brief Bytes of work memory of util_2d_run(): separable filters keep the
+ * row pass result, the column weights and their impulse work area.
+ */
+static size_t util_2d_work(const LuaSGF_Filter2d *f2, size_t rows, size_t cols,
+			   int valid) {
+  if (f2->plan != NULL) {
+    return 0;
+  }
+  size_t esize = util_dtype_size(f2->precision);
+  size_t wy = util_2d_window(f2, 0), wx = util_2d_window(f2, 1);
+  size_t tcols = valid ? cols - wx + 1 : cols;
+  size_t edge_len = valid ? 0 : (rows < 2 * wy) ? rows : 2 * wy;
+  size_t impulses = (edge_len > wy) ? edge_len : wy;
+  return util_align16(rows * tcols * esize) +
+    util_align16((wy + (wy - 1) * edge_len) * sizeof(double)) +
+    util_align16(edge_len * sizeof(size_t)) + 2 * impulses * esize;
+}
+
+/**
+ * @brief Filters an image of the filter precision (rows x cols, at least the
+ * window) into a contiguous output.
+ * @param work util_2d_work() bytes, 16-byte aligned.
+ * @return Non-zero on failure.
+ */
+static int util_2d_run(LuaSGF_Filter2d *f2, const char *x, size_t x_stride,
+		       size_t rows, size_t cols, char *y, int valid, char *work) {
+  size_t esize = util_dtype_size(f2->precision);
+  size_t wy = util_2d_window(f2, 0), wx = util_2d_window(f2, 1);
+  size_t ny = (wy - 1) / 2, nx = (wx - 1) / 2;
+  size_t out_rows = valid ? rows - wy + 1 : rows;
+  size_t out_cols = valid ? cols - wx + 1 : cols;
+
+  LuaSGF_Job2d job;
+  memset(&job, 0, sizeof(job));
+  job.f2 = f2;
+  job.valid = valid;
+  job.in = x;
+  job.in_stride = x_stride;
+
+  if (f2->plan != NULL) {
+    /* Interior tiles, then the boundary outputs around them */
+    job.out = y + (valid ? 0 : (ny * out_cols + nx) * esize);
+    job.out_stride = out_cols;
+    job.rows = rows - wy + 1;
+    job.cols = cols - wx + 1;
+    job.tiles_x = (job.cols + LUASGF_TILE_COLS - 1) / LUASGF_TILE_COLS;
+    sgf_pool_run(f2->threads, util_2d_fit_task, &job,
+		 job.tiles_x * ((job.rows + LUASGF_TILE_ROWS - 1) / LUASGF_TILE_ROWS));
+    if (!valid && f2->precision == LUASGF_DTYPE_DOUBLE) {
+      sgf_apply_edges2d_d(f2->plan, (const double *)x, x_stride, (double *)y, out_cols,
+			  rows, cols);
+    } else if (!valid) {
+      sgf_apply_edges2d_f(f2->plan, (const float *)x, x_stride, (float *)y, out_cols,
+			  rows, cols);
+    }
+    return 0;
+  }
+
+  LuaSGF_Filter *fy = &f2->axes[0], *fx = &f2->axes[1];
+  size_t tcols = valid ? cols - wx + 1 : cols;
+  size_t edge_len = valid ? 0 : (rows < 2 * wy) ? rows : 2 * wy;
+  char *t = work;
+  double *coef = (double *)(t + util_align16(rows * tcols * esize));
+  size_t *edge_rows = (size_t *)((char *)coef +
+				 util_align16((wy + (wy - 1) * edge_len) * sizeof(double)));
+  void *impulses = (char *)edge_rows + util_align16(edge_len * sizeof(size_t));
+
+  /* Rows along x into t */
+  job.out = t;
+  job.out_stride = tcols;
+  job.rows = rows;
+  job.cols = cols - 2 * nx;
+  job.first = valid ? 0 : util_lead(fx);
+  job.row_step = LUASGF_TILE_ROWS *
+    util_task_parts(fx, (rows + LUASGF_TILE_ROWS - 1) / LUASGF_TILE_ROWS);
+  size_t tasks = (rows + job.row_step - 1) / job.row_step;
+  job.fft_work = util_fft_work(fx, tasks);
+  sgf_pool_run(f2->threads, util_2d_rows_task, &job, tasks);
+  for (size_t r = 0; r < rows && !valid; r++) {
+    if (util_edges(fx, x + r * x_stride * esize, cols, t + r * tcols * esize)) {
+      return 1;
+    }
+  }
+
+  /* Columns along y: boundary rows only depend on the first and last
+     window, so their weights are measured on these 2 * wy rows */
+  util_axis_weights(fy, impulses, coef);
+  if (edge_len > 0 && util_axis_edges(fy, edge_len, impulses, coef + wy)) {
+    return 1;
+  }
+  for (size_t j = 0; j < edge_len; j++) {
+    edge_rows[j] = (j < wy) ? j : rows - edge_len + j;
+  }
+  job.in = t;
+  job.in_stride = tcols;
+  job.out = y;
+  job.out_stride = out_cols;
+  job.rows = out_rows;
+  job.cols = out_cols;
+  job.tiles_x = (out_cols + LUASGF_TILE_COLS - 1) / LUASGF_TILE_COLS;
+  job.in_rows = rows;
+  job.weights = coef;
+  job.edges = coef + wy;
+  job.edge_rows = edge_rows;
+  job.edge_len = edge_len;
+  sgf_pool_run(f2->threads, util_2d_columns_task, &job,
+	       job.tiles_x * ((out_rows + LUASGF_TILE_ROWS - 1) / LUASGF_TILE_ROWS));
+  return 0;
+}
+
+/**
+ * @brief Common implementation of Filter2D:apply() and apply_valid().
+ * Stack: 1 = filter, 2 = image buffer, 3 = rows, 4 = columns, 5 = stride.
  */
-static int luaSGF_calc(lua_State *L) {
-  /* 
-   * 1. Handle argument offset
-   * If called as sg(hw, poly, ...), index 1 is the table 'sg'.
-   * If called as sg.calc(hw, poly, ...), index 1 is 'hw'.
-   */
-  int offset = (lua_istable(L, 1) && lua_gettop(L) > 1) ? 1 : 0;
+static int util_2d_apply(lua_State *L, int valid) {
+  LuaSGF_Filter2d *f2 = util_check_2d(L, 1);
+  LuaSGF_Buffer *in = (LuaSGF_Buffer *)luaL_checkudata(L, 2, LUASGF_BUFFER_METATABLE);
+  lua_Integer rows = luaL_checkinteger(L, 3);
+  lua_Integer cols = luaL_checkinteger(L, 4);
+  lua_Integer stride = luaL_optinteger(L, 5, cols);
+  luaL_argcheck(L, rows > 0, 3, "rows must be positive");
+  luaL_argcheck(L, cols > 0, 4, "cols must be positive");
+  luaL_argcheck(L, stride >= cols, 5, "stride must be at least cols");
+  luaL_argcheck(L, (size_t)(rows - 1) * (size_t)stride + (size_t)cols <= in->len, 2,
+		"buffer too short for the image");
 
-  /* 2. Extract and validate arguments using the offset */
-  uint8_t halfWindowSize  = (uint8_t)luaL_checkinteger(L, 1 + offset);
-  uint8_t polynomialOrder = (uint8_t)luaL_checkinteger(L, 2 + offset);
-  uint8_t targetPoint     = (uint8_t)luaL_checkinteger(L, 3 + offset);
-  uint8_t derivativeOrder = (uint8_t)luaL_checkinteger(L, 4 + offset);
-  
-  /* Basic validation against your rules */
-  if (halfWindowSize < 1) {
-    lua_pushnil(L);
-    lua_pushstring(L, "Half-window size must be greater than 0.");
-    return 2;
+  size_t R = (size_t)rows, C = (size_t)cols;
+  size_t wy = util_2d_window(f2, 0), wx = util_2d_window(f2, 1);
+  if (R < wy || C < wx) {
+    return luaL_error(L, "image too small (min: %dx%d, got: %dx%d)", (int)wy, (int)wx,
+		      (int)R, (int)C);
   }
-  if (polynomialOrder >= (uint8_t)(2 * halfWindowSize + 1)) {
-    lua_pushnil(L);
-    lua_pushstring(L, "Polynomial order must be less than the filter window size.");
-    return 2;
+  size_t out_len = (valid ? R - wy + 1 : R) * (valid ? C - wx + 1 : C);
+  LuaSGF_DType precision = f2->precision;
+  size_t esize = util_dtype_size(precision);
+  LuaSGF_Buffer *out = util_new_buffer(L, out_len, util_result_dtype(in->dtype, precision));
+
+  /* Other element types are converted into and out of the scratch arena */
+  int direct_in = (in->dtype == precision);
+  int direct_out = (out->dtype == precision);
+  size_t in_bytes = direct_in ? 0 : util_align16(R * C * esize);
+  size_t out_bytes = direct_out ? 0 : util_align16(out_len * esize);
+  char *base = (char *)util_scratch_array(L, &f2->scratch, in_bytes + out_bytes +
+					  util_2d_work(f2, R, C, valid), 1);
+  char *x = direct_in ? (char *)in->data : base;
+  char *y = direct_out ? (char *)out->data : base + in_bytes;
+  for (size_t r = 0; r < R && !direct_in; r++) {
+    util_buffer_load(in, r * (size_t)stride, C, 1, precision, x + r * C * esize);
   }
-  if (targetPoint > (2 * halfWindowSize)) {
-    lua_pushnil(L);
-    lua_pushstring(L, "Target point must be within the filter window.");
-    return 2;
+
+  if (util_2d_run(f2, x, direct_in ? (size_t)stride : C, R, C, y, valid,
+		  base + in_bytes + out_bytes)) {
+    return luaL_error(L, valid ? "savgol_apply_valid core execution failed"
+		      : "savgol_apply failed");
   }
+  if (!direct_out) {
+    util_buffer_store(out, 0, out_len, 1, precision, y);
+  }
+  util_scratch_release(&f2->scratch);
+  return 1;
+}
 
-  /* 3. Validate input table (now at index 5 + offset) */
-  luaL_checktype(L, 5 + offset, LUA_TTABLE);
-  size_t dataSize = (size_t)lua_rawlen(L, 5 + offset);
-  if ((size_t)(2 * halfWindowSize + 1) > dataSize) {
+/**
+ * @brief Pushes the configuration of one axis of new_2d(): a copy of the
+ * table at index, with the fields of its subtable 'axis' taking precedence.
+ * @return Stack index of the copy.
+ */
+static int util_2d_axis_config(lua_State *L, int index, const char *axis) {
+  lua_newtable(L);
+  int copy = lua_gettop(L);
+  lua_getfield(L, index, axis);
+  luaL_argcheck(L, lua_isnil(L, -1) || lua_istable(L, -1), index,
+		"axis configuration must be a table");
+  int sources[2] = {index, lua_istable(L, -1) ? lua_gettop(L) : 0};
+  for (int k = 0; k < 2 && sources[k] != 0; k++) {
     lua_pushnil(L);
-    lua_pushstring(L, "Filter window size must not exceed data size.");
-    return 2;
+    while (lua_next(L, sources[k]) != 0) {
+      lua_pushvalue(L, -2);
+      lua_insert(L, -2);
+      lua_rawset(L, copy);
+    }
   }
+  lua_pop(L, 1);
+  return copy;
+}
 
-  /* 4. Allocate memory */
-  MqsRawDataPoint_t *rawData = (MqsRawDataPoint_t*)malloc(dataSize * sizeof(MqsRawDataPoint_t));
-  MqsRawDataPoint_t *filteredData = (MqsRawDataPoint_t*)malloc(dataSize * sizeof(MqsRawDataPoint_t));
-    
-  if (!rawData || !filteredData) {
-    free(rawData); free(filteredData);
-    lua_pushnil(L);
-    lua_pushstring(L, "Memory allocation failure.");
-    return 2;
+/**
+ * Creates a 2-D Savitzky-Golay filter for images and gridded data.
+ * The window spans `2 * half_window + 1` rows and columns of the image; the
+ * fields of `new` apply to both axes and can be overridden per axis by the
+ * subtables `config.y` (down the columns, across rows) and `config.x` (along
+ * the rows), e.g. to take a derivative along one axis only.
+ *
+ * With `fit = "tensor"` (default) each axis has its own polynomial order and
+ * the filter is the product of two 1-D filters: the image is filtered along
+ * the rows, then along the columns, with the kernels and boundary modes of
+ * `new`. With `fit = "total"` the window is fitted by one polynomial of total
+ * degree `poly_order` in x and y (e.g. 1, x, y, x^2, xy, y^2 for order 2),
+ * which does not factor into per-axis filters and is computed by a 2-D
+ * kernel in double precision weights (centered, `half_window` up to 32 per
+ * axis). Total fits that do factor (order 0, or order 1 without polynomial
+ * boundaries) run the separable path.
+ *
+ * Both passes work in tiles of 64 rows by 256 columns, distributed across
+ * `config.threads` workers.
+ *
+ * @function new_2d
+ * @tparam table config Filter configuration, see `new`; `target_point` must
+ * be 0 and `missing` is not supported.
+ * @tparam[opt] table config.y Fields of the y axis (rows of the window).
+ * @tparam[opt] table config.x Fields of the x axis (columns of the window).
+ * @tparam[opt="tensor"] string config.fit `"tensor"` or `"total"`.
+ * @treturn Filter2D A new filter object.
+ * @raise Error on invalid parameters, or if the axes of a total fit differ
+ * in polynomial order or boundary mode, or their derivative orders exceed
+ * `poly_order` in sum.
+ * @usage
+ * local smooth = sg.new_2d({half_window = 3, poly_order = 2})
+ * local ddx = sg.new_2d({half_window = 3, poly_order = 2, fit = "total",
+ *                        x = {derivative = 1}})
+ * local img = smooth:apply(pixels, 480, 640)
+ */
+static int luaSGF_2d_create(lua_State *L) {
+  static const char *const axis_names[2] = {"y", "x"};
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_settop(L, 1);
+
+  LuaSGF_Options opts[2];
+  for (int k = 0; k < 2; k++) {
+    util_fill_options(L, util_2d_axis_config(L, 1, axis_names[k]), &opts[k]);
+    luaL_argcheck(L, opts[k].target_point == 0, 1,
+		  "2-D filters are centered (target_point must be 0)");
+    luaL_argcheck(L, opts[k].missing == LUASGF_MISSING_ERROR, 1,
+		  "2-D filters do not support missing");
   }
+  luaL_argcheck(L, opts[0].precision == opts[1].precision, 1,
+		"both axes must have the same precision");
+  int fit = 1 + util_opt_field_option(L, 1, "fit", "tensor", luaSGF_fit_names);
 
-  /* 5. Transfer Lua table to C array (using offset for the table index) */
-  for (size_t i = 1; i <= dataSize; i++) {
-    lua_rawgeti(L, 5 + offset, (int)i);
-    rawData[i-1].phaseAngle = (float)lua_tonumber(L, -1);
-    lua_pop(L, 1);
+  int m = opts[0].config.poly_order;
+  int boundary = (int)opts[0].config.boundary;
+  int dy = opts[0].config.derivative, dx = opts[1].config.derivative;
+  if (fit == LUASGF_FIT_TOTAL) {
+    luaL_argcheck(L, m == opts[1].config.poly_order &&
+		  boundary == (int)opts[1].config.boundary, 1,
+		  "both axes of a total fit must have the same poly_order and boundary");
+    luaL_argcheck(L, dy + dx <= m, 1, "derivative orders exceed poly_order");
+    /* Degree 0 is a box filter, degree 1 fits the plane a + bx + cy, which
+       both factor on the (virtually extended) window */
+    if (m == 0 || (m == 1 && boundary != SAVGOL_BOUNDARY_POLYNOMIAL)) {
+      fit = LUASGF_FIT_TENSOR;
+    }
   }
 
-  /* 6. Perform calculation */
-  int res = mes_savgolFilter(rawData, dataSize, halfWindowSize, filteredData,
-                               polynomialOrder, targetPoint, derivativeOrder);
-    
-  free(rawData);
+  LuaSGF_Filter2d *f2 = (LuaSGF_Filter2d *)lua_newuserdatauv(L, sizeof(LuaSGF_Filter2d),
+							     0);
+  memset(f2, 0, sizeof(LuaSGF_Filter2d));
+  f2->fit = fit;
+  f2->precision = opts[0].precision;
+  f2->threads = opts[0].threads;
+  util_scratch_init(&f2->scratch, opts[0].scratch_limit);
+  luaL_setmetatable(L, LUASGF_FILTER2D_METATABLE);
 
-  if (res != 0) {
-    free(filteredData);
-    lua_pushnil(L);
-    lua_pushstring(L, "Internal filter execution failed.");
-    return 2;
+  if (fit == LUASGF_FIT_TENSOR) {
+    LuaSGF_Cache *cache = (LuaSGF_Cache *)lua_touserdata(L, lua_upvalueindex(2));
+    for (int k = 0; k < 2; k++) {
+      if (util_filter_init(&f2->axes[k], cache, &opts[k], opts[k].config.derivative)) {
+	return luaL_error(L, "luaSGF.new_2d(): invalid parameters or out of memory");
+      }
+    }
+    return 1;
   }
 
-  /* 7. Build result table (Lua 5.4 optimized) */
-  lua_createtable(L, (int)dataSize, 0);
-  for (size_t i = 0; i < dataSize; i++) {
-    lua_pushnumber(L, (lua_Number)filteredData[i].phaseAngle);
-    lua_rawseti(L, -2, (int)(i + 1));
+  SgfPlan2dConfig config = {{opts[0].half_window, opts[1].half_window}, m, {dy, dx},
+			    {opts[0].time_step, opts[1].time_step}, boundary};
+  f2->plan = sgf_plan2d_create(&config);
+  if (f2->plan == NULL) {
+    return luaL_error(L, "luaSGF.new_2d(): invalid parameters or out of memory");
+  }
+  if (f2->precision == LUASGF_DTYPE_FLOAT) {
+    size_t taps = (size_t)f2->plan->window[0] * (size_t)f2->plan->window[1];
+    f2->weights = (float *)malloc(taps * sizeof(float));
+    if (f2->weights == NULL) {
+      return luaL_error(L, "luaSGF.new_2d(): out of memory");
+    }
+    for (size_t j = 0; j < taps; j++) {
+      f2->weights[j] = (float)f2->plan->weights[j];
+    }
   }
+  return 1;
+}
 
-  free(filteredData);
-  lua_pushnil(L); // No error message
-  return 2;
+/**
+ * Filters an image.
+ * The image is `rows` x `cols` samples of a buffer in row-major order, row
+ * `r` (0-based) starting at element `r * stride`, so padded rows and
+ * sub-images of a larger buffer are filtered in place. Buffers of the filter
+ * precision are read without conversion.
+ * @function Filter2D:apply
+ * @tparam Buffer image Samples.
+ * @tparam int rows Image rows (at least the window rows).
+ * @tparam int cols Image columns (at least the window columns).
+ * @tparam[opt=cols] int stride Elements between the starts of two rows.
+ * @treturn Buffer Filtered image of `rows * cols` samples, contiguous, in the
+ * element type of the input (the filter precision for raw types).
+ * @raise Error if the buffer is too short or the image smaller than the
+ * window.
+ * @usage
+ * local out = filter:apply(frame, 480, 640)
+ * local roi = filter:apply(frame, 100, 100, 640) -- top left 100 x 100
+ */
+static int luaSGF_2d_apply(lua_State *L) {
+  return util_2d_apply(L, 0);
+}
+
+/**
+ * Filters an image returning only VALID output.
+ * Only outputs whose window lies inside the image are computed.
+ * @function Filter2D:apply_valid
+ * @tparam Buffer image Samples.
+ * @tparam int rows Image rows.
+ * @tparam int cols Image columns.
+ * @tparam[opt=cols] int stride Elements between the starts of two rows.
+ * @treturn Buffer `(rows - 2 * ny) * (cols - 2 * nx)` samples, with `ny`
+ * and `nx` the half windows along y and x.
+ * @raise Error as for `apply`.
+ */
+static int luaSGF_2d_apply_valid(lua_State *L) {
+  return util_2d_apply(L, 1);
+}
+
+/**
+ * Returns the interior weights of the filter.
+ * Output `(r, c)` is the sum of `w[i][j] * image[r - ny + i - 1][c - nx + j - 1]`
+ * over the window; separable filters report the product of their axes.
+ * @function Filter2D:weights
+ * @treturn table Array of window rows, each an array of weights.
+ */
+static int luaSGF_2d_weights(lua_State *L) {
+  LuaSGF_Filter2d *f2 = util_check_2d(L, 1);
+  size_t wy = util_2d_window(f2, 0), wx = util_2d_window(f2, 1);
+  size_t impulses = (wy > wx ? wy : wx) + 1;
+  double *w = (double *)util_scratch_array(L, &f2->scratch, wy + wx + impulses,
+					   sizeof(double));
+  if (f2->plan == NULL) {
+    util_axis_weights(&f2->axes[0], w + wy + wx, w);
+    util_axis_weights(&f2->axes[1], w + wy + wx, w + wy);
+  }
+
+  lua_createtable(L, (int)wy, 0);
+  for (size_t i = 0; i < wy; i++) {
+    lua_createtable(L, (int)wx, 0);
+    for (size_t j = 0; j < wx; j++) {
+      double v = (f2->plan == NULL) ? w[i] * w[wy + j] :
+	(f2->weights != NULL) ? (double)f2->weights[i * wx + j] :
+	f2->plan->weights[i * wx + j];
+      lua_pushnumber(L, (lua_Number)v);
+      lua_rawseti(L, -2, (lua_Integer)(j + 1));
+    }
+    lua_rawseti(L, -2, (lua_Integer)(i + 1));
+  }
+  util_scratch_release(&f2->scratch);
+  return 1;
+}
+
+/**
+ * Tells whether the filter runs as two 1-D passes.
+ * @function Filter2D:separable
+ * @treturn boolean `true` for tensor fits and total fits that factor.
+ */
+static int luaSGF_2d_separable(lua_State *L) {
+  LuaSGF_Filter2d *f2 = util_check_2d(L, 1);
+  lua_pushboolean(L, f2->plan == NULL);
+  return 1;
+}
+
+/**
+ * Frees the resources associated with the filter.
+ * Also invoked by the garbage collector.
+ * @function Filter2D:destroy
+ */
+static int luaSGF_2d_destroy(lua_State *L) {
+  LuaSGF_Filter2d *f2 = (LuaSGF_Filter2d *)luaL_checkudata(L, 1,
+							   LUASGF_FILTER2D_METATABLE);
+  for (int k = 0; k < 2; k++) {
+    util_filter_release(&f2->axes[k]);
+  }
+  sgf_plan2d_destroy(f2->plan);
+  f2->plan = NULL;
+  free(f2->weights);
+  f2->weights = NULL;
+  f2->fit = LUASGF_FIT_NONE;
+  util_scratch_free(&f2->scratch);
+  return 0;
+}
+
+/*============================================================================
+ * STREAMING
+ *============================================================================*/
+/**
+ * @brief Pushes len samples of the given precision as a table or as a buffer
+ * of the given type.
+ * @param as_buffer Non-zero to push a buffer of element type dtype.
+ */
+static void util_push_samples(lua_State *L, int as_buffer, LuaSGF_DType dtype,
+			      LuaSGF_DType precision, const void *src, size_t len) {
+  LuaSGF_View all = {0, len, 1};
+  if (as_buffer) {
+    util_scatter(L, 0, util_new_buffer(L, len, dtype), &all, precision, src);
+    return;
+  }
+  lua_createtable(L, (int)len, 0);
+  util_scatter(L, lua_gettop(L), NULL, &all, precision, src);
+}
+
+static LuaSGF_Stream *util_check_stream(lua_State *L, int index) {
+  LuaSGF_Stream *st = (LuaSGF_Stream *)luaL_checkudata(L, index, LUASGF_STREAM_METATABLE);
+  luaL_argcheck(L, st->filter.coeffs != NULL, index, "stream has been destroyed");
+  return st;
+}
+
+/**
+ * Creates a streaming filter for sample-by-sample (real-time) processing.
+ * The stream accepts the signal in chunks of arbitrary size and emits exactly
+ * those outputs that became computable with the new samples, doing only
+ * O(window) work per sample. Internally it keeps the most recent window of
+ * samples and filters it like a `SavgolFilter` of the same configuration.
+ *
+ * - **Centered** (default): outputs are identical to `filter:apply()` on the
+ *   concatenated signal and lag `half_window - target_point` samples behind
+ *   the input. The trailing outputs are produced by `flush()` according to
+ *   the configured boundary mode.
+ * - **Causal** (`causal = true`): each output estimates the newest sample from
+ *   the current and past `2 * half_window` samples (zero latency). The first
+ *   window of outputs comes from a polynomial fit over the first window.
+ *
+ * `BOUNDARY_PERIODIC` is not available for streams, since it would require the
+ * end of the stream to filter its beginning. Missing samples are not
+ * supported either.
+ *
+ * @function stream
+ * @tparam table config Filter configuration, see `new`; `missing` must be
+ * `"error"`, causal streams take no `target_point`.
+ * @tparam[opt=false] boolean config.causal Causal instead of centered output.
+ * @treturn Stream A new stream object.
+ * @raise Error on invalid parameters or periodic boundary mode.
+ * @usage
+ * local st = sg.stream({half_window = 5, poly_order = 2})
+ * for chunk in sensor_chunks() do
+ *   local smoothed = st:push(chunk)  -- lags 5 samples behind
+ *   consume(smoothed)
+ * end
+ * consume(st:flush())                -- remaining 5 samples
+ */
+static int luaSGF_stream_create(lua_State *L) {
+  LuaSGF_Options opts;
+  util_fill_options(L, 1, &opts);
+
+  lua_getfield(L, 1, "causal");
+  int causal = lua_toboolean(L, -1);
+  lua_pop(L, 1);
+
+  if (opts.config.boundary == SAVGOL_BOUNDARY_PERIODIC) {
+    return luaL_argerror(L, 1, "periodic boundary is not supported for streams");
+  }
+  util_check_dense(L, 1, opts.missing, "stream");
+  luaL_argcheck(L, !causal || opts.target_point == 0, 1,
+		"causal streams estimate the newest sample (target_point must be 0)");
+  if (causal) {
+    /* The newest sample of every window; the start-up outputs are the
+       polynomial fit over the first window */
+    opts.target_point = opts.half_window;
+    opts.config.boundary = SAVGOL_BOUNDARY_POLYNOMIAL;
+  }
+
+  LuaSGF_Stream *st = (LuaSGF_Stream *)lua_newuserdatauv(L, sizeof(LuaSGF_Stream), 0);
+  memset(st, 0, sizeof(LuaSGF_Stream));
+  st->causal = causal;
+  luaL_setmetatable(L, LUASGF_STREAM_METATABLE);
+
+  LuaSGF_Cache *cache = (LuaSGF_Cache *)lua_touserdata(L, lua_upvalueindex(2));
+  if (util_filter_init(&st->filter, cache, &opts, opts.config.derivative) != 0) {
+    return luaL_error(L, "luaSGF.stream(): invalid parameters or out of memory");
+  }
+
+  /* History of the most recent window */
+  st->hist = malloc(util_window_size(&st->filter) * util_dtype_size(opts.precision));
+  if (st->hist == NULL) {
+    return luaL_error(L, "memory allocation failed");
+  }
+  return 1;
+}
+
+/**
+ * Feeds a chunk of samples into the stream.
+ * Returns all outputs that became computable, in order. Before the first
+ * complete window has been received, nothing is returned.
+ * @function Stream:push
+ * @tparam table|Buffer chunk New input samples (may be empty).
+ * @treturn table|Buffer Newly computable outputs, as a table for table input or
+ * as a buffer of the chunk's element type for buffer input.
+ * @raise Error if the chunk contains holes or non-numeric values.
+ * @usage
+ * local out = st:push({1.0, 1.2, 0.9})
+ */
+static int luaSGF_stream_push(lua_State *L) {
+  LuaSGF_Stream *st = util_check_stream(L, 1);
+  LuaSGF_Buffer *in_buf = (LuaSGF_Buffer *)luaL_testudata(L, 2, LUASGF_BUFFER_METATABLE);
+  if (in_buf == NULL) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+  }
+
+  LuaSGF_Filter *ud = &st->filter;
+  size_t w = util_window_size(ud);
+  size_t lead = util_lead(ud);
+  size_t esize = util_dtype_size(ud->precision);
+  size_t m = (in_buf != NULL) ? in_buf->len : lua_rawlen(L, 2);
+  size_t h = st->hist_len;
+
+  /* Work array: history followed by the new chunk; outputs behind it */
+  size_t work_len = h + m;
+  char *work = (char *)util_scratch_array(L, &ud->scratch, 2 * work_len, esize);
+  char *out = work + work_len * esize;
+
+  memcpy(work, st->hist, h * esize);
+  LuaSGF_View chunk = {0, m, 1};
+  size_t hole = util_gather(L, 2, in_buf, &chunk, ud->precision, work + h * esize);
+  if (hole != 0) {
+    return luaL_error(L, "input table has a hole at index %d", (int)hole);
+  }
+
+  size_t produced = 0;
+  if (st->count < w && st->count + m >= w) {
+    /* First complete window: the work array starts at sample 0. Leading
+       edge by the boundary rule, everything else is interior */
+    if (util_edges(ud, work, w, out) != 0) {
+      return luaL_error(L, "savgol_apply failed");
+    }
+    util_interior_mt(ud, work, out + lead * esize, work_len - w + 1);
+    produced = lead + work_len - w + 1;
+  } else if (st->count >= w && m > 0) {
+    /* Steady state: history holds the last full window */
+    util_interior_mt(ud, work + (h - (w - 1)) * esize, out, m);
+    produced = m;
+  }
+
+  /* Keep the most recent window for the next chunk and flush() */
+  st->hist_len = (work_len < w) ? work_len : w;
+  memcpy(st->hist, work + (work_len - st->hist_len) * esize, st->hist_len * esize);
+  st->count += m;
+  st->as_buffer = (in_buf != NULL);
+  st->dtype = (in_buf != NULL) ? util_result_dtype(in_buf->dtype, ud->precision)
+    : ud->precision;
+
+  util_push_samples(L, st->as_buffer, st->dtype, ud->precision, out, produced);
+  util_scratch_release(&ud->scratch);
+  return 1;
+}
+
+/**
+ * Ends the stream and returns the outstanding outputs.
+ * For centered streams these are the last `half_window - target_point`
+ * outputs, computed with the configured boundary mode; causal streams have
+ * nothing outstanding.
+ * Afterwards the stream is reset and can be reused for a new signal.
+ * The result type follows the last chunk passed to `push`.
+ * @function Stream:flush
+ * @treturn table|Buffer Remaining outputs.
+ * @raise Error if fewer samples than one filter window have been pushed.
+ * @usage
+ * local tail = st:flush()
+ */
+static int luaSGF_stream_flush(lua_State *L) {
+  LuaSGF_Stream *st = util_check_stream(L, 1);
+  LuaSGF_Filter *ud = &st->filter;
+  size_t w = util_window_size(ud);
+  size_t trail = w - 1 - util_lead(ud);
+  size_t esize = util_dtype_size(ud->precision);
+  size_t produced = 0;
+
+  if (st->count > 0 && st->count < w) {
+    return luaL_error(L, "stream too short to flush (min: %d, got: %d)",
+		      (int)w, (int)st->count);
+  }
+
+  char *out = (char *)util_scratch_array(L, &ud->scratch, w, esize);
+  if (st->count > 0 && trail > 0) {
+    /* Trailing edge: filter the last window, keep its trailing outputs */
+    if (util_edges(ud, st->hist, w, out) != 0) {
+      return luaL_error(L, "savgol_apply failed");
+    }
+    out += (w - trail) * esize;
+    produced = trail;
+  }
+
+  st->count = 0;
+  st->hist_len = 0;
+
+  util_push_samples(L, st->as_buffer, st->dtype, ud->precision, out, produced);
+  util_scratch_release(&ud->scratch);
+  return 1;
+}
+
+/**
+ * Discards all buffered samples without producing output.
+ * @function Stream:reset
+ */
+static int luaSGF_stream_reset(lua_State *L) {
+  LuaSGF_Stream *st = util_check_stream(L, 1);
+  st->count = 0;
+  st->hist_len = 0;
+  return 0;
+}
+
+/**
+ * Returns the output latency in samples.
+ * @function Stream:latency
+ * @treturn int `half_window - target_point` for centered streams, 0 for
+ * causal streams.
+ */
+static int luaSGF_stream_latency(lua_State *L) {
+  LuaSGF_Stream *st = util_check_stream(L, 1);
+  lua_pushinteger(L, (lua_Integer)(util_window_size(&st->filter) - 1 - util_lead(&st->filter)));
+  return 1;
+}
+
+/**
+ * Frees the resources associated with the stream.
+ * Also invoked by the garbage collector.
+ * @function Stream:destroy
+ */
+static int luaSGF_stream_destroy(lua_State *L) {
+  LuaSGF_Stream *st = (LuaSGF_Stream *)luaL_checkudata(L, 1, LUASGF_STREAM_METATABLE);
+  util_filter_release(&st->filter);
+  free(st->hist);
+  st->hist = NULL;
+  return 0;
+}
+
+/*============================================================================
+ * KERNEL SELECTION
+ *============================================================================*/
+static const char *const luaSGF_simd_names[] = {"scalar", "sse2", "avx2", "neon", NULL};
+
+/**
+ * Queries or restricts the SIMD kernel used for the interior convolution.
+ * The best kernel supported by the CPU (AVX2+FMA, SSE2 or NEON) is selected
+ * automatically; boundary samples always use the scalar path. Passing a level
+ * restricts the selection process-wide, e.g. `"scalar"` for comparisons.
+ * @function simd_level
+ * @tparam[opt] string level `"scalar"`, `"sse2"`, `"avx2"` or `"neon"`.
+ * @treturn string The active kernel level.
+ * @raise Error if the requested level is not supported by this CPU.
+ * @usage
+ * print(sg.simd_level())  -- e.g. "avx2"
+ * sg.simd_level("scalar") -- force the portable kernel
+ */
+static int luaSGF_simd_level(lua_State *L) {
+  if (!lua_isnoneornil(L, 1)) {
+    int level = luaL_checkoption(L, 1, NULL, luaSGF_simd_names);
+    if (sgf_simd_set_level(level) != 0) {
+      return luaL_argerror(L, 1, "not supported by this CPU");
+    }
+  }
+  lua_pushstring(L, sgf_simd_name(sgf_simd_level()));
+  return 1;
+}
+
+/**
+ * @brief Drops this Lua state's reference to the worker pool.
+ */
+static int luaSGF_pool_gc(lua_State *L) {
+  (void)L;
+  sgf_pool_release();
+  return 0;
 }
 
 /*============================================================================
@@ -432,11 +6862,139 @@ static const struct luaL_Reg luaSGF_filter_methods[] = {
   {"destroy", luaSGF_savgol_destroy},
   {"apply",   luaSGF_savgol_apply},
   {"apply_valid", luaSGF_savgol_apply_valid},
+  {"apply_into", luaSGF_savgol_apply_into},
+  {"apply_valid_into", luaSGF_savgol_apply_valid_into},
+  {"apply_batch", luaSGF_savgol_apply_batch},
+  {"apply_valid_batch", luaSGF_savgol_apply_valid_batch},
+  {"apply_decimated", luaSGF_savgol_apply_decimated},
+  {"apply_irregular", luaSGF_savgol_apply_irregular},
+  {"apply_async", luaSGF_savgol_apply_async},
+  {"submit", luaSGF_savgol_submit},
+  {"shrink",  luaSGF_savgol_shrink},
+  {"stats",   luaSGF_savgol_stats},
+  {"info",    luaSGF_savgol_info},
+  {"dump",    luaSGF_savgol_dump},
+  {NULL, NULL}
+};
+
+static const struct luaL_Reg luaSGF_async_methods[] = {
+  {"__gc", luaSGF_async_cancel},
+  {"cancel", luaSGF_async_cancel},
+  {"step", luaSGF_async_step},
+  {"run", luaSGF_async_run},
+  {"result", luaSGF_async_result},
+  {NULL, NULL}
+};
+
+static const struct luaL_Reg luaSGF_submit_methods[] = {
+  {"__gc", luaSGF_submit_gc},
+  {"ready", luaSGF_submit_ready},
+  {"wait", luaSGF_submit_wait},
+  {"result", luaSGF_submit_result},
+  {NULL, NULL}
+};
+
+static const struct luaL_Reg luaSGF_multi_methods[] = {
+  {"__gc", luaSGF_multi_destroy},
+  {"destroy", luaSGF_multi_destroy},
+  {"apply", luaSGF_multi_apply},
+  {"apply_valid", luaSGF_multi_apply_valid},
+  {"derivatives", luaSGF_multi_derivatives},
+  {NULL, NULL}
+};
+
+static const struct luaL_Reg luaSGF_2d_methods[] = {
+  {"__gc", luaSGF_2d_destroy},
+  {"destroy", luaSGF_2d_destroy},
+  {"apply", luaSGF_2d_apply},
+  {"apply_valid", luaSGF_2d_apply_valid},
+  {"weights", luaSGF_2d_weights},
+  {"separable", luaSGF_2d_separable},
+  {NULL, NULL}
+};
+
+static const struct luaL_Reg luaSGF_pipeline_methods[] = {
+  {"__gc", luaSGF_pipeline_destroy},
+  {"destroy", luaSGF_pipeline_destroy},
+  {"apply", luaSGF_pipeline_apply},
+  {"apply_valid", luaSGF_pipeline_apply_valid},
+  {"taps", luaSGF_pipeline_taps},
+  {NULL, NULL}
+};
+
+static const struct luaL_Reg luaSGF_series_methods[] = {
+  {"__gc", luaSGF_series_destroy},
+  {"__len", luaSGF_series_len},
+  {"destroy", luaSGF_series_destroy},
+  {"set", luaSGF_series_set},
+  {"update_range", luaSGF_series_update_range},
+  {"append", luaSGF_series_append},
+  {"get", luaSGF_series_get},
+  {"output", luaSGF_series_output},
+  {NULL, NULL}
+};
+
+static const struct luaL_Reg luaSGF_buffer_methods[] = {
+  {"to_table", luaSGF_buffer_to_table},
+  {"dtype",    luaSGF_buffer_dtype},
+  {"scaling",  luaSGF_buffer_scaling},
+  {NULL, NULL}
+};
+
+static const struct luaL_Reg luaSGF_buffer_meta[] = {
+  {"__len",      luaSGF_buffer_len},
+  {"__newindex", luaSGF_buffer_newindex},
+  {"__tostring", luaSGF_buffer_tostring},
+  {NULL, NULL}
+};
+
+static const struct luaL_Reg luaSGF_buffer_funcs[] = {
+  {"new",        luaSGF_buffer_new},
+  {"from_table", luaSGF_buffer_from_table},
+  {"from_string", luaSGF_buffer_from_string},
+  {NULL, NULL}
+};
+
+static const struct luaL_Reg luaSGF_stream_methods[] = {
+  {"__gc",    luaSGF_stream_destroy},
+  {"destroy", luaSGF_stream_destroy},
+  {"push",    luaSGF_stream_push},
+  {"flush",   luaSGF_stream_flush},
+  {"reset",   luaSGF_stream_reset},
+  {"latency", luaSGF_stream_latency},
+  {NULL, NULL}
+};
+
+static const struct luaL_Reg luaSGF_scratch_meta[] = {
+  {"__gc", luaSGF_scratch_gc},
+  {NULL, NULL}
+};
+
+static const struct luaL_Reg luaSGF_cache_meta[] = {
+  {"__gc", luaSGF_cache_gc},
+  {NULL, NULL}
+};
+
+static const struct luaL_Reg luaSGF_filemaps_meta[] = {
+  {"__gc", luaSGF_filemaps_gc},
   {NULL, NULL}
 };
 
 static const struct luaL_Reg luaSGF_funcs[] = {
   {"new", luaSGF_savgol_create},
+  {"new_multi", luaSGF_multi_create},
+  {"new_2d", luaSGF_2d_create},
+  {"pipeline", luaSGF_pipeline_create},
+  {"series", luaSGF_series_create},
+  {"stream", luaSGF_stream_create},
+  {"simd_level", luaSGF_simd_level},
+  {"cache_stats", luaSGF_cache_stats},
+  {"cache_clear", luaSGF_cache_clear},
+  {"store_stats", luaSGF_store_stats},
+  {"load", luaSGF_load},
+  {"stats", luaSGF_stats},
+  {"stats_enable", luaSGF_stats_enable},
+  {"apply_file", luaSGF_apply_file},
   {"calc", luaSGF_calc}, // Legacy direct call
   {NULL, NULL}
 };
@@ -444,7 +7002,7 @@ static const struct luaL_Reg luaSGF_funcs[] = {
 /**
  * @brief Main entry point for require("luaSGF")
  */
-LUALIB_API int luaopen_luaSGF(lua_State *L) {
+LUASGF_EXPORT LUALIB_API int luaopen_luaSGF(lua_State *L) {
   // Create and setup the metatable for our userdata
   luaL_newmetatable(L, LUASGF_METATABLE);
   lua_pushvalue(L, -1);            // Duplicate metatable
@@ -452,12 +7010,108 @@ LUALIB_API int luaopen_luaSGF(lua_State *L) {
   luaL_setfuncs(L, luaSGF_filter_methods, 0);
   lua_pop(L, 1);                   // Pop metatable from stack
 
+  // Resumable call metatable
+  luaL_newmetatable(L, LUASGF_ASYNC_METATABLE);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  luaL_setfuncs(L, luaSGF_async_methods, 0);
+  lua_pop(L, 1);
+
+  // Background call metatable
+  luaL_newmetatable(L, LUASGF_SUBMIT_METATABLE);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  luaL_setfuncs(L, luaSGF_submit_methods, 0);
+  lua_pop(L, 1);
+
+  // Multi-derivative filter metatable
+  luaL_newmetatable(L, LUASGF_MULTI_METATABLE);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  luaL_setfuncs(L, luaSGF_multi_methods, 0);
+  lua_pop(L, 1);
+
+  // 2-D filter metatable
+  luaL_newmetatable(L, LUASGF_FILTER2D_METATABLE);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  luaL_setfuncs(L, luaSGF_2d_methods, 0);
+  lua_pop(L, 1);
+
+  // Pipeline metatable
+  luaL_newmetatable(L, LUASGF_PIPELINE_METATABLE);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  luaL_setfuncs(L, luaSGF_pipeline_methods, 0);
+  lua_pop(L, 1);
+
+  // Series metatable
+  luaL_newmetatable(L, LUASGF_SERIES_METATABLE);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  luaL_setfuncs(L, luaSGF_series_methods, 0);
+  lua_pop(L, 1);
+
+  // Stream metatable
+  luaL_newmetatable(L, LUASGF_STREAM_METATABLE);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  luaL_setfuncs(L, luaSGF_stream_methods, 0);
+  lua_pop(L, 1);
+
+  // Buffer metatable: __index dispatches numeric keys and method names
+  luaL_newmetatable(L, LUASGF_BUFFER_METATABLE);
+  luaL_setfuncs(L, luaSGF_buffer_meta, 0);
+  luaL_newlib(L, luaSGF_buffer_methods);
+  lua_pushcclosure(L, luaSGF_buffer_index, 1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+
+  // Module-wide scratch arena, coefficient cache and statistics, shared as
+  // upvalues 1 to 3 by the module functions
+  luaL_newmetatable(L, LUASGF_SCRATCH_METATABLE);
+  luaL_setfuncs(L, luaSGF_scratch_meta, 0);
+  lua_pop(L, 1);
+  luaL_newmetatable(L, LUASGF_CACHE_METATABLE);
+  luaL_setfuncs(L, luaSGF_cache_meta, 0);
+  lua_pop(L, 1);
+  luaL_newmetatable(L, LUASGF_FILEMAPS_METATABLE);
+  luaL_setfuncs(L, luaSGF_filemaps_meta, 0);
+  lua_pop(L, 1);
+
+  // Reference to the process-wide worker pool, released on lua_close()
+  if (lua_getfield(L, LUA_REGISTRYINDEX, LUASGF_POOL_KEY) == LUA_TNIL) {
+    lua_newuserdatauv(L, 0, 0);
+    lua_newtable(L);
+    lua_pushcfunction(L, luaSGF_pool_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    lua_setfield(L, LUA_REGISTRYINDEX, LUASGF_POOL_KEY);
+    sgf_pool_acquire();
+  }
+  lua_pop(L, 1);
+
   // Create the library table
-  luaL_newlib(L, luaSGF_funcs);
+  luaL_newlibtable(L, luaSGF_funcs);
+  util_new_scratch(L, LUASGF_CALC_SCRATCH_LIMIT);
+  util_new_cache(L);
+  // Module-wide statistics (upvalue 3), kept alive by the registry for filters
+  if (lua_getfield(L, LUA_REGISTRYINDEX, LUASGF_MONITOR_KEY) == LUA_TNIL) {
+    lua_pop(L, 1);
+    LuaSGF_Monitor *mon = (LuaSGF_Monitor *)lua_newuserdatauv(L, sizeof(LuaSGF_Monitor), 0);
+    memset(mon, 0, sizeof(LuaSGF_Monitor));
+    lua_pushvalue(L, -1);
+    lua_setfield(L, LUA_REGISTRYINDEX, LUASGF_MONITOR_KEY);
+  }
+  luaL_setfuncs(L, luaSGF_funcs, 3);
+
+  // Buffer constructors live in the luaSGF.buffer sub-table
+  luaL_newlib(L, luaSGF_buffer_funcs);
+  lua_setfield(L, -2, "buffer");
 
   // Create a metatable for the library table itself to support __call
   lua_newtable(L); 
-  lua_pushcfunction(L, luaSGF_calc);
+  lua_getfield(L, -2, "calc");
   lua_setfield(L, -2, "__call");
   lua_setmetatable(L, -2);
   
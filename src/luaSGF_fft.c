@@ -0,0 +1,223 @@
+/*
+MIT License
+
+Copyright (c) 2025-2026 The OneLuaPro project authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+ * Overlap-save FFT convolution for wide windows.
+ * The interior correlation y[i] = sum_j w[j] * x[i + j] is a convolution
+ * with the reversed weights, evaluated blockwise with a radix-2 transform of
+ * N >= 4 * taps points: each block of N input samples yields N - taps + 1
+ * outputs that do not wrap around. Two real blocks share one complex
+ * transform as its real and imaginary part. Cost per output grows with
+ * log N instead of taps; all arithmetic is in double precision.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "luaSGF_kernel.h"
+
+struct SgfFft {
+  int taps;
+  size_t size;        // transform length N, a power of two
+  double *spectrum;   // N complex: transform of the reversed weights, times 1/N
+  double *twiddle;    // N/2 complex: exp(-2 pi i k / N)
+  size_t *reverse;    // bit-reversed index of 0 .. N - 1
+};
+
+/**
+ * @brief In-place transform of N interleaved complex values; the inverse is
+ * not normalized.
+ */
+static void sgf_fft_transform(const SgfFft *f, double *z, int inverse) {
+  size_t n = f->size;
+  double sign = inverse ? -1.0 : 1.0;
+
+  for (size_t i = 0; i < n; i++) {
+    size_t j = f->reverse[i];
+    if (i < j) {
+      double re = z[2 * i], im = z[2 * i + 1];
+      z[2 * i] = z[2 * j];
+      z[2 * i + 1] = z[2 * j + 1];
+      z[2 * j] = re;
+      z[2 * j + 1] = im;
+    }
+  }
+
+  for (size_t len = 2; len <= n; len <<= 1) {
+    size_t half = len / 2, step = n / len;
+    for (size_t i = 0; i < n; i += len) {
+      for (size_t k = 0; k < half; k++) {
+	double wr = f->twiddle[2 * k * step];
+	double wi = sign * f->twiddle[2 * k * step + 1];
+	double *a = z + 2 * (i + k);
+	double *b = a + 2 * half;
+	double tr = b[0] * wr - b[1] * wi;
+	double ti = b[0] * wi + b[1] * wr;
+	b[0] = a[0] - tr;
+	b[1] = a[1] - ti;
+	a[0] += tr;
+	a[1] += ti;
+      }
+    }
+  }
+}
+
+SgfFft *sgf_fft_create(const double *w, int taps) {
+  if (taps < 1) {
+    return NULL;
+  }
+  size_t n = 16;
+  while (n < 4 * (size_t)taps) {
+    n <<= 1;
+  }
+
+  SgfFft *f = (SgfFft *)calloc(1, sizeof(SgfFft));
+  if (f == NULL) {
+    return NULL;
+  }
+  f->taps = taps;
+  f->size = n;
+  f->spectrum = (double *)calloc(2 * n, sizeof(double));
+  f->twiddle = (double *)malloc(n * sizeof(double));
+  f->reverse = (size_t *)malloc(n * sizeof(size_t));
+  if (!f->spectrum || !f->twiddle || !f->reverse) {
+    sgf_fft_destroy(f);
+    return NULL;
+  }
+
+  const double pi = 3.14159265358979323846;
+  for (size_t k = 0; k < n / 2; k++) {
+    double phi = -2.0 * pi * (double)k / (double)n;
+    f->twiddle[2 * k] = cos(phi);
+    f->twiddle[2 * k + 1] = sin(phi);
+  }
+  f->reverse[0] = 0;
+  for (size_t i = 1; i < n; i++) {
+    f->reverse[i] = (f->reverse[i >> 1] >> 1) | ((i & 1) ? n >> 1 : 0);
+  }
+
+  for (int j = 0; j < taps; j++) {
+    f->spectrum[2 * j] = w[taps - 1 - j];
+  }
+  sgf_fft_transform(f, f->spectrum, 0);
+  for (size_t k = 0; k < 2 * n; k++) {
+    f->spectrum[k] /= (double)n;
+  }
+  return f;
+}
+
+void sgf_fft_destroy(SgfFft *f) {
+  if (f != NULL) {
+    free(f->spectrum);
+    free(f->twiddle);
+    free(f->reverse);
+    free(f);
+  }
+}
+
+int sgf_fft_taps(const SgfFft *f) {
+  return f->taps;
+}
+
+size_t sgf_fft_work(const SgfFft *f) {
+  return 2 * f->size;
+}
+
+/**
+ * @brief Common implementation of sgf_fft_interior_f/_d().
+ */
+static void sgf_fft_interior(const SgfFft *f, const void *x, int single, void *y,
+			     size_t count, double *z) {
+  size_t n = f->size;
+  size_t taps = (size_t)f->taps;
+  size_t block = n - taps + 1;            // outputs per real block
+  size_t avail = count + taps - 1;        // input samples
+
+  for (size_t b = 0; b < count; b += 2 * block) {
+    /* Block b in the real part, block b + block in the imaginary part */
+    for (size_t part = 0; part < 2; part++) {
+      size_t first = b + part * block;
+      size_t have = (first < avail) ? avail - first : 0;
+      if (have > n) {
+	have = n;
+      }
+      double *dst = z + part;
+      if (single) {
+	const float *src = (const float *)x + first;
+	for (size_t j = 0; j < have; j++) {
+	  dst[2 * j] = (double)src[j];
+	}
+      } else {
+	const double *src = (const double *)x + first;
+	for (size_t j = 0; j < have; j++) {
+	  dst[2 * j] = src[j];
+	}
+      }
+      for (size_t j = have; j < n; j++) {
+	dst[2 * j] = 0.0;
+      }
+    }
+
+    sgf_fft_transform(f, z, 0);
+    for (size_t k = 0; k < n; k++) {
+      double re = z[2 * k], im = z[2 * k + 1];
+      double hr = f->spectrum[2 * k], hi = f->spectrum[2 * k + 1];
+      z[2 * k] = re * hr - im * hi;
+      z[2 * k + 1] = re * hi + im * hr;
+    }
+    sgf_fft_transform(f, z, 1);
+
+    /* Outputs that did not wrap around start at taps - 1 */
+    for (size_t part = 0; part < 2; part++) {
+      size_t first = b + part * block;
+      size_t len = (first < count) ? count - first : 0;
+      if (len > block) {
+	len = block;
+      }
+      const double *src = z + 2 * (taps - 1) + part;
+      if (single) {
+	float *dst = (float *)y + first;
+	for (size_t i = 0; i < len; i++) {
+	  dst[i] = (float)src[2 * i];
+	}
+      } else {
+	double *dst = (double *)y + first;
+	for (size_t i = 0; i < len; i++) {
+	  dst[i] = src[2 * i];
+	}
+      }
+    }
+  }
+}
+
+void sgf_fft_interior_f(const SgfFft *f, const float *x, float *y, size_t count,
+			double *work) {
+  sgf_fft_interior(f, x, 1, y, count, work);
+}
+
+void sgf_fft_interior_d(const SgfFft *f, const double *x, double *y, size_t count,
+			double *work) {
+  sgf_fft_interior(f, x, 0, y, count, work);
+}
@@ -0,0 +1,222 @@
+/*
+MIT License
+
+Copyright (c) 2025-2026 The OneLuaPro project authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+ * Memory-mapped files.
+ * Thin platform layer over mmap() and CreateFileMapping() for filtering
+ * files larger than the Lua heap. Mappings are shared, so the output is
+ * written through the page cache. Output files get their blocks allocated up
+ * front, so a full disk fails the open instead of faulting on a page write,
+ * and are flushed to disk when closed.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "luaSGF_kernel.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct SgfMap {
+  void *data;
+  size_t size;
+  int writable;
+#if defined(_WIN32)
+  HANDLE file, mapping;
+#else
+  int fd;
+#endif
+};
+
+#if defined(_WIN32)
+SgfMap *sgf_map_open(const char *path, size_t size, int writable) {
+  SgfMap *m = (SgfMap *)calloc(1, sizeof(SgfMap));
+  if (m == NULL) {
+    return NULL;
+  }
+  m->file = CreateFileA(path, writable ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ,
+			FILE_SHARE_READ, NULL, writable ? CREATE_ALWAYS : OPEN_EXISTING,
+			FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (m->file == INVALID_HANDLE_VALUE) {
+    free(m);
+    return NULL;
+  }
+  if (!writable) {
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(m->file, &file_size) ||
+	(unsigned long long)file_size.QuadPart > (unsigned long long)SIZE_MAX) {
+      sgf_map_close(m);
+      return NULL;
+    }
+    size = (size_t)file_size.QuadPart;
+  }
+  m->size = size;
+  m->writable = writable;
+  if (size == 0) {
+    return m;  // empty files cannot be mapped
+  }
+
+  unsigned long long s = (unsigned long long)size;
+  m->mapping = CreateFileMappingA(m->file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY,
+				  (DWORD)(s >> 32), (DWORD)(s & 0xffffffffu), NULL);
+  if (m->mapping != NULL) {
+    m->data = MapViewOfFile(m->mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0,
+			    size);
+  }
+  if (m->data == NULL) {
+    sgf_map_close(m);
+    return NULL;
+  }
+  return m;
+}
+
+int sgf_map_close(SgfMap *m) {
+  int failed = 0;
+  if (m->data != NULL) {
+    if (m->writable) {
+      failed |= !FlushViewOfFile(m->data, 0);
+    }
+    failed |= !UnmapViewOfFile(m->data);
+  }
+  if (m->writable) {
+    failed |= !FlushFileBuffers(m->file);
+  }
+  if (m->mapping != NULL) {
+    failed |= !CloseHandle(m->mapping);
+  }
+  failed |= !CloseHandle(m->file);
+  free(m);
+  return failed ? -1 : 0;
+}
+
+int sgf_map_same_file(const SgfMap *m, const char *path) {
+  BY_HANDLE_FILE_INFORMATION a, b;
+  HANDLE file = CreateFileA(path, FILE_READ_ATTRIBUTES,
+			    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+			    OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return 0;
+  }
+  int same = GetFileInformationByHandle(m->file, &a) && GetFileInformationByHandle(file, &b) &&
+    a.dwVolumeSerialNumber == b.dwVolumeSerialNumber &&
+    a.nFileIndexHigh == b.nFileIndexHigh && a.nFileIndexLow == b.nFileIndexLow;
+  CloseHandle(file);
+  return same;
+}
+#else
+/*
+ * Sizes a new output file. The blocks are allocated rather than left as a
+ * hole, since a mapping cannot report a full disk other than by SIGBUS. File
+ * systems without preallocation only get the size.
+ */
+static int sgf_map_allocate(int fd, size_t size) {
+#if !defined(__APPLE__)
+  if (size > 0) {
+    int rc = posix_fallocate(fd, 0, (off_t)size);
+    if (rc != EINVAL && rc != EOPNOTSUPP) {
+      return (rc == 0) ? 0 : -1;
+    }
+  }
+#endif
+  return (ftruncate(fd, (off_t)size) == 0) ? 0 : -1;
+}
+
+SgfMap *sgf_map_open(const char *path, size_t size, int writable) {
+  SgfMap *m = (SgfMap *)calloc(1, sizeof(SgfMap));
+  if (m == NULL) {
+    return NULL;
+  }
+  m->fd = writable ? open(path, O_RDWR | O_CREAT | O_TRUNC, 0666) : open(path, O_RDONLY);
+  if (m->fd < 0) {
+    free(m);
+    return NULL;
+  }
+  if (writable) {
+    if ((uint64_t)size > (uint64_t)INT64_MAX || sgf_map_allocate(m->fd, size) != 0) {
+      sgf_map_close(m);
+      return NULL;
+    }
+  } else {
+    struct stat st;
+    if (fstat(m->fd, &st) != 0 || (uint64_t)st.st_size > (uint64_t)SIZE_MAX) {
+      sgf_map_close(m);
+      return NULL;
+    }
+    size = (size_t)st.st_size;
+  }
+  m->size = size;
+  m->writable = writable;
+  if (size == 0) {
+    return m;  // empty files cannot be mapped
+  }
+
+  void *data = mmap(NULL, size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ,
+		    MAP_SHARED, m->fd, 0);
+  if (data == MAP_FAILED) {
+    sgf_map_close(m);
+    return NULL;
+  }
+  m->data = data;
+#if defined(POSIX_MADV_SEQUENTIAL)
+  posix_madvise(data, size, POSIX_MADV_SEQUENTIAL);
+#endif
+  return m;
+}
+
+int sgf_map_close(SgfMap *m) {
+  int failed = 0;
+  if (m->data != NULL) {
+    if (m->writable) {
+      failed |= (msync(m->data, m->size, MS_SYNC) != 0);
+    }
+    failed |= (munmap(m->data, m->size) != 0);
+  }
+  failed |= (close(m->fd) != 0);
+  free(m);
+  return failed ? -1 : 0;
+}
+
+int sgf_map_same_file(const SgfMap *m, const char *path) {
+  struct stat a, b;
+  return fstat(m->fd, &a) == 0 && stat(path, &b) == 0 &&
+    a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+}
+#endif
+
+void *sgf_map_data(const SgfMap *m) {
+  return m->data;
+}
+
+size_t sgf_map_size(const SgfMap *m) {
+  return m->size;
+}
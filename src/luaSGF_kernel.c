@@ -0,0 +1,749 @@
+/*
+MIT License
+
+Copyright (c) 2025-2026 The OneLuaPro project authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <savgolFilter.h>
+
+#include "luaSGF_kernel.h"
+
+/*============================================================================
+ * WEIGHTS
+ *============================================================================*/
+/*
+ * The weights for output position pos are row d of the pseudo-inverse of the
+ * Vandermonde matrix A[j][k] = u_j^k, u_j = (j - pos) / s. With the thin QR
+ * decomposition A = QR this row is Q * R^-T * e_d. Scaling the abscissa by
+ * s (about half the window) and orthogonalizing with modified Gram-Schmidt
+ * keeps the problem well conditioned.
+ */
+static void sgf_vandermonde(const double *x, int rows, int cols, double x0, double s,
+			    double *q) {
+  /* Column-major: q[k * rows + j] = u_j^k */
+  for (int j = 0; j < rows; j++) {
+    double u = (x != NULL ? x[j] - x0 : (double)j - x0) / s;
+    double p = 1.0;
+    for (int k = 0; k < cols; k++) {
+      q[k * rows + j] = p;
+      p *= u;
+    }
+  }
+}
+
+static double sgf_factorial(int k) {
+  double f = 1.0;
+  for (int i = 2; i <= k; i++) {
+    f *= i;
+  }
+  return f;
+}
+
+/*
+ * Weights of factor times coefficient 'unit' of the fit from the design
+ * matrix q (rows x cols), overwritten by Q: with unit = d and factor = d!
+ * the derivative at u = 0. r (cols x cols) must be zeroed, z holds cols.
+ * The result is per unit of u; the caller divides by s^d.
+ */
+static int sgf_fit(int rows, int cols, int unit, double factor, double *q, double *r,
+		   double *z, double *weights) {
+  /* Modified Gram-Schmidt with one re-orthogonalization pass */
+  for (int k = 0; k < cols; k++) {
+    double *qk = q + (size_t)k * rows;
+    for (int pass = 0; pass < 2; pass++) {
+      for (int i = 0; i < k; i++) {
+	const double *qi = q + (size_t)i * rows;
+	double dot = 0.0;
+	for (int j = 0; j < rows; j++) {
+	  dot += qi[j] * qk[j];
+	}
+	for (int j = 0; j < rows; j++) {
+	  qk[j] -= dot * qi[j];
+	}
+	r[i * cols + k] += dot;
+      }
+    }
+    double norm = 0.0;
+    for (int j = 0; j < rows; j++) {
+      norm += qk[j] * qk[j];
+    }
+    norm = sqrt(norm);
+    if (norm == 0.0) {
+      return -1;
+    }
+    r[k * cols + k] = norm;
+    for (int j = 0; j < rows; j++) {
+      qk[j] /= norm;
+    }
+  }
+
+  /* Forward substitution: R^T z = e_unit */
+  for (int i = 0; i < cols; i++) {
+    double acc = (i == unit) ? 1.0 : 0.0;
+    for (int k = 0; k < i; k++) {
+      acc -= r[k * cols + i] * z[k];
+    }
+    z[i] = acc / r[i * cols + i];
+  }
+
+  /* w = factor * Q z */
+  for (int j = 0; j < rows; j++) {
+    double acc = 0.0;
+    for (int k = 0; k < cols; k++) {
+      acc += q[(size_t)k * rows + j] * z[k];
+    }
+    weights[j] = factor * acc;
+  }
+  return 0;
+}
+
+int sgf_weights(int window_size, double pos, int poly_order, int derivative,
+		double *weights) {
+  if (window_size < 1 || poly_order < 0 || poly_order >= window_size ||
+      derivative < 0 || derivative > poly_order) {
+    return -1;
+  }
+
+  int rows = window_size;
+  int cols = poly_order + 1;
+  double s = (window_size > 2) ? 0.5 * (window_size - 1) : 1.0;
+
+  double *q = (double *)malloc((size_t)rows * cols * sizeof(double));
+  double *r = (double *)calloc((size_t)cols * cols, sizeof(double));
+  double *z = (double *)malloc((size_t)cols * sizeof(double));
+  if (!q || !r || !z) {
+    free(q); free(r); free(z);
+    return -1;
+  }
+
+  sgf_vandermonde(NULL, rows, cols, pos, s, q);
+  int rc = sgf_fit(rows, cols, derivative, sgf_factorial(derivative), q, r, z, weights);
+  if (rc == 0) {
+    double scale = pow(s, derivative);
+    for (int j = 0; j < rows; j++) {
+      weights[j] /= scale;
+    }
+  }
+
+  free(q); free(r); free(z);
+  return rc;
+}
+
+int sgf_weights_at(const double *x, int count, double x0, int poly_order,
+		   int derivative, double *weights, double *work) {
+  if (count < 1 || poly_order < 0 || poly_order >= count ||
+      derivative < 0 || derivative > poly_order) {
+    return -1;
+  }
+  double s = 0.5 * (x[count - 1] - x[0]);
+  if (!(s > 0.0)) {
+    return -1;
+  }
+
+  int cols = poly_order + 1;
+  double *q = work;
+  double *r = q + (size_t)count * cols;
+  double *z = r + (size_t)cols * cols;
+  memset(r, 0, (size_t)cols * cols * sizeof(double));
+  sgf_vandermonde(x, count, cols, x0, s, q);
+  if (sgf_fit(count, cols, derivative, sgf_factorial(derivative), q, r, z, weights) != 0) {
+    return -1;
+  }
+  double scale = pow(s, derivative);
+  for (int j = 0; j < count; j++) {
+    weights[j] /= scale;
+  }
+  return 0;
+}
+
+/**
+ * @brief Common implementation; tol is relative to the largest weight and
+ * covers the round-off of the weights, not genuinely asymmetric ones.
+ */
+static int sgf_symmetrize(double *w, int n, int derivative, double tol) {
+  int symmetry = (derivative % 2 == 0) ? SGF_SYMMETRIC : SGF_ANTISYMMETRIC;
+  double sign = (symmetry == SGF_SYMMETRIC) ? 1.0 : -1.0;
+
+  double peak = 0.0;
+  for (int j = 0; j <= 2 * n; j++) {
+    peak = fmax(peak, fabs(w[j]));
+  }
+  double lim = tol * peak;
+  for (int k = 1; k <= n; k++) {
+    if (fabs(w[n + k] - sign * w[n - k]) > lim) {
+      return SGF_ASYMMETRIC;
+    }
+  }
+  if (symmetry == SGF_ANTISYMMETRIC) {
+    if (fabs(w[n]) > lim) {
+      return SGF_ASYMMETRIC;
+    }
+    w[n] = 0.0;
+  }
+  for (int k = 1; k <= n; k++) {
+    double mean = 0.5 * (w[n + k] + sign * w[n - k]);
+    w[n + k] = mean;
+    w[n - k] = sign * mean;
+  }
+  return symmetry;
+}
+
+int sgf_symmetrize_d(double *w, int half_window, int derivative) {
+  return sgf_symmetrize(w, half_window, derivative, 1e-12);
+}
+
+int sgf_symmetrize_f(float *w, int half_window, int derivative) {
+  double tmp[2 * SGF_MAX_HALF_WINDOW + 1];
+  if (half_window < 1 || half_window > SGF_MAX_HALF_WINDOW) {
+    return SGF_ASYMMETRIC;
+  }
+  for (int j = 0; j <= 2 * half_window; j++) {
+    tmp[j] = w[j];
+  }
+  int symmetry = sgf_symmetrize(tmp, half_window, derivative, 1e-5);
+  if (symmetry != SGF_ASYMMETRIC) {
+    for (int j = 0; j <= 2 * half_window; j++) {
+      w[j] = (float)tmp[j];
+    }
+  }
+  return symmetry;
+}
+
+/*============================================================================
+ * PLAN
+ *============================================================================*/
+/**
+ * @brief Allocates a plan for a valid configuration, leaving the weights and
+ * fit rows uninitialized.
+ * @return The plan, or NULL on invalid parameters or out of memory.
+ */
+static SgfPlan *sgf_plan_alloc(const SgfPlanConfig *config) {
+  int n = config->half_window;
+  if (n < 1 || n > SGF_MAX_PLAN_HALF_WINDOW ||
+      config->poly_order < 0 || config->poly_order > SGF_MAX_POLY_ORDER ||
+      config->poly_order >= 2 * n + 1 ||
+      config->derivative < 0 || config->derivative > SGF_MAX_DERIVATIVE ||
+      config->derivative > config->poly_order ||
+      !(config->time_step > 0.0) ||
+      config->target_point < -n || config->target_point > n ||
+      config->boundary < SAVGOL_BOUNDARY_POLYNOMIAL ||
+      config->boundary > SAVGOL_BOUNDARY_CONSTANT) {
+    return NULL;
+  }
+
+  int w = 2 * n + 1;
+  SgfPlan *plan = (SgfPlan *)malloc(sizeof(SgfPlan));
+  double *mem = (double *)malloc(SGF_PLAN_DATA(w, config->poly_order) * sizeof(double));
+  if (!plan || !mem) {
+    free(plan); free(mem);
+    return NULL;
+  }
+
+  int t = config->target_point;
+  plan->config = *config;
+  plan->window_size = w;
+  plan->lead = n + t;
+  plan->trail = n - t;
+  plan->symmetry = SGF_ASYMMETRIC;
+  plan->weights = mem;
+  plan->fit = mem + w;
+  return plan;
+}
+
+SgfPlan *sgf_plan_create(const SgfPlanConfig *config) {
+  SgfPlan *plan = sgf_plan_alloc(config);
+  if (plan == NULL) {
+    return NULL;
+  }
+
+  int n = config->half_window;
+  int w = plan->window_size;
+  int m = config->poly_order;
+  int d = config->derivative;
+  int t = config->target_point;
+  int failed = sgf_weights(w, (double)(n + t), m, d, plan->weights);
+
+  /* Polynomial boundaries evaluate the fit of the first/last window
+     off-target: its coefficients in u = (j - n) / s are b_k = s^k / k! times
+     the k-th derivative weights at the center */
+  double s = (w > 2) ? (double)n : 1.0;
+  double factor = 1.0;
+  for (int k = 0; k <= m && !failed; k++) {
+    double *row = plan->fit + (size_t)k * w;
+    failed |= sgf_weights(w, (double)n, m, k, row);
+    factor *= (k > 0) ? s / k : 1.0;
+    for (int j = 0; j < w; j++) {
+      row[j] *= factor;
+    }
+  }
+  if (failed) {
+    sgf_plan_destroy(plan);
+    return NULL;
+  }
+
+  /* Derivatives are scaled from per-sample to per-time_step units */
+  double scale = pow(config->time_step, -d);
+  for (int j = 0; j < w; j++) {
+    plan->weights[j] *= scale;
+  }
+  plan->symmetry = (t == 0) ? sgf_symmetrize_d(plan->weights, n, d) : SGF_ASYMMETRIC;
+  return plan;
+}
+
+SgfPlan *sgf_plan_restore(const SgfPlanConfig *config, const double *data) {
+  SgfPlan *plan = sgf_plan_alloc(config);
+  if (plan == NULL) {
+    return NULL;
+  }
+  int n = config->half_window;
+  memcpy(plan->weights, data,
+	 SGF_PLAN_DATA(plan->window_size, config->poly_order) * sizeof(double));
+  plan->symmetry = (config->target_point == 0) ?
+    sgf_symmetrize_d(plan->weights, n, config->derivative) : SGF_ASYMMETRIC;
+  return plan;
+}
+
+void sgf_plan_destroy(SgfPlan *plan) {
+  if (plan != NULL) {
+    free(plan->weights);
+    free(plan);
+  }
+}
+
+/*============================================================================
+ * APPLY
+ *============================================================================*/
+/**
+ * @brief Maps an out-of-range sample index onto the signal (len >= window).
+ */
+static size_t sgf_edge_index(int boundary, ptrdiff_t i, size_t len) {
+  ptrdiff_t last = (ptrdiff_t)len - 1;
+  switch (boundary) {
+  case SAVGOL_BOUNDARY_REFLECT:
+    /* Mirror about the edge sample: x[-k] = x[k] */
+    return (size_t)((i < 0) ? -i : 2 * last - i);
+  case SAVGOL_BOUNDARY_PERIODIC:
+    return (size_t)((i < 0) ? i + (ptrdiff_t)len : i - (ptrdiff_t)len);
+  default: /* SAVGOL_BOUNDARY_CONSTANT */
+    return (size_t)((i < 0) ? 0 : last);
+  }
+}
+
+/**
+ * @brief Sample i of a float (single != 0) or double array.
+ */
+static double sgf_load(const void *in, int single, size_t i) {
+  return single ? (double)((const float *)in)[i] : ((const double *)in)[i];
+}
+
+static void sgf_store(void *out, int single, size_t i, double v) {
+  if (single) {
+    ((float *)out)[i] = (float)v;
+  } else {
+    ((double *)out)[i] = v;
+  }
+}
+
+/**
+ * @brief Polynomial boundary: fits the window starting at sample 'first' and
+ * writes the d-th derivative of the fit at window positions n + u0, n + u0 +
+ * 1, ... to count outputs starting at 'at'.
+ */
+static void sgf_edge_fit(const SgfPlan *plan, const void *in, int single, size_t first,
+			 void *out, size_t at, int count, double u0) {
+  int n = plan->config.half_window;
+  int m = plan->config.poly_order;
+  int d = plan->config.derivative;
+  int w = plan->window_size;
+  double s = (w > 2) ? (double)n : 1.0;
+  double c[SGF_MAX_POLY_ORDER + 1];
+
+  /* Coefficients of the d-th derivative, times k! / (k - d)! */
+  for (int k = d; k <= m; k++) {
+    const double *row = plan->fit + (size_t)k * w;
+    double acc = 0.0;
+    for (int j = 0; j < w; j++) {
+      acc += row[j] * sgf_load(in, single, first + j);
+    }
+    for (int i = k - d + 1; i <= k; i++) {
+      acc *= i;
+    }
+    c[k] = acc;
+  }
+
+  double scale = pow(plan->config.time_step * s, -d);
+  for (int i = 0; i < count; i++) {
+    double u = (u0 + i) / s;
+    double acc = 0.0;
+    for (int k = m; k >= d; k--) {
+      acc = acc * u + c[k];
+    }
+    sgf_store(out, single, at + i, acc * scale);
+  }
+}
+
+/**
+ * @brief Boundary outputs of either precision; only depends on the first and
+ * last window, except for periodic wrap-around.
+ */
+static void sgf_apply_edges(const SgfPlan *plan, const void *in, int single,
+			    void *out, size_t len) {
+  int n = plan->config.half_window;
+  int t = plan->config.target_point;
+  int w = plan->window_size;
+
+  if (plan->config.boundary == SAVGOL_BOUNDARY_POLYNOMIAL) {
+    sgf_edge_fit(plan, in, single, 0, out, 0, plan->lead, (double)-n);
+    sgf_edge_fit(plan, in, single, len - w, out, len - plan->trail, plan->trail,
+		 (double)(n + 1 - plan->trail));
+    return;
+  }
+
+  /* Interior weights on the virtually extended signal: output k reads the
+     window starting at k - n - t */
+  for (int i = 0; i < plan->lead + plan->trail; i++) {
+    size_t k = (i < plan->lead) ? (size_t)i : len - plan->trail + (i - plan->lead);
+    ptrdiff_t lo = (ptrdiff_t)k - n - t;
+    double acc = 0.0;
+    for (int j = 0; j < w; j++) {
+      ptrdiff_t a = lo + j;
+      size_t ia = (a < 0 || a >= (ptrdiff_t)len) ?
+	sgf_edge_index(plan->config.boundary, a, len) : (size_t)a;
+      acc += plan->weights[j] * sgf_load(in, single, ia);
+    }
+    sgf_store(out, single, k, acc);
+  }
+}
+
+void sgf_apply_edges_d(const SgfPlan *plan, const double *in, double *out,
+		       size_t len) {
+  sgf_apply_edges(plan, in, 0, out, len);
+}
+
+void sgf_apply_edges_f(const SgfPlan *plan, const float *in, float *out,
+		       size_t len) {
+  sgf_apply_edges(plan, in, 1, out, len);
+}
+
+void sgf_edges_periodic_f(const float *w, int half_window, const float *in,
+			  float *out, size_t len) {
+  int n = half_window;
+  for (int i = 0; i < n; i++) {
+    ptrdiff_t lo = (ptrdiff_t)i - n;
+    ptrdiff_t hi = (ptrdiff_t)(len - n + i) - n;
+    float acc_l = 0.0f, acc_r = 0.0f;
+    for (int j = 0; j <= 2 * n; j++) {
+      ptrdiff_t a = lo + j, b = hi + j;
+      size_t ia = (a < 0) ? sgf_edge_index(SAVGOL_BOUNDARY_PERIODIC, a, len) : (size_t)a;
+      size_t ib = (b >= (ptrdiff_t)len) ? sgf_edge_index(SAVGOL_BOUNDARY_PERIODIC, b, len)
+	: (size_t)b;
+      acc_l += w[j] * in[ia];
+      acc_r += w[j] * in[ib];
+    }
+    out[i] = acc_l;
+    out[len - n + i] = acc_r;
+  }
+}
+
+size_t sgf_apply_valid_d(const SgfPlan *plan, const double *in, size_t len,
+			 double *out) {
+  size_t w = (size_t)plan->window_size;
+  if (len < w) {
+    return 0;
+  }
+
+  size_t count = len - w + 1;
+  if (plan->symmetry != SGF_ASYMMETRIC) {
+    sgf_interior_sym_d(plan->weights, plan->config.half_window, plan->symmetry,
+		       in, out, count);
+  } else {
+    sgf_interior_d(plan->weights, (int)w, in, out, count);
+  }
+  return count;
+}
+
+void sgf_apply_d(const SgfPlan *plan, const double *in, double *out, size_t len) {
+  if (len < (size_t)plan->window_size) {
+    return;
+  }
+  sgf_apply_valid_d(plan, in, len, out + plan->lead);
+  sgf_apply_edges_d(plan, in, out, len);
+}
+
+/*============================================================================
+ * 2-D FITS
+ *============================================================================*/
+/*
+ * The window of wy x wx samples is fitted by a polynomial of total degree m
+ * in u = (i - py) / ny and v = (j - px) / nx. Its terms u^a v^b are ordered
+ * by degree a + b, and by b within a degree.
+ */
+static int sgf_term_count(int poly_order) {
+  return (poly_order + 1) * (poly_order + 2) / 2;
+}
+
+/**
+ * @brief Weights of factor times coefficient (a, b) of the 2-D fit around
+ * window position (py, px); per unit of u and v.
+ */
+static int sgf_fit2d(const SgfPlan2dConfig *config, double py, double px, int a, int b,
+		     double factor, double *weights) {
+  int ny = config->half_window[0], nx = config->half_window[1];
+  int wy = 2 * ny + 1, wx = 2 * nx + 1;
+  int m = config->poly_order;
+  int rows = wy * wx;
+  int cols = sgf_term_count(m);
+
+  double *q = (double *)malloc((size_t)rows * cols * sizeof(double));
+  double *r = (double *)calloc((size_t)cols * cols, sizeof(double));
+  double *z = (double *)malloc((size_t)cols * sizeof(double));
+  if (!q || !r || !z) {
+    free(q); free(r); free(z);
+    return -1;
+  }
+
+  /* Column-major design matrix: q[k * rows + i * wx + j] = u_i^a' v_j^b' */
+  int unit = -1, k = 0;
+  for (int g = 0; g <= m; g++) {
+    for (int tb = 0; tb <= g; tb++, k++) {
+      int ta = g - tb;
+      unit = (ta == a && tb == b) ? k : unit;
+      for (int i = 0; i < wy; i++) {
+	double pu = pow(((double)i - py) / ny, ta);
+	for (int j = 0; j < wx; j++) {
+	  q[(size_t)k * rows + i * wx + j] = pu * pow(((double)j - px) / nx, tb);
+	}
+      }
+    }
+  }
+  int rc = (unit >= 0) ? sgf_fit(rows, cols, unit, factor, q, r, z, weights) : -1;
+
+  free(q); free(r); free(z);
+  return rc;
+}
+
+SgfPlan2d *sgf_plan2d_create(const SgfPlan2dConfig *config) {
+  int m = config->poly_order;
+  for (int axis = 0; axis < 2; axis++) {
+    int n = config->half_window[axis];
+    if (n < 1 || n > SGF_MAX_HALF_WINDOW || m >= 2 * n + 1 ||
+	config->derivative[axis] < 0 || !(config->time_step[axis] > 0.0)) {
+      return NULL;
+    }
+  }
+  int dy = config->derivative[0], dx = config->derivative[1];
+  if (m < 0 || m > SGF_MAX_POLY_ORDER || dy + dx > m ||
+      config->boundary < SAVGOL_BOUNDARY_POLYNOMIAL ||
+      config->boundary > SAVGOL_BOUNDARY_CONSTANT) {
+    return NULL;
+  }
+
+  int ny = config->half_window[0], nx = config->half_window[1];
+  int taps = (2 * ny + 1) * (2 * nx + 1);
+  int terms = sgf_term_count(m);
+  SgfPlan2d *plan = (SgfPlan2d *)malloc(sizeof(SgfPlan2d));
+  double *mem = (double *)malloc((size_t)(terms + 1) * taps * sizeof(double));
+  if (!plan || !mem) {
+    free(plan); free(mem);
+    return NULL;
+  }
+
+  plan->config = *config;
+  plan->window[0] = 2 * ny + 1;
+  plan->window[1] = 2 * nx + 1;
+  plan->terms = terms;
+  plan->weights = mem;
+  plan->fit = mem + taps;
+
+  int failed = sgf_fit2d(config, ny, nx, dy, dx, sgf_factorial(dy) * sgf_factorial(dx),
+			 plan->weights);
+  /* Polynomial boundaries evaluate the fit of edge windows off-center */
+  for (int g = 0, k = 0; g <= m && !failed; g++) {
+    for (int b = 0; b <= g && !failed; b++, k++) {
+      failed |= sgf_fit2d(config, ny, nx, g - b, b, 1.0, plan->fit + (size_t)k * taps);
+    }
+  }
+  if (failed) {
+    sgf_plan2d_destroy(plan);
+    return NULL;
+  }
+
+  double scale = pow(config->time_step[0] * ny, -dy) * pow(config->time_step[1] * nx, -dx);
+  for (int j = 0; j < taps; j++) {
+    plan->weights[j] *= scale;
+  }
+  return plan;
+}
+
+void sgf_plan2d_destroy(SgfPlan2d *plan) {
+  if (plan != NULL) {
+    free(plan->weights);
+    free(plan);
+  }
+}
+
+/**
+ * @brief Polynomial boundary: fits the window with its first sample at row
+ * sr, column sc and writes the derivative of the fit at the outputs of rows
+ * [r0, r1) and columns [c0, c1).
+ */
+static void sgf_edge_fit2d(const SgfPlan2d *plan, const void *in, int single,
+			   size_t in_stride, size_t sr, size_t sc, void *out,
+			   size_t out_stride, size_t r0, size_t r1, size_t c0, size_t c1) {
+  int ny = plan->config.half_window[0], nx = plan->config.half_window[1];
+  int dy = plan->config.derivative[0], dx = plan->config.derivative[1];
+  int m = plan->config.poly_order;
+  int wy = plan->window[0], wx = plan->window[1];
+  double c[SGF_MAX_TERMS_2D];
+
+  /* Coefficients of the derivative, times a! / (a - dy)! * b! / (b - dx)! */
+  for (int g = 0, k = 0; g <= m; g++) {
+    for (int b = 0; b <= g; b++, k++) {
+      int a = g - b;
+      c[k] = 0.0;
+      if (a < dy || b < dx) {
+	continue;
+      }
+      const double *row = plan->fit + (size_t)k * wy * wx;
+      double acc = 0.0;
+      for (int i = 0; i < wy; i++) {
+	size_t base = (sr + i) * in_stride + sc;
+	for (int j = 0; j < wx; j++) {
+	  acc += row[i * wx + j] * sgf_load(in, single, base + j);
+	}
+      }
+      c[k] = acc * sgf_factorial(a) / sgf_factorial(a - dy) *
+	sgf_factorial(b) / sgf_factorial(b - dx);
+    }
+  }
+
+  double scale = pow(plan->config.time_step[0] * ny, -dy) *
+    pow(plan->config.time_step[1] * nx, -dx);
+  double pu[SGF_MAX_POLY_ORDER + 1], pv[SGF_MAX_POLY_ORDER + 1];
+  for (size_t r = r0; r < r1; r++) {
+    double u = ((double)(r - sr) - ny) / ny;
+    pu[0] = 1.0;
+    for (int a = 1; a <= m; a++) {
+      pu[a] = pu[a - 1] * u;
+    }
+    for (size_t col = c0; col < c1; col++) {
+      double v = ((double)(col - sc) - nx) / nx;
+      pv[0] = 1.0;
+      for (int b = 1; b <= m; b++) {
+	pv[b] = pv[b - 1] * v;
+      }
+      double acc = 0.0;
+      for (int g = 0, k = 0; g <= m; g++) {
+	for (int b = 0; b <= g; b++, k++) {
+	  if (g - b >= dy && b >= dx) {
+	    acc += c[k] * pu[g - b - dy] * pv[b - dx];
+	  }
+	}
+      }
+      sgf_store(out, single, r * out_stride + col, acc * scale);
+    }
+  }
+}
+
+/**
+ * @brief Outputs of row r, columns [c0, c1) from the interior weights on the
+ * virtually extended image.
+ */
+static void sgf_edge_conv2d(const SgfPlan2d *plan, const void *in, int single,
+			    size_t in_stride, size_t rows, size_t cols, void *out,
+			    size_t out_stride, size_t r, size_t c0, size_t c1) {
+  int ny = plan->config.half_window[0], nx = plan->config.half_window[1];
+  int wy = plan->window[0], wx = plan->window[1];
+  int boundary = plan->config.boundary;
+  for (size_t col = c0; col < c1; col++) {
+    double acc = 0.0;
+    for (int i = 0; i < wy; i++) {
+      ptrdiff_t a = (ptrdiff_t)r - ny + i;
+      size_t ia = (a < 0 || a >= (ptrdiff_t)rows) ? sgf_edge_index(boundary, a, rows) :
+	(size_t)a;
+      for (int j = 0; j < wx; j++) {
+	ptrdiff_t b = (ptrdiff_t)col - nx + j;
+	size_t ib = (b < 0 || b >= (ptrdiff_t)cols) ? sgf_edge_index(boundary, b, cols) :
+	  (size_t)b;
+	acc += plan->weights[i * wx + j] * sgf_load(in, single, ia * in_stride + ib);
+      }
+    }
+    sgf_store(out, single, r * out_stride + col, acc);
+  }
+}
+
+/**
+ * @brief Boundary outputs of either precision. Polynomial boundaries fit each
+ * edge window once and evaluate it at all outputs it serves.
+ */
+static void sgf_apply_edges2d(const SgfPlan2d *plan, const void *in, int single,
+			      size_t in_stride, void *out, size_t out_stride,
+			      size_t rows, size_t cols) {
+  size_t ny = (size_t)plan->config.half_window[0];
+  size_t nx = (size_t)plan->config.half_window[1];
+  size_t last_r = rows - (size_t)plan->window[0];
+  size_t last_c = cols - (size_t)plan->window[1];
+
+  if (plan->config.boundary == SAVGOL_BOUNDARY_POLYNOMIAL) {
+    /* Top and bottom bands: first and last window row, every window column */
+    for (int e = 0; e < 2; e++) {
+      size_t sr = e ? last_r : 0;
+      size_t r0 = e ? rows - ny : 0;
+      for (size_t sc = 0; sc <= last_c; sc++) {
+	size_t c0 = (sc == 0) ? 0 : sc + nx;
+	size_t c1 = (sc == last_c) ? cols : sc + nx + 1;
+	sgf_edge_fit2d(plan, in, single, in_stride, sr, sc, out, out_stride,
+		       r0, r0 + ny, c0, c1);
+      }
+    }
+    /* Left and right bands in between */
+    for (size_t r = ny; r < rows - ny; r++) {
+      sgf_edge_fit2d(plan, in, single, in_stride, r - ny, 0, out, out_stride,
+		     r, r + 1, 0, nx);
+      sgf_edge_fit2d(plan, in, single, in_stride, r - ny, last_c, out, out_stride,
+		     r, r + 1, cols - nx, cols);
+    }
+    return;
+  }
+
+  for (size_t r = 0; r < rows; r++) {
+    if (r < ny || r >= rows - ny) {
+      sgf_edge_conv2d(plan, in, single, in_stride, rows, cols, out, out_stride, r, 0, cols);
+    } else {
+      sgf_edge_conv2d(plan, in, single, in_stride, rows, cols, out, out_stride, r, 0, nx);
+      sgf_edge_conv2d(plan, in, single, in_stride, rows, cols, out, out_stride, r,
+		      cols - nx, cols);
+    }
+  }
+}
+
+void sgf_apply_edges2d_d(const SgfPlan2d *plan, const double *in, size_t in_stride,
+			 double *out, size_t out_stride, size_t rows, size_t cols) {
+  sgf_apply_edges2d(plan, in, 0, in_stride, out, out_stride, rows, cols);
+}
+
+void sgf_apply_edges2d_f(const SgfPlan2d *plan, const float *in, size_t in_stride,
+			 float *out, size_t out_stride, size_t rows, size_t cols) {
+  sgf_apply_edges2d(plan, in, 1, in_stride, out, out_stride, rows, cols);
+}
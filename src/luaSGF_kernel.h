@@ -0,0 +1,364 @@
+/*
+MIT License
+
+Copyright (c) 2025-2026 The OneLuaPro project authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * Filter kernels of the luaSGF binding.
+ * Computes Savitzky-Golay weights in double precision and applies them,
+ * independent of the Lua API. Boundary modes use the SAVGOL_BOUNDARY_*
+ * values of the core library.
+ */
+
+#ifndef LUASGF_KERNEL_H
+#define LUASGF_KERNEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Parameter limits, identical to the core library
+#define SGF_MAX_HALF_WINDOW 32
+#define SGF_MAX_POLY_ORDER  10
+#define SGF_MAX_DERIVATIVE  4
+
+// Half-window limit of plans (binding kernels only, 8193 taps)
+#define SGF_MAX_PLAN_HALF_WINDOW 4096
+
+typedef struct {
+  int half_window;   // n: window spans 2n+1 samples
+  int poly_order;    // m
+  int derivative;    // d
+  double time_step;  // sample spacing for derivative scaling
+  int boundary;      // SAVGOL_BOUNDARY_*
+  int target_point;  // t: evaluated sample relative to the window center, -n..n
+} SgfPlanConfig;
+
+// Symmetry of centered weights, selects the folded interior kernel
+enum {
+  SGF_ASYMMETRIC = 0,
+  SGF_SYMMETRIC,      // w[n-k] == w[n+k]: smoothing, even derivatives
+  SGF_ANTISYMMETRIC   // w[n-k] == -w[n+k]: odd derivatives
+};
+
+/*
+ * Precomputed double-precision filter. Output k estimates sample k from the
+ * window starting at k - n - t, so t = n is causal (newest sample) and t = 0
+ * centered. The first n + t and last n - t outputs are boundary outputs.
+ */
+typedef struct {
+  SgfPlanConfig config;
+  int window_size;
+  int lead, trail;     // boundary outputs before/after the interior (n + t, n - t)
+  int symmetry;        // SGF_SYMMETRIC etc. of the weights (centered only)
+  double *weights;     // interior weights, window_size entries
+  double *fit;         // polynomial boundary: poly_order + 1 rows of window_size,
+                       // coefficients of the window fit in u = (j - n) / n
+} SgfPlan;
+
+/**
+ * @brief Least-squares weights for evaluating the d-th derivative of the
+ * order-m polynomial fitted to window_size equidistant samples at position
+ * pos (0 = first sample, may be fractional or outside the window).
+ * Derivatives are per sample; divide by time_step^d for physical units.
+ * @return 0 on success, -1 on invalid parameters or out of memory.
+ */
+int sgf_weights(int window_size, double pos, int poly_order, int derivative,
+		double *weights);
+
+/**
+ * @brief Least-squares weights for evaluating the d-th derivative at x0 of
+ * the order-m polynomial fitted to count samples at increasing abscissas x
+ * (non-uniform sampling). Derivatives are per unit of x.
+ * @param work SGF_WEIGHTS_WORK(count, poly_order) doubles.
+ * @return 0 on success, -1 on invalid parameters or degenerate abscissas.
+ */
+#define SGF_WEIGHTS_WORK(count, m) ((size_t)((m) + 1) * ((size_t)(count) + (m) + 2))
+int sgf_weights_at(const double *x, int count, double x0, int poly_order,
+		   int derivative, double *weights, double *work);
+
+/**
+ * @brief Checks centered weights (2n+1 taps) for the symmetry expected from
+ * the derivative parity and makes it exact, e.g. after float round-off.
+ * @return SGF_SYMMETRIC or SGF_ANTISYMMETRIC, or SGF_ASYMMETRIC (weights
+ * unchanged) if they do not match within a relative tolerance.
+ */
+int sgf_symmetrize_f(float *w, int half_window, int derivative);
+int sgf_symmetrize_d(double *w, int half_window, int derivative);
+
+/**
+ * @brief Creates a plan, or returns NULL on invalid parameters/out of memory.
+ */
+SgfPlan *sgf_plan_create(const SgfPlanConfig *config);
+void sgf_plan_destroy(SgfPlan *plan);
+
+// Doubles of the weights and fit rows of a plan, contiguous from plan->weights
+#define SGF_PLAN_DATA(w, m) ((size_t)((m) + 2) * (size_t)(w))
+
+/**
+ * @brief Recreates a plan from SGF_PLAN_DATA() doubles previously copied from
+ * plan->weights of sgf_plan_create() with the same configuration, instead of
+ * solving the fits again.
+ * @return The plan, or NULL on invalid parameters or out of memory.
+ */
+SgfPlan *sgf_plan_restore(const SgfPlanConfig *config, const double *data);
+
+/**
+ * @brief Same-length filtering with boundary handling (len >= window_size).
+ * Input and output must not overlap.
+ */
+void sgf_apply_d(const SgfPlan *plan, const double *in, double *out, size_t len);
+
+/**
+ * @brief Boundary part of sgf_apply_d(): only the lead leading and trail
+ * trailing outputs are written (len >= window_size). The float variant
+ * applies the plan to float samples, accumulating in double.
+ */
+void sgf_apply_edges_d(const SgfPlan *plan, const double *in, double *out,
+		       size_t len);
+void sgf_apply_edges_f(const SgfPlan *plan, const float *in, float *out,
+		       size_t len);
+
+/**
+ * @brief 'Valid' filtering: writes len - 2n outputs, no boundary handling.
+ * Output i is the estimate of sample i + lead.
+ * @return Number of outputs written (0 if len < window_size).
+ */
+size_t sgf_apply_valid_d(const SgfPlan *plan, const double *in, size_t len,
+			 double *out);
+
+/**
+ * @brief Periodic boundary outputs for float data: the n leading and n
+ * trailing outputs of centered weights w (2n+1 taps) on wrapped input.
+ */
+void sgf_edges_periodic_f(const float *w, int half_window, const float *in,
+			  float *out, size_t len);
+
+/*============================================================================
+ * 2-D FITS
+ *============================================================================*/
+// Terms of a 2-D polynomial of total degree SGF_MAX_POLY_ORDER
+#define SGF_MAX_TERMS_2D ((SGF_MAX_POLY_ORDER + 1) * (SGF_MAX_POLY_ORDER + 2) / 2)
+
+typedef struct {
+  int half_window[2];   // rows (y) and columns (x), up to SGF_MAX_HALF_WINDOW
+  int poly_order;       // total degree: terms y^a x^b with a + b <= poly_order
+  int derivative[2];    // orders of d/dy and d/dx
+  double time_step[2];  // sample spacing along y and x
+  int boundary;         // SAVGOL_BOUNDARY_*, both axes
+} SgfPlan2dConfig;
+
+/*
+ * Centered 2-D least-squares filter whose polynomial does not factor into
+ * one per axis, e.g. total degree 2 (1, x, y, x^2, xy, y^2).
+ */
+typedef struct {
+  SgfPlan2dConfig config;
+  int window[2];        // window rows and columns (2n+1 each)
+  int terms;            // monomials of the fit
+  double *weights;      // interior weights, window[0] x window[1] row-major
+  double *fit;          // polynomial boundary: terms rows of window[0] * window[1],
+                        // coefficients of the window fit
+} SgfPlan2d;
+
+/**
+ * @brief Creates a 2-D plan, or returns NULL on invalid parameters/out of
+ * memory (the polynomial order must be below both window sizes).
+ */
+SgfPlan2d *sgf_plan2d_create(const SgfPlan2dConfig *config);
+void sgf_plan2d_destroy(SgfPlan2d *plan);
+
+/**
+ * @brief Boundary part of 2-D filtering: writes the outputs within the half
+ * windows of the image edges (rows and cols at least the window size). Image
+ * rows start every in_stride resp. out_stride elements.
+ */
+void sgf_apply_edges2d_d(const SgfPlan2d *plan, const double *in, size_t in_stride,
+			 double *out, size_t out_stride, size_t rows, size_t cols);
+void sgf_apply_edges2d_f(const SgfPlan2d *plan, const float *in, size_t in_stride,
+			 float *out, size_t out_stride, size_t rows, size_t cols);
+
+/*============================================================================
+ * SIMD (luaSGF_simd.c)
+ *============================================================================*/
+enum {
+  SGF_SIMD_SCALAR = 0,
+  SGF_SIMD_SSE2,
+  SGF_SIMD_AVX2,
+  SGF_SIMD_NEON
+};
+
+/**
+ * @brief Interior convolution y[i] = sum_j w[j] * x[i + j], i < count.
+ * Dispatches to the best kernel of the running CPU.
+ */
+void sgf_interior_f(const float *w, int taps, const float *x, float *y,
+		    size_t count);
+void sgf_interior_d(const double *w, int taps, const double *x, double *y,
+		    size_t count);
+
+/**
+ * @brief Folded interior convolution for (anti)symmetric weights w (2n+1
+ * taps): mirrored samples are added or subtracted first, so only n + 1
+ * multiplies are needed per output. Same result as sgf_interior_*().
+ */
+void sgf_interior_sym_f(const float *w, int half_window, int symmetry,
+			const float *x, float *y, size_t count);
+void sgf_interior_sym_d(const double *w, int half_window, int symmetry,
+			const double *x, double *y, size_t count);
+
+// Half windows 2 to this have folded kernels with the tap loop unrolled
+#define SGF_UNROLLED_MAX_HALF_WINDOW 7
+
+// Non-zero if sgf_interior_sym_*() runs an unrolled kernel for half_window
+int sgf_interior_unrolled(int half_window);
+
+/**
+ * @brief Strided interior convolution y[i] = sum_j w[j] * x[i * stride + j],
+ * i < count: only every stride-th output, e.g. for decimation.
+ */
+void sgf_interior_strided_f(const float *w, int taps, const float *x, size_t stride,
+			    float *y, size_t count);
+void sgf_interior_strided_d(const double *w, int taps, const double *x, size_t stride,
+			    double *y, size_t count);
+
+// Active kernel level (SGF_SIMD_*), detected on first use
+int sgf_simd_level(void);
+// Restricts dispatch to a supported level; returns -1 if unsupported
+int sgf_simd_set_level(int level);
+const char *sgf_simd_name(int level);
+
+/*============================================================================
+ * FFT CONVOLUTION (luaSGF_fft.c)
+ *============================================================================*/
+typedef struct SgfFft SgfFft;
+
+/* Window sizes from which overlap-save beats the SIMD direct kernels (4 resp.
+   8 lanes with AVX2); below, direct convolution is faster */
+#define SGF_FFT_MIN_TAPS_D 257
+#define SGF_FFT_MIN_TAPS_F 513
+
+/**
+ * @brief Overlap-save engine for the weights w, or NULL if out of memory.
+ */
+SgfFft *sgf_fft_create(const double *w, int taps);
+void sgf_fft_destroy(SgfFft *f);
+int sgf_fft_taps(const SgfFft *f);
+
+// Doubles of the work area of sgf_fft_interior_*() (one transform block)
+size_t sgf_fft_work(const SgfFft *f);
+
+/**
+ * @brief Same as sgf_interior_*() with the weights of the engine, computed
+ * in double precision. In-place operation is not supported; concurrent calls
+ * need separate work areas of sgf_fft_work() doubles.
+ */
+void sgf_fft_interior_f(const SgfFft *f, const float *x, float *y, size_t count,
+			double *work);
+void sgf_fft_interior_d(const SgfFft *f, const double *x, double *y, size_t count,
+			double *work);
+
+/*============================================================================
+ * WORKER POOL (luaSGF_pool.c)
+ *============================================================================*/
+#define SGF_POOL_MAX_THREADS 64
+
+typedef void (*sgf_task_fn)(void *arg, size_t task);
+
+/**
+ * @brief Runs fn(arg, 0) ... fn(arg, tasks - 1) on up to 'threads' threads,
+ * including the caller, and returns when all tasks are done. Workers are
+ * spawned on first use and kept for later jobs. Tasks must not submit jobs.
+ */
+void sgf_pool_run(int threads, sgf_task_fn fn, void *arg, size_t tasks);
+
+// Background task, owned by the submitter until it is done or cancelled
+enum { SGF_POST_IDLE = 0, SGF_POST_QUEUED, SGF_POST_RUNNING, SGF_POST_DONE };
+
+typedef struct SgfPost {
+  sgf_task_fn fn;
+  void *arg;
+  struct SgfPost *next;
+  int state;           // SGF_POST_*, read with sgf_post_state()
+} SgfPost;
+
+/**
+ * @brief Queues fn(arg, 0) to run on a background thread and returns. Up to
+ * one thread per processor is spawned on demand; if none can be started the
+ * task runs on the caller before returning. Tasks may call sgf_pool_run().
+ */
+void sgf_post_submit(SgfPost *p, sgf_task_fn fn, void *arg);
+
+// Current SGF_POST_* state of a task
+int sgf_post_state(SgfPost *p);
+
+// Blocks until a submitted task is done
+void sgf_post_wait(SgfPost *p);
+
+/**
+ * @brief Removes a task that has not started yet from the queue.
+ * @return 1 if it was removed, 0 if it is running or done.
+ */
+int sgf_post_cancel(SgfPost *p);
+
+// Reference counting of pool users; the last release finishes the background
+// tasks and joins all threads
+void sgf_pool_acquire(void);
+void sgf_pool_release(void);
+
+// Process-wide lock of state shared by Lua states (weight store)
+void sgf_shared_lock(void);
+void sgf_shared_unlock(void);
+
+// Number of online processors, limited to SGF_POOL_MAX_THREADS
+int sgf_pool_cpu_count(void);
+
+// Monotonic clock in nanoseconds (statistics)
+uint64_t sgf_clock_ns(void);
+
+/*============================================================================
+ * FILE MAPPING (luaSGF_file.c)
+ *============================================================================*/
+typedef struct SgfMap SgfMap;
+
+/**
+ * @brief Maps a file into memory. Read-only mappings cover the whole file
+ * (size is ignored); writable ones create or truncate the file and allocate
+ * size bytes for it. Empty files are opened without a mapping (data NULL).
+ * @return NULL if the file cannot be opened or mapped.
+ */
+SgfMap *sgf_map_open(const char *path, size_t size, int writable);
+
+// Writes a writable mapping back to disk, unmaps and closes the file;
+// returns non-zero if any of this failed
+int sgf_map_close(SgfMap *m);
+
+/**
+ * @brief Checks whether path names the mapped file itself (also through
+ * links or a different spelling), without opening it for writing.
+ * @return Non-zero if it does, 0 otherwise or if path does not exist.
+ */
+int sgf_map_same_file(const SgfMap *m, const char *path);
+
+void *sgf_map_data(const SgfMap *m);
+size_t sgf_map_size(const SgfMap *m);
+
+#endif /* LUASGF_KERNEL_H */
@@ -0,0 +1,449 @@
+/*
+MIT License
+
+Copyright (c) 2025-2026 The OneLuaPro project authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * Process-wide worker pool.
+ * Workers are spawned on demand and then sleep until the next job. A job is a
+ * number of independent tasks; the submitting thread works on them as well
+ * and returns once all are finished. Jobs are serialized, so the pool can be
+ * shared by several Lua states.
+ * Background tasks are queued instead and run on a separate set of threads,
+ * one task per thread at a time, while the submitter continues; their tasks
+ * may submit jobs to the pool.
+ * The platform layer also provides the monotonic clock of the statistics and
+ * the lock of the process-wide weight store.
+ */
+
+#include <stdint.h>
+
+#include "luaSGF_kernel.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+typedef SRWLOCK sgf_mutex;
+typedef CONDITION_VARIABLE sgf_cond;
+typedef HANDLE sgf_thread;
+#define SGF_MUTEX_INIT SRWLOCK_INIT
+#define SGF_COND_INIT CONDITION_VARIABLE_INIT
+#define sgf_lock(m) AcquireSRWLockExclusive(m)
+#define sgf_unlock(m) ReleaseSRWLockExclusive(m)
+#define sgf_wait(c, m) SleepConditionVariableSRW(c, m, INFINITE, 0)
+#define sgf_signal(c) WakeConditionVariable(c)
+#define sgf_broadcast(c) WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+typedef pthread_mutex_t sgf_mutex;
+typedef pthread_cond_t sgf_cond;
+typedef pthread_t sgf_thread;
+#define SGF_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+#define SGF_COND_INIT PTHREAD_COND_INITIALIZER
+#define sgf_lock(m) pthread_mutex_lock(m)
+#define sgf_unlock(m) pthread_mutex_unlock(m)
+#define sgf_wait(c, m) pthread_cond_wait(c, m)
+#define sgf_signal(c) pthread_cond_signal(c)
+#define sgf_broadcast(c) pthread_cond_broadcast(c)
+#endif
+
+static sgf_mutex sgf_pool_submit = SGF_MUTEX_INIT;  // serializes jobs and shutdown
+static sgf_mutex sgf_pool_lock = SGF_MUTEX_INIT;    // protects sgf_pool
+static sgf_cond sgf_pool_wake = SGF_COND_INIT;      // workers: new job or shutdown
+static sgf_cond sgf_pool_done = SGF_COND_INIT;      // submitter: last task finished
+
+static sgf_mutex sgf_shared = SGF_MUTEX_INIT;        // sgf_shared_lock()
+static sgf_mutex sgf_post_lock = SGF_MUTEX_INIT;    // protects sgf_post and SgfPost.state
+static sgf_cond sgf_post_wake = SGF_COND_INIT;      // background threads: task queued
+static sgf_cond sgf_post_done = SGF_COND_INIT;      // waiters: a task finished
+
+static struct {
+  sgf_thread threads[SGF_POOL_MAX_THREADS];
+  int workers;
+  int idle, queued;           // threads waiting for a task, and tasks waiting
+  int shutdown;               // drain the queue, then exit
+  SgfPost *head, *tail;       // queued tasks, oldest first
+} sgf_post;
+
+static struct {
+  sgf_thread threads[SGF_POOL_MAX_THREADS - 1];
+  int workers;
+  int users;                  // sgf_pool_acquire() references
+  int shutdown;
+  uintptr_t generation;       // incremented per job
+  int joined, limit;          // workers on the current job, and their maximum
+  sgf_task_fn fn;
+  void *arg;
+  size_t tasks, next, finished;
+} sgf_pool;
+
+/**
+ * @brief Processes tasks of the current job until none are left.
+ * Called with the pool lock held.
+ */
+static void sgf_pool_work(void) {
+  while (sgf_pool.next < sgf_pool.tasks) {
+    size_t task = sgf_pool.next++;
+    sgf_task_fn fn = sgf_pool.fn;
+    void *arg = sgf_pool.arg;
+
+    sgf_unlock(&sgf_pool_lock);
+    fn(arg, task);
+    sgf_lock(&sgf_pool_lock);
+
+    if (++sgf_pool.finished == sgf_pool.tasks) {
+      sgf_signal(&sgf_pool_done);
+    }
+  }
+}
+
+static void sgf_pool_worker(uintptr_t seen) {
+  sgf_lock(&sgf_pool_lock);
+  for (;;) {
+    while (!sgf_pool.shutdown && sgf_pool.generation == seen) {
+      sgf_wait(&sgf_pool_wake, &sgf_pool_lock);
+    }
+    if (sgf_pool.shutdown) {
+      break;
+    }
+    seen = sgf_pool.generation;
+    if (sgf_pool.joined < sgf_pool.limit) {
+      sgf_pool.joined++;
+      sgf_pool_work();
+    }
+  }
+  sgf_unlock(&sgf_pool_lock);
+}
+
+static void sgf_post_worker(void) {
+  sgf_lock(&sgf_post_lock);
+  for (;;) {
+    while (sgf_post.head == NULL && !sgf_post.shutdown) {
+      sgf_post.idle++;
+      sgf_wait(&sgf_post_wake, &sgf_post_lock);
+      sgf_post.idle--;
+    }
+    SgfPost *p = sgf_post.head;
+    if (p == NULL) {
+      break;
+    }
+    sgf_post.head = p->next;
+    sgf_post.queued--;
+    if (sgf_post.head == NULL) {
+      sgf_post.tail = NULL;
+    }
+    p->state = SGF_POST_RUNNING;
+
+    sgf_unlock(&sgf_post_lock);
+    p->fn(p->arg, 0);
+    sgf_lock(&sgf_post_lock);
+
+    p->state = SGF_POST_DONE;
+    sgf_broadcast(&sgf_post_done);
+  }
+  sgf_unlock(&sgf_post_lock);
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI sgf_pool_main(LPVOID seen) {
+  sgf_pool_worker((uintptr_t)seen);
+  return 0;
+}
+
+static DWORD WINAPI sgf_post_main(LPVOID unused) {
+  (void)unused;
+  sgf_post_worker();
+  return 0;
+}
+
+static int sgf_pool_spawn(sgf_thread *t, uintptr_t seen) {
+  *t = CreateThread(NULL, 0, sgf_pool_main, (LPVOID)seen, 0, NULL);
+  return (*t != NULL) ? 0 : -1;
+}
+
+static int sgf_post_spawn(sgf_thread *t) {
+  *t = CreateThread(NULL, 0, sgf_post_main, NULL, 0, NULL);
+  return (*t != NULL) ? 0 : -1;
+}
+
+static void sgf_pool_join(sgf_thread t) {
+  WaitForSingleObject(t, INFINITE);
+  CloseHandle(t);
+}
+#else
+static void *sgf_pool_main(void *seen) {
+  sgf_pool_worker((uintptr_t)seen);
+  return NULL;
+}
+
+static void *sgf_post_main(void *unused) {
+  (void)unused;
+  sgf_post_worker();
+  return NULL;
+}
+
+static int sgf_pool_spawn(sgf_thread *t, uintptr_t seen) {
+  return (pthread_create(t, NULL, sgf_pool_main, (void *)seen) == 0) ? 0 : -1;
+}
+
+static int sgf_post_spawn(sgf_thread *t) {
+  return (pthread_create(t, NULL, sgf_post_main, NULL) == 0) ? 0 : -1;
+}
+
+static void sgf_pool_join(sgf_thread t) {
+  pthread_join(t, NULL);
+}
+#endif
+
+void sgf_shared_lock(void) {
+  sgf_lock(&sgf_shared);
+}
+
+void sgf_shared_unlock(void) {
+  sgf_unlock(&sgf_shared);
+}
+
+int sgf_pool_cpu_count(void) {
+#if defined(_WIN32)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  int n = (int)info.dwNumberOfProcessors;
+#else
+  int n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  if (n < 1) {
+    return 1;
+  }
+  return (n > SGF_POOL_MAX_THREADS) ? SGF_POOL_MAX_THREADS : n;
+}
+
+uint64_t sgf_clock_ns(void) {
+#if defined(_WIN32)
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER now;
+  if (freq.QuadPart == 0) {
+    QueryPerformanceFrequency(&freq);
+  }
+  QueryPerformanceCounter(&now);
+  return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+void sgf_pool_run(int threads, sgf_task_fn fn, void *arg, size_t tasks) {
+  if (threads > SGF_POOL_MAX_THREADS) {
+    threads = SGF_POOL_MAX_THREADS;
+  }
+  if (threads <= 1 || tasks <= 1) {
+    for (size_t t = 0; t < tasks; t++) {
+      fn(arg, t);
+    }
+    return;
+  }
+
+  sgf_lock(&sgf_pool_submit);
+  sgf_lock(&sgf_pool_lock);
+
+  int helpers = threads - 1;
+  if ((size_t)helpers > tasks - 1) {
+    helpers = (int)(tasks - 1);
+  }
+  /* Spawn missing workers; on failure the job runs with fewer threads */
+  while (sgf_pool.workers < helpers &&
+	 sgf_pool_spawn(&sgf_pool.threads[sgf_pool.workers], sgf_pool.generation) == 0) {
+    sgf_pool.workers++;
+  }
+
+  sgf_pool.fn = fn;
+  sgf_pool.arg = arg;
+  sgf_pool.tasks = tasks;
+  sgf_pool.next = 0;
+  sgf_pool.finished = 0;
+  sgf_pool.joined = 0;
+  sgf_pool.limit = helpers;
+  sgf_pool.generation++;
+  sgf_broadcast(&sgf_pool_wake);
+
+  sgf_pool_work();
+  while (sgf_pool.finished < sgf_pool.tasks) {
+    sgf_wait(&sgf_pool_done, &sgf_pool_lock);
+  }
+  sgf_pool.fn = NULL;
+  sgf_pool.arg = NULL;
+
+  sgf_unlock(&sgf_pool_lock);
+  sgf_unlock(&sgf_pool_submit);
+}
+
+void sgf_pool_acquire(void) {
+  sgf_lock(&sgf_pool_lock);
+  sgf_pool.users++;
+  sgf_unlock(&sgf_pool_lock);
+}
+
+/**
+ * @brief Starts a background thread if no idle one can take the queued task.
+ * Called with the background lock held.
+ * @return 0 if some thread will run the task, -1 if none can be started.
+ */
+static int sgf_post_grow(void) {
+  if (sgf_post.queued <= sgf_post.idle && !sgf_post.shutdown) {
+    sgf_signal(&sgf_post_wake);
+    return 0;
+  }
+  if (!sgf_post.shutdown && sgf_post.workers < sgf_pool_cpu_count() &&
+      sgf_post_spawn(&sgf_post.threads[sgf_post.workers]) == 0) {
+    sgf_post.workers++;
+    return 0;
+  }
+  /* Busy threads (or the drain) pick the task up once they are done */
+  return (sgf_post.workers > 0) ? 0 : -1;
+}
+
+void sgf_post_submit(SgfPost *p, sgf_task_fn fn, void *arg) {
+  p->fn = fn;
+  p->arg = arg;
+  p->next = NULL;
+
+  sgf_lock(&sgf_post_lock);
+  p->state = SGF_POST_QUEUED;
+  if (sgf_post.tail != NULL) {
+    sgf_post.tail->next = p;
+  } else {
+    sgf_post.head = p;
+  }
+  sgf_post.tail = p;
+  sgf_post.queued++;
+  int rc = sgf_post_grow();
+  if (rc != 0) {
+    /* No thread at all: run the task on the caller */
+    sgf_post.head = sgf_post.tail = NULL;
+    sgf_post.queued = 0;
+    p->state = SGF_POST_RUNNING;
+  }
+  sgf_unlock(&sgf_post_lock);
+
+  if (rc != 0) {
+    fn(arg, 0);
+    sgf_lock(&sgf_post_lock);
+    p->state = SGF_POST_DONE;
+    sgf_unlock(&sgf_post_lock);
+  }
+}
+
+int sgf_post_state(SgfPost *p) {
+  sgf_lock(&sgf_post_lock);
+  int state = p->state;
+  sgf_unlock(&sgf_post_lock);
+  return state;
+}
+
+void sgf_post_wait(SgfPost *p) {
+  sgf_lock(&sgf_post_lock);
+  while (p->state == SGF_POST_QUEUED || p->state == SGF_POST_RUNNING) {
+    sgf_wait(&sgf_post_done, &sgf_post_lock);
+  }
+  sgf_unlock(&sgf_post_lock);
+}
+
+int sgf_post_cancel(SgfPost *p) {
+  sgf_lock(&sgf_post_lock);
+  int removed = 0;
+  if (p->state == SGF_POST_QUEUED) {
+    SgfPost **link = &sgf_post.head, *prev = NULL;
+    while (*link != p) {
+      prev = *link;
+      link = &prev->next;
+    }
+    *link = p->next;
+    sgf_post.queued--;
+    if (sgf_post.tail == p) {
+      sgf_post.tail = prev;
+    }
+    p->state = SGF_POST_IDLE;
+    removed = 1;
+  }
+  sgf_unlock(&sgf_post_lock);
+  return removed;
+}
+
+/**
+ * @brief Runs the queued background tasks to completion and joins the
+ * background threads. Tasks submitted meanwhile start new threads afterwards.
+ */
+static void sgf_post_drain(void) {
+  sgf_lock(&sgf_post_lock);
+  sgf_post.shutdown = 1;
+  sgf_broadcast(&sgf_post_wake);
+  int workers = sgf_post.workers;
+  sgf_unlock(&sgf_post_lock);
+
+  for (int i = 0; i < workers; i++) {
+    sgf_pool_join(sgf_post.threads[i]);
+  }
+
+  sgf_lock(&sgf_post_lock);
+  for (int i = workers; i < sgf_post.workers; i++) {
+    sgf_post.threads[i - workers] = sgf_post.threads[i];
+  }
+  sgf_post.workers -= workers;
+  sgf_post.shutdown = 0;
+  if (sgf_post.head != NULL) {
+    sgf_post_grow();
+  }
+  sgf_unlock(&sgf_post_lock);
+}
+
+void sgf_pool_release(void) {
+  /* Background tasks may submit jobs: finish them before taking the pool */
+  sgf_lock(&sgf_pool_lock);
+  int draining = (sgf_pool.users == 1);
+  sgf_unlock(&sgf_pool_lock);
+  if (draining) {
+    sgf_post_drain();
+  }
+
+  sgf_lock(&sgf_pool_submit);
+  sgf_lock(&sgf_pool_lock);
+  int last = (--sgf_pool.users == 0);
+  int workers = sgf_pool.workers;
+  if (last) {
+    sgf_pool.shutdown = 1;
+    sgf_broadcast(&sgf_pool_wake);
+  }
+  sgf_unlock(&sgf_pool_lock);
+
+  if (last) {
+    for (int i = 0; i < workers; i++) {
+      sgf_pool_join(sgf_pool.threads[i]);
+    }
+    sgf_lock(&sgf_pool_lock);
+    sgf_pool.workers = 0;
+    sgf_pool.shutdown = 0;
+    sgf_unlock(&sgf_pool_lock);
+  }
+  sgf_unlock(&sgf_pool_submit);
+}
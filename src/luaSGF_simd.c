@@ -0,0 +1,788 @@
+/*
+MIT License
+
+Copyright (c) 2025-2026 The OneLuaPro project authors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * Vectorized interior convolution: y[i] = sum_j w[j] * x[i + j].
+ * Each lane computes a different output sample, so the taps are broadcast
+ * and the input is read with unaligned loads. The best kernel available on
+ * the running CPU is selected on first use.
+ *
+ * The folded (_sym) variants serve (anti)symmetric weights: the mirrored
+ * samples x[c+k] and x[c-k] around the center c are combined first, the sign
+ * of x[c-k] being flipped by an XOR for antisymmetric weights. For the
+ * common half windows 2 to SGF_UNROLLED_MAX_HALF_WINDOW they are instantiated
+ * with a constant half window, so the tap loop is unrolled at compile time.
+ */
+
+#include <stddef.h>
+
+#include "luaSGF_kernel.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SGF_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define SGF_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Per-function ISA selection, so the module itself needs no -mavx2
+#if defined(SGF_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SGF_TARGET_SSE2 __attribute__((target("sse2")))
+#define SGF_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define SGF_TARGET_SSE2
+#define SGF_TARGET_AVX2
+#endif
+
+// Folded kernels are inlined into their unrolled instances
+#if defined(_MSC_VER)
+#define SGF_INLINE static __forceinline
+#elif defined(__GNUC__) || defined(__clang__)
+#define SGF_INLINE static inline __attribute__((always_inline))
+#else
+#define SGF_INLINE static inline
+#endif
+
+/*============================================================================
+ * SCALAR
+ *============================================================================*/
+static void sgf_interior_f_scalar(const float *w, int taps, const float *x,
+				  float *y, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const float *xi = x + i;
+    float acc = 0.0f;
+    for (int j = 0; j < taps; j++) {
+      acc += w[j] * xi[j];
+    }
+    y[i] = acc;
+  }
+}
+
+static void sgf_interior_d_scalar(const double *w, int taps, const double *x,
+				  double *y, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const double *xi = x + i;
+    double acc = 0.0;
+    for (int j = 0; j < taps; j++) {
+      acc += w[j] * xi[j];
+    }
+    y[i] = acc;
+  }
+}
+
+SGF_INLINE void sgf_interior_sym_f_scalar(const float *w, int n, int symmetry,
+					  const float *x, float *y, size_t count) {
+  const float *c = w + n;
+  for (size_t i = 0; i < count; i++) {
+    const float *xi = x + i + n;
+    float acc;
+    if (symmetry == SGF_SYMMETRIC) {
+      acc = c[0] * xi[0];
+      for (int k = 1; k <= n; k++) {
+	acc += c[k] * (xi[k] + xi[-k]);
+      }
+    } else {
+      acc = 0.0f;
+      for (int k = 1; k <= n; k++) {
+	acc += c[k] * (xi[k] - xi[-k]);
+      }
+    }
+    y[i] = acc;
+  }
+}
+
+SGF_INLINE void sgf_interior_sym_d_scalar(const double *w, int n, int symmetry,
+					  const double *x, double *y, size_t count) {
+  const double *c = w + n;
+  for (size_t i = 0; i < count; i++) {
+    const double *xi = x + i + n;
+    double acc;
+    if (symmetry == SGF_SYMMETRIC) {
+      acc = c[0] * xi[0];
+      for (int k = 1; k <= n; k++) {
+	acc += c[k] * (xi[k] + xi[-k]);
+      }
+    } else {
+      acc = 0.0;
+      for (int k = 1; k <= n; k++) {
+	acc += c[k] * (xi[k] - xi[-k]);
+      }
+    }
+    y[i] = acc;
+  }
+}
+
+static void sgf_strided_f_scalar(const float *w, int taps, const float *x,
+				 size_t stride, float *y, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const float *xi = x + i * stride;
+    float acc = 0.0f;
+    for (int j = 0; j < taps; j++) {
+      acc += w[j] * xi[j];
+    }
+    y[i] = acc;
+  }
+}
+
+static void sgf_strided_d_scalar(const double *w, int taps, const double *x,
+				 size_t stride, double *y, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const double *xi = x + i * stride;
+    double acc = 0.0;
+    for (int j = 0; j < taps; j++) {
+      acc += w[j] * xi[j];
+    }
+    y[i] = acc;
+  }
+}
+
+/*============================================================================
+ * X86
+ *============================================================================*/
+#if defined(SGF_X86)
+SGF_TARGET_SSE2
+static void sgf_interior_f_sse2(const float *w, int taps, const float *x,
+				float *y, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (int j = 0; j < taps; j++) {
+      __m128 wj = _mm_set1_ps(w[j]);
+      acc0 = _mm_add_ps(acc0, _mm_mul_ps(wj, _mm_loadu_ps(x + i + j)));
+      acc1 = _mm_add_ps(acc1, _mm_mul_ps(wj, _mm_loadu_ps(x + i + j + 4)));
+    }
+    _mm_storeu_ps(y + i, acc0);
+    _mm_storeu_ps(y + i + 4, acc1);
+  }
+  sgf_interior_f_scalar(w, taps, x + i, y + i, count - i);
+}
+
+SGF_TARGET_SSE2
+static void sgf_interior_d_sse2(const double *w, int taps, const double *x,
+				double *y, size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128d acc0 = _mm_setzero_pd();
+    __m128d acc1 = _mm_setzero_pd();
+    for (int j = 0; j < taps; j++) {
+      __m128d wj = _mm_set1_pd(w[j]);
+      acc0 = _mm_add_pd(acc0, _mm_mul_pd(wj, _mm_loadu_pd(x + i + j)));
+      acc1 = _mm_add_pd(acc1, _mm_mul_pd(wj, _mm_loadu_pd(x + i + j + 2)));
+    }
+    _mm_storeu_pd(y + i, acc0);
+    _mm_storeu_pd(y + i + 2, acc1);
+  }
+  sgf_interior_d_scalar(w, taps, x + i, y + i, count - i);
+}
+
+SGF_TARGET_AVX2
+static void sgf_interior_f_avx2(const float *w, int taps, const float *x,
+				float *y, size_t count) {
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (int j = 0; j < taps; j++) {
+      __m256 wj = _mm256_set1_ps(w[j]);
+      acc0 = _mm256_fmadd_ps(wj, _mm256_loadu_ps(x + i + j), acc0);
+      acc1 = _mm256_fmadd_ps(wj, _mm256_loadu_ps(x + i + j + 8), acc1);
+    }
+    _mm256_storeu_ps(y + i, acc0);
+    _mm256_storeu_ps(y + i + 8, acc1);
+  }
+  sgf_interior_f_scalar(w, taps, x + i, y + i, count - i);
+}
+
+SGF_TARGET_AVX2
+static void sgf_interior_d_avx2(const double *w, int taps, const double *x,
+				double *y, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256d acc0 = _mm256_setzero_pd();
+    __m256d acc1 = _mm256_setzero_pd();
+    for (int j = 0; j < taps; j++) {
+      __m256d wj = _mm256_set1_pd(w[j]);
+      acc0 = _mm256_fmadd_pd(wj, _mm256_loadu_pd(x + i + j), acc0);
+      acc1 = _mm256_fmadd_pd(wj, _mm256_loadu_pd(x + i + j + 4), acc1);
+    }
+    _mm256_storeu_pd(y + i, acc0);
+    _mm256_storeu_pd(y + i + 4, acc1);
+  }
+  sgf_interior_d_scalar(w, taps, x + i, y + i, count - i);
+}
+
+SGF_TARGET_SSE2
+SGF_INLINE void sgf_interior_sym_f_sse2(const float *w, int n, int symmetry,
+					const float *x, float *y, size_t count) {
+  const float *c = w + n;
+  __m128 flip = _mm_set1_ps((symmetry == SGF_SYMMETRIC) ? 0.0f : -0.0f);
+  __m128 c0 = _mm_set1_ps(c[0]);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const float *xi = x + i + n;
+    __m128 acc0 = _mm_mul_ps(c0, _mm_loadu_ps(xi));
+    __m128 acc1 = _mm_mul_ps(c0, _mm_loadu_ps(xi + 4));
+    for (int k = 1; k <= n; k++) {
+      __m128 ck = _mm_set1_ps(c[k]);
+      __m128 s0 = _mm_add_ps(_mm_loadu_ps(xi + k), _mm_xor_ps(_mm_loadu_ps(xi - k), flip));
+      __m128 s1 = _mm_add_ps(_mm_loadu_ps(xi + k + 4), _mm_xor_ps(_mm_loadu_ps(xi - k + 4), flip));
+      acc0 = _mm_add_ps(acc0, _mm_mul_ps(ck, s0));
+      acc1 = _mm_add_ps(acc1, _mm_mul_ps(ck, s1));
+    }
+    _mm_storeu_ps(y + i, acc0);
+    _mm_storeu_ps(y + i + 4, acc1);
+  }
+  sgf_interior_sym_f_scalar(w, n, symmetry, x + i, y + i, count - i);
+}
+
+SGF_TARGET_SSE2
+SGF_INLINE void sgf_interior_sym_d_sse2(const double *w, int n, int symmetry,
+					const double *x, double *y, size_t count) {
+  const double *c = w + n;
+  __m128d flip = _mm_set1_pd((symmetry == SGF_SYMMETRIC) ? 0.0 : -0.0);
+  __m128d c0 = _mm_set1_pd(c[0]);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const double *xi = x + i + n;
+    __m128d acc0 = _mm_mul_pd(c0, _mm_loadu_pd(xi));
+    __m128d acc1 = _mm_mul_pd(c0, _mm_loadu_pd(xi + 2));
+    for (int k = 1; k <= n; k++) {
+      __m128d ck = _mm_set1_pd(c[k]);
+      __m128d s0 = _mm_add_pd(_mm_loadu_pd(xi + k), _mm_xor_pd(_mm_loadu_pd(xi - k), flip));
+      __m128d s1 = _mm_add_pd(_mm_loadu_pd(xi + k + 2), _mm_xor_pd(_mm_loadu_pd(xi - k + 2), flip));
+      acc0 = _mm_add_pd(acc0, _mm_mul_pd(ck, s0));
+      acc1 = _mm_add_pd(acc1, _mm_mul_pd(ck, s1));
+    }
+    _mm_storeu_pd(y + i, acc0);
+    _mm_storeu_pd(y + i + 2, acc1);
+  }
+  sgf_interior_sym_d_scalar(w, n, symmetry, x + i, y + i, count - i);
+}
+
+SGF_TARGET_AVX2
+SGF_INLINE void sgf_interior_sym_f_avx2(const float *w, int n, int symmetry,
+					const float *x, float *y, size_t count) {
+  const float *c = w + n;
+  __m256 flip = _mm256_set1_ps((symmetry == SGF_SYMMETRIC) ? 0.0f : -0.0f);
+  __m256 c0 = _mm256_set1_ps(c[0]);
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const float *xi = x + i + n;
+    __m256 acc0 = _mm256_mul_ps(c0, _mm256_loadu_ps(xi));
+    __m256 acc1 = _mm256_mul_ps(c0, _mm256_loadu_ps(xi + 8));
+    for (int k = 1; k <= n; k++) {
+      __m256 ck = _mm256_set1_ps(c[k]);
+      __m256 s0 = _mm256_add_ps(_mm256_loadu_ps(xi + k),
+				_mm256_xor_ps(_mm256_loadu_ps(xi - k), flip));
+      __m256 s1 = _mm256_add_ps(_mm256_loadu_ps(xi + k + 8),
+				_mm256_xor_ps(_mm256_loadu_ps(xi - k + 8), flip));
+      acc0 = _mm256_fmadd_ps(ck, s0, acc0);
+      acc1 = _mm256_fmadd_ps(ck, s1, acc1);
+    }
+    _mm256_storeu_ps(y + i, acc0);
+    _mm256_storeu_ps(y + i + 8, acc1);
+  }
+  sgf_interior_sym_f_scalar(w, n, symmetry, x + i, y + i, count - i);
+}
+
+SGF_TARGET_AVX2
+SGF_INLINE void sgf_interior_sym_d_avx2(const double *w, int n, int symmetry,
+					const double *x, double *y, size_t count) {
+  const double *c = w + n;
+  __m256d flip = _mm256_set1_pd((symmetry == SGF_SYMMETRIC) ? 0.0 : -0.0);
+  __m256d c0 = _mm256_set1_pd(c[0]);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const double *xi = x + i + n;
+    __m256d acc0 = _mm256_mul_pd(c0, _mm256_loadu_pd(xi));
+    __m256d acc1 = _mm256_mul_pd(c0, _mm256_loadu_pd(xi + 4));
+    for (int k = 1; k <= n; k++) {
+      __m256d ck = _mm256_set1_pd(c[k]);
+      __m256d s0 = _mm256_add_pd(_mm256_loadu_pd(xi + k),
+				 _mm256_xor_pd(_mm256_loadu_pd(xi - k), flip));
+      __m256d s1 = _mm256_add_pd(_mm256_loadu_pd(xi + k + 4),
+				 _mm256_xor_pd(_mm256_loadu_pd(xi - k + 4), flip));
+      acc0 = _mm256_fmadd_pd(ck, s0, acc0);
+      acc1 = _mm256_fmadd_pd(ck, s1, acc1);
+    }
+    _mm256_storeu_pd(y + i, acc0);
+    _mm256_storeu_pd(y + i + 4, acc1);
+  }
+  sgf_interior_sym_d_scalar(w, n, symmetry, x + i, y + i, count - i);
+}
+
+/*
+ * Strided kernels: the outputs are too far apart to share loads, so each one
+ * is a dot product over the window, vectorized along the taps.
+ */
+SGF_TARGET_SSE2
+static void sgf_strided_f_sse2(const float *w, int taps, const float *x,
+			       size_t stride, float *y, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const float *xi = x + i * stride;
+    __m128 acc = _mm_setzero_ps();
+    int j = 0;
+    for (; j + 4 <= taps; j += 4) {
+      acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(w + j), _mm_loadu_ps(xi + j)));
+    }
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    float sum = _mm_cvtss_f32(acc);
+    for (; j < taps; j++) {
+      sum += w[j] * xi[j];
+    }
+    y[i] = sum;
+  }
+}
+
+SGF_TARGET_SSE2
+static void sgf_strided_d_sse2(const double *w, int taps, const double *x,
+			       size_t stride, double *y, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const double *xi = x + i * stride;
+    __m128d acc = _mm_setzero_pd();
+    int j = 0;
+    for (; j + 2 <= taps; j += 2) {
+      acc = _mm_add_pd(acc, _mm_mul_pd(_mm_loadu_pd(w + j), _mm_loadu_pd(xi + j)));
+    }
+    double sum = _mm_cvtsd_f64(_mm_add_sd(acc, _mm_unpackhi_pd(acc, acc)));
+    for (; j < taps; j++) {
+      sum += w[j] * xi[j];
+    }
+    y[i] = sum;
+  }
+}
+
+SGF_TARGET_AVX2
+static void sgf_strided_f_avx2(const float *w, int taps, const float *x,
+			       size_t stride, float *y, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const float *xi = x + i * stride;
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    int j = 0;
+    for (; j + 16 <= taps; j += 16) {
+      acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(w + j), _mm256_loadu_ps(xi + j), acc0);
+      acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(w + j + 8), _mm256_loadu_ps(xi + j + 8), acc1);
+    }
+    if (j + 8 <= taps) {
+      acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(w + j), _mm256_loadu_ps(xi + j), acc0);
+      j += 8;
+    }
+    acc0 = _mm256_add_ps(acc0, acc1);
+    __m128 acc = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    float sum = _mm_cvtss_f32(acc);
+    for (; j < taps; j++) {
+      sum += w[j] * xi[j];
+    }
+    y[i] = sum;
+  }
+}
+
+SGF_TARGET_AVX2
+static void sgf_strided_d_avx2(const double *w, int taps, const double *x,
+			       size_t stride, double *y, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const double *xi = x + i * stride;
+    __m256d acc0 = _mm256_setzero_pd();
+    __m256d acc1 = _mm256_setzero_pd();
+    int j = 0;
+    for (; j + 8 <= taps; j += 8) {
+      acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(w + j), _mm256_loadu_pd(xi + j), acc0);
+      acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(w + j + 4), _mm256_loadu_pd(xi + j + 4), acc1);
+    }
+    if (j + 4 <= taps) {
+      acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(w + j), _mm256_loadu_pd(xi + j), acc0);
+      j += 4;
+    }
+    acc0 = _mm256_add_pd(acc0, acc1);
+    __m128d acc = _mm_add_pd(_mm256_castpd256_pd128(acc0), _mm256_extractf128_pd(acc0, 1));
+    double sum = _mm_cvtsd_f64(_mm_add_sd(acc, _mm_unpackhi_pd(acc, acc)));
+    for (; j < taps; j++) {
+      sum += w[j] * xi[j];
+    }
+    y[i] = sum;
+  }
+}
+
+/**
+ * @brief Detects AVX2 and FMA including operating system support.
+ */
+static int sgf_cpu_has_avx2(void) {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return 0;
+  }
+  __cpuid(info, 1);
+  int fma = (info[2] >> 12) & 1;
+  int osxsave = (info[2] >> 27) & 1;
+  if (!fma || !osxsave || (_xgetbv(0) & 0x6) != 0x6) {
+    return 0;
+  }
+  __cpuidex(info, 7, 0);
+  return (info[1] >> 5) & 1;
+#elif defined(__GNUC__) || defined(__clang__)
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+  return 0;
+#endif
+}
+
+static int sgf_cpu_has_sse2(void) {
+#if defined(__x86_64__) || defined(_M_X64)
+  return 1; /* Part of the x86-64 baseline */
+#elif defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  return (info[3] >> 26) & 1;
+#elif defined(__GNUC__) || defined(__clang__)
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse2");
+#else
+  return 0;
+#endif
+}
+#endif /* SGF_X86 */
+
+/*============================================================================
+ * NEON
+ *============================================================================*/
+#if defined(SGF_NEON)
+static void sgf_interior_f_neon(const float *w, int taps, const float *x,
+				float *y, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    for (int j = 0; j < taps; j++) {
+      float32x4_t wj = vdupq_n_f32(w[j]);
+      acc0 = vfmaq_f32(acc0, wj, vld1q_f32(x + i + j));
+      acc1 = vfmaq_f32(acc1, wj, vld1q_f32(x + i + j + 4));
+    }
+    vst1q_f32(y + i, acc0);
+    vst1q_f32(y + i + 4, acc1);
+  }
+  sgf_interior_f_scalar(w, taps, x + i, y + i, count - i);
+}
+
+static void sgf_interior_d_neon(const double *w, int taps, const double *x,
+				double *y, size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    float64x2_t acc0 = vdupq_n_f64(0.0);
+    float64x2_t acc1 = vdupq_n_f64(0.0);
+    for (int j = 0; j < taps; j++) {
+      float64x2_t wj = vdupq_n_f64(w[j]);
+      acc0 = vfmaq_f64(acc0, wj, vld1q_f64(x + i + j));
+      acc1 = vfmaq_f64(acc1, wj, vld1q_f64(x + i + j + 2));
+    }
+    vst1q_f64(y + i, acc0);
+    vst1q_f64(y + i + 2, acc1);
+  }
+  sgf_interior_d_scalar(w, taps, x + i, y + i, count - i);
+}
+
+SGF_INLINE void sgf_interior_sym_f_neon(const float *w, int n, int symmetry,
+					const float *x, float *y, size_t count) {
+  const float *c = w + n;
+  uint32x4_t flip = vdupq_n_u32((symmetry == SGF_SYMMETRIC) ? 0u : 0x80000000u);
+  float32x4_t c0 = vdupq_n_f32(c[0]);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const float *xi = x + i + n;
+    float32x4_t acc0 = vmulq_f32(c0, vld1q_f32(xi));
+    float32x4_t acc1 = vmulq_f32(c0, vld1q_f32(xi + 4));
+    for (int k = 1; k <= n; k++) {
+      float32x4_t ck = vdupq_n_f32(c[k]);
+      float32x4_t m0 = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(vld1q_f32(xi - k)), flip));
+      float32x4_t m1 = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(vld1q_f32(xi - k + 4)), flip));
+      acc0 = vfmaq_f32(acc0, ck, vaddq_f32(vld1q_f32(xi + k), m0));
+      acc1 = vfmaq_f32(acc1, ck, vaddq_f32(vld1q_f32(xi + k + 4), m1));
+    }
+    vst1q_f32(y + i, acc0);
+    vst1q_f32(y + i + 4, acc1);
+  }
+  sgf_interior_sym_f_scalar(w, n, symmetry, x + i, y + i, count - i);
+}
+
+SGF_INLINE void sgf_interior_sym_d_neon(const double *w, int n, int symmetry,
+					const double *x, double *y, size_t count) {
+  const double *c = w + n;
+  uint64x2_t flip = vdupq_n_u64((symmetry == SGF_SYMMETRIC) ? 0u : 0x8000000000000000u);
+  float64x2_t c0 = vdupq_n_f64(c[0]);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const double *xi = x + i + n;
+    float64x2_t acc0 = vmulq_f64(c0, vld1q_f64(xi));
+    float64x2_t acc1 = vmulq_f64(c0, vld1q_f64(xi + 2));
+    for (int k = 1; k <= n; k++) {
+      float64x2_t ck = vdupq_n_f64(c[k]);
+      float64x2_t m0 = vreinterpretq_f64_u64(veorq_u64(vreinterpretq_u64_f64(vld1q_f64(xi - k)), flip));
+      float64x2_t m1 = vreinterpretq_f64_u64(veorq_u64(vreinterpretq_u64_f64(vld1q_f64(xi - k + 2)), flip));
+      acc0 = vfmaq_f64(acc0, ck, vaddq_f64(vld1q_f64(xi + k), m0));
+      acc1 = vfmaq_f64(acc1, ck, vaddq_f64(vld1q_f64(xi + k + 2), m1));
+    }
+    vst1q_f64(y + i, acc0);
+    vst1q_f64(y + i + 2, acc1);
+  }
+  sgf_interior_sym_d_scalar(w, n, symmetry, x + i, y + i, count - i);
+}
+
+static void sgf_strided_f_neon(const float *w, int taps, const float *x,
+			       size_t stride, float *y, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const float *xi = x + i * stride;
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    int j = 0;
+    for (; j + 4 <= taps; j += 4) {
+      acc = vfmaq_f32(acc, vld1q_f32(w + j), vld1q_f32(xi + j));
+    }
+    float sum = vaddvq_f32(acc);
+    for (; j < taps; j++) {
+      sum += w[j] * xi[j];
+    }
+    y[i] = sum;
+  }
+}
+
+static void sgf_strided_d_neon(const double *w, int taps, const double *x,
+			       size_t stride, double *y, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const double *xi = x + i * stride;
+    float64x2_t acc = vdupq_n_f64(0.0);
+    int j = 0;
+    for (; j + 2 <= taps; j += 2) {
+      acc = vfmaq_f64(acc, vld1q_f64(w + j), vld1q_f64(xi + j));
+    }
+    double sum = vaddvq_f64(acc);
+    for (; j < taps; j++) {
+      sum += w[j] * xi[j];
+    }
+    y[i] = sum;
+  }
+}
+#endif /* SGF_NEON */
+
+/*============================================================================
+ * DISPATCH
+ *============================================================================*/
+typedef void (*sgf_interior_f_fn)(const float *, int, const float *, float *, size_t);
+typedef void (*sgf_interior_d_fn)(const double *, int, const double *, double *, size_t);
+typedef void (*sgf_sym_f_fn)(const float *, int, int, const float *, float *, size_t);
+typedef void (*sgf_sym_d_fn)(const double *, int, int, const double *, double *, size_t);
+typedef void (*sgf_strided_f_fn)(const float *, int, const float *, size_t, float *, size_t);
+typedef void (*sgf_strided_d_fn)(const double *, int, const double *, size_t, double *,
+				 size_t);
+
+/*
+ * Unrolled folded kernels, indexed by half window. The instances pass a
+ * constant half window to the inlined generic kernel.
+ */
+#define SGF_UNROLLED(kernel, target, T, N)					\
+  target static void kernel##_##N(const T *w, int n, int symmetry, const T *x,	\
+				  T *y, size_t count) {			\
+    (void)n;									\
+    kernel(w, N, symmetry, x, y, count);					\
+  }
+#define SGF_UNROLLED_SET(kernel, target, T, fn_type)				\
+  SGF_UNROLLED(kernel, target, T, 2)						\
+  SGF_UNROLLED(kernel, target, T, 3)						\
+  SGF_UNROLLED(kernel, target, T, 4)						\
+  SGF_UNROLLED(kernel, target, T, 5)						\
+  SGF_UNROLLED(kernel, target, T, 6)						\
+  SGF_UNROLLED(kernel, target, T, 7)						\
+  static const fn_type kernel##_unrolled[SGF_UNROLLED_MAX_HALF_WINDOW + 1] = {	\
+    NULL, NULL, kernel##_2, kernel##_3, kernel##_4, kernel##_5, kernel##_6,	\
+    kernel##_7};
+
+SGF_UNROLLED_SET(sgf_interior_sym_f_scalar, , float, sgf_sym_f_fn)
+SGF_UNROLLED_SET(sgf_interior_sym_d_scalar, , double, sgf_sym_d_fn)
+#if defined(SGF_X86)
+SGF_UNROLLED_SET(sgf_interior_sym_f_sse2, SGF_TARGET_SSE2, float, sgf_sym_f_fn)
+SGF_UNROLLED_SET(sgf_interior_sym_d_sse2, SGF_TARGET_SSE2, double, sgf_sym_d_fn)
+SGF_UNROLLED_SET(sgf_interior_sym_f_avx2, SGF_TARGET_AVX2, float, sgf_sym_f_fn)
+SGF_UNROLLED_SET(sgf_interior_sym_d_avx2, SGF_TARGET_AVX2, double, sgf_sym_d_fn)
+#endif
+#if defined(SGF_NEON)
+SGF_UNROLLED_SET(sgf_interior_sym_f_neon, , float, sgf_sym_f_fn)
+SGF_UNROLLED_SET(sgf_interior_sym_d_neon, , double, sgf_sym_d_fn)
+#endif
+
+static const char *const sgf_simd_names[] = {"scalar", "sse2", "avx2", "neon"};
+
+// Kernels of one SIMD level. Dispatch goes through a single pointer to one of
+// the constant tables below, so a call never mixes kernels of two levels.
+typedef struct {
+  int level;
+  sgf_interior_f_fn interior_f;
+  sgf_interior_d_fn interior_d;
+  sgf_sym_f_fn sym_f;
+  sgf_sym_d_fn sym_d;
+  const sgf_sym_f_fn *unrolled_f;
+  const sgf_sym_d_fn *unrolled_d;
+  sgf_strided_f_fn strided_f;
+  sgf_strided_d_fn strided_d;
+} SgfKernels;
+
+#define SGF_KERNELS(LEVEL, isa)						\
+  {LEVEL, sgf_interior_f_##isa, sgf_interior_d_##isa, sgf_interior_sym_f_##isa,	\
+   sgf_interior_sym_d_##isa, sgf_interior_sym_f_##isa##_unrolled,		\
+   sgf_interior_sym_d_##isa##_unrolled, sgf_strided_f_##isa, sgf_strided_d_##isa}
+
+static const SgfKernels sgf_kernels_scalar = SGF_KERNELS(SGF_SIMD_SCALAR, scalar);
+#if defined(SGF_X86)
+static const SgfKernels sgf_kernels_sse2 = SGF_KERNELS(SGF_SIMD_SSE2, sse2);
+static const SgfKernels sgf_kernels_avx2 = SGF_KERNELS(SGF_SIMD_AVX2, avx2);
+#endif
+#if defined(SGF_NEON)
+static const SgfKernels sgf_kernels_neon = SGF_KERNELS(SGF_SIMD_NEON, neon);
+#endif
+
+// Written under sgf_shared_lock(); -1 / NULL = not yet detected
+static int sgf_detected = -1;
+static const SgfKernels *volatile sgf_kernels = NULL;
+
+static const SgfKernels *sgf_simd_table(int level) {
+  switch (level) {
+#if defined(SGF_X86)
+  case SGF_SIMD_AVX2:
+    return &sgf_kernels_avx2;
+  case SGF_SIMD_SSE2:
+    return &sgf_kernels_sse2;
+#endif
+#if defined(SGF_NEON)
+  case SGF_SIMD_NEON:
+    return &sgf_kernels_neon;
+#endif
+  default:
+    return &sgf_kernels_scalar;
+  }
+}
+
+static void sgf_simd_detect(void) {
+  sgf_shared_lock();
+  if (sgf_detected < 0) {
+    int level = SGF_SIMD_SCALAR;
+#if defined(SGF_X86)
+    if (sgf_cpu_has_avx2()) {
+      level = SGF_SIMD_AVX2;
+    } else if (sgf_cpu_has_sse2()) {
+      level = SGF_SIMD_SSE2;
+    }
+#elif defined(SGF_NEON)
+    level = SGF_SIMD_NEON;
+#endif
+    sgf_detected = level;
+    sgf_kernels = sgf_simd_table(level);
+  }
+  sgf_shared_unlock();
+}
+
+/*
+ * Active kernel table. Calls already running keep the table they loaded, so
+ * sgf_simd_set_level() only affects calls made after it returns.
+ */
+static const SgfKernels *sgf_simd_kernels(void) {
+  const SgfKernels *k = sgf_kernels;
+  if (k == NULL) {
+    sgf_simd_detect();
+    k = sgf_kernels;
+  }
+  return k;
+}
+
+int sgf_simd_level(void) {
+  return sgf_simd_kernels()->level;
+}
+
+int sgf_simd_set_level(int level) {
+  sgf_simd_detect();
+  sgf_shared_lock();
+  /* Only levels the CPU supports: scalar, or anything up to detected */
+  int ok = (level == SGF_SIMD_SCALAR || level == sgf_detected ||
+	    (sgf_detected == SGF_SIMD_AVX2 && level == SGF_SIMD_SSE2));
+  if (ok) {
+    sgf_kernels = sgf_simd_table(level);
+  }
+  sgf_shared_unlock();
+  return ok ? 0 : -1;
+}
+
+const char *sgf_simd_name(int level) {
+  return (level >= 0 && level <= SGF_SIMD_NEON) ? sgf_simd_names[level] : "unknown";
+}
+
+void sgf_interior_f(const float *w, int taps, const float *x, float *y,
+		    size_t count) {
+  sgf_simd_kernels()->interior_f(w, taps, x, y, count);
+}
+
+void sgf_interior_d(const double *w, int taps, const double *x, double *y,
+		    size_t count) {
+  sgf_simd_kernels()->interior_d(w, taps, x, y, count);
+}
+
+int sgf_interior_unrolled(int half_window) {
+  return half_window >= 2 && half_window <= SGF_UNROLLED_MAX_HALF_WINDOW;
+}
+
+void sgf_interior_sym_f(const float *w, int half_window, int symmetry,
+			const float *x, float *y, size_t count) {
+  const SgfKernels *k = sgf_simd_kernels();
+  if (sgf_interior_unrolled(half_window)) {
+    k->unrolled_f[half_window](w, half_window, symmetry, x, y, count);
+    return;
+  }
+  k->sym_f(w, half_window, symmetry, x, y, count);
+}
+
+void sgf_interior_sym_d(const double *w, int half_window, int symmetry,
+			const double *x, double *y, size_t count) {
+  const SgfKernels *k = sgf_simd_kernels();
+  if (sgf_interior_unrolled(half_window)) {
+    k->unrolled_d[half_window](w, half_window, symmetry, x, y, count);
+    return;
+  }
+  k->sym_d(w, half_window, symmetry, x, y, count);
+}
+
+void sgf_interior_strided_f(const float *w, int taps, const float *x, size_t stride,
+			    float *y, size_t count) {
+  sgf_simd_kernels()->strided_f(w, taps, x, stride, y, count);
+}
+
+void sgf_interior_strided_d(const double *w, int taps, const double *x, size_t stride,
+			    double *y, size_t count) {
+  sgf_simd_kernels()->strided_d(w, taps, x, stride, y, count);
+}